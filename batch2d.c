@@ -0,0 +1,370 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "batch2d.h"
+
+static void write_vertex(const Batch2D* batch, VertexP2C* v, float x, float y, uint32_t rgba)
+{
+    v->x = x * batch->scaleX - 1.0f;
+    v->y = y * batch->scaleY - 1.0f;
+    v->rgba = rgba;
+}
+
+static void close_chunk(Batch2D* batch, uint32_t index)
+{
+    Batch2DBucket* bucket = &batch->buckets[index];
+    if (bucket->vertices && bucket->quadCount)
+    {
+        if (batch->drawCount < BATCH2D_MAX_DRAWS)
+        {
+            batch->drawBuckets[batch->drawCount] = index;
+            batch->pending[batch->drawCount++] = (Batch2DDraw){
+                index % BATCH2D_STATE_COUNT, bucket->buffer, bucket->offset, bucket->quadCount * 6
+            };
+        }
+        else
+        {
+            batch->droppedQuads += bucket->quadCount;
+        }
+    }
+    if (bucket->vertices && bucket->vertices != bucket->mapped)
+    {
+        vertexpack(batch->vertexFormat, bucket->vertices, bucket->mapped, bucket->quadCount * 4);
+    }
+    bucket->vertices = 0;
+    bucket->quadCount = 0;
+}
+
+static VertexP2C* get_staging(Batch2D* batch, uint32_t index)
+{
+    if (!batch->staging[index])
+    {
+        batch->staging[index] = (VertexP2C*)malloc(BATCH2D_MAX_CHUNK_QUADS * 4 * sizeof(VertexP2C));
+    }
+    return batch->staging[index];
+}
+
+static VertexP2C* reserve_frame(Batch2D* batch, uint32_t quadCount)
+{
+    Batch2DBucket* bucket = &batch->buckets[batch->bucket];
+    if (!bucket->vertices || bucket->quadCount + quadCount > bucket->capacity)
+    {
+        close_chunk(batch, batch->bucket);
+
+        // Chunks double as the bucket fills, so a few primitives don't pin a big chunk of the ring.
+        uint32_t capacity = batch->nextCapacity[batch->bucket];
+        capacity = quadCount > capacity ? quadCount : capacity;
+        batch->nextCapacity[batch->bucket] = capacity * 2 < BATCH2D_MAX_CHUNK_QUADS ? capacity * 2 : BATCH2D_MAX_CHUNK_QUADS;
+
+        UploadAllocation allocation;
+        VertexP2C* staging = batch->vertexFormat == VERTEX_FORMAT_F32 ? 0 : get_staging(batch, batch->bucket);
+        if (batch->drawCount == BATCH2D_MAX_DRAWS || (batch->vertexFormat != VERTEX_FORMAT_F32 && !staging)
+            || !upload_alloc(batch->ring, (VkDeviceSize)capacity * 4 * vertexpack_stride(batch->vertexFormat), 0, &allocation))
+        {
+            batch->droppedQuads += quadCount;
+            return 0;
+        }
+        bucket->mapped = allocation.ptr;
+        bucket->vertices = staging ? staging : (VertexP2C*)allocation.ptr;
+        bucket->buffer = allocation.buffer;
+        bucket->offset = allocation.offset;
+        bucket->capacity = capacity;
+    }
+
+    VertexP2C* vertices = bucket->vertices + bucket->quadCount * 4;
+    bucket->quadCount += quadCount;
+    batch->quadCount += quadCount;
+    return vertices;
+}
+
+static VertexP2C* reserve_capture(Batch2D* batch, uint32_t quadCount)
+{
+    Batch2DList* list = batch->capture;
+    if (list->quadCount + quadCount > list->quadCapacity)
+    {
+        uint32_t capacity = list->quadCapacity ? list->quadCapacity * 2 : BATCH2D_MIN_CHUNK_QUADS;
+        capacity = capacity < list->quadCount + quadCount ? list->quadCount + quadCount : capacity;
+        VertexP2C* vertices = (VertexP2C*)realloc(list->vertices, (size_t)capacity * 4 * sizeof(VertexP2C));
+        if (!vertices)
+        {
+            return 0;
+        }
+        list->vertices = vertices;
+        list->quadCapacity = capacity;
+    }
+
+    Batch2DRun* run = list->runCount ? &list->runs[list->runCount - 1] : 0;
+    if (!run || run->bucket != batch->bucket)
+    {
+        if (list->runCount == list->runCapacity)
+        {
+            uint32_t capacity = list->runCapacity ? list->runCapacity * 2 : 16;
+            Batch2DRun* runs = (Batch2DRun*)realloc(list->runs, capacity * sizeof(Batch2DRun));
+            if (!runs)
+            {
+                return 0;
+            }
+            list->runs = runs;
+            list->runCapacity = capacity;
+        }
+        run = &list->runs[list->runCount++];
+        *run = (Batch2DRun){ batch->bucket, list->quadCount, 0 };
+    }
+
+    VertexP2C* vertices = list->vertices + list->quadCount * 4;
+    run->quadCount += quadCount;
+    list->quadCount += quadCount;
+    return vertices;
+}
+
+void batch2d_init(Batch2D* batch, UploadRing* ring, uint32_t vertexFormat)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->ring = ring;
+    batch->vertexFormat = vertexFormat;
+    batch->scaleX = 1.0f;
+    batch->scaleY = 1.0f;
+}
+
+void batch2d_destroy(Batch2D* batch)
+{
+    for (uint32_t i = 0; i < BATCH2D_MAX_BUCKETS; ++i)
+    {
+        free(batch->staging[i]);
+    }
+    memset(batch, 0, sizeof(*batch));
+}
+
+void batch2d_fill_indices(uint16_t* indices)
+{
+    for (uint32_t i = 0; i < BATCH2D_MAX_CHUNK_QUADS; ++i)
+    {
+        uint16_t base = (uint16_t)(i * 4);
+        indices[i * 6 + 0] = base;
+        indices[i * 6 + 1] = base + 1;
+        indices[i * 6 + 2] = base + 2;
+        indices[i * 6 + 3] = base + 2;
+        indices[i * 6 + 4] = base + 3;
+        indices[i * 6 + 5] = base;
+    }
+}
+
+void batch2d_begin_frame(Batch2D* batch, uint32_t width, uint32_t height)
+{
+    batch->scaleX = 2.0f / (float)width;
+    batch->scaleY = 2.0f / (float)height;
+    batch->bucket = 0;
+    memset(batch->buckets, 0, sizeof(batch->buckets));
+    for (uint32_t i = 0; i < BATCH2D_MAX_BUCKETS; ++i)
+    {
+        batch->nextCapacity[i] = BATCH2D_MIN_CHUNK_QUADS;
+    }
+    batch->drawCount = 0;
+    batch->primitiveCount = 0;
+    batch->quadCount = 0;
+    batch->droppedQuads = 0;
+}
+
+uint32_t batch2d_flush(Batch2D* batch)
+{
+    for (uint32_t i = 0; i < BATCH2D_MAX_BUCKETS; ++i)
+    {
+        close_chunk(batch, i);
+    }
+
+    // Counting sort on the bucket, stable so a bucket's chunks stay in submission order.
+    uint32_t starts[BATCH2D_MAX_BUCKETS + 1] = { 0 };
+    for (uint32_t i = 0; i < batch->drawCount; ++i)
+    {
+        ++starts[batch->drawBuckets[i] + 1];
+    }
+    for (uint32_t i = 0; i < BATCH2D_MAX_BUCKETS; ++i)
+    {
+        starts[i + 1] += starts[i];
+    }
+    for (uint32_t i = 0; i < batch->drawCount; ++i)
+    {
+        batch->draws[starts[batch->drawBuckets[i]]++] = batch->pending[i];
+    }
+
+    batch->stats = (Batch2DStats){ batch->primitiveCount, batch->quadCount, batch->drawCount, batch->droppedQuads };
+    return batch->drawCount;
+}
+
+void batch2d_set_layer(Batch2D* batch, uint32_t layer)
+{
+    assert(layer < BATCH2D_MAX_LAYERS);
+    batch->bucket = layer * BATCH2D_STATE_COUNT + batch->bucket % BATCH2D_STATE_COUNT;
+}
+
+void batch2d_set_state(Batch2D* batch, uint32_t state)
+{
+    assert(state < BATCH2D_STATE_COUNT);
+    batch->bucket = batch->bucket / BATCH2D_STATE_COUNT * BATCH2D_STATE_COUNT + state;
+}
+
+VertexP2C* batch2d_reserve(Batch2D* batch, uint32_t quadCount)
+{
+    assert(quadCount <= BATCH2D_MAX_CHUNK_QUADS);
+    return batch->capture ? reserve_capture(batch, quadCount) : reserve_frame(batch, quadCount);
+}
+
+static void count_primitive(Batch2D* batch)
+{
+    if (batch->capture)
+    {
+        ++batch->capture->primitiveCount;
+    }
+    else
+    {
+        ++batch->primitiveCount;
+    }
+}
+
+void batch2d_quad(Batch2D* batch, const float* xy, uint32_t rgba)
+{
+    VertexP2C* v = batch2d_reserve(batch, 1);
+    if (!v)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        write_vertex(batch, &v[i], xy[i * 2], xy[i * 2 + 1], rgba);
+    }
+    count_primitive(batch);
+}
+
+static void write_rect(const Batch2D* batch, VertexP2C* v, float x, float y, float w, float h, uint32_t rgba)
+{
+    write_vertex(batch, &v[0], x, y, rgba);
+    write_vertex(batch, &v[1], x + w, y, rgba);
+    write_vertex(batch, &v[2], x + w, y + h, rgba);
+    write_vertex(batch, &v[3], x, y + h, rgba);
+}
+
+void batch2d_rect(Batch2D* batch, float x, float y, float w, float h, uint32_t rgba)
+{
+    VertexP2C* v = batch2d_reserve(batch, 1);
+    if (!v)
+    {
+        return;
+    }
+    write_rect(batch, v, x, y, w, h, rgba);
+    count_primitive(batch);
+}
+
+void batch2d_rect_outline(Batch2D* batch, float x, float y, float w, float h, float thickness, uint32_t rgba)
+{
+    VertexP2C* v = batch2d_reserve(batch, 4);
+    if (!v)
+    {
+        return;
+    }
+    // Sides don't overlap, so blended outlines have even corners.
+    write_rect(batch, v + 0, x, y, w, thickness, rgba);
+    write_rect(batch, v + 4, x, y + h - thickness, w, thickness, rgba);
+    write_rect(batch, v + 8, x, y + thickness, thickness, h - 2.0f * thickness, rgba);
+    write_rect(batch, v + 12, x + w - thickness, y + thickness, thickness, h - 2.0f * thickness, rgba);
+    count_primitive(batch);
+}
+
+void batch2d_line(Batch2D* batch, float x0, float y0, float x1, float y1, float thickness, uint32_t rgba)
+{
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float length = sqrtf(dx * dx + dy * dy);
+    if (length <= 0.0f)
+    {
+        return;
+    }
+
+    VertexP2C* v = batch2d_reserve(batch, 1);
+    if (!v)
+    {
+        return;
+    }
+    float scale = 0.5f * thickness / length;
+    float nx = -dy * scale;
+    float ny = dx * scale;
+    write_vertex(batch, &v[0], x0 + nx, y0 + ny, rgba);
+    write_vertex(batch, &v[1], x1 + nx, y1 + ny, rgba);
+    write_vertex(batch, &v[2], x1 - nx, y1 - ny, rgba);
+    write_vertex(batch, &v[3], x0 - nx, y0 - ny, rgba);
+    count_primitive(batch);
+}
+
+void batch2d_fan(Batch2D* batch, const float* xy, uint32_t count, uint32_t rgba)
+{
+    if (count < 3)
+    {
+        return;
+    }
+
+    // Every quad is two fan triangles (0, a, b) and (b, c, 0); an odd count ends on a degenerate one.
+    uint32_t quadCount = (count - 1) / 2;
+    for (uint32_t first = 0; first < quadCount;)
+    {
+        uint32_t pieceCount = quadCount - first < BATCH2D_MAX_CHUNK_QUADS ? quadCount - first : BATCH2D_MAX_CHUNK_QUADS;
+        VertexP2C* v = batch2d_reserve(batch, pieceCount);
+        if (!v)
+        {
+            return;
+        }
+        for (uint32_t i = first; i < first + pieceCount; ++i, v += 4)
+        {
+            uint32_t a = 1 + i * 2;
+            uint32_t c = a + 2 < count ? a + 2 : a + 1;
+            write_vertex(batch, &v[0], xy[0], xy[1], rgba);
+            write_vertex(batch, &v[1], xy[a * 2], xy[a * 2 + 1], rgba);
+            write_vertex(batch, &v[2], xy[a * 2 + 2], xy[a * 2 + 3], rgba);
+            write_vertex(batch, &v[3], xy[c * 2], xy[c * 2 + 1], rgba);
+        }
+        first += pieceCount;
+    }
+    count_primitive(batch);
+}
+
+void batch2d_capture_begin(Batch2D* batch, Batch2DList* list)
+{
+    assert(!batch->capture);
+    memset(list, 0, sizeof(*list));
+    batch->capture = list;
+}
+
+void batch2d_capture_end(Batch2D* batch)
+{
+    batch->capture = 0;
+}
+
+void batch2d_draw_list(Batch2D* batch, const Batch2DList* list)
+{
+    uint32_t bucket = batch->bucket;
+    for (uint32_t i = 0; i < list->runCount; ++i)
+    {
+        const Batch2DRun* run = &list->runs[i];
+        batch->bucket = run->bucket;
+        for (uint32_t first = 0; first < run->quadCount;)
+        {
+            uint32_t pieceCount = run->quadCount - first < BATCH2D_MAX_CHUNK_QUADS ? run->quadCount - first : BATCH2D_MAX_CHUNK_QUADS;
+            VertexP2C* v = reserve_frame(batch, pieceCount);
+            if (!v)
+            {
+                break;
+            }
+            memcpy(v, list->vertices + (run->firstQuad + first) * 4, (size_t)pieceCount * 4 * sizeof(VertexP2C));
+            first += pieceCount;
+        }
+    }
+    batch->bucket = bucket;
+    batch->primitiveCount += list->primitiveCount;
+}
+
+void batch2d_list_free(Batch2DList* list)
+{
+    free(list->vertices);
+    free(list->runs);
+    memset(list, 0, sizeof(*list));
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "upload.h"
+#include "vertexpack.h"
+
+/*
+** Batched 2D primitives.
+**
+** Quads, lines, rectangles and convex fans are written straight into
+** mapped upload ring memory as quads of four vertices, so one shared
+** index buffer (0 1 2 2 3 0, +4 per quad) serves every draw. Vertices go
+** to a bucket per (layer, state); each bucket fills chunks that double
+** in size up to 64K vertices, and every chunk is one indexed draw.
+** batch2d_flush orders the draws by layer, then by state, so all
+** primitives of a state in a layer merge into the same few draws.
+** Within a layer, primitives of different states have no defined order.
+**
+** Positions are in pixels, converted to clip space as they are written.
+** With a packed vertex format, chunks are written to CPU staging memory
+** and packed into the upload ring when they close, so the mapped memory
+** is still only written once, sequentially.
+**
+** Retained lists capture primitives once into CPU memory, already
+** converted, and are copied into the frame's buckets on every draw;
+** recapture them when the viewport size changes.
+*/
+
+enum {
+    BATCH2D_STATE_OPAQUE,
+    BATCH2D_STATE_BLEND,            // premultiplied alpha
+    BATCH2D_STATE_COUNT,
+    BATCH2D_MAX_LAYERS = 16,
+    BATCH2D_MAX_BUCKETS = BATCH2D_MAX_LAYERS * BATCH2D_STATE_COUNT,
+    BATCH2D_MIN_CHUNK_QUADS = 256,
+    BATCH2D_MAX_CHUNK_QUADS = 16384, // 64K vertices, indices fit 16 bits
+    BATCH2D_INDEX_COUNT = BATCH2D_MAX_CHUNK_QUADS * 6,
+    BATCH2D_MAX_DRAWS = 1024,
+};
+
+typedef struct tagBatch2DDraw
+{
+    uint32_t state;
+    VkBuffer buffer;
+    VkDeviceSize offset;            // vertex buffer offset, indices start at 0
+    uint32_t indexCount;
+} Batch2DDraw;
+
+typedef struct tagBatch2DBucket
+{
+    VertexP2C* vertices;            // current chunk, 0 if none
+    void* mapped;                   // chunk in the upload ring, vertices unless packing
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t quadCount;
+    uint32_t capacity;
+} Batch2DBucket;
+
+typedef struct tagBatch2DRun
+{
+    uint32_t bucket;
+    uint32_t firstQuad;
+    uint32_t quadCount;
+} Batch2DRun;
+
+typedef struct tagBatch2DList
+{
+    VertexP2C* vertices;
+    uint32_t primitiveCount;
+    uint32_t quadCount;
+    uint32_t quadCapacity;
+    Batch2DRun* runs;
+    uint32_t runCount;
+    uint32_t runCapacity;
+} Batch2DList;
+
+typedef struct tagBatch2DStats
+{
+    uint32_t primitiveCount;        // last flushed frame
+    uint32_t quadCount;
+    uint32_t drawCount;
+    uint32_t droppedQuads;          // out of upload memory or draw slots
+} Batch2DStats;
+
+typedef struct tagBatch2D
+{
+    UploadRing* ring;
+    uint32_t vertexFormat;          // VERTEX_FORMAT_*
+    VertexP2C* staging[BATCH2D_MAX_BUCKETS];    // packed formats only, BATCH2D_MAX_CHUNK_QUADS each
+    float scaleX, scaleY;           // pixels to clip space
+    uint32_t bucket;                // layer * BATCH2D_STATE_COUNT + state
+    Batch2DBucket buckets[BATCH2D_MAX_BUCKETS];
+    uint32_t nextCapacity[BATCH2D_MAX_BUCKETS];
+    Batch2DList* capture;
+
+    uint32_t drawCount;
+    uint32_t drawBuckets[BATCH2D_MAX_DRAWS];
+    Batch2DDraw pending[BATCH2D_MAX_DRAWS];
+    Batch2DDraw draws[BATCH2D_MAX_DRAWS];   // sorted by batch2d_flush
+
+    uint32_t primitiveCount;
+    uint32_t quadCount;
+    uint32_t droppedQuads;
+    Batch2DStats stats;
+} Batch2D;
+
+void batch2d_init(Batch2D* batch, UploadRing* ring, uint32_t vertexFormat);
+void batch2d_destroy(Batch2D* batch);
+
+// Index data for the shared index buffer, BATCH2D_INDEX_COUNT entries.
+void batch2d_fill_indices(uint16_t* indices);
+
+// Call after upload_begin_frame; width and height map pixels to the viewport.
+void batch2d_begin_frame(Batch2D* batch, uint32_t width, uint32_t height);
+// Closes the frame's chunks and returns how many draws batch->draws holds.
+uint32_t batch2d_flush(Batch2D* batch);
+
+void batch2d_set_layer(Batch2D* batch, uint32_t layer);
+void batch2d_set_state(Batch2D* batch, uint32_t state);
+
+// Room for quadCount quads (4 vertices each) in the current bucket, 0 if out of memory.
+VertexP2C* batch2d_reserve(Batch2D* batch, uint32_t quadCount);
+
+// Corners in order around the quad, xy holds 4 points.
+void batch2d_quad(Batch2D* batch, const float* xy, uint32_t rgba);
+void batch2d_rect(Batch2D* batch, float x, float y, float w, float h, uint32_t rgba);
+void batch2d_rect_outline(Batch2D* batch, float x, float y, float w, float h, float thickness, uint32_t rgba);
+void batch2d_line(Batch2D* batch, float x0, float y0, float x1, float y1, float thickness, uint32_t rgba);
+// Convex polygon or triangle fan around xy[0], count points.
+void batch2d_fan(Batch2D* batch, const float* xy, uint32_t count, uint32_t rgba);
+
+// Primitives between begin and end go to the list instead of the frame.
+void batch2d_capture_begin(Batch2D* batch, Batch2DList* list);
+void batch2d_capture_end(Batch2D* batch);
+void batch2d_draw_list(Batch2D* batch, const Batch2DList* list);
+void batch2d_list_free(Batch2DList* list);
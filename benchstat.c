@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+
+#include "benchstat.h"
+
+static int cmp_float(const void* a, const void* b)
+{
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static const BenchMetric* find_metric(const BenchResults* results, const char* name)
+{
+    for (uint32_t i = 0; i < results->metricCount; ++i)
+    {
+        if (strcmp(results->metrics[i].name, name) == 0)
+        {
+            return &results->metrics[i];
+        }
+    }
+    return 0;
+}
+
+void benchstat_init(BenchResults* results)
+{
+    memset(results, 0, sizeof(*results));
+}
+
+static void add_text(BenchInfo* entries, uint32_t* count, const char* name, const char* format, va_list args)
+{
+    if (*count == BENCHSTAT_MAX_INFO)
+    {
+        return;
+    }
+    BenchInfo* entry = &entries[(*count)++];
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    vsnprintf(entry->value, sizeof(entry->value), format, args);
+}
+
+static const BenchInfo* find_text(const BenchInfo* entries, uint32_t count, const char* name)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (strcmp(entries[i].name, name) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return 0;
+}
+
+void benchstat_config(BenchResults* results, const char* name, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    add_text(results->config, &results->configCount, name, format, args);
+    va_end(args);
+}
+
+void benchstat_info(BenchResults* results, const char* name, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    add_text(results->info, &results->infoCount, name, format, args);
+    va_end(args);
+}
+
+void benchstat_metric(BenchResults* results, const char* name, double value, double slack, uint32_t flags)
+{
+    if (results->metricCount == BENCHSTAT_MAX_METRICS)
+    {
+        return;
+    }
+    BenchMetric* metric = &results->metrics[results->metricCount++];
+    snprintf(metric->name, sizeof(metric->name), "%s", name);
+    metric->value = value;
+    metric->slack = slack;
+    metric->flags = flags;
+}
+
+float benchstat_bucket_edge(uint32_t bucket)
+{
+    return 0.1f * powf(2.0f, (bucket + 1) * 0.25f);
+}
+
+void benchstat_timing(BenchResults* results, const char* name, float* samples, uint32_t count, double slack)
+{
+    if (!count)
+    {
+        return;
+    }
+    qsort(samples, count, sizeof(float), cmp_float);
+
+    // Nearest-rank percentiles, like the console report.
+    static const struct { const char* suffix; float percentile; } ranks[] = { { "p50", 50.0f }, { "p95", 95.0f }, { "p99", 99.0f } };
+    char metricName[BENCHSTAT_MAX_NAME];
+    for (uint32_t i = 0; i < sizeof(ranks) / sizeof(ranks[0]); ++i)
+    {
+        uint32_t rank = (uint32_t)(ranks[i].percentile / 100.0f * count + 0.999f);
+        rank = rank < 1 ? 1 : (rank > count ? count : rank);
+        snprintf(metricName, sizeof(metricName), "%s_%s_ms", name, ranks[i].suffix);
+        benchstat_metric(results, metricName, samples[rank - 1], slack, BENCHSTAT_CHECKED);
+    }
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        sum += samples[i];
+    }
+    snprintf(metricName, sizeof(metricName), "%s_mean_ms", name);
+    benchstat_metric(results, metricName, sum / count, slack, BENCHSTAT_CHECKED);
+    // A single hitch decides the maximum, too noisy to fail a run on.
+    snprintf(metricName, sizeof(metricName), "%s_max_ms", name);
+    benchstat_metric(results, metricName, samples[count - 1], slack, 0);
+
+    if (results->histogramCount == sizeof(results->histograms) / sizeof(results->histograms[0]))
+    {
+        return;
+    }
+    BenchHistogram* histogram = &results->histograms[results->histogramCount++];
+    snprintf(histogram->name, sizeof(histogram->name), "%s", name);
+    memset(histogram->counts, 0, sizeof(histogram->counts));
+    // Samples are sorted, so the buckets are filled in one sweep.
+    uint32_t bucket = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        while (bucket + 1 < BENCHSTAT_HISTOGRAM_BUCKETS && samples[i] > benchstat_bucket_edge(bucket))
+        {
+            ++bucket;
+        }
+        ++histogram->counts[bucket];
+    }
+}
+
+static void write_string(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const unsigned char* c = (const unsigned char*)text; *c; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            fprintf(file, "\\%c", *c);
+        }
+        else if (*c < 0x20)
+        {
+            fprintf(file, "\\u%04x", *c);
+        }
+        else
+        {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void write_texts(FILE* file, const char* object, const BenchInfo* entries, uint32_t count)
+{
+    fprintf(file, "  \"%s\": {\n", object);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        fprintf(file, "    ");
+        write_string(file, entries[i].name);
+        fprintf(file, ": ");
+        write_string(file, entries[i].value);
+        fprintf(file, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  },\n");
+}
+
+// Reads a "name": "value" line back, undoing write_string. Returns 0 for anything else.
+static int read_text(const char* line, BenchInfo* entry)
+{
+    char* out = entry->name;
+    size_t capacity = sizeof(entry->name);
+    const char* c = strchr(line, '"');
+    for (int field = 0; c && field < 2; ++field)
+    {
+        size_t length = 0;
+        for (++c; *c && *c != '"'; ++c)
+        {
+            char ch = *c;
+            if (ch == '\\')
+            {
+                unsigned code;
+                if (c[1] == 'u' && sscanf(c + 2, "%4x", &code) == 1)
+                {
+                    ch = (char)code;
+                    c += 5;
+                }
+                else if (c[1])
+                {
+                    ch = *++c;
+                }
+            }
+            if (length + 1 < capacity)
+            {
+                out[length++] = ch;
+            }
+        }
+        if (*c != '"')
+        {
+            return 0;
+        }
+        out[length] = 0;
+        if (field == 0)
+        {
+            c = strstr(c + 1, ": \"");
+            c = c ? c + 2 : 0;
+            out = entry->value;
+            capacity = sizeof(entry->value);
+        }
+    }
+    return c != 0;
+}
+
+int benchstat_write_json(const BenchResults* results, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "{\n");
+    write_texts(file, "config", results->config, results->configCount);
+    write_texts(file, "info", results->info, results->infoCount);
+
+    fprintf(file, "  \"metrics\": {\n");
+    for (uint32_t i = 0; i < results->metricCount; ++i)
+    {
+        // JSON has no NaN or infinity, a metric that could not be measured is null.
+        const BenchMetric* metric = &results->metrics[i];
+        fprintf(file, "    \"%s\": ", metric->name);
+        fprintf(file, isfinite(metric->value) ? "%.9g" : "null", metric->value);
+        fprintf(file, "%s\n", i + 1 < results->metricCount ? "," : "");
+    }
+
+    fprintf(file, "  },\n  \"histograms\": {\n    \"edges_ms\": [");
+    for (uint32_t i = 0; i + 1 < BENCHSTAT_HISTOGRAM_BUCKETS; ++i)
+    {
+        fprintf(file, "%s%.4g", i ? ", " : "", benchstat_bucket_edge(i));
+    }
+    fprintf(file, "]");
+    for (uint32_t i = 0; i < results->histogramCount; ++i)
+    {
+        fprintf(file, ",\n    \"%s\": [", results->histograms[i].name);
+        for (uint32_t j = 0; j < BENCHSTAT_HISTOGRAM_BUCKETS; ++j)
+        {
+            fprintf(file, "%s%u", j ? ", " : "", results->histograms[i].counts[j]);
+        }
+        fprintf(file, "]");
+    }
+    fprintf(file, "\n  }\n}\n");
+
+    return fclose(file) == 0;
+}
+
+int benchstat_load_baseline(BenchResults* baseline, const char* path)
+{
+    benchstat_init(baseline);
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+
+    // Escaped values can take six characters per byte.
+    char line[1024];
+    enum { SECTION_NONE, SECTION_CONFIG, SECTION_METRICS } section = SECTION_NONE;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strstr(line, "\"config\": {"))
+        {
+            section = SECTION_CONFIG;
+            continue;
+        }
+        if (strstr(line, "\"metrics\": {"))
+        {
+            section = SECTION_METRICS;
+            continue;
+        }
+        char first;
+        if (sscanf(line, " %c", &first) == 1 && first == '}')
+        {
+            section = SECTION_NONE;
+            continue;
+        }
+        BenchInfo entry;
+        double value;
+        if (section == SECTION_CONFIG && baseline->configCount < BENCHSTAT_MAX_INFO && read_text(line, &entry))
+        {
+            baseline->config[baseline->configCount++] = entry;
+        }
+        // Null metrics do not parse and are left out, as if the baseline had never had them.
+        else if (section == SECTION_METRICS && sscanf(line, " \"%39[^\"]\": %lf", entry.name, &value) == 2)
+        {
+            benchstat_metric(baseline, entry.name, value, 0.0, BENCHSTAT_CHECKED);
+        }
+    }
+    fclose(file);
+
+    return baseline->metricCount != 0;
+}
+
+uint32_t benchstat_config_mismatches(const BenchResults* results, const BenchResults* baseline)
+{
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < results->configCount; ++i)
+    {
+        const BenchInfo* entry = &results->config[i];
+        const BenchInfo* base = find_text(baseline->config, baseline->configCount, entry->name);
+        if (!base || strcmp(entry->value, base->value) != 0)
+        {
+            printf("Config: %s \"%s\", baseline %s%s%s\n", entry->name, entry->value,
+                base ? "\"" : "", base ? base->value : "has none", base ? "\"" : "");
+            ++mismatches;
+        }
+    }
+    for (uint32_t i = 0; i < baseline->configCount; ++i)
+    {
+        const BenchInfo* base = &baseline->config[i];
+        if (!find_text(results->config, results->configCount, base->name))
+        {
+            printf("Config: %s not set, baseline \"%s\"\n", base->name, base->value);
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+uint32_t benchstat_compare(const BenchResults* results, const BenchResults* baseline, double tolerance)
+{
+    uint32_t regressions = 0;
+    for (uint32_t i = 0; i < results->metricCount; ++i)
+    {
+        const BenchMetric* metric = &results->metrics[i];
+        const BenchMetric* base = find_metric(baseline, metric->name);
+        if (!(metric->flags & BENCHSTAT_CHECKED) || !base || !isfinite(metric->value))
+        {
+            continue;
+        }
+        if (metric->value > base->value * (1.0 + tolerance) && metric->value - base->value > metric->slack)
+        {
+            printf("Regression: %s %.4g, baseline %.4g (%+.1f%%)\n", metric->name, metric->value, base->value,
+                base->value > 0.0 ? (metric->value / base->value - 1.0) * 100.0 : 100.0);
+            ++regressions;
+        }
+    }
+    return regressions;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+** Benchmark results and baselines.
+**
+** A run collects named metrics, plus frame time histograms, into
+** BenchResults and writes them as JSON. Every metric goes on a line of its
+** own inside the "metrics" object; one that could not be measured is
+** written as null and left out when read back. Along with the "config"
+** object, that is all benchstat_load_baseline reads, so the results of one
+** run serve as the baseline of the next.
+**
+** The config holds everything that decides what a run measures. A
+** baseline is only compared against a run with the same config, anything
+** else would report regressions and passes down to the setup rather than
+** the code.
+**
+** Every checked metric is one where lower is better. A metric regresses
+** when it exceeds the baseline by more than the relative tolerance and by
+** more than its own absolute slack, which keeps near-zero values, such as
+** sub-millisecond frame times, from failing on noise.
+*/
+
+enum {
+    BENCHSTAT_MAX_METRICS = 48,
+    BENCHSTAT_MAX_INFO = 16,
+    BENCHSTAT_MAX_NAME = 40,
+    BENCHSTAT_MAX_TEXT = 128,
+    BENCHSTAT_HISTOGRAM_BUCKETS = 40,   // four per octave from 0.1 ms, the last one is open
+};
+
+enum {
+    BENCHSTAT_CHECKED = 1,          // compared against the baseline
+};
+
+typedef struct tagBenchMetric
+{
+    char name[BENCHSTAT_MAX_NAME];
+    double value;
+    double slack;                   // absolute, on top of the relative tolerance
+    uint32_t flags;
+} BenchMetric;
+
+typedef struct tagBenchInfo
+{
+    char name[BENCHSTAT_MAX_NAME];
+    char value[BENCHSTAT_MAX_TEXT];
+} BenchInfo;
+
+typedef struct tagBenchHistogram
+{
+    char name[BENCHSTAT_MAX_NAME];
+    uint32_t counts[BENCHSTAT_HISTOGRAM_BUCKETS];
+} BenchHistogram;
+
+typedef struct tagBenchResults
+{
+    uint32_t configCount;
+    BenchInfo config[BENCHSTAT_MAX_INFO];       // has to match the baseline's
+    uint32_t infoCount;
+    BenchInfo info[BENCHSTAT_MAX_INFO];         // run configuration, not compared
+    uint32_t metricCount;
+    BenchMetric metrics[BENCHSTAT_MAX_METRICS];
+    uint32_t histogramCount;
+    BenchHistogram histograms[2];
+} BenchResults;
+
+void benchstat_init(BenchResults* results);
+
+void benchstat_config(BenchResults* results, const char* name, const char* format, ...);
+void benchstat_info(BenchResults* results, const char* name, const char* format, ...);
+void benchstat_metric(BenchResults* results, const char* name, double value, double slack, uint32_t flags);
+
+// Adds name_p50, _p95, _p99, _mean and _max and a histogram of samples in ms. Sorts samples.
+void benchstat_timing(BenchResults* results, const char* name, float* samples, uint32_t count, double slack);
+
+// Upper edge of a histogram bucket in ms.
+float benchstat_bucket_edge(uint32_t bucket);
+
+int benchstat_write_json(const BenchResults* results, const char* path);
+int benchstat_load_baseline(BenchResults* baseline, const char* path);
+
+// Prints every config entry that differs from the baseline, or is missing from either, and returns how many do.
+uint32_t benchstat_config_mismatches(const BenchResults* results, const BenchResults* baseline);
+
+// Prints every checked metric that regressed against baseline and returns how many did.
+// Metrics missing from the baseline are new and never regress.
+uint32_t benchstat_compare(const BenchResults* results, const BenchResults* baseline, double tolerance);
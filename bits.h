@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <assert.h>
 
 /*
 ** Architecture-specific bit manipulation routines.
@@ -21,12 +22,12 @@
 #if defined (__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4)) \
     && defined (__GNUC_PATCHLEVEL__)
 
-inline uint32_t bit_ffs32(uint32_t word)
+static inline uint32_t bit_ffs32(uint32_t word)
 {
     return __builtin_ffs(word) - 1;
 }
 
-inline uint32_t bit_fls32(uint32_t word)
+static inline uint32_t bit_fls32(uint32_t word)
 {
     const uint32_t bit = word ? 32 - __builtin_clz(word) : 0;
     return bit - 1;
@@ -40,26 +41,26 @@ inline uint32_t bit_fls32(uint32_t word)
 #pragma intrinsic(_BitScanReverse)
 #pragma intrinsic(_BitScanForward)
 
-inline uint32_t bit_fls32(uint32_t word)
+static inline uint32_t bit_fls32(uint32_t word)
 {
     uint32_t index;
     return _BitScanReverse(&index, word) ? index : -1;
 }
 
-inline uint32_t bit_ffs32(uint32_t word)
+static inline uint32_t bit_ffs32(uint32_t word)
 {
     uint32_t index;
     return _BitScanForward(&index, word) ? index : -1;
 }
 
-inline uint32_t bit_fls64(uint64_t word)
+static inline uint32_t bit_fls64(uint64_t word)
 {
     uint32_t index;
     if (_BitScanReverse(&index, word>>32)) return index+32;
     return _BitScanReverse(&index, word&0xFFFFFFFF) ? index : UINT32_MAX;
 }
 
-inline uint32_t bit_ffs64(uint64_t word)
+static inline uint32_t bit_ffs64(uint64_t word)
 {
     uint32_t index;
     if (_BitScanForward(&index, word&0xFFFFFFFF)) return index;
@@ -74,25 +75,25 @@ inline uint32_t bit_ffs64(uint64_t word)
 #pragma intrinsic(_BitScanReverse)
 #pragma intrinsic(_BitScanForward)
 
-inline uint32_t bit_fls32(uint32_t word)
+static inline uint32_t bit_fls32(uint32_t word)
 {
     uint32_t index;
     return _BitScanReverse(&index, word) ? index : -1;
 }
 
-inline uint32_t bit_ffs32(uint32_t word)
+static inline uint32_t bit_ffs32(uint32_t word)
 {
     uint32_t index;
     return _BitScanForward(&index, word) ? index : -1;
 }
 
-inline uint32_t bit_fls64(uint64_t word)
+static inline uint32_t bit_fls64(uint64_t word)
 {
     uint32_t index;
     return _BitScanReverse64(&index, word) ? index : UINT32_MAX;
 }
 
-inline uint32_t bit_ffs64(uint64_t word)
+static inline uint32_t bit_ffs64(uint64_t word)
 {
     uint32_t index;
     return _BitScanForward64(&index, word) ? index : UINT32_MAX;
@@ -101,14 +102,14 @@ inline uint32_t bit_ffs64(uint64_t word)
 #elif defined (__ARMCC_VERSION)
 /* RealView Compilation Tools for ARM */
 
-inline uint32_t bit_ffs32(uint32_t word)
+static inline uint32_t bit_ffs32(uint32_t word)
 {
     const uint32_t reverse = word & (~word + 1);
     const uint32_t bit = 32 - __clz(reverse);
     return bit - 1;
 }
 
-inline uint32_t bit_fls32(uint32_t word)
+static inline uint32_t bit_fls32(uint32_t word)
 {
     const uint32_t bit = word ? 32 - __clz(word) : 0;
     return bit - 1;
@@ -117,7 +118,7 @@ inline uint32_t bit_fls32(uint32_t word)
 #else
 /* Fall back to generic implementation. */
 
-inline uint32_t bit_fls_generic(uint32_t word)
+static inline uint32_t bit_fls_generic(uint32_t word)
 {
     uint32_t bit = 32;
 
@@ -132,24 +133,24 @@ inline uint32_t bit_fls_generic(uint32_t word)
 }
 
 /* Implement ffs in terms of fls. */
-inline uint32_t bit_ffs32(uint32_t word)
+static inline uint32_t bit_ffs32(uint32_t word)
 {
     return bit_fls_generic(word & (~word + 1)) - 1;
 }
 
-inline uint32_t bit_fls32(uint32_t word)
+static inline uint32_t bit_fls32(uint32_t word)
 {
     return bit_fls_generic(word) - 1;
 }
 
 #endif
 
-inline uint32_t bit_is_pow2(uint32_t x)
+static inline uint32_t bit_is_pow2(uint32_t x)
 {
     return (x != 0) && ((x & (x - 1)) == 0);
 }
 
-inline uint32_t bit_align_up(uint32_t size, uint32_t align)
+static inline uint32_t bit_align_up(uint32_t size, uint32_t align)
 {
     assert(bit_is_pow2(align));
     return (size + (align - 1)) & ~(align - 1);
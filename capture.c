@@ -0,0 +1,497 @@
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+
+#include "capture.h"
+#include "cpuprof.h"
+
+enum {
+    PNG_STORED_BLOCK = 65535,       // largest stored deflate block
+};
+
+static const char* const formatNames[CAPTURE_FORMAT_COUNT] = { "raw RGBA", "Y4M", "PNG" };
+
+static uint32_t crcTable[256];
+
+//----------------------------------------------------------
+// Encoders, run on the writer thread
+
+static void fetch_rgb(const FrameCapture* capture, const uint8_t* pixel, int* r, int* g, int* b)
+{
+    *r = pixel[capture->swapRedBlue ? 2 : 0];
+    *g = pixel[1];
+    *b = pixel[capture->swapRedBlue ? 0 : 2];
+}
+
+static int write_raw(FrameCapture* capture, const uint8_t* pixels)
+{
+    size_t size = (size_t)capture->extent.width * capture->extent.height * 4;
+    if (capture->swapRedBlue)
+    {
+        for (size_t i = 0; i < size; i += 4)
+        {
+            capture->scratch[i + 0] = pixels[i + 2];
+            capture->scratch[i + 1] = pixels[i + 1];
+            capture->scratch[i + 2] = pixels[i + 0];
+            capture->scratch[i + 3] = pixels[i + 3];
+        }
+        pixels = capture->scratch;
+    }
+    capture->stats.writtenBytes += size;
+    return fwrite(pixels, 1, size, capture->file) == size;
+}
+
+static uint8_t clamp_u8(int value)
+{
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Full range BT.601 in 8.8 fixed point, as JPEG does it.
+static int write_y4m(FrameCapture* capture, const uint8_t* pixels)
+{
+    uint32_t w = capture->extent.width;
+    uint32_t h = capture->extent.height;
+    uint32_t cw = (w + 1) / 2;
+    uint32_t ch = (h + 1) / 2;
+    uint8_t* lumaPlane = capture->scratch;
+    uint8_t* cbPlane = lumaPlane + (size_t)w * h;
+    uint8_t* crPlane = cbPlane + (size_t)cw * ch;
+
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        const uint8_t* row = pixels + (size_t)y * w * 4;
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            int r, g, b;
+            fetch_rgb(capture, row + x * 4, &r, &g, &b);
+            lumaPlane[(size_t)y * w + x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+        }
+    }
+    // Chroma of each 2x2 block's average, edge blocks of odd sizes repeat their last row or column.
+    for (uint32_t y = 0; y < ch; ++y)
+    {
+        const uint8_t* row0 = pixels + (size_t)(y * 2) * w * 4;
+        const uint8_t* row1 = pixels + (size_t)(y * 2 + 1 < h ? y * 2 + 1 : y * 2) * w * 4;
+        for (uint32_t x = 0; x < cw; ++x)
+        {
+            uint32_t x0 = x * 2 * 4;
+            uint32_t x1 = (x * 2 + 1 < w ? x * 2 + 1 : x * 2) * 4;
+            int r = 0, g = 0, b = 0;
+            const uint8_t* quad[4] = { row0 + x0, row0 + x1, row1 + x0, row1 + x1 };
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                int pr, pg, pb;
+                fetch_rgb(capture, quad[i], &pr, &pg, &pb);
+                r += pr;
+                g += pg;
+                b += pb;
+            }
+            // Sums of four, so the shift is two bits longer; biased to stay positive.
+            cbPlane[(size_t)y * cw + x] = clamp_u8((-43 * r - 85 * g + 128 * b + (128 << 10) + 512) >> 10);
+            crPlane[(size_t)y * cw + x] = clamp_u8((128 * r - 107 * g - 21 * b + (128 << 10) + 512) >> 10);
+        }
+    }
+
+    size_t size = (size_t)w * h + (size_t)cw * ch * 2;
+    capture->stats.writtenBytes += size;
+    return fputs("FRAME\n", capture->file) >= 0 && fwrite(capture->scratch, 1, size, capture->file) == size;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void put_be32(uint8_t* out, uint32_t value)
+{
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+typedef struct tagPngChunk
+{
+    FILE* file;
+    uint32_t crc;
+    int ok;
+} PngChunk;
+
+static void chunk_begin(PngChunk* chunk, FILE* file, const char* type, uint32_t size)
+{
+    uint8_t header[8];
+    put_be32(header, size);
+    memcpy(header + 4, type, 4);
+    chunk->file = file;
+    chunk->crc = crc32_update(0xFFFFFFFFu, header + 4, 4);
+    chunk->ok = fwrite(header, 1, 8, file) == 8;
+}
+
+static void chunk_write(PngChunk* chunk, const void* data, size_t size)
+{
+    chunk->crc = crc32_update(chunk->crc, (const uint8_t*)data, size);
+    chunk->ok = chunk->ok && fwrite(data, 1, size, chunk->file) == size;
+}
+
+static int chunk_end(PngChunk* chunk)
+{
+    uint8_t crc[4];
+    put_be32(crc, chunk->crc ^ 0xFFFFFFFFu);
+    return chunk->ok && fwrite(crc, 1, 4, chunk->file) == 4;
+}
+
+// RGB8 with every row unfiltered, in stored deflate blocks.
+static int write_png(FrameCapture* capture, const uint8_t* pixels)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint32_t w = capture->extent.width;
+    uint32_t h = capture->extent.height;
+
+    size_t rowSize = (size_t)w * 3 + 1;
+    size_t dataSize = rowSize * h;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        uint8_t* out = capture->scratch + rowSize * y;
+        const uint8_t* row = pixels + (size_t)y * w * 4;
+        *out++ = 0;
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            int r, g, b;
+            fetch_rgb(capture, row + x * 4, &r, &g, &b);
+            *out++ = (uint8_t)r;
+            *out++ = (uint8_t)g;
+            *out++ = (uint8_t)b;
+        }
+    }
+
+    char name[CAPTURE_MAX_PATH + 16];
+    const char* dot = strrchr(capture->path, '.');
+    int baseLength = dot ? (int)(dot - capture->path) : (int)strlen(capture->path);
+    snprintf(name, sizeof(name), "%.*s_%05u.png", baseLength, capture->path, capture->slots[capture->writeSlot % capture->slotCount].frame);
+    FILE* file = fopen(name, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+
+    int ok = fwrite(signature, 1, sizeof(signature), file) == sizeof(signature);
+
+    PngChunk chunk;
+    uint8_t header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };    // 8 bits, RGB
+    put_be32(header, w);
+    put_be32(header + 4, h);
+    chunk_begin(&chunk, file, "IHDR", sizeof(header));
+    chunk_write(&chunk, header, sizeof(header));
+    ok = chunk_end(&chunk) && ok;
+
+    size_t blockCount = (dataSize + PNG_STORED_BLOCK - 1) / PNG_STORED_BLOCK;
+    chunk_begin(&chunk, file, "IDAT", (uint32_t)(2 + blockCount * 5 + dataSize + 4));
+    chunk_write(&chunk, (const uint8_t[]){ 0x78, 0x01 }, 2);
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < dataSize; offset += PNG_STORED_BLOCK)
+    {
+        uint32_t size = (uint32_t)(dataSize - offset < PNG_STORED_BLOCK ? dataSize - offset : PNG_STORED_BLOCK);
+        uint8_t blockHeader[5] = { offset + size == dataSize, (uint8_t)size, (uint8_t)(size >> 8), (uint8_t)~size, (uint8_t)(~size >> 8) };
+        chunk_write(&chunk, blockHeader, sizeof(blockHeader));
+        chunk_write(&chunk, capture->scratch + offset, size);
+        // Reduced every 4K bytes, well before the sums could overflow.
+        const uint8_t* data = capture->scratch + offset;
+        for (uint32_t i = 0; i < size; ++i)
+        {
+            adlerA += data[i];
+            adlerB += adlerA;
+            if ((i & 4095) == 4095)
+            {
+                adlerA %= 65521;
+                adlerB %= 65521;
+            }
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+    }
+    uint8_t adler[4];
+    put_be32(adler, (adlerB << 16) | adlerA);
+    chunk_write(&chunk, adler, sizeof(adler));
+    ok = chunk_end(&chunk) && ok;
+
+    chunk_begin(&chunk, file, "IEND", 0);
+    ok = chunk_end(&chunk) && ok;
+
+    ok = fclose(file) == 0 && ok;
+    capture->stats.writtenBytes += dataSize;
+    return ok;
+}
+
+static int writer_main(void* data)
+{
+    FrameCapture* capture = (FrameCapture*)data;
+
+    CPUPROF_THREAD("capture writer");
+    for (;;)
+    {
+        SDL_SemWait(capture->queuedSignal);
+        SDL_LockMutex(capture->lock);
+        if (!capture->queuedCount)
+        {
+            // Only the quit post comes without a slot.
+            SDL_UnlockMutex(capture->lock);
+            break;
+        }
+        --capture->queuedCount;
+        SDL_UnlockMutex(capture->lock);
+
+        const CaptureSlot* slot = &capture->slots[capture->writeSlot % capture->slotCount];
+        if (!capture->failed)
+        {
+            CPUPROF_BEGIN("write frame");
+            uint64_t start = SDL_GetPerformanceCounter();
+            const uint8_t* pixels = (const uint8_t*)slot->memory.mapped;
+            int ok = capture->format == CAPTURE_FORMAT_Y4M ? write_y4m(capture, pixels)
+                : capture->format == CAPTURE_FORMAT_PNG ? write_png(capture, pixels)
+                : write_raw(capture, pixels);
+            capture->failed = !ok;
+            capture->stats.writtenFrames += ok;
+            capture->stats.writerNs += (SDL_GetPerformanceCounter() - start) * 1000000000ull / SDL_GetPerformanceFrequency();
+            CPUPROF_END();
+        }
+        ++capture->writeSlot;
+        SDL_SemPost(capture->freeSlots);
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------
+
+uint32_t capture_format_from_path(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    char extension[4] = { 0 };
+    for (uint32_t i = 0; dot && i < 3 && dot[i + 1]; ++i)
+    {
+        extension[i] = (char)tolower((unsigned char)dot[i + 1]);
+    }
+    return strcmp(extension, "y4m") == 0 ? CAPTURE_FORMAT_Y4M
+        : strcmp(extension, "png") == 0 ? CAPTURE_FORMAT_PNG
+        : CAPTURE_FORMAT_RAW;
+}
+
+const char* capture_format_name(uint32_t format)
+{
+    return format < CAPTURE_FORMAT_COUNT ? formatNames[format] : "unknown";
+}
+
+int capture_supports_format(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB
+        || format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+int capture_init(FrameCapture* capture, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes,
+    VkDeviceSize nonCoherentAtomSize, const char* path, VkFormat format, VkExtent2D extent, uint32_t slotCount, uint32_t fps)
+{
+    assert(slotCount >= 1 && slotCount <= CAPTURE_MAX_SLOTS);
+
+    memset(capture, 0, sizeof(*capture));
+    if (!capture_supports_format(format) || strlen(path) >= CAPTURE_MAX_PATH)
+    {
+        return 0;
+    }
+    capture->device = device;
+    capture->allocator = allocator;
+    capture->nonCoherentAtomSize = nonCoherentAtomSize ? nonCoherentAtomSize : 1;
+    capture->extent = extent;
+    capture->format = capture_format_from_path(path);
+    capture->swapRedBlue = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    capture->fps = fps;
+    strcpy(capture->path, path);
+    capture->slotCount = slotCount;
+
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t crc = i;
+        for (uint32_t j = 0; j < 8; ++j)
+        {
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+        crcTable[i] = crc;
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (VkDeviceSize)extent.width * extent.height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    for (uint32_t i = 0; i < slotCount; ++i)
+    {
+        CaptureSlot* slot = &capture->slots[i];
+        if (vkCreateBuffer(device, &bufferCreateInfo, 0, &slot->buffer) != VK_SUCCESS)
+        {
+            return 0;
+        }
+        // Whole atoms, so invalidating a slot never needs to know about its neighbours.
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, slot->buffer, &requirements);
+        VkDeviceSize atom = capture->nonCoherentAtomSize;
+        requirements.alignment = requirements.alignment > atom ? requirements.alignment : atom;
+        requirements.size = (requirements.size + atom - 1) / atom * atom;
+        if (!devmem_alloc(allocator, &requirements, memoryTypes, DEVMEM_KIND_LINEAR, &slot->memory)
+            || vkBindBufferMemory(device, slot->buffer, slot->memory.memory, slot->memory.offset) != VK_SUCCESS
+            || !slot->memory.mapped)
+        {
+            return 0;
+        }
+    }
+    uint32_t memoryType = capture->slots[0].memory.block->memoryType;
+    capture->coherent = (allocator->memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    capture->scratch = (uint8_t*)malloc((size_t)extent.width * extent.height * 4 + extent.height);
+    if (!capture->scratch)
+    {
+        return 0;
+    }
+    if (capture->format != CAPTURE_FORMAT_PNG)
+    {
+        capture->file = fopen(path, "wb");
+        if (!capture->file)
+        {
+            return 0;
+        }
+        if (capture->format == CAPTURE_FORMAT_Y4M)
+        {
+            fprintf(capture->file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", extent.width, extent.height, fps);
+        }
+    }
+
+    capture->lock = SDL_CreateMutex();
+    capture->freeSlots = SDL_CreateSemaphore(slotCount);
+    capture->queuedSignal = SDL_CreateSemaphore(0);
+    capture->thread = SDL_CreateThread(writer_main, "CaptureWriter", capture);
+    return capture->thread != 0;
+}
+
+void capture_destroy(FrameCapture* capture)
+{
+    capture_finish(capture);
+    for (uint32_t i = 0; i < capture->slotCount; ++i)
+    {
+        vkDestroyBuffer(capture->device, capture->slots[i].buffer, 0);
+        if (capture->slots[i].memory.memory)
+        {
+            devmem_free(capture->allocator, &capture->slots[i].memory);
+        }
+    }
+    if (capture->lock)
+    {
+        SDL_DestroyMutex(capture->lock);
+        SDL_DestroySemaphore(capture->freeSlots);
+        SDL_DestroySemaphore(capture->queuedSignal);
+    }
+    free(capture->scratch);
+    memset(capture, 0, sizeof(*capture));
+}
+
+int capture_frame(FrameCapture* capture, VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, uint64_t serial)
+{
+    if (!capture->thread)
+    {
+        return 0;
+    }
+    if (extent.width != capture->extent.width || extent.height != capture->extent.height)
+    {
+        ++capture->stats.skippedFrames;
+        return 0;
+    }
+    // The writer frees slots in ring order, so a free slot is always the next one.
+    if (SDL_SemTryWait(capture->freeSlots) != 0)
+    {
+        ++capture->stats.droppedFrames;
+        return 0;
+    }
+
+    CaptureSlot* slot = &capture->slots[capture->nextSlot++ % capture->slotCount];
+    slot->serial = serial;
+    slot->frame = capture->frameCount++;
+
+    VkBufferImageCopy region = {
+        .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+        .imageExtent = { extent.width, extent.height, 1 },
+    };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &(VkMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        },
+        0, 0, 0, 0);
+
+    ++capture->stats.capturedFrames;
+    return 1;
+}
+
+void capture_poll(FrameCapture* capture, uint64_t completedSerial)
+{
+    uint32_t queued = 0;
+    while (capture->pollSlot != capture->nextSlot && capture->slots[capture->pollSlot % capture->slotCount].serial <= completedSerial)
+    {
+        const CaptureSlot* slot = &capture->slots[capture->pollSlot++ % capture->slotCount];
+        if (!capture->coherent)
+        {
+            VkMappedMemoryRange range = {
+                .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                .memory = slot->memory.memory,
+                .offset = slot->memory.offset,
+                .size = slot->memory.size,
+            };
+            vkInvalidateMappedMemoryRanges(capture->device, 1, &range);
+        }
+        ++queued;
+    }
+    if (!queued)
+    {
+        return;
+    }
+
+    SDL_LockMutex(capture->lock);
+    capture->queuedCount += queued;
+    SDL_UnlockMutex(capture->lock);
+    for (uint32_t i = 0; i < queued; ++i)
+    {
+        SDL_SemPost(capture->queuedSignal);
+    }
+}
+
+void capture_finish(FrameCapture* capture)
+{
+    if (capture->thread)
+    {
+        capture_poll(capture, UINT64_MAX);
+        SDL_SemPost(capture->queuedSignal);
+        SDL_WaitThread(capture->thread, 0);
+        capture->thread = 0;
+    }
+    if (capture->file)
+    {
+        capture->failed = fclose(capture->file) != 0 || capture->failed;
+        capture->file = 0;
+    }
+}
+
+void capture_print_stats(const FrameCapture* capture)
+{
+    const CaptureStats* stats = &capture->stats;
+    printf("Capture: %s to %s, %u of %u frames written, %u dropped, %u skipped, %.1f MB, writer %.2f ms/frame%s\n",
+        capture_format_name(capture->format), capture->path, stats->writtenFrames, stats->capturedFrames,
+        stats->droppedFrames, stats->skippedFrames, stats->writtenBytes / (1024.0 * 1024.0),
+        stats->writtenFrames ? stats->writerNs * 1e-6 / stats->writtenFrames : 0.0,
+        capture->failed ? ", WRITE FAILED" : "");
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+#include "devmem.h"
+
+/*
+** Asynchronous frame capture.
+**
+** capture_frame records a copy of the finished backbuffer into the next
+** buffer of a ring of host-visible readback buffers, tagged with the frame
+** serial. capture_poll hands every buffer whose serial the GPU has finished
+** to a writer thread, in order, and never waits: when the writer falls
+** behind and the next buffer is still queued, the frame is dropped and
+** counted instead of stalling the frame loop. The writer converts the
+** pixels and appends them to the output, then gives the buffer back.
+**
+** Outputs, picked by the file extension:
+**  .y4m  YUV4MPEG2, 4:2:0 with JPEG (full range BT.601) coefficients
+**  .png  one file per frame, name_00000.png, name_00001.png, ...; stored
+**        without compression so the writer keeps up at full frame rate
+**  else  raw RGBA8 frames back to back
+**
+** Only 8-bit RGBA and BGRA backbuffers are captured, and only at the size
+** capture_init was given; frames of other sizes are skipped.
+*/
+
+enum {
+    CAPTURE_FORMAT_RAW,
+    CAPTURE_FORMAT_Y4M,
+    CAPTURE_FORMAT_PNG,
+    CAPTURE_FORMAT_COUNT,
+};
+
+enum {
+    CAPTURE_MAX_SLOTS = 8,
+    CAPTURE_MAX_PATH = 256,
+};
+
+typedef struct tagCaptureSlot
+{
+    VkBuffer buffer;
+    DeviceAllocation memory;
+    uint64_t serial;
+    uint32_t frame;                 // index in the output sequence
+} CaptureSlot;
+
+typedef struct tagCaptureStats
+{
+    uint32_t capturedFrames;        // copies recorded
+    uint32_t droppedFrames;         // no free buffer, the writer was behind
+    uint32_t skippedFrames;         // backbuffer size differed
+    uint32_t writtenFrames;         // by the writer, valid after capture_finish
+    uint64_t writtenBytes;
+    uint64_t writerNs;              // spent converting and writing
+} CaptureStats;
+
+typedef struct tagFrameCapture
+{
+    VkDevice device;
+    DeviceMemoryAllocator* allocator;
+    VkDeviceSize nonCoherentAtomSize;
+    int coherent;                   // readback memory needs no invalidate
+    VkExtent2D extent;
+    uint32_t format;                // CAPTURE_FORMAT_*
+    uint32_t swapRedBlue;           // backbuffer is BGRA
+    uint32_t fps;                   // Y4M header only
+    char path[CAPTURE_MAX_PATH];
+
+    // Slots are used, written and freed strictly in ring order.
+    uint32_t slotCount;
+    CaptureSlot slots[CAPTURE_MAX_SLOTS];
+    uint32_t nextSlot;              // monotonic, the slot capture_frame uses next
+    uint32_t pollSlot;              // oldest slot still on the GPU
+    uint32_t frameCount;
+
+    // Writer thread.
+    struct SDL_Thread* thread;
+    struct SDL_semaphore* freeSlots;        // one post per slot the writer is done with
+    struct SDL_semaphore* queuedSignal;     // one post per queued slot, one more to quit
+    struct SDL_mutex* lock;
+    uint32_t queuedCount;           // guarded by lock
+    uint32_t writeSlot;             // writer only from here on
+    int failed;                     // output error, the remaining frames are dropped
+    FILE* file;                     // raw and Y4M
+    uint8_t* scratch;
+
+    CaptureStats stats;
+} FrameCapture;
+
+// Format from the path's extension.
+uint32_t capture_format_from_path(const char* path);
+const char* capture_format_name(uint32_t format);
+
+// 0 if the backbuffer format can not be captured.
+int capture_supports_format(VkFormat format);
+
+// memoryTypes should be host visible and preferably cached, readback buffers are only ever read by the CPU.
+int capture_init(FrameCapture* capture, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes,
+    VkDeviceSize nonCoherentAtomSize, const char* path, VkFormat format, VkExtent2D extent, uint32_t slotCount, uint32_t fps);
+// The GPU must be idle.
+void capture_destroy(FrameCapture* capture);
+
+// Records the copy of image, which must be in TRANSFER_SRC_OPTIMAL layout, for the frame with serial.
+// Returns 0 if the frame was dropped or skipped.
+int capture_frame(FrameCapture* capture, VkCommandBuffer commandBuffer, VkImage image, VkExtent2D extent, uint64_t serial);
+
+// Passes every copy up to completedSerial to the writer, never blocks.
+void capture_poll(FrameCapture* capture, uint64_t completedSerial);
+
+// Writes everything captured and stops the writer. The GPU must be idle.
+void capture_finish(FrameCapture* capture);
+
+void capture_print_stats(const FrameCapture* capture);
@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "cpuprof.h"
+
+#ifdef _MSC_VER
+#define CPUPROF_THREAD_LOCAL __declspec(thread)
+#else
+#define CPUPROF_THREAD_LOCAL __thread
+#endif
+
+enum {
+    CPUPROF_MAX_SUMMARY_NAMES = 64,
+};
+
+typedef struct tagCpuProfEvent
+{
+    const char* name;
+    uint64_t start;     // performance counter ticks
+    uint64_t end;
+    uint32_t depth;
+} CpuProfEvent;
+
+typedef struct tagCpuProfThread
+{
+    const char* name;
+    uint32_t id;
+    SDL_atomic_t head;  // scopes written, wraps with the ring
+    uint32_t written;   // owner's copy of head
+
+    uint32_t depth;
+    const char* stackNames[CPUPROF_MAX_DEPTH];
+    uint64_t stackStart[CPUPROF_MAX_DEPTH];
+
+    CpuProfEvent events[CPUPROF_RING_SIZE];
+} CpuProfThread;
+
+typedef struct tagCpuProfFrame
+{
+    uint64_t serial;
+    uint64_t start;
+} CpuProfFrame;
+
+static CpuProfThread* threads[CPUPROF_MAX_THREADS];
+static SDL_atomic_t threadCount;
+static CPUPROF_THREAD_LOCAL CpuProfThread* currentThread;
+
+// Written by the thread calling cpuprof_frame only.
+static CpuProfThread* frameThread;
+static CpuProfFrame frames[CPUPROF_MAX_FRAMES];
+static uint64_t frameHead;
+
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+}
+
+static CpuProfThread* get_thread(void)
+{
+    if (currentThread)
+    {
+        return currentThread;
+    }
+
+    int id = SDL_AtomicAdd(&threadCount, 1);
+    if (id >= CPUPROF_MAX_THREADS)
+    {
+        return 0;
+    }
+
+    CpuProfThread* thread = (CpuProfThread*)calloc(1, sizeof(CpuProfThread));
+    if (!thread)
+    {
+        return 0;
+    }
+    thread->id = (uint32_t)id;
+    SDL_MemoryBarrierRelease();
+    threads[id] = thread;
+    currentThread = thread;
+
+    return thread;
+}
+
+// Copies the thread's valid scopes, skipping any the owner overwrote while they were being copied.
+static uint32_t snapshot(CpuProfThread* thread, CpuProfEvent* events)
+{
+    uint32_t head = (uint32_t)SDL_AtomicGet(&thread->head);
+    SDL_MemoryBarrierAcquire();
+    uint32_t count = head < CPUPROF_RING_SIZE ? head : CPUPROF_RING_SIZE;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        events[i] = thread->events[(head - count + i) & (CPUPROF_RING_SIZE - 1)];
+    }
+
+    SDL_MemoryBarrierAcquire();
+    uint32_t overwritten = (uint32_t)SDL_AtomicGet(&thread->head) - head;
+    overwritten = overwritten < count ? overwritten : count;
+    memmove(events, events + overwritten, (count - overwritten) * sizeof(CpuProfEvent));
+
+    return count - overwritten;
+}
+
+static uint64_t first_frame_ticks(uint32_t frameCount)
+{
+    uint64_t available = frameHead < CPUPROF_MAX_FRAMES ? frameHead : CPUPROF_MAX_FRAMES;
+    if (!available)
+    {
+        return 0;
+    }
+    frameCount = frameCount < available ? frameCount : (uint32_t)available;
+    return frames[(frameHead - frameCount) % CPUPROF_MAX_FRAMES].start;
+}
+
+void cpuprof_thread_name(const char* name)
+{
+    CpuProfThread* thread = get_thread();
+    if (thread)
+    {
+        thread->name = name;
+    }
+}
+
+void cpuprof_begin(const char* name)
+{
+    CpuProfThread* thread = get_thread();
+    if (!thread)
+    {
+        return;
+    }
+
+    // Scopes nested too deep are dropped but still counted, so ends keep matching.
+    if (thread->depth < CPUPROF_MAX_DEPTH)
+    {
+        thread->stackNames[thread->depth] = name;
+        thread->stackStart[thread->depth] = SDL_GetPerformanceCounter();
+    }
+    ++thread->depth;
+}
+
+void cpuprof_end(void)
+{
+    CpuProfThread* thread = currentThread;
+    if (!thread || !thread->depth)
+    {
+        return;
+    }
+
+    uint32_t depth = --thread->depth;
+    if (depth >= CPUPROF_MAX_DEPTH)
+    {
+        return;
+    }
+
+    CpuProfEvent* event = &thread->events[thread->written & (CPUPROF_RING_SIZE - 1)];
+    event->name = thread->stackNames[depth];
+    event->start = thread->stackStart[depth];
+    event->end = SDL_GetPerformanceCounter();
+    event->depth = depth;
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&thread->head, (int)++thread->written);
+}
+
+void cpuprof_frame(uint64_t serial)
+{
+    frameThread = get_thread();
+    frames[frameHead % CPUPROF_MAX_FRAMES] = (CpuProfFrame){ serial, SDL_GetPerformanceCounter() };
+    ++frameHead;
+}
+
+uint64_t cpuprof_now_ns(void)
+{
+    return ticks_to_ns(SDL_GetPerformanceCounter());
+}
+
+int cpuprof_write_trace(const char* fileName, uint32_t frameCount, CpuProfTraceFunc extra, void* userData)
+{
+    CpuProfEvent* events = (CpuProfEvent*)malloc(CPUPROF_RING_SIZE * sizeof(CpuProfEvent));
+    FILE* file = events ? fopen(fileName, "w") : 0;
+    if (!file)
+    {
+        free(events);
+        return 0;
+    }
+
+    uint64_t from = first_frame_ticks(frameCount);
+    uint64_t baseNs = ticks_to_ns(from);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Vulkan\"}}");
+
+    uint32_t count = (uint32_t)SDL_AtomicGet(&threadCount);
+    count = count < CPUPROF_MAX_THREADS ? count : CPUPROF_MAX_THREADS;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        CpuProfThread* thread = threads[i];
+        if (!thread)
+        {
+            continue;
+        }
+        SDL_MemoryBarrierAcquire();
+
+        char defaultName[32];
+        snprintf(defaultName, sizeof(defaultName), "thread %u", i);
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            i + 1, thread->name ? thread->name : defaultName);
+
+        uint32_t eventCount = snapshot(thread, events);
+        for (uint32_t j = 0; j < eventCount; ++j)
+        {
+            if (events[j].start < from)
+            {
+                continue;
+            }
+            uint64_t start = ticks_to_ns(events[j].start);
+            uint64_t end = ticks_to_ns(events[j].end);
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                events[j].name, i + 1, (start - baseNs) * 1e-3, (end - start) * 1e-3);
+        }
+    }
+
+    for (uint64_t i = frameHead > CPUPROF_MAX_FRAMES ? frameHead - CPUPROF_MAX_FRAMES : 0; i < frameHead; ++i)
+    {
+        const CpuProfFrame* frame = &frames[i % CPUPROF_MAX_FRAMES];
+        if (frame->start >= from)
+        {
+            fprintf(file, ",\n{\"name\":\"frame %llu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                (unsigned long long)frame->serial, frameThread ? frameThread->id + 1 : 1, (ticks_to_ns(frame->start) - baseNs) * 1e-3);
+        }
+    }
+
+    if (extra)
+    {
+        extra(file, baseNs, baseNs, userData);
+    }
+
+    fprintf(file, "\n]}\n");
+    free(events);
+
+    return fclose(file) == 0;
+}
+
+void cpuprof_print_summary(uint32_t frameCount)
+{
+    CpuProfEvent* events = (CpuProfEvent*)malloc(CPUPROF_RING_SIZE * sizeof(CpuProfEvent));
+    if (!events || !frameThread || !frameHead)
+    {
+        free(events);
+        return;
+    }
+
+    frameCount = frameCount < frameHead ? frameCount : (uint32_t)frameHead;
+    frameCount = frameCount < CPUPROF_MAX_FRAMES ? frameCount : CPUPROF_MAX_FRAMES;
+    uint64_t from = first_frame_ticks(frameCount);
+
+    const char* names[CPUPROF_MAX_SUMMARY_NAMES];
+    uint32_t depths[CPUPROF_MAX_SUMMARY_NAMES];
+    uint64_t firstStart[CPUPROF_MAX_SUMMARY_NAMES];
+    uint64_t totals[CPUPROF_MAX_SUMMARY_NAMES] = { 0 };
+    uint32_t nameCount = 0;
+
+    uint32_t eventCount = snapshot(frameThread, events);
+    for (uint32_t i = 0; i < eventCount; ++i)
+    {
+        if (events[i].start < from)
+        {
+            continue;
+        }
+
+        uint32_t j = 0;
+        while (j < nameCount && strcmp(names[j], events[i].name) != 0)
+        {
+            ++j;
+        }
+        if (j == nameCount)
+        {
+            if (nameCount == CPUPROF_MAX_SUMMARY_NAMES)
+            {
+                continue;
+            }
+            names[j] = events[i].name;
+            depths[j] = events[i].depth;
+            firstStart[j] = events[i].start;
+            ++nameCount;
+        }
+        totals[j] += events[i].end - events[i].start;
+    }
+
+    // Scopes complete inner first, list them in start order so parents come before children.
+    uint32_t order[CPUPROF_MAX_SUMMARY_NAMES];
+    for (uint32_t j = 0; j < nameCount; ++j)
+    {
+        uint32_t k = j;
+        while (k > 0 && firstStart[order[k - 1]] > firstStart[j])
+        {
+            order[k] = order[k - 1];
+            --k;
+        }
+        order[k] = j;
+    }
+
+    printf("CPU scopes (ms per frame over last %u frames):\n", frameCount);
+    for (uint32_t i = 0; i < nameCount; ++i)
+    {
+        uint32_t j = order[i];
+        printf("  %*s%-24s %8.3f\n", 2 * depths[j], "", names[j], ticks_to_ns(totals[j]) * 1e-6 / frameCount);
+    }
+    free(events);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+** CPU hot-path instrumentation.
+**
+** Every thread that opens a scope gets its own ring of completed scopes,
+** written only by that thread and published with a release store of the
+** head index, so recording takes no locks. Frame marks from the main
+** thread are kept in a ring of recent frames; a dump writes every scope
+** of the last frames as a Chrome trace, optionally merged with GPU scopes
+** already converted to the CPU clock.
+**
+** The macros compile to nothing when CPUPROF_DISABLED is defined. Scope
+** names are not copied, pass string literals.
+*/
+
+enum {
+    CPUPROF_MAX_THREADS = 32,
+    CPUPROF_MAX_DEPTH = 32,
+    CPUPROF_RING_SIZE = 1 << 14,    // scopes per thread, power of 2
+    CPUPROF_MAX_FRAMES = 128,       // frame marks kept for dumps
+};
+
+// Appends extra trace events, timestamps are CPU ns; fromNs is the first dumped frame, baseNs is trace time 0.
+typedef void (*CpuProfTraceFunc)(FILE* file, uint64_t fromNs, uint64_t baseNs, void* userData);
+
+void cpuprof_thread_name(const char* name);
+void cpuprof_begin(const char* name);
+void cpuprof_end(void);
+void cpuprof_frame(uint64_t serial);
+
+uint64_t cpuprof_now_ns(void);
+
+// Writes the last frameCount frames of every thread.
+int cpuprof_write_trace(const char* fileName, uint32_t frameCount, CpuProfTraceFunc extra, void* userData);
+
+// Average time per frame of every main thread scope over the last frameCount frames.
+void cpuprof_print_summary(uint32_t frameCount);
+
+#ifndef CPUPROF_DISABLED
+#define CPUPROF_THREAD(name) cpuprof_thread_name(name)
+#define CPUPROF_BEGIN(name) cpuprof_begin(name)
+#define CPUPROF_END() cpuprof_end()
+#define CPUPROF_FRAME(serial) cpuprof_frame(serial)
+#else
+#define CPUPROF_THREAD(name) ((void)0)
+#define CPUPROF_BEGIN(name) ((void)0)
+#define CPUPROF_END() ((void)0)
+#define CPUPROF_FRAME(serial) ((void)0)
+#endif
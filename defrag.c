@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bits.h"
+#include "defrag.h"
+
+static void release_retired(Defragmenter* defrag, uint64_t completedSerial)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < defrag->retiredCount; ++i)
+    {
+        DefragRetired* retired = &defrag->retired[i];
+        if (retired->serial > completedSerial)
+        {
+            defrag->retired[kept++] = *retired;
+            continue;
+        }
+        uint32_t blockCount = defrag->allocator->deviceMemoryCount;
+        vkDestroyBuffer(defrag->device, retired->buffer, 0);
+        devmem_free(defrag->allocator, &retired->allocation);
+        defrag->stats.freedBlocks += retired->moved && defrag->allocator->deviceMemoryCount < blockCount;
+    }
+    defrag->retiredCount = kept;
+}
+
+static uint32_t movable_count(const Defragmenter* defrag, const DeviceMemoryBlock* block)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < defrag->bufferCount; ++i)
+    {
+        count += defrag->buffers[i].allocation->block == block;
+    }
+    return count;
+}
+
+// The sparsest shared block that only holds registered buffers and whose contents fit into the other blocks.
+static const DeviceMemoryBlock* pick_source(const Defragmenter* defrag)
+{
+    const DeviceMemoryBlock* best = 0;
+    uint32_t types = defrag->memoryTypes;
+    while (types)
+    {
+        uint32_t memoryType = bit_ffs32(types);
+        types &= types - 1;
+
+        const DeviceMemoryBlock* list = defrag->allocator->blocks[memoryType][DEVMEM_KIND_LINEAR];
+        VkDeviceSize freeBytes = 0;
+        for (const DeviceMemoryBlock* block = list; block; block = block->next)
+        {
+            freeBytes += block->dedicated ? 0 : block->tlsf.size - block->tlsf.usedSize;
+        }
+        for (const DeviceMemoryBlock* block = list; block; block = block->next)
+        {
+            VkDeviceSize used = block->tlsf.usedSize;
+            VkDeviceSize freeElsewhere = freeBytes - (block->tlsf.size - used);
+            if (block->dedicated || !used || used >= block->tlsf.size * defrag->sparseFraction || used > freeElsewhere
+                || (best && used >= best->tlsf.usedSize) || movable_count(defrag, block) != block->tlsf.allocCount)
+            {
+                continue;
+            }
+            best = block;
+        }
+    }
+    return best;
+}
+
+static int move_buffer(Defragmenter* defrag, DefragBuffer* entry, VkCommandBuffer commandBuffer, uint64_t serial, int* barrier)
+{
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = entry->size,
+        .usage = entry->usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    VkBuffer buffer;
+    if (vkCreateBuffer(defrag->device, &bufferCreateInfo, 0, &buffer) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(defrag->device, buffer, &memoryRequirements);
+    const DeviceMemoryBlock* source = entry->allocation->block;
+    DeviceAllocation allocation;
+    if (!devmem_alloc_existing(defrag->allocator, &memoryRequirements, source->memoryType, source->kind, source, &allocation))
+    {
+        vkDestroyBuffer(defrag->device, buffer, 0);
+        return 0;
+    }
+    if (vkBindBufferMemory(defrag->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+    {
+        devmem_free(defrag->allocator, &allocation);
+        vkDestroyBuffer(defrag->device, buffer, 0);
+        return 0;
+    }
+
+    if (!*barrier)
+    {
+        // Whatever last wrote the sources, an upload or an earlier move, has to land before they are read.
+        VkMemoryBarrier memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            1, &memoryBarrier, 0, 0, 0, 0);
+        *barrier = 1;
+    }
+    VkBufferCopy region = { 0, 0, entry->size };
+    vkCmdCopyBuffer(commandBuffer, *entry->buffer, buffer, 1, &region);
+
+    defrag->retired[defrag->retiredCount++] = (DefragRetired){ *entry->buffer, *entry->allocation, serial, 1 };
+    *entry->buffer = buffer;
+    *entry->allocation = allocation;
+    return 1;
+}
+
+void defrag_init(Defragmenter* defrag, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes, VkDeviceSize frameBytes)
+{
+    memset(defrag, 0, sizeof(*defrag));
+    defrag->device = device;
+    defrag->allocator = allocator;
+    defrag->memoryTypes = memoryTypes;
+    defrag->frameBytes = frameBytes;
+    defrag->sparseFraction = 0.5f;
+}
+
+void defrag_destroy(Defragmenter* defrag)
+{
+    release_retired(defrag, UINT64_MAX);
+    defrag->bufferCount = 0;
+    defrag->source = 0;
+}
+
+int defrag_register(Defragmenter* defrag, VkBuffer* buffer, DeviceAllocation* allocation, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    if (defrag->bufferCount == DEFRAG_MAX_BUFFERS)
+    {
+        return 0;
+    }
+    defrag->buffers[defrag->bufferCount++] = (DefragBuffer){ buffer, allocation, size, usage };
+    return 1;
+}
+
+void defrag_unregister(Defragmenter* defrag, VkBuffer* buffer)
+{
+    for (uint32_t i = 0; i < defrag->bufferCount; ++i)
+    {
+        if (defrag->buffers[i].buffer == buffer)
+        {
+            defrag->buffers[i] = defrag->buffers[--defrag->bufferCount];
+            return;
+        }
+    }
+}
+
+int defrag_retire(Defragmenter* defrag, VkBuffer* buffer, DeviceAllocation* allocation, uint64_t serial)
+{
+    if (defrag->retiredCount == DEFRAG_MAX_RETIRED)
+    {
+        return 0;
+    }
+    defrag_unregister(defrag, buffer);
+    defrag->retired[defrag->retiredCount++] = (DefragRetired){ *buffer, *allocation, serial, 0 };
+    *buffer = VK_NULL_HANDLE;
+    allocation->block = 0;
+    return 1;
+}
+
+uint32_t defrag_step(Defragmenter* defrag, VkCommandBuffer commandBuffer, uint64_t serial, uint64_t completedSerial)
+{
+    release_retired(defrag, completedSerial);
+    defrag->stats.frameMoves = 0;
+    defrag->stats.frameBytes = 0;
+    if (!defrag->frameBytes)
+    {
+        return 0;
+    }
+    if (defrag->retryFrames)
+    {
+        --defrag->retryFrames;
+        return 0;
+    }
+    if (!defrag->source)
+    {
+        // The last source is still draining, picking now could refill it from the block chosen next.
+        for (uint32_t i = 0; i < defrag->retiredCount; ++i)
+        {
+            if (defrag->retired[i].moved)
+            {
+                return 0;
+            }
+        }
+        defrag->source = pick_source(defrag);
+        if (!defrag->source)
+        {
+            return 0;
+        }
+        ++defrag->stats.sourceBlocks;
+    }
+
+    uint32_t moves = 0;
+    VkDeviceSize bytes = 0;
+    int barrier = 0;
+    int done = 1;
+    for (uint32_t i = 0; i < defrag->bufferCount; ++i)
+    {
+        DefragBuffer* entry = &defrag->buffers[i];
+        if (entry->allocation->block != defrag->source)
+        {
+            continue;
+        }
+        // A buffer bigger than the budget still moves, on a frame of its own.
+        if (moves == DEFRAG_MAX_FRAME_MOVES || (moves && bytes + entry->size > defrag->frameBytes)
+            || defrag->retiredCount == DEFRAG_MAX_RETIRED)
+        {
+            done = 0;
+            break;
+        }
+        if (!move_buffer(defrag, entry, commandBuffer, serial, &barrier))
+        {
+            ++defrag->stats.failedMoves;
+            defrag->retryFrames = DEFRAG_RETRY_FRAMES;
+            break;
+        }
+        ++moves;
+        bytes += entry->size;
+    }
+    // Once the last buffer has left, the block is freed along with the last retired copy source.
+    if (done)
+    {
+        defrag->source = 0;
+    }
+
+    if (moves)
+    {
+        VkMemoryBarrier memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &memoryBarrier, 0, 0, 0, 0);
+    }
+    defrag->stats.frameMoves = moves;
+    defrag->stats.frameBytes = bytes;
+    defrag->stats.moves += moves;
+    defrag->stats.movedBytes += bytes;
+    return moves;
+}
+
+void defrag_print_stats(const Defragmenter* defrag)
+{
+    const DefragStats* stats = &defrag->stats;
+    printf("Defrag: %u buffers registered, %u moves %.2f MB, %u of %u picked blocks released, %u failed moves, budget %.0f KB per frame\n",
+        defrag->bufferCount, stats->moves, stats->movedBytes / (1024.0 * 1024.0), stats->freedBlocks, stats->sourceBlocks,
+        stats->failedMoves, defrag->frameBytes / 1024.0);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "devmem.h"
+
+/*
+** Incremental defragmenter for device-local buffers.
+**
+** Owners register buffers whose contents only change through transfers
+** and that no descriptor set points at, handing over pointers to their
+** VkBuffer and DeviceAllocation. Once a frame, defrag_step picks the
+** sparsest shared block that holds nothing but registered buffers and
+** copies them into other blocks of the same memory type, a few per frame
+** within a byte budget. The owner's handle is switched to the copy right
+** away, draws recorded later in the frame read from it, while the old
+** buffer is kept until the GPU has finished the frame. When the last
+** allocation leaves, the source block goes back to the driver.
+**
+** Nothing is moved into a fresh block: if the other blocks have no room,
+** the source is given up for a while.
+*/
+
+enum {
+    DEFRAG_MAX_BUFFERS = 128,
+    DEFRAG_MAX_RETIRED = 256,
+    DEFRAG_MAX_FRAME_MOVES = 16,
+    DEFRAG_DEFAULT_FRAME_BYTES = 2 << 20,
+    DEFRAG_RETRY_FRAMES = 120,          // after a failed move, before the next source is picked
+};
+
+typedef struct tagDefragBuffer
+{
+    VkBuffer* buffer;                   // owner's handle, replaced when the buffer moves
+    DeviceAllocation* allocation;       // owner's allocation, replaced along with it
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+} DefragBuffer;
+
+typedef struct tagDefragRetired
+{
+    VkBuffer buffer;
+    DeviceAllocation allocation;
+    uint64_t serial;                    // last frame that may read it
+    uint32_t moved;                     // left behind by a move rather than retired by its owner
+} DefragRetired;
+
+typedef struct tagDefragStats
+{
+    uint32_t moves;
+    uint64_t movedBytes;
+    uint32_t frameMoves;                // last defrag_step
+    uint64_t frameBytes;
+    uint32_t sourceBlocks;              // blocks picked to be emptied
+    uint32_t freedBlocks;               // blocks released once emptied
+    uint32_t failedMoves;               // no room outside the source
+} DefragStats;
+
+typedef struct tagDefragmenter
+{
+    VkDevice device;
+    DeviceMemoryAllocator* allocator;
+    uint32_t memoryTypes;               // only blocks of these types are emptied
+    VkDeviceSize frameBytes;            // copy budget per frame, 0 - never move
+    float sparseFraction;               // only blocks used below this fraction are emptied
+
+    uint32_t bufferCount;
+    DefragBuffer buffers[DEFRAG_MAX_BUFFERS];
+    uint32_t retiredCount;
+    DefragRetired retired[DEFRAG_MAX_RETIRED];
+
+    const DeviceMemoryBlock* source;    // block being emptied
+    uint32_t retryFrames;
+
+    DefragStats stats;
+} Defragmenter;
+
+void defrag_init(Defragmenter* defrag, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes, VkDeviceSize frameBytes);
+// The GPU must be idle. Registered buffers stay with their owners.
+void defrag_destroy(Defragmenter* defrag);
+
+// buffer must have been created with VK_BUFFER_USAGE_TRANSFER_SRC_BIT; both pointers must stay valid until unregistered.
+int defrag_register(Defragmenter* defrag, VkBuffer* buffer, DeviceAllocation* allocation, VkDeviceSize size, VkBufferUsageFlags usage);
+void defrag_unregister(Defragmenter* defrag, VkBuffer* buffer);
+// Unregisters buffer and destroys it with its allocation once the GPU has finished serial. Returns 0 if nothing can be queued.
+int defrag_retire(Defragmenter* defrag, VkBuffer* buffer, DeviceAllocation* allocation, uint64_t serial);
+
+// Frees what the GPU is done with and records this frame's copies, followed by a barrier that makes them
+// visible to every later command. Must be recorded outside a render pass. Returns the number of buffers moved.
+uint32_t defrag_step(Defragmenter* defrag, VkCommandBuffer commandBuffer, uint64_t serial, uint64_t completedSerial);
+
+void defrag_print_stats(const Defragmenter* defrag);
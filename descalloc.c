@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "descalloc.h"
+
+static VkDescriptorPool create_pool(DescriptorAllocator* alloc)
+{
+    VkDescriptorPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = alloc->setsPerPool,
+        .poolSizeCount = alloc->poolSizeCount,
+        .pPoolSizes = alloc->poolSizes,
+    };
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    if (vkCreateDescriptorPool(alloc->device, &poolCreateInfo, 0, &pool) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+    ++alloc->stats.poolCount;
+    return pool;
+}
+
+int descalloc_init(DescriptorAllocator* alloc, VkDevice device, uint32_t frameCount, uint32_t setsPerPool,
+    const VkDescriptorPoolSize* poolSizes, uint32_t poolSizeCount)
+{
+    assert(frameCount >= 1 && frameCount <= DESCALLOC_MAX_FRAMES);
+    assert(poolSizeCount <= DESCALLOC_MAX_POOL_SIZES);
+
+    memset(alloc, 0, sizeof(*alloc));
+    alloc->device = device;
+    alloc->frameCount = frameCount;
+    alloc->setsPerPool = setsPerPool;
+    alloc->poolSizeCount = poolSizeCount;
+    memcpy(alloc->poolSizes, poolSizes, poolSizeCount * sizeof(VkDescriptorPoolSize));
+
+    // One pool per slot up front, most frames never need a second.
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        alloc->pools[i][0] = create_pool(alloc);
+        if (!alloc->pools[i][0])
+        {
+            return 0;
+        }
+        alloc->poolCounts[i] = 1;
+    }
+
+    return 1;
+}
+
+void descalloc_destroy(DescriptorAllocator* alloc)
+{
+    for (uint32_t i = 0; i < alloc->frameCount; ++i)
+    {
+        for (uint32_t j = 0; j < alloc->poolCounts[i]; ++j)
+        {
+            vkDestroyDescriptorPool(alloc->device, alloc->pools[i][j], 0);
+        }
+    }
+    memset(alloc, 0, sizeof(*alloc));
+}
+
+void descalloc_begin_frame(DescriptorAllocator* alloc, uint32_t frame)
+{
+    assert(frame < alloc->frameCount);
+
+    for (uint32_t i = 0; i < alloc->poolCounts[frame]; ++i)
+    {
+        vkResetDescriptorPool(alloc->device, alloc->pools[frame][i], 0);
+    }
+    alloc->frame = frame;
+    alloc->current = 0;
+    alloc->stats.frameSets = 0;
+}
+
+VkDescriptorSet descalloc_alloc(DescriptorAllocator* alloc, VkDescriptorSetLayout layout)
+{
+    VkDescriptorSetAllocateInfo setAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    uint32_t frame = alloc->frame;
+    for (;;)
+    {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        setAllocateInfo.descriptorPool = alloc->pools[frame][alloc->current];
+        // Out of pool memory and fragmentation both mean this pool is done for the frame.
+        if (vkAllocateDescriptorSets(alloc->device, &setAllocateInfo, &set) == VK_SUCCESS)
+        {
+            ++alloc->stats.frameSets;
+            alloc->stats.highWaterSets = alloc->stats.frameSets > alloc->stats.highWaterSets ? alloc->stats.frameSets : alloc->stats.highWaterSets;
+            return set;
+        }
+
+        if (alloc->current + 1 == alloc->poolCounts[frame])
+        {
+            VkDescriptorPool pool = alloc->poolCounts[frame] < DESCALLOC_MAX_POOLS ? create_pool(alloc) : VK_NULL_HANDLE;
+            if (!pool)
+            {
+                ++alloc->stats.failedCount;
+                return VK_NULL_HANDLE;
+            }
+            alloc->pools[frame][alloc->poolCounts[frame]++] = pool;
+        }
+        ++alloc->current;
+    }
+}
+
+void descalloc_print_stats(const DescriptorAllocator* alloc)
+{
+    printf("Frame descriptors: %u sets last frame, high water %u, %u pools of %u sets, %u failed allocations\n",
+        alloc->stats.frameSets, alloc->stats.highWaterSets, alloc->stats.poolCount, alloc->setsPerPool,
+        alloc->stats.failedCount);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/*
+** Per-frame descriptor allocator.
+**
+** Descriptor sets that live for one frame are allocated linearly from
+** pools owned by the frame slot. There is no per-set free:
+** descalloc_begin_frame resets every pool of the slot at once, which
+** must only happen once the slot's previous frame has finished. A slot
+** that runs out of space chains another pool and keeps it, so once the
+** busiest frame has been seen allocation never creates pools.
+**
+** Sets are allocated on one thread, the one recording the frame. Workers
+** may bind them.
+*/
+
+enum {
+    DESCALLOC_MAX_FRAMES = 4,
+    DESCALLOC_MAX_POOLS = 8,        // per frame slot
+    DESCALLOC_MAX_POOL_SIZES = 4,
+};
+
+typedef struct tagDescriptorAllocatorStats
+{
+    uint32_t frameSets;             // sets allocated in the last frame
+    uint32_t highWaterSets;
+    uint32_t poolCount;             // over all slots
+    uint32_t failedCount;           // allocations that found no space
+} DescriptorAllocatorStats;
+
+typedef struct tagDescriptorAllocator
+{
+    VkDevice device;
+    uint32_t frameCount;
+    uint32_t frame;                 // slot being allocated from
+    uint32_t current;               // pool of the slot being allocated from
+    uint32_t setsPerPool;
+    uint32_t poolSizeCount;
+    VkDescriptorPoolSize poolSizes[DESCALLOC_MAX_POOL_SIZES];
+    VkDescriptorPool pools[DESCALLOC_MAX_FRAMES][DESCALLOC_MAX_POOLS];
+    uint32_t poolCounts[DESCALLOC_MAX_FRAMES];
+    DescriptorAllocatorStats stats;
+} DescriptorAllocator;
+
+// Every pool holds setsPerPool sets and poolSizes descriptors.
+int descalloc_init(DescriptorAllocator* alloc, VkDevice device, uint32_t frameCount, uint32_t setsPerPool,
+    const VkDescriptorPoolSize* poolSizes, uint32_t poolSizeCount);
+void descalloc_destroy(DescriptorAllocator* alloc);
+
+// Frees every set the slot handed out; its previous frame must have finished.
+void descalloc_begin_frame(DescriptorAllocator* alloc, uint32_t frame);
+
+// Returns VK_NULL_HANDLE when no pool has space and no more can be created.
+VkDescriptorSet descalloc_alloc(DescriptorAllocator* alloc, VkDescriptorSetLayout layout);
+
+void descalloc_print_stats(const DescriptorAllocator* alloc);
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bits.h"
+#include "devmem.h"
+
+static DeviceMemoryBlock* create_block(DeviceMemoryAllocator* allocator, uint32_t memoryType, uint32_t kind, VkDeviceSize size, uint32_t dedicated)
+{
+    if (allocator->deviceMemoryCount >= allocator->maxAllocationCount || size > (1u << 31))
+    {
+        return 0;
+    }
+
+    DeviceMemoryBlock* block = (DeviceMemoryBlock*)calloc(1, sizeof(DeviceMemoryBlock));
+    if (!block)
+    {
+        return 0;
+    }
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryType,
+    };
+    if (vkAllocateMemory(allocator->device, &allocInfo, 0, &block->memory) != VK_SUCCESS)
+    {
+        free(block);
+        return 0;
+    }
+
+    if (allocator->memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, (void**)&block->mapped);
+    }
+
+    if (!tlsf_init(&block->tlsf, (uint32_t)size))
+    {
+        if (block->mapped)
+        {
+            vkUnmapMemory(allocator->device, block->memory);
+        }
+        vkFreeMemory(allocator->device, block->memory, 0);
+        free(block);
+        return 0;
+    }
+    block->memoryType = memoryType;
+    block->kind = kind;
+    block->dedicated = dedicated;
+    block->next = allocator->blocks[memoryType][kind];
+    allocator->blocks[memoryType][kind] = block;
+    ++allocator->deviceMemoryCount;
+
+    DeviceMemoryCounters* counters = &allocator->counters;
+    ++counters->blockAllocations;
+    counters->blockBytes += size;
+    counters->peakBlockBytes = counters->blockBytes > counters->peakBlockBytes ? counters->blockBytes : counters->peakBlockBytes;
+
+    return block;
+}
+
+static void destroy_block(DeviceMemoryAllocator* allocator, DeviceMemoryBlock* block)
+{
+    DeviceMemoryBlock** link = &allocator->blocks[block->memoryType][block->kind];
+    while (*link != block)
+    {
+        link = &(*link)->next;
+    }
+    *link = block->next;
+
+    if (block->mapped)
+    {
+        vkUnmapMemory(allocator->device, block->memory);
+    }
+    vkFreeMemory(allocator->device, block->memory, 0);
+    ++allocator->counters.blockFrees;
+    allocator->counters.blockBytes -= block->tlsf.size;
+    tlsf_destroy(&block->tlsf);
+    free(block);
+    --allocator->deviceMemoryCount;
+}
+
+static int suballocate(DeviceMemoryBlock* block, uint32_t size, uint32_t align, DeviceAllocation* allocation)
+{
+    uint32_t offset;
+    uint32_t handle = tlsf_alloc(&block->tlsf, size, align, &offset);
+    if (handle == TLSF_INVALID)
+    {
+        return 0;
+    }
+
+    allocation->block = block;
+    allocation->handle = handle;
+    allocation->memory = block->memory;
+    allocation->offset = offset;
+    allocation->size = size;
+    allocation->mapped = block->mapped ? block->mapped + offset : 0;
+
+    return 1;
+}
+
+int devmem_init(DeviceMemoryAllocator* allocator, VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    memset(allocator, 0, sizeof(*allocator));
+    allocator->device = device;
+    allocator->physicalDevice = physicalDevice;
+    allocator->blockSize = blockSize;
+    allocator->separateKinds = properties.limits.bufferImageGranularity > 1;
+    allocator->maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->memProperties);
+
+    return 1;
+}
+
+void devmem_destroy(DeviceMemoryAllocator* allocator)
+{
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        for (uint32_t j = 0; j < DEVMEM_KIND_COUNT; ++j)
+        {
+            while (allocator->blocks[i][j])
+            {
+                destroy_block(allocator, allocator->blocks[i][j]);
+            }
+        }
+    }
+}
+
+const char* devmem_budget_extension(VkPhysicalDevice physicalDevice)
+{
+#ifdef VK_EXT_memory_budget
+    VkExtensionProperties extensions[256];
+    uint32_t extensionCount = sizeof(extensions) / sizeof(extensions[0]);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions);
+    for (uint32_t i = 0; i < extensionCount; ++i)
+    {
+        if (strcmp(extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+        {
+            return VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+        }
+    }
+#endif
+    return 0;
+}
+
+int devmem_enable_budget(DeviceMemoryAllocator* allocator, VkInstance instance)
+{
+#ifdef VK_EXT_memory_budget
+    allocator->getMemoryProperties2 = vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2");
+#endif
+    return allocator->getMemoryProperties2 != 0;
+}
+
+int devmem_alloc(DeviceMemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+    uint32_t allowedTypes, uint32_t kind, DeviceAllocation* allocation)
+{
+    uint32_t size = (uint32_t)requirements->size;
+    uint32_t align = (uint32_t)requirements->alignment;
+    uint32_t dedicated = requirements->size > allocator->blockSize / 2;
+
+    kind = allocator->separateKinds ? kind : DEVMEM_KIND_LINEAR;
+    align = align ? align : 1;
+    if (requirements->size > (1u << 31) || !bit_is_pow2(align))
+    {
+        return 0;
+    }
+
+    uint32_t types = allowedTypes & requirements->memoryTypeBits;
+    while (types)
+    {
+        uint32_t memoryType = bit_ffs32(types);
+        types &= types - 1;
+
+        if (!dedicated)
+        {
+            for (DeviceMemoryBlock* block = allocator->blocks[memoryType][kind]; block; block = block->next)
+            {
+                if (!block->dedicated && suballocate(block, size, align, allocation))
+                {
+                    ++allocator->counters.allocations;
+                    return 1;
+                }
+            }
+        }
+
+        // A dedicated block is sized for the TLSF search to find it whole, which is a little more than size.
+        VkDeviceSize blockSize = dedicated ? tlsf_fit_size(size, align) : allocator->blockSize;
+        DeviceMemoryBlock* block = blockSize ? create_block(allocator, memoryType, kind, blockSize, dedicated) : 0;
+        if (block && suballocate(block, size, align, allocation))
+        {
+            ++allocator->counters.allocations;
+            return 1;
+        }
+        if (block)
+        {
+            destroy_block(allocator, block);
+        }
+        // Heap is full or out of allocations, fall through to the next compatible type.
+    }
+
+    ++allocator->counters.failures;
+    return 0;
+}
+
+int devmem_alloc_existing(DeviceMemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+    uint32_t memoryType, uint32_t kind, const DeviceMemoryBlock* exclude, DeviceAllocation* allocation)
+{
+    uint32_t align = requirements->alignment ? (uint32_t)requirements->alignment : 1;
+    kind = allocator->separateKinds ? kind : DEVMEM_KIND_LINEAR;
+    if (requirements->size > allocator->blockSize / 2 || !(requirements->memoryTypeBits & (1u << memoryType)) || !bit_is_pow2(align))
+    {
+        return 0;
+    }
+
+    for (DeviceMemoryBlock* block = allocator->blocks[memoryType][kind]; block; block = block->next)
+    {
+        if (block != exclude && !block->dedicated && suballocate(block, (uint32_t)requirements->size, align, allocation))
+        {
+            ++allocator->counters.allocations;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void devmem_free(DeviceMemoryAllocator* allocator, DeviceAllocation* allocation)
+{
+    DeviceMemoryBlock* block = allocation->block;
+    if (!block)
+    {
+        return;
+    }
+
+    tlsf_free(&block->tlsf, allocation->handle);
+    allocation->block = 0;
+    ++allocator->counters.frees;
+
+    // Keep one empty shared block around per list to avoid vkAllocateMemory churn.
+    if (tlsf_is_empty(&block->tlsf))
+    {
+        int isOnlyBlock = allocator->blocks[block->memoryType][block->kind] == block && !block->next;
+        if (block->dedicated || !isOnlyBlock)
+        {
+            destroy_block(allocator, block);
+        }
+    }
+}
+
+int devmem_alloc_buffer(DeviceMemoryAllocator* allocator, VkBuffer buffer, uint32_t allowedTypes, DeviceAllocation* allocation)
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(allocator->device, buffer, &memoryRequirements);
+
+    if (!devmem_alloc(allocator, &memoryRequirements, allowedTypes, DEVMEM_KIND_LINEAR, allocation))
+    {
+        return 0;
+    }
+    if (vkBindBufferMemory(allocator->device, buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        devmem_free(allocator, allocation);
+        return 0;
+    }
+    return 1;
+}
+
+int devmem_alloc_image(DeviceMemoryAllocator* allocator, VkImage image, uint32_t allowedTypes, DeviceAllocation* allocation)
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(allocator->device, image, &memoryRequirements);
+
+    if (!devmem_alloc(allocator, &memoryRequirements, allowedTypes, DEVMEM_KIND_OPTIMAL, allocation))
+    {
+        return 0;
+    }
+    if (vkBindImageMemory(allocator->device, image, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        devmem_free(allocator, allocation);
+        return 0;
+    }
+    return 1;
+}
+
+void devmem_get_heap_stats(const DeviceMemoryAllocator* allocator, DeviceHeapStats stats[VK_MAX_MEMORY_HEAPS])
+{
+    VkDeviceSize freeBytes[VK_MAX_MEMORY_HEAPS] = { 0 };
+    memset(stats, 0, VK_MAX_MEMORY_HEAPS * sizeof(DeviceHeapStats));
+
+    for (uint32_t i = 0; i < allocator->memProperties.memoryTypeCount; ++i)
+    {
+        DeviceHeapStats* heap = &stats[allocator->memProperties.memoryTypes[i].heapIndex];
+        VkDeviceSize* heapFree = &freeBytes[allocator->memProperties.memoryTypes[i].heapIndex];
+
+        for (uint32_t j = 0; j < DEVMEM_KIND_COUNT; ++j)
+        {
+            for (const DeviceMemoryBlock* block = allocator->blocks[i][j]; block; block = block->next)
+            {
+                uint32_t largestFree = tlsf_largest_free(&block->tlsf);
+                heap->blockBytes += block->tlsf.size;
+                heap->usedBytes += block->tlsf.usedSize;
+                heap->largestFree = largestFree > heap->largestFree ? largestFree : heap->largestFree;
+                heap->blockCount += 1;
+                heap->allocationCount += block->tlsf.allocCount;
+                heap->freeRangeCount += block->tlsf.freeBlockCount;
+                *heapFree += block->tlsf.size - block->tlsf.usedSize;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < allocator->memProperties.memoryHeapCount; ++i)
+    {
+        stats[i].fragmentation = freeBytes[i] ? 1.0f - (float)stats[i].largestFree / (float)freeBytes[i] : 0.0f;
+        stats[i].heapSize = allocator->memProperties.memoryHeaps[i].size;
+    }
+
+#ifdef VK_EXT_memory_budget
+    if (allocator->getMemoryProperties2)
+    {
+        // Budgets move with what other processes use, so they are queried every time rather than cached.
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+        };
+        VkPhysicalDeviceMemoryProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+            .pNext = &budget,
+        };
+        ((PFN_vkGetPhysicalDeviceMemoryProperties2)allocator->getMemoryProperties2)(allocator->physicalDevice, &properties);
+        for (uint32_t i = 0; i < allocator->memProperties.memoryHeapCount; ++i)
+        {
+            stats[i].budget = budget.heapBudget[i];
+            stats[i].heapUsage = budget.heapUsage[i];
+        }
+    }
+#endif
+}
+
+void devmem_get_type_stats(const DeviceMemoryAllocator* allocator, DeviceTypeStats stats[VK_MAX_MEMORY_TYPES])
+{
+    memset(stats, 0, VK_MAX_MEMORY_TYPES * sizeof(DeviceTypeStats));
+
+    for (uint32_t i = 0; i < allocator->memProperties.memoryTypeCount; ++i)
+    {
+        for (uint32_t j = 0; j < DEVMEM_KIND_COUNT; ++j)
+        {
+            for (const DeviceMemoryBlock* block = allocator->blocks[i][j]; block; block = block->next)
+            {
+                stats[i].blockBytes += block->tlsf.size;
+                stats[i].usedBytes += block->tlsf.usedSize;
+                stats[i].blockCount += 1;
+                stats[i].allocationCount += block->tlsf.allocCount;
+            }
+        }
+    }
+}
+
+void devmem_print_stats(const DeviceMemoryAllocator* allocator)
+{
+    DeviceHeapStats stats[VK_MAX_MEMORY_HEAPS];
+    devmem_get_heap_stats(allocator, stats);
+
+    DeviceTypeStats typeStats[VK_MAX_MEMORY_TYPES];
+    devmem_get_type_stats(allocator, typeStats);
+    const DeviceMemoryCounters* counters = &allocator->counters;
+
+    printf("Device memory: %u vkAllocateMemory allocations (limit %u), peak %.2f MB\n", allocator->deviceMemoryCount,
+        allocator->maxAllocationCount, counters->peakBlockBytes / (1024.0 * 1024.0));
+    printf("  lifetime: %u allocations, %u frees, %u failed, %u blocks allocated, %u freed\n", counters->allocations,
+        counters->frees, counters->failures, counters->blockAllocations, counters->blockFrees);
+    for (uint32_t i = 0; i < allocator->memProperties.memoryHeapCount; ++i)
+    {
+        const DeviceHeapStats* heap = &stats[i];
+        printf("  heap %u%s: %u blocks %.2f MB, %u allocations %.2f MB used, %u free ranges, largest free %.2f MB, fragmentation %.1f%%\n",
+            i, (allocator->memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+            heap->blockCount, heap->blockBytes / (1024.0 * 1024.0),
+            heap->allocationCount, heap->usedBytes / (1024.0 * 1024.0),
+            heap->freeRangeCount, heap->largestFree / (1024.0 * 1024.0),
+            heap->fragmentation * 100.0f);
+        if (heap->budget)
+        {
+            printf("    budget %.2f MB of %.2f MB, process usage %.2f MB (%.1f%%)%s\n", heap->budget / (1024.0 * 1024.0),
+                heap->heapSize / (1024.0 * 1024.0), heap->heapUsage / (1024.0 * 1024.0), heap->heapUsage * 100.0 / heap->budget,
+                heap->heapUsage > heap->budget ? ", over budget" : "");
+        }
+        for (uint32_t j = 0; j < allocator->memProperties.memoryTypeCount; ++j)
+        {
+            const DeviceTypeStats* type = &typeStats[j];
+            if (allocator->memProperties.memoryTypes[j].heapIndex == i && type->blockCount)
+            {
+                printf("    type %u (flags 0x%x): %u blocks %.2f MB, %u allocations %.2f MB used\n", j,
+                    allocator->memProperties.memoryTypes[j].propertyFlags, type->blockCount, type->blockBytes / (1024.0 * 1024.0),
+                    type->allocationCount, type->usedBytes / (1024.0 * 1024.0));
+            }
+        }
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "tlsf.h"
+
+/*
+** Device memory sub-allocator.
+**
+** Buffers and images are carved out of large per-memory-type blocks, each
+** block managed by a TLSF allocator. Linear resources (buffers) and
+** optimal-tiling images live in separate blocks whenever
+** bufferImageGranularity is above 1, so neighbours never share a
+** granularity page. Requests bigger than half a block get a block of
+** their own, which is released as soon as it becomes empty.
+**
+** Telemetry covers every heap and memory type, plus lifetime counters.
+** With VK_EXT_memory_budget enabled, heap stats also carry the driver's
+** budget and the process's usage of each heap, which includes memory the
+** allocator never sees, such as swapchain images.
+*/
+
+enum {
+    DEVMEM_KIND_LINEAR,     // buffers and linear images
+    DEVMEM_KIND_OPTIMAL,    // optimally tiled images
+    DEVMEM_KIND_COUNT,
+    DEVMEM_DEFAULT_BLOCK_SIZE = 64 << 20,
+};
+
+typedef struct tagDeviceMemoryBlock
+{
+    VkDeviceMemory memory;
+    uint8_t* mapped;        // persistently mapped if memory type is host visible
+    uint32_t memoryType;
+    uint32_t kind;
+    uint32_t dedicated;
+    Tlsf tlsf;
+    struct tagDeviceMemoryBlock* next;
+} DeviceMemoryBlock;
+
+typedef struct tagDeviceAllocation
+{
+    DeviceMemoryBlock* block;
+    uint32_t handle;
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;
+} DeviceAllocation;
+
+typedef struct tagDeviceMemoryCounters
+{
+    uint32_t allocations;           // lifetime, successful devmem_alloc calls
+    uint32_t frees;
+    uint32_t failures;              // no allowed memory type had room
+    uint32_t blockAllocations;      // vkAllocateMemory calls that succeeded
+    uint32_t blockFrees;
+    VkDeviceSize blockBytes;        // reserved right now, all heaps
+    VkDeviceSize peakBlockBytes;
+} DeviceMemoryCounters;
+
+typedef struct tagDeviceMemoryAllocator
+{
+    VkDevice device;
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceMemoryProperties memProperties;
+    VkDeviceSize blockSize;
+    uint32_t separateKinds;
+    uint32_t maxAllocationCount;
+    uint32_t deviceMemoryCount;     // live vkAllocateMemory allocations
+    DeviceMemoryBlock* blocks[VK_MAX_MEMORY_TYPES][DEVMEM_KIND_COUNT];
+    PFN_vkVoidFunction getMemoryProperties2;   // set by devmem_enable_budget
+    DeviceMemoryCounters counters;
+} DeviceMemoryAllocator;
+
+typedef struct tagDeviceHeapStats
+{
+    VkDeviceSize blockBytes;        // reserved with vkAllocateMemory
+    VkDeviceSize usedBytes;         // handed out to resources
+    VkDeviceSize largestFree;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    uint32_t freeRangeCount;
+    float fragmentation;            // 1 - largestFree / totalFree, 0 when free space is one range
+    VkDeviceSize heapSize;
+    VkDeviceSize budget;            // VK_EXT_memory_budget, 0 when unknown
+    VkDeviceSize heapUsage;         // by the whole process, 0 when unknown
+} DeviceHeapStats;
+
+typedef struct tagDeviceTypeStats
+{
+    VkDeviceSize blockBytes;
+    VkDeviceSize usedBytes;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+} DeviceTypeStats;
+
+int devmem_init(DeviceMemoryAllocator* allocator, VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize);
+void devmem_destroy(DeviceMemoryAllocator* allocator);
+
+// Name of the device extension to enable for budget queries, 0 if not available. Needs a Vulkan 1.1 instance.
+const char* devmem_budget_extension(VkPhysicalDevice physicalDevice);
+// Call once the extension is enabled on the device, returns 0 if the query is missing.
+int devmem_enable_budget(DeviceMemoryAllocator* allocator, VkInstance instance);
+
+// allowedTypes is a mask of acceptable memory types, tried from the lowest index.
+int devmem_alloc(DeviceMemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+    uint32_t allowedTypes, uint32_t kind, DeviceAllocation* allocation);
+void devmem_free(DeviceMemoryAllocator* allocator, DeviceAllocation* allocation);
+
+// Sub-allocates from a shared block of memoryType that already exists, other than exclude. Never calls vkAllocateMemory.
+int devmem_alloc_existing(DeviceMemoryAllocator* allocator, const VkMemoryRequirements* requirements,
+    uint32_t memoryType, uint32_t kind, const DeviceMemoryBlock* exclude, DeviceAllocation* allocation);
+
+// Allocate and bind in one go, images are assumed to be optimally tiled.
+int devmem_alloc_buffer(DeviceMemoryAllocator* allocator, VkBuffer buffer, uint32_t allowedTypes, DeviceAllocation* allocation);
+int devmem_alloc_image(DeviceMemoryAllocator* allocator, VkImage image, uint32_t allowedTypes, DeviceAllocation* allocation);
+
+void devmem_get_heap_stats(const DeviceMemoryAllocator* allocator, DeviceHeapStats stats[VK_MAX_MEMORY_HEAPS]);
+void devmem_get_type_stats(const DeviceMemoryAllocator* allocator, DeviceTypeStats stats[VK_MAX_MEMORY_TYPES]);
+void devmem_print_stats(const DeviceMemoryAllocator* allocator);
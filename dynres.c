@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "dynres.h"
+
+static float clamp_scale(const DynamicResolution* dr, float scale)
+{
+    return scale < dr->minScale ? dr->minScale : (scale > dr->maxScale ? dr->maxScale : scale);
+}
+
+void dynres_init(DynamicResolution* dr, float budgetMs, float minScale, float maxScale)
+{
+    *dr = (DynamicResolution){
+        .budgetMs = budgetMs,
+        .minScale = minScale,
+        .maxScale = maxScale,
+        .scale = maxScale,
+        .lowestScale = maxScale,
+    };
+}
+
+float dynres_update(DynamicResolution* dr, float frameScale, float gpuMs)
+{
+    if (gpuMs < 0.0f || frameScale <= 0.0f)
+    {
+        return dr->scale;
+    }
+
+    ++dr->sampleCount;
+    dr->overBudgetCount += gpuMs > dr->budgetMs;
+    dr->scaleSum += frameScale;
+    dr->lowestScale = frameScale < dr->lowestScale ? frameScale : dr->lowestScale;
+
+    float fullScaleMs = gpuMs / (frameScale * frameScale);
+    float rate = fullScaleMs > dr->fullScaleMs ? 0.5f : 0.05f;
+    dr->fullScaleMs = dr->fullScaleMs > 0.0f ? dr->fullScaleMs + (fullScaleMs - dr->fullScaleMs) * rate : fullScaleMs;
+
+    float ideal = clamp_scale(dr, sqrtf(dr->budgetMs / dr->fullScaleMs));
+    // Round down to a step, but never below minScale.
+    float stepped = clamp_scale(dr, floorf(ideal * DYNRES_STEPS) / DYNRES_STEPS);
+    if (stepped < dr->scale || stepped >= dr->scale + 2.0f / DYNRES_STEPS || (stepped > dr->scale && ideal == dr->maxScale))
+    {
+        dr->changeCount += stepped != dr->scale;
+        dr->scale = stepped;
+    }
+    return dr->scale;
+}
+
+VkExtent2D dynres_extent(const DynamicResolution* dr, VkExtent2D outputExtent)
+{
+    uint32_t width = (uint32_t)(outputExtent.width * dr->scale + 0.5f);
+    uint32_t height = (uint32_t)(outputExtent.height * dr->scale + 0.5f);
+    return (VkExtent2D){ width ? width : 1, height ? height : 1 };
+}
+
+void dynres_print_stats(const DynamicResolution* dr)
+{
+    if (!dr->sampleCount)
+    {
+        printf("Dynamic resolution: no GPU timings, scale %.2f\n", dr->scale);
+        return;
+    }
+    printf("Dynamic resolution: %.1f ms budget, scale mean %.2f lowest %.2f last %.2f, %u changes, %u of %u frames over budget\n",
+        dr->budgetMs, dr->scaleSum / dr->sampleCount, dr->lowestScale, dr->scale, dr->changeCount,
+        dr->overBudgetCount, dr->sampleCount);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/*
+** Dynamic resolution controller.
+**
+** Picks the render scale (fraction of the output size per axis) that
+** keeps the measured GPU frame time within a budget. GPU times arrive
+** frames after the frame was recorded, so every sample comes with the
+** scale its frame was rendered at and is converted to an estimated
+** full-scale cost, assuming the cost grows with the pixel count. The
+** estimate rises quickly and falls slowly, so the scale drops as soon as
+** a frame runs over and only climbs back once there is steady headroom.
+** Scales move in DYNRES_STEPS steps, and an increase needs a margin of
+** two steps, so the target doesn't flip between neighbouring sizes.
+*/
+
+enum {
+    DYNRES_STEPS = 32,          // scale granularity, 1/32 of the output size
+};
+
+typedef struct tagDynamicResolution
+{
+    float budgetMs;
+    float minScale;
+    float maxScale;
+    float scale;                // for the next frame
+    float fullScaleMs;          // filtered estimate of the frame at scale 1, 0 until the first sample
+
+    uint32_t sampleCount;
+    uint32_t overBudgetCount;
+    uint32_t changeCount;
+    double scaleSum;
+    float lowestScale;
+} DynamicResolution;
+
+void dynres_init(DynamicResolution* dr, float budgetMs, float minScale, float maxScale);
+
+// Feeds the GPU time of a finished frame rendered at frameScale, returns the scale for the next frame.
+float dynres_update(DynamicResolution* dr, float frameScale, float gpuMs);
+
+// Render size for the current scale, at least 1x1.
+VkExtent2D dynres_extent(const DynamicResolution* dr, VkExtent2D outputExtent);
+
+void dynres_print_stats(const DynamicResolution* dr);
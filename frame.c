@@ -0,0 +1,203 @@
+#include <string.h>
+#include <assert.h>
+
+#include "frame.h"
+
+enum {
+    FRAME_MAX_SIGNALS = 8,
+};
+
+static uint32_t slot_of(const FrameScheduler* scheduler, uint64_t serial)
+{
+    return (uint32_t)((serial - 1) % scheduler->frameCount);
+}
+
+const char* frame_timeline_extension(VkPhysicalDevice physicalDevice)
+{
+#ifdef VK_KHR_timeline_semaphore
+    VkExtensionProperties extensions[256];
+    uint32_t extensionCount = sizeof(extensions) / sizeof(extensions[0]);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions);
+    for (uint32_t i = 0; i < extensionCount; ++i)
+    {
+        if (strcmp(extensions[i].extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0)
+        {
+            return VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+        }
+    }
+#endif
+    return 0;
+}
+
+int frame_init(FrameScheduler* scheduler, VkDevice device, uint32_t frameCount, int useTimeline)
+{
+    assert(frameCount >= 1 && frameCount <= FRAME_MAX_IN_FLIGHT);
+
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->device = device;
+    scheduler->frameCount = frameCount;
+
+#ifdef VK_KHR_timeline_semaphore
+    if (useTimeline)
+    {
+        scheduler->getCounterValue = vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+        scheduler->waitSemaphores = vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+
+        VkSemaphoreTypeCreateInfoKHR typeCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+            .initialValue = 0,
+        };
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &typeCreateInfo,
+        };
+        if (scheduler->getCounterValue && scheduler->waitSemaphores
+            && vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &scheduler->timeline) == VK_SUCCESS)
+        {
+            return 1;
+        }
+        scheduler->timeline = VK_NULL_HANDLE;
+    }
+#else
+    (void)useTimeline;
+#endif
+
+    VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        if (vkCreateFence(device, &fenceCreateInfo, 0, &scheduler->fences[i]) != VK_SUCCESS)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void frame_destroy(FrameScheduler* scheduler)
+{
+    if (scheduler->timeline)
+    {
+        vkDestroySemaphore(scheduler->device, scheduler->timeline, 0);
+    }
+    for (uint32_t i = 0; i < scheduler->frameCount; ++i)
+    {
+        if (scheduler->fences[i])
+        {
+            vkDestroyFence(scheduler->device, scheduler->fences[i], 0);
+        }
+    }
+    memset(scheduler, 0, sizeof(*scheduler));
+}
+
+uint64_t frame_completed(FrameScheduler* scheduler)
+{
+#ifdef VK_KHR_timeline_semaphore
+    if (scheduler->timeline)
+    {
+        uint64_t value = 0;
+        ((PFN_vkGetSemaphoreCounterValueKHR)scheduler->getCounterValue)(scheduler->device, scheduler->timeline, &value);
+        scheduler->completedSerial = value > scheduler->completedSerial ? value : scheduler->completedSerial;
+        return scheduler->completedSerial;
+    }
+#endif
+
+    // Frames finish in submission order, stop at the first fence that hasn't signaled.
+    while (scheduler->completedSerial < scheduler->submittedSerial)
+    {
+        VkFence fence = scheduler->fences[slot_of(scheduler, scheduler->completedSerial + 1)];
+        if (vkGetFenceStatus(scheduler->device, fence) != VK_SUCCESS)
+        {
+            break;
+        }
+        ++scheduler->completedSerial;
+    }
+    return scheduler->completedSerial;
+}
+
+void frame_wait(FrameScheduler* scheduler, uint64_t serial)
+{
+    assert(serial <= scheduler->submittedSerial);
+
+    if (serial <= scheduler->completedSerial)
+    {
+        return;
+    }
+
+#ifdef VK_KHR_timeline_semaphore
+    if (scheduler->timeline)
+    {
+        VkSemaphoreWaitInfoKHR waitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+            .semaphoreCount = 1,
+            .pSemaphores = &scheduler->timeline,
+            .pValues = &serial,
+        };
+        ((PFN_vkWaitSemaphoresKHR)scheduler->waitSemaphores)(scheduler->device, &waitInfo, UINT64_MAX);
+        scheduler->completedSerial = serial;
+        frame_completed(scheduler);
+        return;
+    }
+#endif
+
+    vkWaitForFences(scheduler->device, 1, &scheduler->fences[slot_of(scheduler, serial)], VK_TRUE, UINT64_MAX);
+    frame_completed(scheduler);
+}
+
+uint32_t frame_begin(FrameScheduler* scheduler)
+{
+    uint64_t serial = frame_serial(scheduler);
+
+    // The slot is reused from frameCount frames back, only that frame has to be done.
+    if (serial > scheduler->frameCount && frame_completed(scheduler) < serial - scheduler->frameCount)
+    {
+        frame_wait(scheduler, serial - scheduler->frameCount);
+    }
+
+    return slot_of(scheduler, serial);
+}
+
+VkResult frame_submit(FrameScheduler* scheduler, VkQueue queue, const VkSubmitInfo* submitInfo)
+{
+    uint64_t serial = frame_serial(scheduler);
+    VkSubmitInfo info = *submitInfo;
+    VkFence fence = VK_NULL_HANDLE;
+
+#ifdef VK_KHR_timeline_semaphore
+    VkSemaphore signalSemaphores[FRAME_MAX_SIGNALS];
+    uint64_t signalValues[FRAME_MAX_SIGNALS] = { 0 };
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo;
+    if (scheduler->timeline)
+    {
+        assert(info.signalSemaphoreCount < FRAME_MAX_SIGNALS);
+
+        // Binary semaphores ignore their values, the timeline gets the serial.
+        memcpy(signalSemaphores, info.pSignalSemaphores, info.signalSemaphoreCount * sizeof(VkSemaphore));
+        signalSemaphores[info.signalSemaphoreCount] = scheduler->timeline;
+        signalValues[info.signalSemaphoreCount] = serial;
+        ++info.signalSemaphoreCount;
+        info.pSignalSemaphores = signalSemaphores;
+
+        timelineInfo = (VkTimelineSemaphoreSubmitInfoKHR){
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+            .pNext = info.pNext,
+            .signalSemaphoreValueCount = info.signalSemaphoreCount,
+            .pSignalSemaphoreValues = signalValues,
+        };
+        info.pNext = &timelineInfo;
+    }
+    else
+#endif
+    {
+        fence = scheduler->fences[slot_of(scheduler, serial)];
+        vkResetFences(scheduler->device, 1, &fence);
+    }
+
+    VkResult result = vkQueueSubmit(queue, 1, &info, fence);
+    if (result == VK_SUCCESS)
+    {
+        scheduler->submittedSerial = serial;
+    }
+    return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/*
+** Frames-in-flight scheduler.
+**
+** Every submitted frame gets a serial, starting at 1. Completion is
+** tracked on a timeline semaphore signaled with the frame serial, so the
+** CPU can ask how far the GPU has progressed without blocking and every
+** per-frame resource can be retired by comparing its serial against
+** frame_completed. Devices without VK_KHR_timeline_semaphore fall back to
+** one fence per frame slot, polled in submission order, which gives the
+** same serials at the cost of a fence query per frame.
+*/
+
+enum {
+    FRAME_MAX_IN_FLIGHT = 4,
+};
+
+typedef struct tagFrameScheduler
+{
+    VkDevice device;
+    uint32_t frameCount;        // frames in flight, 1..FRAME_MAX_IN_FLIGHT
+    uint64_t submittedSerial;
+    uint64_t completedSerial;
+
+    VkSemaphore timeline;       // VK_NULL_HANDLE when using fences
+    PFN_vkVoidFunction getCounterValue;
+    PFN_vkVoidFunction waitSemaphores;
+    VkFence fences[FRAME_MAX_IN_FLIGHT];
+} FrameScheduler;
+
+// Name of the device extension to enable for timeline semaphores, 0 if not available.
+const char* frame_timeline_extension(VkPhysicalDevice physicalDevice);
+
+int frame_init(FrameScheduler* scheduler, VkDevice device, uint32_t frameCount, int useTimeline);
+void frame_destroy(FrameScheduler* scheduler);
+
+// Waits until the frame slot of the next serial is free, returns the slot index.
+uint32_t frame_begin(FrameScheduler* scheduler);
+
+// Submits the frame, signaling its serial on top of the semaphores in submitInfo.
+VkResult frame_submit(FrameScheduler* scheduler, VkQueue queue, const VkSubmitInfo* submitInfo);
+
+// Last serial the GPU has finished, never blocks.
+uint64_t frame_completed(FrameScheduler* scheduler);
+
+// Blocks until serial has finished.
+void frame_wait(FrameScheduler* scheduler, uint64_t serial);
+
+static inline uint64_t frame_serial(const FrameScheduler* scheduler) { return scheduler->submittedSerial + 1; }
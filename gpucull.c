@@ -0,0 +1,88 @@
+#include <math.h>
+
+#include "gpucull.h"
+
+enum {
+    GPUCULL_SPACING = 4,            // world units per object along each axis
+};
+
+static const uint32_t meshSides[GPUCULL_MESH_COUNT] = { 3, 4, 6 };
+
+void gpucull_build_meshes(float* vertices, uint16_t* indices, CullMesh* meshes)
+{
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    for (uint32_t i = 0; i < GPUCULL_MESH_COUNT; ++i)
+    {
+        uint32_t sides = meshSides[i];
+        meshes[i] = (CullMesh){ (sides - 2) * 3, indexCount, (int32_t)vertexCount, 0 };
+
+        for (uint32_t j = 0; j < sides; ++j)
+        {
+            float angle = 6.2831853f * j / sides;
+            vertices[(vertexCount + j) * 2 + 0] = cosf(angle);
+            vertices[(vertexCount + j) * 2 + 1] = sinf(angle);
+        }
+        // A fan, the polygons are convex.
+        for (uint32_t j = 1; j + 1 < sides; ++j)
+        {
+            indices[indexCount++] = 0;
+            indices[indexCount++] = (uint16_t)j;
+            indices[indexCount++] = (uint16_t)(j + 1);
+        }
+        vertexCount += sides;
+    }
+}
+
+float gpucull_build_objects(CullObject* objects, uint32_t count)
+{
+    uint32_t side = (uint32_t)ceilf(sqrtf((float)count));
+    float halfSize = 0.5f * GPUCULL_SPACING * side;
+
+    // Jittered grid from a fixed seed, so runs with the same count draw the same scene.
+    uint32_t seed = 0x9E3779B9u;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        float jitter[2];
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            jitter[j] = (seed >> 8) * (1.0f / 16777216.0f) - 0.5f;
+        }
+        seed = seed * 1664525u + 1013904223u;
+
+        CullObject* object = &objects[i];
+        object->center[0] = ((i % side) + 0.5f + jitter[0]) * GPUCULL_SPACING - halfSize;
+        object->center[1] = ((i / side) + 0.5f + jitter[1]) * GPUCULL_SPACING - halfSize;
+        object->radius = 0.6f + (seed >> 29) * 0.15f;
+        object->mesh = (seed >> 8) % GPUCULL_MESH_COUNT;
+        object->color = 0xFF000000u | (seed & 0x7F7F7Fu) | 0x404040u;
+        object->phase = (seed >> 16) * (6.2831853f / 65536.0f);
+        object->pad[0] = object->pad[1] = 0;
+    }
+    return halfSize;
+}
+
+void gpucull_view(float time, float aspect, float worldHalfSize, float* view)
+{
+    float halfHeight = worldHalfSize < GPUCULL_VIEW_HALF_HEIGHT ? worldHalfSize : (float)GPUCULL_VIEW_HALF_HEIGHT;
+    // About eight units a second along a Lissajous path through most of the world.
+    float reach = 0.75f * worldHalfSize;
+    float speed = reach > 0.0f ? 8.0f / reach : 0.0f;
+    view[0] = reach * sinf(time * speed);
+    view[1] = reach * sinf(time * speed * 0.7f + 1.0f);
+    view[2] = halfHeight * aspect;
+    view[3] = halfHeight;
+}
+
+uint32_t gpucull_count_visible(const CullObject* objects, uint32_t count, const float* view)
+{
+    uint32_t visible = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const CullObject* object = &objects[i];
+        visible += fabsf(object->center[0] - view[0]) <= view[2] + object->radius
+            && fabsf(object->center[1] - view[1]) <= view[3] + object->radius;
+    }
+    return visible;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+** GPU-driven object scene.
+**
+** Objects are mesh instances in a flat world: a bounding circle, a mesh,
+** a color and a spin phase, laid out like the std430 CullObject in
+** shaders/objects.glsl. Meshes are regular polygons sharing one vertex and
+** one index buffer; a CullMesh holds the fields of
+** VkDrawIndexedIndirectCommand that are the same for every object using it.
+**
+** Every frame objectcull.glsl-cs tests each object's circle against the
+** view rectangle and writes a draw command for it with firstInstance set to
+** the object index, which is how objects.glsl-vs finds the object. When
+** compacting, visible commands are packed at the front and counted for
+** vkCmdDrawIndexedIndirectCount. Otherwise every object keeps its own slot
+** and culled ones get instanceCount 0, which the GPU skips. Either way the
+** CPU records one fill, one dispatch and one draw, whatever the object
+** count.
+**
+** gpucull_count_visible runs the same test on the CPU. It only adds and
+** compares, which are exact on both sides, so the counts must match.
+*/
+
+enum {
+    GPUCULL_MESH_COUNT = 3,         // triangle, square, hexagon
+    GPUCULL_VERTEX_COUNT = 13,      // over all meshes
+    GPUCULL_INDEX_COUNT = 21,
+    GPUCULL_GROUP_SIZE = 64,        // local_size_x of objectcull.glsl-cs
+    GPUCULL_MAX_OBJECTS = 1 << 20,
+    GPUCULL_VIEW_HALF_HEIGHT = 32,  // world units, the view never shows more of a large world than this
+};
+
+typedef struct tagCullObject
+{
+    float center[2];
+    float radius;
+    uint32_t mesh;
+    uint32_t color;                 // RGBA8
+    float phase;                    // radians
+    uint32_t pad[2];
+} CullObject;
+
+typedef struct tagCullMesh
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t pad;
+} CullMesh;
+
+// Push constants of objectcull.glsl-cs and objects.glsl-vs.
+typedef struct tagCullConst
+{
+    float view[4];                  // xy center, zw half size, in world units
+    uint32_t objectCount;
+    uint32_t compact;               // pack visible commands at the front
+    float time;                     // seconds, spins the objects
+    uint32_t pad;
+} CullConst;
+
+// Unit-radius polygons, xy pairs, with 16-bit indices relative to each mesh's vertexOffset.
+void gpucull_build_meshes(float* vertices, uint16_t* indices, CullMesh* meshes);
+
+// Scatters count objects over a square world sized so density is the same for any count.
+// Returns the half size of the world.
+float gpucull_build_objects(CullObject* objects, uint32_t count);
+
+// View rectangle at time seconds, panning across a world of worldHalfSize.
+void gpucull_view(float time, float aspect, float worldHalfSize, float* view);
+
+uint32_t gpucull_count_visible(const CullObject* objects, uint32_t count, const float* view);
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "gpuprof.h"
+
+enum {
+    GPUPROF_MAX_SUMMARY_NAMES = 64,
+    GPUPROF_CALIBRATION_TRIES = 5,
+};
+
+static const GpuProfEvent* event_at(const GpuProfiler* prof, uint32_t i)
+{
+    uint32_t first = (prof->eventHead + GPUPROF_MAX_EVENTS - prof->eventCount) % GPUPROF_MAX_EVENTS;
+    return &prof->events[(first + i) % GPUPROF_MAX_EVENTS];
+}
+
+static void push_event(GpuProfiler* prof, const GpuProfEvent* event)
+{
+    prof->events[prof->eventHead] = *event;
+    prof->eventHead = (prof->eventHead + 1) % GPUPROF_MAX_EVENTS;
+    prof->eventCount += prof->eventCount < GPUPROF_MAX_EVENTS;
+}
+
+int gpuprof_init(GpuProfiler* prof, VkDevice device, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount)
+{
+    assert(frameCount <= GPUPROF_MAX_FRAMES);
+
+    memset(prof, 0, sizeof(*prof));
+    prof->device = device;
+    prof->frameCount = frameCount;
+    if (!timestampValidBits)
+    {
+        return 0;
+    }
+
+    prof->nsPerTick = timestampPeriod;
+    prof->tickMask = timestampValidBits < 64 ? (1ull << timestampValidBits) - 1 : UINT64_MAX;
+    prof->events = (GpuProfEvent*)malloc(GPUPROF_MAX_EVENTS * sizeof(GpuProfEvent));
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * GPUPROF_MAX_SCOPES * frameCount + 1,     // last one for calibration
+    };
+    if (!prof->events || vkCreateQueryPool(device, &queryPoolCreateInfo, 0, &prof->queryPool) != VK_SUCCESS)
+    {
+        free(prof->events);
+        prof->events = 0;
+        prof->queryPool = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    return 1;
+}
+
+void gpuprof_destroy(GpuProfiler* prof)
+{
+    if (prof->queryPool)
+    {
+        vkDestroyQueryPool(prof->device, prof->queryPool, 0);
+    }
+    free(prof->events);
+    memset(prof, 0, sizeof(*prof));
+}
+
+float gpuprof_collect(GpuProfiler* prof, uint32_t frame)
+{
+    GpuProfFrame* slot = &prof->frames[frame];
+    uint32_t scopeCount = slot->scopeCount;
+    slot->scopeCount = 0;
+    prof->frameEndNs = 0;
+    if (!prof->queryPool || !scopeCount)
+    {
+        return -1.0f;
+    }
+
+    uint64_t timestamps[2 * GPUPROF_MAX_SCOPES];
+    VkResult result = vkGetQueryPoolResults(prof->device, prof->queryPool, 2 * GPUPROF_MAX_SCOPES * frame, 2 * scopeCount,
+        sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+    {
+        return -1.0f;
+    }
+
+    // Counters may have fewer than 64 valid bits, measure everything from the frame's first timestamp.
+    uint64_t base = timestamps[0];
+    uint64_t baseNs = (uint64_t)(base * prof->nsPerTick);
+    uint64_t frameEnd = 0;
+    for (uint32_t i = 0; i < scopeCount; ++i)
+    {
+        uint64_t start = (timestamps[2 * i] - base) & prof->tickMask;
+        uint64_t end = (timestamps[2 * i + 1] - base) & prof->tickMask;
+        GpuProfEvent event = {
+            .name = slot->names[i],
+            .serial = slot->serial,
+            .start = baseNs + (uint64_t)(start * prof->nsPerTick),
+            .end = baseNs + (uint64_t)(end * prof->nsPerTick),
+            .depth = slot->depths[i],
+        };
+        push_event(prof, &event);
+        frameEnd = end > frameEnd ? end : frameEnd;
+    }
+
+    if (prof->calibrated)
+    {
+        prof->frameEndNs = (uint64_t)((int64_t)(baseNs + (uint64_t)(frameEnd * prof->nsPerTick)) + prof->cpuOffset);
+    }
+    return (float)(frameEnd * prof->nsPerTick * 1e-6);
+}
+
+void gpuprof_begin_frame(GpuProfiler* prof, VkCommandBuffer commandBuffer, uint32_t frame, uint64_t serial)
+{
+    GpuProfFrame* slot = &prof->frames[frame];
+    prof->frame = frame;
+    slot->serial = serial;
+    slot->scopeCount = 0;
+    slot->depth = 0;
+
+    if (prof->queryPool)
+    {
+        vkCmdResetQueryPool(commandBuffer, prof->queryPool, 2 * GPUPROF_MAX_SCOPES * frame, 2 * GPUPROF_MAX_SCOPES);
+    }
+}
+
+uint32_t gpuprof_begin(GpuProfiler* prof, VkCommandBuffer commandBuffer, const char* name)
+{
+    GpuProfFrame* slot = &prof->frames[prof->frame];
+    if (!prof->queryPool || slot->scopeCount == GPUPROF_MAX_SCOPES)
+    {
+        return GPUPROF_INVALID;
+    }
+
+    uint32_t scope = slot->scopeCount++;
+    slot->names[scope] = name;
+    slot->depths[scope] = (uint8_t)slot->depth++;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, prof->queryPool,
+        2 * (GPUPROF_MAX_SCOPES * prof->frame + scope));
+
+    return scope;
+}
+
+void gpuprof_end(GpuProfiler* prof, VkCommandBuffer commandBuffer, uint32_t scope)
+{
+    if (scope == GPUPROF_INVALID)
+    {
+        return;
+    }
+
+    --prof->frames[prof->frame].depth;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, prof->queryPool,
+        2 * (GPUPROF_MAX_SCOPES * prof->frame + scope) + 1);
+}
+
+void gpuprof_calibrate(GpuProfiler* prof, VkQueue queue, uint32_t queueFamilyIndex, uint64_t (*cpuClockNs)(void))
+{
+    if (!prof->queryPool)
+    {
+        return;
+    }
+
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queueFamilyIndex,
+    };
+    if (vkCreateCommandPool(prof->device, &commandPoolCreateInfo, 0, &commandPool) != VK_SUCCESS)
+    {
+        return;
+    }
+    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    vkAllocateCommandBuffers(prof->device, &commandBufferAllocInfo, &commandBuffer);
+    vkCreateFence(prof->device, &(VkFenceCreateInfo) { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO }, 0, &fence);
+
+    // Keep the try with the shortest round trip, its midpoint is the tightest estimate.
+    uint32_t query = 2 * GPUPROF_MAX_SCOPES * prof->frameCount;
+    uint64_t bestWindow = UINT64_MAX;
+    for (uint32_t i = 0; i < GPUPROF_CALIBRATION_TRIES; ++i)
+    {
+        vkResetCommandPool(prof->device, commandPool, 0);
+        vkBeginCommandBuffer(commandBuffer, &(VkCommandBufferBeginInfo) {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        });
+        vkCmdResetQueryPool(commandBuffer, prof->queryPool, query, 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, prof->queryPool, query);
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+        };
+        uint64_t before = cpuClockNs();
+        vkQueueSubmit(queue, 1, &submitInfo, fence);
+        vkWaitForFences(prof->device, 1, &fence, VK_TRUE, UINT64_MAX);
+        uint64_t after = cpuClockNs();
+        vkResetFences(prof->device, 1, &fence);
+
+        uint64_t timestamp;
+        if (vkGetQueryPoolResults(prof->device, prof->queryPool, query, 1, sizeof(timestamp), &timestamp,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        {
+            continue;
+        }
+        if (after - before < bestWindow)
+        {
+            bestWindow = after - before;
+            prof->cpuOffset = (int64_t)(before + (after - before) / 2) - (int64_t)(timestamp * prof->nsPerTick);
+            prof->calibrated = 1;
+        }
+    }
+
+    vkDestroyFence(prof->device, fence, 0);
+    vkDestroyCommandPool(prof->device, commandPool, 0);
+}
+
+static void write_event(FILE* file, const GpuProfEvent* event, int64_t start)
+{
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+        event->name, start * 1e-3, (event->end - event->start) * 1e-3, (unsigned long long)event->serial);
+}
+
+void gpuprof_append_trace(FILE* file, uint64_t fromNs, uint64_t baseNs, void* userData)
+{
+    const GpuProfiler* prof = (const GpuProfiler*)userData;
+    if (!prof->calibrated)
+    {
+        return;
+    }
+
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+    for (uint32_t i = 0; i < prof->eventCount; ++i)
+    {
+        const GpuProfEvent* event = event_at(prof, i);
+        int64_t start = (int64_t)event->start + prof->cpuOffset;
+        if (start >= (int64_t)fromNs)
+        {
+            write_event(file, event, start - (int64_t)baseNs);
+        }
+    }
+}
+
+int gpuprof_write_trace(const GpuProfiler* prof, const char* fileName)
+{
+    FILE* file = fopen(fileName, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}");
+
+    uint64_t base = prof->eventCount ? event_at(prof, 0)->start : 0;
+    for (uint32_t i = 0; i < prof->eventCount; ++i)
+    {
+        const GpuProfEvent* event = event_at(prof, i);
+        write_event(file, event, (int64_t)(event->start - base));
+    }
+    fprintf(file, "\n]}\n");
+
+    return fclose(file) == 0;
+}
+
+int gpuprof_write_csv(const GpuProfiler* prof, const char* fileName)
+{
+    FILE* file = fopen(fileName, "w");
+    if (!file)
+    {
+        return 0;
+    }
+
+    fprintf(file, "frame,scope,depth,start_ms,duration_ms\n");
+    uint64_t base = prof->eventCount ? event_at(prof, 0)->start : 0;
+    for (uint32_t i = 0; i < prof->eventCount; ++i)
+    {
+        const GpuProfEvent* event = event_at(prof, i);
+        fprintf(file, "%llu,%s,%u,%.6f,%.6f\n", (unsigned long long)event->serial, event->name, event->depth,
+            (event->start - base) * 1e-6, (event->end - event->start) * 1e-6);
+    }
+
+    return fclose(file) == 0;
+}
+
+void gpuprof_print_summary(const GpuProfiler* prof)
+{
+    const char* names[GPUPROF_MAX_SUMMARY_NAMES];
+    uint32_t depths[GPUPROF_MAX_SUMMARY_NAMES];
+    uint32_t counts[GPUPROF_MAX_SUMMARY_NAMES] = { 0 };
+    double totals[GPUPROF_MAX_SUMMARY_NAMES] = { 0 };
+    uint32_t nameCount = 0;
+    uint32_t frames = 0;
+    uint64_t lastSerial = 0;
+
+    for (uint32_t i = 0; i < prof->eventCount; ++i)
+    {
+        const GpuProfEvent* event = event_at(prof, i);
+        frames += event->serial != lastSerial;
+        lastSerial = event->serial;
+
+        uint32_t j = 0;
+        while (j < nameCount && strcmp(names[j], event->name) != 0)
+        {
+            ++j;
+        }
+        if (j == nameCount)
+        {
+            if (nameCount == GPUPROF_MAX_SUMMARY_NAMES)
+            {
+                continue;
+            }
+            names[j] = event->name;
+            depths[j] = event->depth;
+            ++nameCount;
+        }
+        ++counts[j];
+        totals[j] += (event->end - event->start) * 1e-6;
+    }
+
+    if (!frames)
+    {
+        return;
+    }
+
+    printf("GPU scopes (ms per frame over %u frames):\n", frames);
+    for (uint32_t j = 0; j < nameCount; ++j)
+    {
+        printf("  %*s%-24s %8.3f  (%.1f per frame)\n", 2 * depths[j], "", names[j], totals[j] / frames, (double)counts[j] / frames);
+    }
+}
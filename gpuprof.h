@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdio.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+** GPU timestamp profiler.
+**
+** Named scopes write a pair of timestamps into a query range owned by the
+** frame slot. Results are read back when the slot comes around again,
+** after its frame has finished, so reading never stalls. Resolved scopes
+** land in a ring of recent events that can be exported as a Chrome trace
+** (chrome://tracing, Perfetto) or CSV, and summarized per scope name.
+**
+** Scope names are not copied, pass string literals.
+**
+** gpuprof_calibrate measures the offset between the device timeline and a
+** CPU clock by timestamping an empty submit, so GPU scopes can be drawn
+** on the same time axis as CPU scopes. The error is bounded by half of
+** the submit round trip, typically tens of microseconds.
+*/
+
+enum {
+    GPUPROF_MAX_FRAMES = 4,
+    GPUPROF_MAX_SCOPES = 64,        // per frame
+    GPUPROF_MAX_EVENTS = 1 << 16,   // resolved scopes kept for export
+    GPUPROF_INVALID = UINT32_MAX,
+};
+
+typedef struct tagGpuProfEvent
+{
+    const char* name;
+    uint64_t serial;
+    uint64_t start;     // ns, device timeline
+    uint64_t end;
+    uint32_t depth;
+} GpuProfEvent;
+
+typedef struct tagGpuProfFrame
+{
+    uint64_t serial;
+    uint32_t scopeCount;
+    uint32_t depth;
+    const char* names[GPUPROF_MAX_SCOPES];
+    uint8_t depths[GPUPROF_MAX_SCOPES];
+} GpuProfFrame;
+
+typedef struct tagGpuProfiler
+{
+    VkDevice device;
+    VkQueryPool queryPool;      // VK_NULL_HANDLE if the queue has no timestamps
+    double nsPerTick;
+    uint64_t tickMask;
+    uint32_t frameCount;
+    uint32_t frame;             // slot being recorded
+    GpuProfFrame frames[GPUPROF_MAX_FRAMES];
+
+    int64_t cpuOffset;          // CPU ns minus device ns, valid if calibrated
+    int calibrated;
+    uint64_t frameEndNs;        // CPU ns the last collected frame finished at, 0 if unknown
+
+    GpuProfEvent* events;       // ring
+    uint32_t eventHead;
+    uint32_t eventCount;
+} GpuProfiler;
+
+int gpuprof_init(GpuProfiler* prof, VkDevice device, float timestampPeriod, uint32_t timestampValidBits, uint32_t frameCount);
+void gpuprof_destroy(GpuProfiler* prof);
+
+// Resolves the slot's previous frame, returns its GPU time in ms or a negative value if there was none.
+// Must only be called once that frame has finished. Also sets frameEndNs when calibrated.
+float gpuprof_collect(GpuProfiler* prof, uint32_t frame);
+
+// Starts recording frame serial into the slot, commandBuffer must be outside a render pass.
+void gpuprof_begin_frame(GpuProfiler* prof, VkCommandBuffer commandBuffer, uint32_t frame, uint64_t serial);
+
+uint32_t gpuprof_begin(GpuProfiler* prof, VkCommandBuffer commandBuffer, const char* name);
+void gpuprof_end(GpuProfiler* prof, VkCommandBuffer commandBuffer, uint32_t scope);
+
+// Queue must be idle and not used by other threads during the call.
+void gpuprof_calibrate(GpuProfiler* prof, VkQueue queue, uint32_t queueFamilyIndex, uint64_t (*cpuClockNs)(void));
+
+// Appends calibrated scopes starting at or after fromNs to a trace, times relative to baseNs on the CPU clock.
+// Matches CpuProfTraceFunc with prof as userData.
+void gpuprof_append_trace(FILE* file, uint64_t fromNs, uint64_t baseNs, void* prof);
+
+int gpuprof_write_trace(const GpuProfiler* prof, const char* fileName);
+int gpuprof_write_csv(const GpuProfiler* prof, const char* fileName);
+void gpuprof_print_summary(const GpuProfiler* prof);
+
+static inline int gpuprof_enabled(const GpuProfiler* prof) { return prof->queryPool != VK_NULL_HANDLE; }
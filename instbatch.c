@@ -0,0 +1,137 @@
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "instbatch.h"
+
+static void close_chunk(InstanceBatch* batch, uint32_t mesh)
+{
+    InstanceBucket* bucket = &batch->buckets[mesh];
+    if (bucket->instances)
+    {
+        --batch->openChunks;
+    }
+    if (bucket->instances && bucket->count)
+    {
+        // Opening a chunk reserves its draw slot, so closing it always finds one.
+        assert(batch->drawCount < INSTBATCH_MAX_DRAWS);
+        batch->pending[batch->drawCount++] = (InstanceDraw){ mesh, bucket->buffer, bucket->offset, bucket->count };
+    }
+    bucket->instances = 0;
+    bucket->count = 0;
+}
+
+void instbatch_init(InstanceBatch* batch, UploadRing* ring, uint32_t vertexStride)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->ring = ring;
+    batch->vertexStride = vertexStride;
+}
+
+uint32_t instbatch_add_mesh(InstanceBatch* batch, const InstanceMesh* mesh)
+{
+    if (batch->meshCount == INSTBATCH_MAX_MESHES)
+    {
+        return INSTBATCH_INVALID;
+    }
+    batch->meshes[batch->meshCount] = *mesh;
+    batch->nextCapacity[batch->meshCount] = INSTBATCH_MIN_CHUNK_INSTANCES;
+    return batch->meshCount++;
+}
+
+void instbatch_begin_frame(InstanceBatch* batch)
+{
+    for (uint32_t i = 0; i < batch->meshCount; ++i)
+    {
+        batch->buckets[i] = (InstanceBucket){ 0 };
+        batch->nextCapacity[i] = INSTBATCH_MIN_CHUNK_INSTANCES;
+    }
+    batch->drawCount = 0;
+    batch->openChunks = 0;
+    batch->instanceCount = 0;
+    batch->droppedInstances = 0;
+}
+
+uint32_t instbatch_flush(InstanceBatch* batch)
+{
+    for (uint32_t i = 0; i < batch->meshCount; ++i)
+    {
+        close_chunk(batch, i);
+    }
+
+    // Counting sort by mesh, stable so chunks keep the order they were written in.
+    uint32_t starts[INSTBATCH_MAX_MESHES + 1] = { 0 };
+    for (uint32_t i = 0; i < batch->drawCount; ++i)
+    {
+        ++starts[batch->pending[i].mesh + 1];
+    }
+    for (uint32_t i = 0; i < batch->meshCount; ++i)
+    {
+        starts[i + 1] += starts[i];
+    }
+    uint64_t vertexBytes = 0;
+    for (uint32_t i = 0; i < batch->drawCount; ++i)
+    {
+        const InstanceDraw* draw = &batch->pending[i];
+        batch->draws[starts[draw->mesh]++] = *draw;
+        vertexBytes += (uint64_t)draw->instanceCount * batch->meshes[draw->mesh].vertexCount * batch->vertexStride;
+    }
+
+    batch->stats.instanceCount = batch->instanceCount;
+    batch->stats.drawCount = batch->drawCount;
+    batch->stats.droppedInstances = batch->droppedInstances;
+    batch->stats.vertexBytes = vertexBytes;
+    return batch->drawCount;
+}
+
+InstanceData* instbatch_reserve(InstanceBatch* batch, uint32_t mesh, uint32_t count)
+{
+    assert(mesh < batch->meshCount);
+    InstanceBucket* bucket = &batch->buckets[mesh];
+    if (!bucket->instances || bucket->count + count > bucket->capacity)
+    {
+        close_chunk(batch, mesh);
+
+        // Chunks double as the bucket fills, so a few copies don't pin a big chunk of the ring.
+        uint32_t capacity = batch->nextCapacity[mesh];
+        capacity = count > capacity ? count : capacity;
+
+        UploadAllocation allocation;
+        if (batch->drawCount + batch->openChunks >= INSTBATCH_MAX_DRAWS
+            || !upload_alloc(batch->ring, (VkDeviceSize)capacity * sizeof(InstanceData), sizeof(float), &allocation))
+        {
+            batch->droppedInstances += count;
+            return 0;
+        }
+        bucket->instances = (InstanceData*)allocation.ptr;
+        bucket->buffer = allocation.buffer;
+        bucket->offset = allocation.offset;
+        bucket->capacity = capacity;
+        ++batch->openChunks;
+        batch->nextCapacity[mesh] = capacity * 2 < INSTBATCH_MAX_CHUNK_INSTANCES ? capacity * 2 : INSTBATCH_MAX_CHUNK_INSTANCES;
+    }
+
+    InstanceData* instances = bucket->instances + bucket->count;
+    bucket->count += count;
+    batch->instanceCount += count;
+    return instances;
+}
+
+void instbatch_add(InstanceBatch* batch, uint32_t mesh, float x, float y, float scale, float angle, uint32_t rgba)
+{
+    InstanceData* instance = instbatch_reserve(batch, mesh, 1);
+    if (!instance)
+    {
+        return;
+    }
+    float c = cosf(angle) * scale;
+    float s = sinf(angle) * scale;
+    // Written field by field, the chunk is write-combined memory.
+    instance->transform[0] = c;
+    instance->transform[1] = s;
+    instance->transform[2] = -s;
+    instance->transform[3] = c;
+    instance->offset[0] = x;
+    instance->offset[1] = y;
+    instance->rgba = rgba;
+}
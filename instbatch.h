@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "upload.h"
+
+/*
+** Instanced draws of repeated meshes.
+**
+** A mesh is registered once as a range of vertices in a static vertex
+** buffer. Every frame its copies are written as InstanceData straight
+** into mapped upload ring memory, into a bucket per mesh. Like batch2d,
+** each bucket fills chunks that double in size up to
+** INSTBATCH_MAX_CHUNK_INSTANCES, and every chunk becomes one draw: the
+** mesh's vertices on binding 0 and the chunk on binding 1, advanced per
+** instance. A thousand copies of a mesh cost a few draws and
+** sizeof(InstanceData) bytes each, instead of a draw or a full copy of the
+** vertices per copy.
+**
+** instbatch_flush orders the draws by mesh, so a mesh's draws are
+** adjacent. There is no order between meshes.
+*/
+
+enum {
+    INSTBATCH_MAX_MESHES = 16,
+    INSTBATCH_MIN_CHUNK_INSTANCES = 64,
+    INSTBATCH_MAX_CHUNK_INSTANCES = 16384,
+    INSTBATCH_MAX_DRAWS = 256,
+    INSTBATCH_INVALID = UINT32_MAX,
+};
+
+// Binding 1 of instanced.glsl-vs: clip = transform * position + offset.
+typedef struct tagInstanceData
+{
+    float transform[4];             // 2x2, column major
+    float offset[2];
+    uint32_t rgba;                  // multiplies the vertex color
+} InstanceData;
+
+typedef struct tagInstanceMesh
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t firstVertex;
+    uint32_t vertexCount;           // triangle list
+} InstanceMesh;
+
+typedef struct tagInstanceDraw
+{
+    uint32_t mesh;
+    VkBuffer buffer;                // instance data
+    VkDeviceSize offset;
+    uint32_t instanceCount;
+} InstanceDraw;
+
+typedef struct tagInstanceBucket
+{
+    InstanceData* instances;        // current chunk, 0 if none
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t count;
+    uint32_t capacity;
+} InstanceBucket;
+
+typedef struct tagInstanceBatchStats
+{
+    uint32_t instanceCount;         // last flushed frame
+    uint32_t drawCount;
+    uint32_t droppedInstances;      // out of upload memory or draw slots
+    uint64_t vertexBytes;           // the same copies as transformed vertices
+} InstanceBatchStats;
+
+typedef struct tagInstanceBatch
+{
+    UploadRing* ring;
+    uint32_t vertexStride;          // of the mesh vertices, for the stats
+    uint32_t meshCount;
+    InstanceMesh meshes[INSTBATCH_MAX_MESHES];
+    InstanceBucket buckets[INSTBATCH_MAX_MESHES];
+    uint32_t nextCapacity[INSTBATCH_MAX_MESHES];
+
+    uint32_t drawCount;
+    uint32_t openChunks;            // each holds a draw slot until it is closed
+    InstanceDraw pending[INSTBATCH_MAX_DRAWS];
+    InstanceDraw draws[INSTBATCH_MAX_DRAWS];    // sorted by instbatch_flush
+
+    uint32_t instanceCount;
+    uint32_t droppedInstances;
+    InstanceBatchStats stats;
+} InstanceBatch;
+
+void instbatch_init(InstanceBatch* batch, UploadRing* ring, uint32_t vertexStride);
+
+// Returns the mesh id, INSTBATCH_INVALID when the table is full.
+uint32_t instbatch_add_mesh(InstanceBatch* batch, const InstanceMesh* mesh);
+
+// Call after upload_begin_frame.
+void instbatch_begin_frame(InstanceBatch* batch);
+// Closes the frame's chunks and returns how many draws batch->draws holds.
+uint32_t instbatch_flush(InstanceBatch* batch);
+
+// Room for count instances of mesh, 0 if out of memory.
+InstanceData* instbatch_reserve(InstanceBatch* batch, uint32_t mesh, uint32_t count);
+
+// One copy of mesh scaled, rotated by angle radians and moved to x, y in clip space.
+void instbatch_add(InstanceBatch* batch, uint32_t mesh, float x, float y, float scale, float angle, uint32_t rgba);
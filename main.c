@@ -2,15 +2,44 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_syswm.h>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #include <vulkan/vulkan.h>
 
 #include "bits.h"
+#include "devmem.h"
+#include "upload.h"
+#include "transfer.h"
+#include "record.h"
+#include "frame.h"
+#include "gpuprof.h"
+#include "cpuprof.h"
+#include "rendergraph.h"
+#include "vertexpack.h"
+#include "batch2d.h"
+#include "dynres.h"
+#include "sdfscene.h"
+#include "sdfcpu.h"
+#include "shaderpak.h"
+#include "pipemgr.h"
+#include "present.h"
+#include "descalloc.h"
+#include "gpucull.h"
+#include "instbatch.h"
+#include "capture.h"
+#include "benchstat.h"
+#include "defrag.h"
 
 enum {
     Kb = (1 << 10),
@@ -18,13 +47,18 @@ enum {
     MAX_DEVICE_COUNT = 8,
     MAX_QUEUE_COUNT = 4, //ATM there should be at most transfer, graphics, compute, graphics+compute families
     MAX_PRESENT_MODE_COUNT = 6, // At the moment in spec
-    MAX_SWAPCHAIN_IMAGES = 3,
-    FRAME_COUNT = 2,
-    PRESENT_MODE_MAILBOX_IMAGE_COUNT = 3,
-    PRESENT_MODE_DEFAULT_IMAGE_COUNT = 2,
-    UPLOAD_REGION_SIZE = 64 * Kb,
-    UPLOAD_BUFFER_SIZE = FRAME_COUNT * UPLOAD_REGION_SIZE,
+    MAX_SWAPCHAIN_IMAGES = 8,
+    MAX_RETIRED_SWAPCHAINS = 4,
+    MAX_FRAME_COUNT = FRAME_MAX_IN_FLIGHT,
+    DEFAULT_FRAME_COUNT = 2,
+    SWAPCHAIN_RETRY_DELAY = 10,     // ms between attempts while the window has no area
+    FRAME_DESCRIPTOR_SETS = 16,     // per pool, a frame needs one set per upload buffer plus the raymarch and object sets
+    MAX_DRAW_CONSTANT_BUFFERS = 8,  // upload buffers a frame streams constants from: the ring and its spills
+    UPLOAD_RING_INITIAL_SIZE = DEFAULT_FRAME_COUNT * 64 * Kb,
     STATIC_BUFFER_SIZE = 64 * Kb,
+    MAX_MESH_INSTANCES = 1 << 20,   // 28 MB of instance data a frame, a few dozen draws at the largest chunk size
+    HEADLESS_DEFAULT_FRAME_COUNT = 1000,
+    MAX_CHURN_BUFFERS = 64,
 };
 
 enum {
@@ -34,16 +68,39 @@ enum {
     VULKAN_MEM_COUNT
 };
 
+// How far main got through initialization, only the stages reached are torn down.
+enum {
+    INIT_STAGE_NONE,
+    INIT_STAGE_VULKAN,
+    INIT_STAGE_WINDOW,              // passed without a window in headless mode
+    INIT_STAGE_DEVICE,
+    INIT_STAGE_TARGET,              // swapchain or offscreen images
+    INIT_STAGE_RENDER,
+};
+
 static uint32_t clamp_u32(uint32_t value, uint32_t min, uint32_t max)
 {
     return value < min ? min : (value > max ? max : value);
 }
 
-typedef struct tagVertexP2C
+static int cmp_float(const void* a, const void* b)
 {
-    float x, y;
-    uint32_t rgba;
-} VertexP2C;
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+//----------------------------------------------------------
+
+// Headless mode renders into device-local images instead of swapchain images,
+// so it needs neither a window nor a surface and runs on display-less machines.
+int headless = 0;
+uint32_t benchmarkFrames = 0; // 0 - run until window is closed
+uint32_t warmupFrames = 0;    // submitted before the measured frames, left out of every statistic
+float timestepMs = -1.0f;     // fixed animation step per frame, < 0 - the wall clock unless results are written
+float sceneTime = 0.0f;       // seconds, set by draw_frame, everything animates from it
+
+// More frames in flight keep the GPU busier at the cost of input latency.
+uint32_t frameCount = DEFAULT_FRAME_COUNT;
 
 //----------------------------------------------------------
 
@@ -56,11 +113,20 @@ const VkApplicationInfo appInfo = {
     .apiVersion = VK_API_VERSION_1_0,
 };
 
+// Surface extensions go last, headless mode simply drops them from the count.
+#ifdef _WIN32
+#define SURFACE_EXTENSION_COUNT 2
+#define SURFACE_EXTENSION_NAMES VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+#else
+#define SURFACE_EXTENSION_COUNT 1
+#define SURFACE_EXTENSION_NAMES VK_KHR_SURFACE_EXTENSION_NAME
+#endif
+
 const VkInstanceCreateInfo createInfo = {
     .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
     .pApplicationInfo = &appInfo,
-    .enabledExtensionCount = 2,
-    .ppEnabledExtensionNames = (const char* const[]) { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME },
+    .enabledExtensionCount = SURFACE_EXTENSION_COUNT,
+    .ppEnabledExtensionNames = (const char* const[]) { SURFACE_EXTENSION_NAMES },
 };
 
 #ifdef VULKAN_ENABLE_LUNARG_VALIDATION
@@ -69,8 +135,8 @@ const VkInstanceCreateInfo createInfoLunarGValidation = {
     .pApplicationInfo = &appInfo,
     .enabledLayerCount = 1,
     .ppEnabledLayerNames = (const char* const[]) { "VK_LAYER_LUNARG_standard_validation" },
-    .enabledExtensionCount = 3,
-    .ppEnabledExtensionNames = (const char* const[]) { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_REPORT_EXTENSION_NAME },
+    .enabledExtensionCount = 1 + SURFACE_EXTENSION_COUNT,
+    .ppEnabledExtensionNames = (const char* const[]) { VK_EXT_DEBUG_REPORT_EXTENSION_NAME, SURFACE_EXTENSION_NAMES },
 };
 
 PFN_vkCreateDebugReportCallbackEXT vkpfn_CreateDebugReportCallbackEXT = 0;
@@ -100,12 +166,31 @@ VkDebugReportCallbackCreateInfoEXT debugCallbackCreateInfo = {
 #endif
 
 VkInstance instance = VK_NULL_HANDLE;
+uint32_t instanceApiVersion = VK_API_VERSION_1_0;
 
 int init_vulkan()
 {
     VkResult result = VK_ERROR_INITIALIZATION_FAILED;
+    const uint32_t skipExtensions = headless ? SURFACE_EXTENSION_COUNT : 0;
+
+    // Timeline semaphores depend on Vulkan 1.1, ask for it whenever the loader has it.
+    VkApplicationInfo app = appInfo;
+#ifdef VK_KHR_timeline_semaphore
+    PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+        (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion && enumerateInstanceVersion(&instanceApiVersion) == VK_SUCCESS
+        && instanceApiVersion >= VK_API_VERSION_1_1)
+    {
+        app.apiVersion = VK_API_VERSION_1_1;
+    }
+#endif
+    instanceApiVersion = app.apiVersion;
+
 #ifdef VULKAN_ENABLE_LUNARG_VALIDATION
-    result = vkCreateInstance(&createInfoLunarGValidation, 0, &instance);
+    VkInstanceCreateInfo validationInfo = createInfoLunarGValidation;
+    validationInfo.pApplicationInfo = &app;
+    validationInfo.enabledExtensionCount -= skipExtensions;
+    result = vkCreateInstance(&validationInfo, 0, &instance);
     if (result == VK_SUCCESS)
     {
         vkpfn_CreateDebugReportCallbackEXT =
@@ -120,7 +205,10 @@ int init_vulkan()
 #endif
     if (result != VK_SUCCESS)
     {
-        result = vkCreateInstance(&createInfo, 0, &instance);
+        VkInstanceCreateInfo info = createInfo;
+        info.pApplicationInfo = &app;
+        info.enabledExtensionCount -= skipExtensions;
+        result = vkCreateInstance(&info, 0, &instance);
     }
 
     return result == VK_SUCCESS;
@@ -140,18 +228,24 @@ void fini_vulkan()
 //----------------------------------------------------------
 
 SDL_Window* window = 0;
+#ifdef _WIN32
 VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = { VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR };
+#endif
 VkSurfaceKHR surface = VK_NULL_HANDLE;
 uint32_t width = 1280;
 uint32_t height = 720;
 
 int init_window()
 {
+#ifndef _WIN32
+    printf("Windowed mode is only supported on Win32, use --headless\n");
+    return 0;
+#else
     SDL_Window* window = SDL_CreateWindow(
         "Vulkan Sample",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         width, height,
-        0
+        SDL_WINDOW_RESIZABLE
     );
 
     SDL_SysWMinfo info;
@@ -164,6 +258,7 @@ int init_window()
     VkResult result = vkCreateWin32SurfaceKHR(instance, &surfaceCreateInfo, NULL, &surface);
 
     return window != 0 && result == VK_SUCCESS;
+#endif
 }
 
 void fini_window()
@@ -176,10 +271,16 @@ void fini_window()
 
 VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 uint32_t queueFamilyIndex;
+uint32_t timestampValidBits;
 VkQueue queue;
+uint32_t transferQueueFamilyIndex;  // same as queueFamilyIndex if there is no transfer-only family
+VkQueue transferQueue;
 VkDevice device = VK_NULL_HANDLE;
+VkPhysicalDeviceProperties deviceProperties;
 VkPhysicalDeviceMemoryProperties deviceMemProperties;
 uint32_t compatibleMemTypes[VULKAN_MEM_COUNT];
+DeviceMemoryAllocator deviceAllocator;
+int timelineSemaphores = 0;
 
 uint32_t vkutFindCompatibleMemoryType(VkPhysicalDeviceMemoryProperties* memProperties, VkMemoryPropertyFlags flags)
 {
@@ -194,10 +295,28 @@ uint32_t vkutFindCompatibleMemoryType(VkPhysicalDeviceMemoryProperties* memPrope
     return compatibleMemoryTypes;
 }
 
+int vkutHasDeviceExtension(VkPhysicalDevice physicalDevice, const char* name)
+{
+    VkExtensionProperties extensions[256];
+    uint32_t extensionCount = sizeof(extensions) / sizeof(extensions[0]);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, extensions);
+    for (uint32_t i = 0; i < extensionCount; ++i)
+    {
+        if (strcmp(extensions[i].extensionName, name) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// GPU-driven objects: objectcull.glsl-cs culls and compacts draw commands, one indirect draw renders them.
+uint32_t gpuObjectCount = 0;                // 0 - off
+int indirectCount = 1;                      // compact and draw with vkCmdDrawIndexedIndirectCountKHR when supported
+int gpuObjectCheck = 0;                     // count visible objects on the CPU too and compare
+
 VkDeviceCreateInfo deviceCreateInfo = {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-    .enabledExtensionCount = 1,
-    .ppEnabledExtensionNames = (const char* const[]) { VK_KHR_SWAPCHAIN_EXTENSION_NAME },
 };
 
 int init_device()
@@ -219,12 +338,16 @@ int init_device()
 
         for (uint32_t j = 0; j < queueFamilyCount; ++j) {
 
-            VkBool32 supportsPresent = VK_FALSE;
-            vkGetPhysicalDeviceSurfaceSupportKHR(deviceHandles[i], j, surface, &supportsPresent);
+            VkBool32 supportsPresent = headless; // no presentation in headless mode
+            if (!headless)
+            {
+                vkGetPhysicalDeviceSurfaceSupportKHR(deviceHandles[i], j, surface, &supportsPresent);
+            }
 
             if (supportsPresent && (queueFamilyProperties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
             {
                 queueFamilyIndex = j;
+                timestampValidBits = queueFamilyProperties[j].timestampValidBits;
                 physicalDevice = deviceHandles[i];
                 break;
             }
@@ -236,18 +359,112 @@ int init_device()
         }
     }
 
-    deviceCreateInfo.queueCreateInfoCount = 1,
+    if (!physicalDevice)
+    {
+        return 0;
+    }
+
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    // Transfer-only family maps to the DMA engines, which copy without taking graphics time.
+    uint32_t queueFamilyCount = MAX_QUEUE_COUNT;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties);
+    transferQueueFamilyIndex = queueFamilyIndex;
+    for (uint32_t j = 0; j < queueFamilyCount; ++j)
+    {
+        VkQueueFlags flags = queueFamilyProperties[j].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            transferQueueFamilyIndex = j;
+            break;
+        }
+    }
+
+    const char* deviceExtensions[4];
+    uint32_t deviceExtensionCount = 0;
+    if (!headless)
+    {
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    }
+
+    // Timeline semaphores are a hard requirement of the extension, so finding the extension is enough.
+    const char* timelineExtension = instanceApiVersion > VK_API_VERSION_1_0 && deviceProperties.apiVersion > VK_API_VERSION_1_0
+        ? frame_timeline_extension(physicalDevice) : 0;
+#ifdef VK_KHR_timeline_semaphore
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+        .timelineSemaphore = VK_TRUE,
+    };
+    if (timelineExtension)
+    {
+        deviceExtensions[deviceExtensionCount++] = timelineExtension;
+        deviceCreateInfo.pNext = &timelineFeatures;
+    }
+#endif
+    timelineSemaphores = timelineExtension != 0;
+
+    // Budgets are read with vkGetPhysicalDeviceMemoryProperties2, core in the same 1.1 the timeline needs.
+    const char* budgetExtension = instanceApiVersion > VK_API_VERSION_1_0 && deviceProperties.apiVersion > VK_API_VERSION_1_0
+        ? devmem_budget_extension(physicalDevice) : 0;
+    if (budgetExtension)
+    {
+        deviceExtensions[deviceExtensionCount++] = budgetExtension;
+    }
+
+    // Every indirect command carries its object index in firstInstance, and there is one command per object.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    VkPhysicalDeviceFeatures enabledFeatures = { 0 };
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    if (gpuObjectCount && (!supportedFeatures.multiDrawIndirect || !supportedFeatures.drawIndirectFirstInstance))
+    {
+        printf("GPU objects: multiDrawIndirect and drawIndirectFirstInstance are not supported, disabled\n");
+        gpuObjectCount = 0;
+    }
+    if (gpuObjectCount)
+    {
+        enabledFeatures.multiDrawIndirect = VK_TRUE;
+        enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        if (gpuObjectCount > deviceProperties.limits.maxDrawIndirectCount)
+        {
+            printf("GPU objects: limited to %u by maxDrawIndirectCount\n", deviceProperties.limits.maxDrawIndirectCount);
+            gpuObjectCount = deviceProperties.limits.maxDrawIndirectCount;
+        }
+    }
+#ifdef VK_KHR_draw_indirect_count
+    indirectCount = indirectCount && gpuObjectCount && vkutHasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (indirectCount)
+    {
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+    }
+#else
+    indirectCount = 0;
+#endif
+
+    deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+    deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
+    deviceCreateInfo.queueCreateInfoCount = transferQueueFamilyIndex != queueFamilyIndex ? 2 : 1,
     deviceCreateInfo.pQueueCreateInfos = (VkDeviceQueueCreateInfo[]) {
         {
             .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
                 .queueFamilyIndex = queueFamilyIndex,
                 .queueCount = 1,
                 .pQueuePriorities = (const float[]) { 1.0f }
-        }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                .queueFamilyIndex = transferQueueFamilyIndex,
+                .queueCount = 1,
+                .pQueuePriorities = (const float[]) { 1.0f }
+        },
     };
     VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, &device);
+    deviceCreateInfo.pNext = 0;
+    deviceCreateInfo.pEnabledFeatures = 0;
+    deviceCreateInfo.ppEnabledExtensionNames = 0;
 
     vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
+    vkGetDeviceQueue(device, transferQueueFamilyIndex, 0, &transferQueue);
 
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemProperties);
     compatibleMemTypes[VULKAN_MEM_DEVICE_READBACK]
@@ -259,11 +476,18 @@ int init_device()
     compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL]
         = vkutFindCompatibleMemoryType(&deviceMemProperties, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
+    devmem_init(&deviceAllocator, device, physicalDevice, DEVMEM_DEFAULT_BLOCK_SIZE);
+    if (budgetExtension)
+    {
+        devmem_enable_budget(&deviceAllocator, instance);
+    }
+
     return result == VK_SUCCESS;
 }
 
 void fini_device()
 {
+    devmem_destroy(&deviceAllocator);
     vkDestroyDevice(device, 0);
 }
 
@@ -274,77 +498,153 @@ uint32_t swapchainImageCount;
 VkImage swapchainImages[MAX_SWAPCHAIN_IMAGES];
 VkExtent2D swapchainExtent;
 VkSurfaceFormatKHR surfaceFormat;
-
-int init_swapchain()
+VkPresentModeKHR presentMode;
+uint32_t presentPolicy = PRESENT_POLICY_MAILBOX;
+int swapchainDirty = 0;         // out of date, suboptimal or the policy changed, recreate before the next acquire
+VkResult fatalResult = VK_SUCCESS;  // acquire or present failed for good, ends the main loop
+const char* captureFile = 0;    // --capture, 0 - off
+uint32_t captureFps = 60;       // Y4M header
+
+// Creates a swapchain for the current surface size and present policy. A previous swapchain goes in as
+// oldSwapchain, which retires it even if creation fails, so the caller destroys it either way.
+// Returns 0 without touching anything while the window has no area.
+int createSwapchain(VkSwapchainKHR oldSwapchain)
 {
-    //Use first available format
-    uint32_t formatCount = 1;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, 0); // suppress validation layer
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, &surfaceFormat);
-    surfaceFormat.format = surfaceFormat.format == VK_FORMAT_UNDEFINED ? VK_FORMAT_B8G8R8A8_UNORM : surfaceFormat.format;
-
-    uint32_t presentModeCount = 0;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, NULL);
-    VkPresentModeKHR presentModes[MAX_PRESENT_MODE_COUNT];
-    presentModeCount = presentModeCount > MAX_PRESENT_MODE_COUNT ? MAX_PRESENT_MODE_COUNT : presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes);
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
 
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;   // always supported.
-    for (uint32_t i = 0; i < presentModeCount; ++i)
+    VkExtent2D extent = surfaceCapabilities.currentExtent;
+    if (extent.width == UINT32_MAX)
     {
-        if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-        {
-            presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-            break;
-        }
+        extent.width = clamp_u32(width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+        extent.height = clamp_u32(height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+    }
+    if (!extent.width || !extent.height)
+    {
+        return 0;
     }
-    swapchainImageCount = presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? PRESENT_MODE_MAILBOX_IMAGE_COUNT : PRESENT_MODE_DEFAULT_IMAGE_COUNT;
-
-    VkSurfaceCapabilitiesKHR surfaceCapabilities;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
 
-    swapchainExtent = surfaceCapabilities.currentExtent;
-    if (swapchainExtent.width == UINT32_MAX)
+    // Captured frames are copied out of the swapchain images.
+    if (captureFile && !(surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
     {
-        swapchainExtent.width = clamp_u32(width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
-        swapchainExtent.height = clamp_u32(height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+        printf("Capture: swapchain images can not be copied from, capture is off\n");
+        captureFile = 0;
     }
 
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, NULL);
+    VkPresentModeKHR presentModes[MAX_PRESENT_MODE_COUNT];
+    presentModeCount = presentModeCount > MAX_PRESENT_MODE_COUNT ? MAX_PRESENT_MODE_COUNT : presentModeCount;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes);
+    presentMode = present_choose_mode(presentPolicy, presentModes, presentModeCount);
+
     VkSwapchainCreateInfoKHR swapChainCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = surface,
-        .minImageCount = swapchainImageCount,
+        .minImageCount = present_image_count(presentMode, &surfaceCapabilities, MAX_SWAPCHAIN_IMAGES),
         .imageFormat = surfaceFormat.format,
         .imageColorSpace = surfaceFormat.colorSpace,
-        .imageExtent = swapchainExtent,
+        .imageExtent = extent,
         .imageArrayLayers = 1, // 2 for stereo
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (captureFile ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .preTransform = surfaceCapabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = presentMode,
         .clipped = VK_TRUE,
+        .oldSwapchain = oldSwapchain,
     };
 
+    swapchain = VK_NULL_HANDLE;
     VkResult result = vkCreateSwapchainKHR(device, &swapChainCreateInfo, 0, &swapchain);
     if (result != VK_SUCCESS)
     {
+        swapchain = VK_NULL_HANDLE;
         return 0;
     }
 
+    // The presentation engine may add images; more than we have room for would be indexed past the arrays.
     vkGetSwapchainImagesKHR(device, swapchain, &swapchainImageCount, NULL);
+    if (swapchainImageCount > MAX_SWAPCHAIN_IMAGES)
+    {
+        vkDestroySwapchainKHR(device, swapchain, 0);
+        swapchain = VK_NULL_HANDLE;
+        return 0;
+    }
     vkGetSwapchainImagesKHR(device, swapchain, &swapchainImageCount, swapchainImages);
+    swapchainExtent = extent;
 
     return 1;
 }
 
+int init_swapchain()
+{
+    //Use first available format
+    uint32_t formatCount = 1;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, 0); // suppress validation layer
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &formatCount, &surfaceFormat);
+    surfaceFormat.format = surfaceFormat.format == VK_FORMAT_UNDEFINED ? VK_FORMAT_B8G8R8A8_UNORM : surfaceFormat.format;
+
+    return createSwapchain(VK_NULL_HANDLE);
+}
+
 void fini_swapchain()
 {
     vkDestroySwapchainKHR(device, swapchain, 0);
 }
 
+DeviceAllocation offscreenImageMemory[MAX_SWAPCHAIN_IMAGES];
+
+// Stand-in for the swapchain in headless mode: one device-local image per frame in flight,
+// so frames never have to wait for each other's render target.
+int init_offscreen()
+{
+    surfaceFormat = (VkSurfaceFormatKHR){ VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+    swapchainExtent = (VkExtent2D){ width, height };
+    swapchainImageCount = frameCount;
+
+    for (uint32_t i = 0; i < swapchainImageCount; ++i)
+    {
+        VkImageCreateInfo imageCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = surfaceFormat.format,
+            .extent = { swapchainExtent.width, swapchainExtent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        if (vkCreateImage(device, &imageCreateInfo, 0, &swapchainImages[i]) != VK_SUCCESS)
+        {
+            return 0;
+        }
+
+        if (!devmem_alloc_image(&deviceAllocator, swapchainImages[i], compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &offscreenImageMemory[i]))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void fini_offscreen()
+{
+    for (uint32_t i = 0; i < swapchainImageCount; ++i)
+    {
+        vkDestroyImage(device, swapchainImages[i], 0);
+        devmem_free(&deviceAllocator, &offscreenImageMemory[i]);
+    }
+}
+
 //----------------------------------------------------------
 
+// Pipelines and secondary command buffers are created against this render pass. Rendering uses the
+// render graph's passes, which are compatible with it: same formats and sample counts.
 VkRenderPass renderPass;
 
 int createRenderPass()
@@ -359,8 +659,8 @@ int createRenderPass()
             .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            .initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         },
         .subpassCount = 1,
         .pSubpasses = &(VkSubpassDescription) {
@@ -384,9 +684,8 @@ void destroyRenderPass()
 }
 
 VkImageView swapchainImageViews[MAX_SWAPCHAIN_IMAGES];
-VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
 
-int createFramebuffers()
+int createSwapchainViews()
 {
     for (uint32_t i = 0; i < swapchainImageCount; ++i)
     {
@@ -404,460 +703,2959 @@ int createFramebuffers()
             },
         };
         vkCreateImageView(device, &createInfo, 0, &swapchainImageViews[i]);
-
-        VkFramebufferCreateInfo framebufferCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = renderPass,
-            .attachmentCount = 1,
-            .pAttachments = &swapchainImageViews[i],
-            .width = swapchainExtent.width,
-            .height = swapchainExtent.height,
-            .layers = 1,
-        };
-        vkCreateFramebuffer(device, &framebufferCreateInfo, 0, &framebuffers[i]);
     }
 
     return 1;
 }
 
-void destroyFramebuffers()
+void destroySwapchainViews()
 {
     for (uint32_t i = 0; i < swapchainImageCount; ++i)
     {
-        vkDestroyFramebuffer(device, framebuffers[i], NULL);
         vkDestroyImageView(device, swapchainImageViews[i], NULL);
     }
 }
 
-VkShaderModule createShaderModule(const char* shaderFile)
+const char* pipelineCacheFile = "pipeline.cache";
+VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+int pipelineCacheWarm = 0;       // cache was loaded from disk and passed validation
+float pipelineCreateTime = 0.0f; // ms the driver spent on the startup pipelines, summed over workers
+float pipelineColdCreateTime = 0.0f; // ms it took without a cache, as recorded in the file
+
+enum {
+    PIPELINE_CACHE_MAGIC = 0x43505056, // 'VPPC'
+    PIPELINE_CACHE_FILE_VERSION = 1,
+};
+
+// Our own header in front of the driver blob. Drivers are supposed to reject foreign
+// data themselves, but not all of them do so gracefully, so everything is checked here first.
+typedef struct tagPipelineCacheFileHeader
 {
-    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    uint32_t magic;
+    uint32_t fileVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint32_t dataSize;
+    uint32_t dataHash;
+    float    coldCreateTime;
+} PipelineCacheFileHeader;
+
+static uint32_t hash_fnv1a(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
 
-    HANDLE hFile = CreateFile(shaderFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) return VK_NULL_HANDLE;
+// Validates both our header and the VK_PIPELINE_CACHE_HEADER_VERSION_ONE header of the blob itself.
+int validatePipelineCacheData(const PipelineCacheFileHeader* header, const uint8_t* data)
+{
+    if (header->magic != PIPELINE_CACHE_MAGIC || header->fileVersion != PIPELINE_CACHE_FILE_VERSION)
+    {
+        return 0;
+    }
+    if (header->vendorID != deviceProperties.vendorID
+        || header->deviceID != deviceProperties.deviceID
+        || header->driverVersion != deviceProperties.driverVersion
+        || memcmp(header->pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        return 0;
+    }
+    if (header->dataSize < 16 + VK_UUID_SIZE || hash_fnv1a(data, header->dataSize) != header->dataHash)
+    {
+        return 0;
+    }
 
-    LARGE_INTEGER size;
-    GetFileSizeEx(hFile, &size);
+    uint32_t blobHeader[4];
+    memcpy(blobHeader, data, sizeof(blobHeader));
+    return blobHeader[0] >= 16 + VK_UUID_SIZE
+        && blobHeader[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && blobHeader[2] == deviceProperties.vendorID
+        && blobHeader[3] == deviceProperties.deviceID
+        && memcmp(data + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
 
-    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
-    CloseHandle(hFile);
-    if (!hMapping) return VK_NULL_HANDLE;
+int createPipelineCache()
+{
+    PipelineCacheFileHeader header;
+    uint8_t* data = 0;
 
-    const uint32_t* data = (const uint32_t*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    FILE* file = pipelineCacheFile ? fopen(pipelineCacheFile, "rb") : 0;
+    if (file)
+    {
+        if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == PIPELINE_CACHE_MAGIC && header.dataSize < 256 * Mb)
+        {
+            data = (uint8_t*)malloc(header.dataSize);
+            if (!data)
+            {
+                printf("Pipeline cache %s needs %u bytes, out of memory, ignoring it\n", pipelineCacheFile, header.dataSize);
+            }
+            else if (fread(data, 1, header.dataSize, file) != header.dataSize || !validatePipelineCacheData(&header, data))
+            {
+                printf("Pipeline cache %s is corrupt or stale, ignoring it\n", pipelineCacheFile);
+                free(data);
+                data = 0;
+            }
+        }
+        fclose(file);
+    }
 
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = size.LowPart,
-        .pCode = data,
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data ? header.dataSize : 0,
+        .pInitialData = data,
     };
-    vkCreateShaderModule(device, &shaderModuleCreateInfo, 0, &shaderModule);
+    VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, 0, &pipelineCache);
+    if (result != VK_SUCCESS && data)
+    {
+        // Driver refused the blob after all, start from scratch.
+        pipelineCacheCreateInfo.initialDataSize = 0;
+        pipelineCacheCreateInfo.pInitialData = 0;
+        free(data);
+        data = 0;
+        result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, 0, &pipelineCache);
+    }
 
-    UnmapViewOfFile(data);
-    CloseHandle(hMapping);
+    pipelineCacheWarm = data != 0;
+    pipelineColdCreateTime = data ? header.coldCreateTime : 0.0f;
+    free(data);
 
-    return shaderModule;
+    return result == VK_SUCCESS;
 }
 
-VkPipelineLayout pipelineLayout; 
-VkPipeline pipeline;
-
-int createPipeline()
+void savePipelineCache()
 {
-    VkShaderModule vertexShader = createShaderModule("shaders\\vertex_color.spv-vs");
-    VkShaderModule fragmentShader = createShaderModule("shaders\\vertex_color.spv-fs");
+    size_t dataSize = 0;
+    if (!pipelineCacheFile || vkGetPipelineCacheData(device, pipelineCache, &dataSize, 0) != VK_SUCCESS || !dataSize)
+    {
+        return;
+    }
 
-    const VkPipelineShaderStageCreateInfo stages[] = {
-        {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = vertexShader,
-            .pName = "main",
-        },
+    uint8_t* data = (uint8_t*)malloc(dataSize);
+    if (data && vkGetPipelineCacheData(device, pipelineCache, &dataSize, data) == VK_SUCCESS)
+    {
+        PipelineCacheFileHeader header = {
+            .magic = PIPELINE_CACHE_MAGIC,
+            .fileVersion = PIPELINE_CACHE_FILE_VERSION,
+            .vendorID = deviceProperties.vendorID,
+            .deviceID = deviceProperties.deviceID,
+            .driverVersion = deviceProperties.driverVersion,
+            .dataSize = (uint32_t)dataSize,
+            .dataHash = hash_fnv1a(data, dataSize),
+            .coldCreateTime = pipelineCacheWarm ? pipelineColdCreateTime : pipelineCreateTime,
+        };
+        memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+        // Write to a temporary file first so a crash never leaves a truncated cache behind.
+        char tempFile[256];
+        snprintf(tempFile, sizeof(tempFile), "%s.tmp", pipelineCacheFile);
+        FILE* file = fopen(tempFile, "wb");
+        if (file)
         {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .module = fragmentShader,
-            .pName = "main",
+            int written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, dataSize, file) == dataSize;
+            written = (fclose(file) == 0) && written;
+            // The old cache is only replaced by a complete new one. Win32 rename refuses to overwrite, hence the remove.
+            if (written)
+            {
+                remove(pipelineCacheFile);
+            }
+            if (!written || rename(tempFile, pipelineCacheFile) != 0)
+            {
+                remove(tempFile);
+            }
+        }
+    }
+    free(data);
+}
+
+void destroyPipelineCache()
+{
+    savePipelineCache();
+    vkDestroyPipelineCache(device, pipelineCache, 0);
+}
+
+const char* shaderPakFile = "shaders/shaders.pak";
+ShaderPak shaderPak;
+
+void openShaderPak()
+{
+    if (!shaderPakFile)
+    {
+        return;
+    }
+    if (!shaderpak_open(&shaderPak, shaderPakFile))
+    {
+        printf("Shader archive %s is missing or invalid, loading shaders from files\n", shaderPakFile);
+        return;
+    }
+    printf("Shader archive: %u shaders, %u unique, %u KB mapped\n",
+        shaderPak.header->entryCount, shaderPak.header->blobCount, (uint32_t)(shaderPak.size / 1024));
+}
+
+PipelineManager pipelineManager;
+int shaderReload = 1;           // rebuild pipelines when their .spv files change, windowed mode only
+int pipelineCacheReported = 0;
+
+// Called once the startup pipelines are in.
+void reportPipelineCache()
+{
+    pipelineCreateTime = pipelineManager.stats.compileMs;
+    pipelineCacheReported = 1;
+    printf("Pipelines: %u requested, %u unique, %u compiled on %u threads, %u shader modules from the archive\n",
+        pipelineManager.stats.requests, pipelineManager.stats.requests - pipelineManager.stats.deduplicated,
+        pipelineManager.stats.compiled, pipelineManager.threadCount, pipelineManager.stats.archiveModules);
+    if (pipelineManager.stats.archiveMismatches)
+    {
+        printf("Pipelines: %u archive shaders failed their hash check and were read from disk\n", pipelineManager.stats.archiveMismatches);
+    }
+    if (pipelineCacheWarm)
+    {
+        printf("Pipeline creation: %.2f ms with warm cache, %.2f ms cold, saved %.2f ms\n",
+            pipelineCreateTime, pipelineColdCreateTime, pipelineColdCreateTime - pipelineCreateTime);
+    }
+    else
+    {
+        printf("Pipeline creation: %.2f ms with cold cache\n", pipelineCreateTime);
+    }
+}
+
+// Per-draw constants of vertex_color.glsl-vs.
+typedef struct tagDrawConstants
+{
+    float transform[4];     // xy scale, zw offset, in clip space
+    float tint[4];          // multiplies the vertex color
+} DrawConstants;
+
+static const DrawConstants identityDrawConstants = { { 1.0f, 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+
+VkDescriptorSetLayout drawConstantsSetLayout;
+VkPipelineLayout pipelineLayout;
+PipelineHandle pipeline;
+PipelineHandle batchPipelines[BATCH2D_STATE_COUNT];
+PipelineHandle instancedPipeline;
+uint32_t meshInstances = 0;                 // animated mesh instances per frame, 0 - off
+uint32_t vertexFormat = VERTEX_FORMAT_F32;  // 2D batch vertices
+
+// Vertices in VERTEX_FORMAT_*.
+PipelineHandle requestVertexColorPipeline(uint32_t format, VkCullModeFlags cullMode, VkBool32 blend)
+{
+    PipelineDesc desc = {
+        .vertexShader = "shaders/vertex_color.spv-vs",
+        .fragmentShader = "shaders/vertex_color.spv-fs",
+        .layout = pipelineLayout,
+        .renderPass = renderPass,
+        .vertexStride = vertexpack_stride(format),
+        .attributeCount = 2,
+        .attributes = {
+            // Color comes last in every format.
+            {.location = 0, .binding = 0, .format = vertexpack_position_format(format), .offset = 0},
+            {.location = 1, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = vertexpack_stride(format) - sizeof(uint32_t)}
         },
+        .cullMode = cullMode,
+        .blend = blend,
     };
-    VkPipelineVertexInputStateCreateInfo vertexInputState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = (VkVertexInputBindingDescription[]) {
-            {.binding = 0, .stride = sizeof(VertexP2C), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX}
-        },
-        .vertexAttributeDescriptionCount = 2,
-        .pVertexAttributeDescriptions = (VkVertexInputAttributeDescription[]) {
-            {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT,  .offset = offsetof(VertexP2C, x)},
-            {.location = 1, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(VertexP2C, rgba)}
+    return pipemgr_request(&pipelineManager, &desc, 0);
+}
+
+// VertexP2C meshes on binding 0, InstanceData on binding 1.
+PipelineHandle requestInstancedPipeline()
+{
+    PipelineDesc desc = {
+        .vertexShader = "shaders/instanced.spv-vs",
+        .fragmentShader = "shaders/vertex_color.spv-fs",
+        .layout = pipelineLayout,
+        .renderPass = renderPass,
+        .vertexStride = sizeof(VertexP2C),
+        .instanceStride = sizeof(InstanceData),
+        .attributeCount = 5,
+        .attributes = {
+            {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(VertexP2C, x)},
+            {.location = 1, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(VertexP2C, rgba)},
+            {.location = 2, .binding = 1, .format = VK_FORMAT_R32G32B32A32_SFLOAT, .offset = offsetof(InstanceData, transform)},
+            {.location = 3, .binding = 1, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(InstanceData, offset)},
+            {.location = 4, .binding = 1, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(InstanceData, rgba)}
         },
+        .cullMode = VK_CULL_MODE_NONE,
+        .blend = VK_FALSE,
     };
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        .primitiveRestartEnable = VK_FALSE,
-    };
-    VkPipelineRasterizationStateCreateInfo rasterizationState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = VK_FALSE,
-        .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
-        .frontFace = VK_FRONT_FACE_CLOCKWISE,
-        .depthBiasEnable = VK_FALSE,
-        .depthBiasConstantFactor = 0.0f,
-        .depthBiasClamp = 0.0f,
-        .depthBiasSlopeFactor = 0.0f,
-        .lineWidth = 1.0f,
-    };
-    VkPipelineViewportStateCreateInfo viewportState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .pViewports = 0,
-        .scissorCount = 1,
-        .pScissors = 0,
-    };
-    VkPipelineMultisampleStateCreateInfo multisampleState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-        .sampleShadingEnable = VK_FALSE,
-        .minSampleShading = 1.0f,
-        .pSampleMask = 0,
-        .alphaToCoverageEnable = VK_FALSE,
-        .alphaToOneEnable = VK_FALSE,
-    };
-    VkPipelineColorBlendStateCreateInfo colorBlendState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = VK_FALSE,
-        .attachmentCount = 1,
-        .pAttachments = (VkPipelineColorBlendAttachmentState[]) {
-            {
-                .blendEnable = VK_FALSE,
-                .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-                .dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-                .colorBlendOp = VK_BLEND_OP_ADD,
-                .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-                .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-                .alphaBlendOp = VK_BLEND_OP_ADD,
-                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-            },
+    return pipemgr_request(&pipelineManager, &desc, 0);
+}
+
+int createPipeline()
+{
+    // Draws pick their constants out of the upload ring with the dynamic offset.
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &(VkDescriptorSetLayoutBinding) {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
         },
     };
-    VkPipelineDynamicStateCreateInfo dynamicState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .dynamicStateCount = 2,
-        .pDynamicStates = (VkDynamicState[]) { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR },
-    };
+    vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, 0, &drawConstantsSetLayout);
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &drawConstantsSetLayout,
     };
     vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, 0, &pipelineLayout);
 
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 2,
-        .pStages = stages, 
-        .pVertexInputState = &vertexInputState,
-        .pInputAssemblyState = &inputAssemblyState,
-        .pViewportState = &viewportState,
-        .pRasterizationState = &rasterizationState,
-        .pMultisampleState = &multisampleState ,
-        .pColorBlendState = &colorBlendState,
-        .pDynamicState = &dynamicState,
-        .layout = pipelineLayout,
-        .renderPass = renderPass,
-    };
-
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, 0, &pipeline);
-
-    vkDestroyShaderModule(device, vertexShader, 0);
-    vkDestroyShaderModule(device, fragmentShader, 0);
+    pipeline = requestVertexColorPipeline(VERTEX_FORMAT_F32, VK_CULL_MODE_BACK_BIT, VK_FALSE);
+    // 2D primitives come with either winding.
+    batchPipelines[BATCH2D_STATE_OPAQUE] = requestVertexColorPipeline(vertexFormat, VK_CULL_MODE_NONE, VK_FALSE);
+    batchPipelines[BATCH2D_STATE_BLEND] = requestVertexColorPipeline(vertexFormat, VK_CULL_MODE_NONE, VK_TRUE);
+    instancedPipeline = meshInstances ? requestInstancedPipeline() : 0;
 
-    return pipeline != 0;
+    return pipeline != 0 && batchPipelines[BATCH2D_STATE_OPAQUE] != 0 && batchPipelines[BATCH2D_STATE_BLEND] != 0
+        && (!meshInstances || instancedPipeline != 0);
 }
 
+// The pipelines themselves belong to the pipeline manager.
 void destroyPipeline()
 {
-    vkDestroyPipeline(device, pipeline, 0);
     vkDestroyPipelineLayout(device, pipelineLayout, 0);
+    vkDestroyDescriptorSetLayout(device, drawConstantsSetLayout, 0);
 }
 
-VkBuffer uploadBuffer;
-VkDeviceMemory uploadBufferMemory;
-void* uploadBufferPtr;
+UploadRing uploadRing;
+TransferContext transfer;
 VkBuffer staticBuffer;
-VkDeviceMemory staticBufferMemory;
+DeviceAllocation staticBufferMemory;
+VkBuffer quadIndexBuffer;   // shared by every 2D batch draw
+DeviceAllocation quadIndexBufferMemory;
+uint64_t staticUploadId;    // transfer batch carrying staticBuffer and quadIndexBuffer contents
+Defragmenter defragmenter;  // moves the static buffers, which nothing but draws refers to
+uint32_t defragFrameKb = DEFRAG_DEFAULT_FRAME_BYTES / Kb;  // copy budget per frame, 0 - off
+uint32_t memoryChurnBuffers = 0;    // device-local buffers replaced one a frame, fragments memory for the defragmenter
+VkBuffer churnBuffers[MAX_CHURN_BUFFERS];
+DeviceAllocation churnMemory[MAX_CHURN_BUFFERS];
+
+const VertexP2C staticVertices[] = {
+    { 0.5f, 0.0f, 0xFF0000FF },
+    { 1.0f, 1.0f, 0xFF00FF00 },
+    { 0.0f, 1.0f, 0xFFFF0000 }
+};
+
+// Unit-sized meshes drawn by instbatch, triangle lists right after staticVertices.
+const VertexP2C instanceMeshVertices[] = {
+    // Square
+    { -1.0f, -1.0f, 0xFFFFFFFF }, {  1.0f, -1.0f, 0xFFC0C0C0 }, {  1.0f,  1.0f, 0xFF808080 },
+    {  1.0f,  1.0f, 0xFF808080 }, { -1.0f,  1.0f, 0xFFC0C0C0 }, { -1.0f, -1.0f, 0xFFFFFFFF },
+    // Hexagon, lighter in the middle
+    { 0.0f, 0.0f, 0xFFFFFFFF }, {  1.0f,    0.0f, 0xFF909090 }, {  0.5f,  0.866f, 0xFF909090 },
+    { 0.0f, 0.0f, 0xFFFFFFFF }, {  0.5f,  0.866f, 0xFF909090 }, { -0.5f,  0.866f, 0xFF909090 },
+    { 0.0f, 0.0f, 0xFFFFFFFF }, { -0.5f,  0.866f, 0xFF909090 }, { -1.0f,    0.0f, 0xFF909090 },
+    { 0.0f, 0.0f, 0xFFFFFFFF }, { -1.0f,    0.0f, 0xFF909090 }, { -0.5f, -0.866f, 0xFF909090 },
+    { 0.0f, 0.0f, 0xFFFFFFFF }, { -0.5f, -0.866f, 0xFF909090 }, {  0.5f, -0.866f, 0xFF909090 },
+    { 0.0f, 0.0f, 0xFFFFFFFF }, {  0.5f, -0.866f, 0xFF909090 }, {  1.0f,    0.0f, 0xFF909090 },
+};
+const InstanceMesh instanceMeshes[] = {
+    { VK_NULL_HANDLE, 0, sizeof(staticVertices) / sizeof(VertexP2C), 6 },
+    { VK_NULL_HANDLE, 0, sizeof(staticVertices) / sizeof(VertexP2C) + 6, 18 },
+};
 
 int createUploadBuffer()
 {
     VkBufferCreateInfo bufferCreateInfo;
-    VkMemoryAllocateInfo allocInfo;
-    VkMemoryRequirements memoryRequirements;
-    uint32_t memoryIndex;
-
-    bufferCreateInfo = (VkBufferCreateInfo){
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = UPLOAD_BUFFER_SIZE,
-        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
-                | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = &queueFamilyIndex,
-    };
-    vkCreateBuffer(device, &bufferCreateInfo, NULL, &uploadBuffer);
-    vkGetBufferMemoryRequirements(device, uploadBuffer, &memoryRequirements);
 
-    memoryIndex = bit_ffs32(compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD] & memoryRequirements.memoryTypeBits);
-    allocInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = memoryIndex,
-    };
-    vkAllocateMemory(device, &allocInfo, NULL, &uploadBufferMemory);
-    vkBindBufferMemory(device, uploadBuffer, uploadBufferMemory, 0);
-    vkMapMemory(device, uploadBufferMemory, 0, VK_WHOLE_SIZE, 0, &uploadBufferPtr);
+    int result = upload_init(&uploadRing, device, &deviceAllocator, compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD],
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+        | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        UPLOAD_RING_INITIAL_SIZE);
+    if (!result)
+    {
+        return 0;
+    }
+    defrag_init(&defragmenter, device, &deviceAllocator, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], (VkDeviceSize)defragFrameKb * Kb);
 
+    // Both static buffers can be copied away by the defragmenter.
     bufferCreateInfo = (VkBufferCreateInfo){
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = STATIC_BUFFER_SIZE,
         .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
         | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-        | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .queueFamilyIndexCount = 1,
         .pQueueFamilyIndices = &queueFamilyIndex,
     };
     vkCreateBuffer(device, &bufferCreateInfo, NULL, &staticBuffer);
-    vkGetBufferMemoryRequirements(device, staticBuffer, &memoryRequirements);
+    if (!devmem_alloc_buffer(&deviceAllocator, staticBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &staticBufferMemory))
+    {
+        return 0;
+    }
+    defrag_register(&defragmenter, &staticBuffer, &staticBufferMemory, bufferCreateInfo.size, bufferCreateInfo.usage);
 
-    memoryIndex = bit_ffs32(compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL] & memoryRequirements.memoryTypeBits);
-    allocInfo = (VkMemoryAllocateInfo){
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = memoryIndex,
-    };
-    vkAllocateMemory(device, &allocInfo, NULL, &staticBufferMemory);
-    vkBindBufferMemory(device, staticBuffer, staticBufferMemory, 0);
+    transfer_init(&transfer, device, &deviceAllocator, compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD],
+        transferQueue, transferQueueFamilyIndex, queueFamilyIndex);
+    transfer_upload_buffer(&transfer, staticBuffer, 0, staticVertices, sizeof(staticVertices));
+    transfer_upload_buffer(&transfer, staticBuffer, sizeof(staticVertices), instanceMeshVertices, sizeof(instanceMeshVertices));
 
-    return TRUE;
-}
+    bufferCreateInfo.size = BATCH2D_INDEX_COUNT * sizeof(uint16_t);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    vkCreateBuffer(device, &bufferCreateInfo, NULL, &quadIndexBuffer);
+    if (!devmem_alloc_buffer(&deviceAllocator, quadIndexBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &quadIndexBufferMemory))
+    {
+        return 0;
+    }
+    defrag_register(&defragmenter, &quadIndexBuffer, &quadIndexBufferMemory, bufferCreateInfo.size, bufferCreateInfo.usage);
+    uint16_t* quadIndices = (uint16_t*)malloc(BATCH2D_INDEX_COUNT * sizeof(uint16_t));
+    if (!quadIndices)
+    {
+        return 0;
+    }
+    batch2d_fill_indices(quadIndices);
+    transfer_upload_buffer(&transfer, quadIndexBuffer, 0, quadIndices, BATCH2D_INDEX_COUNT * sizeof(uint16_t));
+    free(quadIndices);
+
+    staticUploadId = transfer_flush(&transfer);
+
+    return 1;
+}
 
 void destroyUploadBuffer()
 {
-    vkFreeMemory(device, staticBufferMemory, NULL);
+    transfer_destroy(&transfer);
+    defrag_unregister(&defragmenter, &staticBuffer);
     vkDestroyBuffer(device, staticBuffer, NULL);
+    devmem_free(&deviceAllocator, &staticBufferMemory);
+    defrag_unregister(&defragmenter, &quadIndexBuffer);
+    vkDestroyBuffer(device, quadIndexBuffer, NULL);
+    devmem_free(&deviceAllocator, &quadIndexBufferMemory);
+    for (uint32_t i = 0; i < memoryChurnBuffers; ++i)
+    {
+        if (churnBuffers[i])
+        {
+            defrag_unregister(&defragmenter, &churnBuffers[i]);
+            vkDestroyBuffer(device, churnBuffers[i], NULL);
+            devmem_free(&deviceAllocator, &churnMemory[i]);
+        }
+    }
+    defrag_destroy(&defragmenter);
 
-    vkFreeMemory(device, uploadBufferMemory, NULL);
-    vkDestroyBuffer(device, uploadBuffer, NULL);
+    upload_destroy(&uploadRing);
 }
 
-uint32_t frameIndex = 0;
-VkCommandPool commandPool;
-VkCommandBuffer commandBuffers[FRAME_COUNT];
-VkFence frameFences[FRAME_COUNT]; // Create with VK_FENCE_CREATE_SIGNALED_BIT.
-VkSemaphore imageAvailableSemaphores[FRAME_COUNT];
-VkSemaphore renderFinishedSemaphores[FRAME_COUNT];
-
-int init_render()
+// Replaces one churn buffer with one of another size, 256 KB to 4 MB. Nothing reads them,
+// they only punch holes into device-local blocks the way a long session's streaming would.
+void churnDeviceMemory(uint64_t frameSerial)
 {
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queueFamilyIndex,
+    uint32_t hash = (uint32_t)frameSerial * 2654435761u;
+    uint32_t slot = (hash >> 8) % memoryChurnBuffers;
+    if (churnBuffers[slot] && !defrag_retire(&defragmenter, &churnBuffers[slot], &churnMemory[slot], frameSerial))
+    {
+        return;
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (256 * Kb) << ((hash >> 4) % 5),
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
     };
+    if (vkCreateBuffer(device, &bufferCreateInfo, NULL, &churnBuffers[slot]) != VK_SUCCESS)
+    {
+        churnBuffers[slot] = VK_NULL_HANDLE;
+        return;
+    }
+    if (!devmem_alloc_buffer(&deviceAllocator, churnBuffers[slot], compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &churnMemory[slot]))
+    {
+        vkDestroyBuffer(device, churnBuffers[slot], NULL);
+        churnBuffers[slot] = VK_NULL_HANDLE;
+        return;
+    }
+    defrag_register(&defragmenter, &churnBuffers[slot], &churnMemory[slot], bufferCreateInfo.size, bufferCreateInfo.usage);
+}
 
-    vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &commandPool);
+typedef struct tagDrawItem
+{
+    const char* name;   // GPU profiler scope
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    uint32_t vertexCount;
+    uint32_t firstVertex;
+    VkPipeline pipeline;    // 0 - the VertexP2C pipeline, which must be ready
+    uint32_t indexCount;    // non-zero - indexed with quadIndexBuffer, vertexCount is ignored
+    VkDescriptorSet constantSet;    // DrawConstants, from streamDrawConstants
+    uint32_t constantOffset;
+    VkBuffer instanceBuffer;        // binding 1, 0 - not instanced
+    VkDeviceSize instanceOffset;
+    uint32_t instanceCount;
+} DrawItem;
+
+typedef struct tagDrawList
+{
+    const DrawItem* items;
+    uint32_t count;
+    GpuProfiler* profiler;  // times every draw, only when recording on one thread
+} DrawList;
+
+DescriptorAllocator frameDescriptors;
+// Sets handed out this frame, one per upload buffer that holds constants.
+VkBuffer drawConstantBuffers[MAX_DRAW_CONSTANT_BUFFERS];
+VkDescriptorSet drawConstantSets[MAX_DRAW_CONSTANT_BUFFERS];
+uint32_t drawConstantSetCount = 0;
+
+// Call once the slot's frame has finished, the sets it used are recycled.
+void beginFrameDescriptors(uint32_t index)
+{
+    descalloc_begin_frame(&frameDescriptors, index);
+    drawConstantSetCount = 0;
+}
 
-    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = FRAME_COUNT,
-    };
+// Every draw whose constants are in buffer shares the set, only the dynamic offset differs.
+VkDescriptorSet drawConstantSet(VkBuffer buffer)
+{
+    for (uint32_t i = 0; i < drawConstantSetCount; ++i)
+    {
+        if (drawConstantBuffers[i] == buffer)
+        {
+            return drawConstantSets[i];
+        }
+    }
 
-    vkAllocateCommandBuffers(device, &commandBufferAllocInfo, commandBuffers);
+    VkDescriptorSet set = descalloc_alloc(&frameDescriptors, drawConstantsSetLayout);
+    if (!set)
+    {
+        return VK_NULL_HANDLE;
+    }
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+        .pBufferInfo = &(VkDescriptorBufferInfo) { buffer, 0, sizeof(DrawConstants) },
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, 0);
 
-    VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    // A frame that spills more often than this gets a set per draw, still correct.
+    if (drawConstantSetCount < MAX_DRAW_CONSTANT_BUFFERS)
+    {
+        drawConstantBuffers[drawConstantSetCount] = buffer;
+        drawConstantSets[drawConstantSetCount++] = set;
+    }
+    return set;
+}
 
-    vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &imageAvailableSemaphores[0]);
-    vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &imageAvailableSemaphores[1]);
-    vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &renderFinishedSemaphores[0]);
-    vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &renderFinishedSemaphores[1]);
+// Copies constants into the upload ring and points item at them, returns 0 when out of memory.
+int streamDrawConstants(const DrawConstants* constants, DrawItem* item)
+{
+    UploadAllocation alloc;
+    void* ptr = upload_alloc(&uploadRing, sizeof(DrawConstants), deviceProperties.limits.minUniformBufferOffsetAlignment, &alloc);
+    VkDescriptorSet set = ptr ? drawConstantSet(alloc.buffer) : VK_NULL_HANDLE;
+    if (!set)
+    {
+        return 0;
+    }
+    memcpy(ptr, constants, sizeof(DrawConstants));
+    item->constantSet = set;
+    item->constantOffset = (uint32_t)alloc.offset;
+    return 1;
+}
 
-    VkFenceCreateInfo fenceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
+ParallelRecorder recorder;
+uint32_t recordThreads = 0;     // 0 records inline into the primary command buffer
+uint32_t recordBenchDraws = 0;
 
-    vkCreateFence(device, &fenceCreateInfo, 0, &frameFences[0]);
-    vkCreateFence(device, &fenceCreateInfo, 0, &frameFences[1]);
+// RecordFunc for a range of a DrawList. Secondaries inherit no state, so every range sets up its own.
+void recordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, void* userData)
+{
+    const DrawList* list = (const DrawList*)userData;
+    const DrawItem* items = list->items;
+
+    vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport){ 0.0f, 0.0f, (float)swapchainExtent.width, (float)swapchainExtent.height, 0.0f, 1.0f});
+    vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D){ {0, 0}, swapchainExtent});
+
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    VkBuffer boundBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundOffset = 0;
+    VkBuffer boundInstanceBuffer = VK_NULL_HANDLE;
+    VkDeviceSize boundInstanceOffset = 0;
+    VkDescriptorSet boundSet = VK_NULL_HANDLE;
+    uint32_t boundConstantOffset = 0;
+    uint32_t indexBufferBound = 0;
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        VkPipeline itemPipeline = items[i].pipeline ? items[i].pipeline : pipemgr_get(&pipelineManager, pipeline);
+        if (itemPipeline != boundPipeline)
+        {
+            boundPipeline = itemPipeline;
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
+        }
+        if (items[i].indexCount && !indexBufferBound)
+        {
+            vkCmdBindIndexBuffer(commandBuffer, quadIndexBuffer, 0, VK_INDEX_TYPE_UINT16);
+            indexBufferBound = 1;
+        }
+        if (items[i].buffer != boundBuffer || items[i].offset != boundOffset)
+        {
+            boundBuffer = items[i].buffer;
+            boundOffset = items[i].offset;
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &boundBuffer, &boundOffset);
+        }
+        // Consecutive instanced draws of different meshes only move binding 1.
+        if (items[i].instanceBuffer && (items[i].instanceBuffer != boundInstanceBuffer || items[i].instanceOffset != boundInstanceOffset))
+        {
+            boundInstanceBuffer = items[i].instanceBuffer;
+            boundInstanceOffset = items[i].instanceOffset;
+            vkCmdBindVertexBuffers(commandBuffer, 1, 1, &boundInstanceBuffer, &boundInstanceOffset);
+        }
+        // Draws sharing constants skip the bind, the rest only move the dynamic offset.
+        if (items[i].constantSet != boundSet || items[i].constantOffset != boundConstantOffset)
+        {
+            boundSet = items[i].constantSet;
+            boundConstantOffset = items[i].constantOffset;
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &boundSet, 1, &boundConstantOffset);
+        }
+        uint32_t scope = list->profiler ? gpuprof_begin(list->profiler, commandBuffer, items[i].name) : GPUPROF_INVALID;
+        if (items[i].indexCount)
+        {
+            vkCmdDrawIndexed(commandBuffer, items[i].indexCount, 1, 0, (int32_t)items[i].firstVertex, 0);
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, items[i].vertexCount, items[i].instanceBuffer ? items[i].instanceCount : 1, items[i].firstVertex, 0);
+        }
+        if (list->profiler)
+        {
+            gpuprof_end(list->profiler, commandBuffer, scope);
+        }
+    }
+}
 
-    createRenderPass();
-    createFramebuffers();
-    createPipeline();
-    createUploadBuffer();
+Batch2D batch2d;
+Batch2DList batchOverlay;       // retained primitives, captured once
+uint32_t batchPrimitives = 0;   // animated 2D primitives per frame, 0 - off
+uint32_t vertexPackBenchVertices = 0;
+uint64_t batchTicks = 0;        // CPU time spent batching, for the benchmark
+uint64_t batchTotalPrimitives = 0;
 
-    return 1;
+void captureBatchOverlay()
+{
+    float w = (float)swapchainExtent.width;
+    float h = (float)swapchainExtent.height;
+
+    batch2d_capture_begin(&batch2d, &batchOverlay);
+    batch2d_set_layer(&batch2d, 1);
+    batch2d_set_state(&batch2d, BATCH2D_STATE_OPAQUE);
+    batch2d_rect_outline(&batch2d, 4.0f, 4.0f, w - 8.0f, h - 8.0f, 2.0f, 0xFFFFFFFF);
+    batch2d_set_state(&batch2d, BATCH2D_STATE_BLEND);
+    batch2d_rect(&batch2d, 8.0f, h - 40.0f, w - 16.0f, 32.0f, 0x80000000);
+    batch2d_capture_end(&batch2d);
 }
 
-void fini_render()
+// Moving rects, lines, outlines and hexagons; one in eight is blended.
+void emitBatchScene(float time)
 {
-    vkDeviceWaitIdle(device);
-    destroyUploadBuffer();
-    destroyPipeline();
-    destroyFramebuffers();
-    destroyRenderPass();
-    vkDestroyFence(device, frameFences[0], 0);
-    vkDestroyFence(device, frameFences[1], 0);
-    vkDestroySemaphore(device, renderFinishedSemaphores[0], 0);
-    vkDestroySemaphore(device, renderFinishedSemaphores[1], 0);
-    vkDestroySemaphore(device, imageAvailableSemaphores[0], 0);
-    vkDestroySemaphore(device, imageAvailableSemaphores[1], 0);
-    vkDestroyCommandPool(device, commandPool, 0);
+    static const float hexagon[12] = { 6.0f, 0.0f, 3.0f, 5.2f, -3.0f, 5.2f, -6.0f, 0.0f, -3.0f, -5.2f, 3.0f, -5.2f };
+    float w = (float)swapchainExtent.width;
+    float h = (float)swapchainExtent.height;
+
+    batch2d_set_layer(&batch2d, 0);
+    for (uint32_t i = 0; i < batchPrimitives; ++i)
+    {
+        uint32_t hash = i * 2654435761u;
+        float speed = 20.0f * (1 + (i & 3));
+        float x = fmodf((hash & 0xFFFF) * (1.0f / 65535.0f) * w + time * speed, w);
+        float y = fmodf((hash >> 16) * (1.0f / 65535.0f) * h + time * speed * 0.5f, h);
+        uint32_t blend = (i & 7) == 7;
+        uint32_t rgba = blend ? 0x80000000 | ((hash >> 1) & 0x007F7F7F) : 0xFF000000 | hash;
+
+        batch2d_set_state(&batch2d, blend ? BATCH2D_STATE_BLEND : BATCH2D_STATE_OPAQUE);
+        switch (i & 3)
+        {
+        case 0:
+            batch2d_rect(&batch2d, x, y, 6.0f, 6.0f, rgba);
+            break;
+        case 1:
+            batch2d_line(&batch2d, x, y, x + 12.0f * cosf(time + i), y + 12.0f * sinf(time + i), 1.5f, rgba);
+            break;
+        case 2:
+            batch2d_rect_outline(&batch2d, x, y, 10.0f, 10.0f, 1.0f, rgba);
+            break;
+        default:
+        {
+            float fan[14] = { x, y };
+            for (uint32_t j = 0; j < 12; ++j)
+            {
+                fan[2 + j] = hexagon[j] + (j & 1 ? y : x);
+            }
+            batch2d_fan(&batch2d, fan, 7, rgba);
+            break;
+        }
+        }
+    }
 }
 
-void draw_frame()
+InstanceBatch instanceBatch;
+uint32_t instanceMeshIds[sizeof(instanceMeshes) / sizeof(instanceMeshes[0])];
+uint64_t instanceTicks = 0;     // CPU time spent writing instances, for the benchmark
+uint64_t instanceTotal = 0;
+
+void initInstanceBatch()
 {
-    uint32_t index = frameIndex % FRAME_COUNT;
-    vkWaitForFences(device, 1, &frameFences[index], VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &frameFences[index]);
+    instbatch_init(&instanceBatch, &uploadRing, sizeof(VertexP2C));
+    for (uint32_t i = 0; i < sizeof(instanceMeshes) / sizeof(instanceMeshes[0]); ++i)
+    {
+        InstanceMesh mesh = instanceMeshes[i];
+        mesh.buffer = staticBuffer;
+        instanceMeshIds[i] = instbatch_add_mesh(&instanceBatch, &mesh);
+    }
+}
 
-    size_t uploadOffset = index * UPLOAD_REGION_SIZE;
-    size_t uploadLimit = uploadOffset + UPLOAD_REGION_SIZE;
-    uint8_t* uploadPtr = (uint8_t*)uploadBufferPtr;
+// Squares and hexagons circling on rings, each spinning at its own rate.
+void emitInstanceScene(float time)
+{
+    for (uint32_t i = 0; i < meshInstances; ++i)
+    {
+        uint32_t hash = i * 2654435761u;
+        float radius = 0.05f + 0.9f * (hash & 0xFFFF) * (1.0f / 65535.0f);
+        float angle = (hash >> 16) * (6.2831853f / 65536.0f) + time * 0.3f / radius;
+        float spin = time * (1.0f + (i & 7));
+        uint32_t rgba = 0xFF000000 | (hash & 0x7F7F7F) | 0x404040;
+        instbatch_add(&instanceBatch, instanceMeshIds[i & 1], radius * cosf(angle), radius * sinf(angle), 0.01f, spin, rgba);
+    }
+}
 
-    uint32_t mask = (SDL_GetTicks() >> 3) & 0x1FF;
-    mask = mask > 0xFF ? 0x1FF - mask : mask;
-    mask = (mask << 16) | (mask << 8) | mask;
-    VertexP2C dynamicVertices[] = {
-        { -0.5f, -1.0f, 0xFF0000FF|mask },
-        {  0.0f,  0.0f, 0xFF00FF00|mask },
-        { -1.0f,  0.0f, 0xFFFF0000|mask }
-    };
-    memcpy(uploadPtr+uploadOffset, dynamicVertices, sizeof(dynamicVertices));
-    uploadOffset += sizeof(dynamicVertices);
+// Main pass of the render graph: the frame's draws, inline or from secondaries.
+void executeMainPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    DrawList* drawList = (DrawList*)userData;
+    uint32_t drawCount = drawList->count;
 
-    VkBufferCopy bufferCopyInfo;
-    if (frameIndex == 0)
+    if (recordThreads)
     {
-        VertexP2C staticVertices[] = {
-            { 0.5f, 0.0f, 0xFF0000FF },
-            { 1.0f, 1.0f, 0xFF00FF00 },
-            { 0.0f, 1.0f, 0xFFFF0000 }
-        };
-        memcpy(uploadPtr + uploadOffset, staticVertices, sizeof(staticVertices));
-        bufferCopyInfo = (VkBufferCopy){
-            .srcOffset = uploadOffset,
-            .dstOffset = 0,
-            .size = sizeof(staticVertices),
-        };
+        VkCommandBuffer secondaries[RECORD_MAX_THREADS];
+        uint32_t secondaryCount = recorder_record(&recorder, context->renderPass, 0, context->framebuffer,
+            drawCount, recordDraws, drawList, secondaries);
+        if (secondaryCount)
+        {
+            vkCmdExecuteCommands(commandBuffer, secondaryCount, secondaries);
+        }
+    }
+    else
+    {
+        recordDraws(commandBuffer, 0, drawCount, drawList);
     }
+}
 
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[index], VK_NULL_HANDLE, &imageIndex);
+GpuProfiler gpuProfiler;
+
+// Dynamic-resolution raymarch: rtprimitives renders into the top left of a full-size target,
+// scaled to hold the GPU budget, and an upscale pass stretches it over the backbuffer.
+int raymarch = 0;
+float raymarchBudgetMs = 14.0f;
+float raymarchFixedScale = 0.0f;            // 0 - dynamic
+DynamicResolution dynamicResolution;
+float raymarchFrameScales[MAX_FRAME_COUNT]; // scale each frame slot was rendered at
+VkExtent2D raymarchExtent;                  // this frame's render size
+int tileCulling = 1;                        // compute prepass bins primitives into per-tile lists
+uint32_t sdfRepeat = 1;
+const char* cpuRenderFile = 0;              // CPU reference render of the SDF scene, written as PPM
+const char* cpuGoldenFile = 0;              // the CPU render must match this image
+uint32_t cpuGoldenTolerance = 2;            // 8-bit steps per channel
+uint32_t cpuRenderThreads = 0;              // 0 - every core
+SdfPrimitive sdfPrimitives[SDF_MAX_PRIMITIVES];
+uint32_t sdfPrimitiveCount;
+VkBuffer sdfPrimitiveBuffer;                // host visible, written once
+DeviceAllocation sdfPrimitiveMemory;
+VkDescriptorSetLayout raymarchSetLayout;
+VkDescriptorSet raymarchDescriptorSet;
+VkPipelineLayout raymarchPipelineLayout;    // shared by the raymarch and tile cull pipelines
+PipelineHandle raymarchPipelines[SDF_QUALITY_COUNT];    // requested on first use
+uint32_t raymarchQuality = SDF_QUALITY_MEDIUM;
+PipelineHandle tileCullPipeline;
+VkSampler upscaleSampler;
+VkDescriptorSetLayout upscaleSetLayout;
+VkDescriptorSet upscaleDescriptorSet;
+VkPipelineLayout upscalePipelineLayout;
+PipelineHandle upscalePipeline;
+
+// Push constants of rtprimitives.glsl-fs and tilecull.glsl-cs, see shaders/sdfscene.glsl.
+typedef struct tagFSConst
+{
+    float resolution[2];
+    float mouse[2];
+    float time;
+    uint32_t primitiveCount;
+    uint32_t tileCountX;    // 0 - no tile lists
+    uint32_t tileStride;
+} FSConst;
+
+// Push constants of upscale.glsl-fs.
+typedef struct tagUpscaleConst
+{
+    float uvScale[2];
+    float uvMax[2];
+} UpscaleConst;
 
-    VkCommandBufferBeginInfo beginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+// Near and far list per tile, each holding up to SDF_MAX_TILE_PRIMITIVES indices, after the two counts.
+uint32_t tileListStride()
+{
+    return 2 + 2 * (sdfPrimitiveCount < SDF_MAX_TILE_PRIMITIVES ? sdfPrimitiveCount : SDF_MAX_TILE_PRIMITIVES);
+}
+
+// Same for the tile cull and raymarch passes, they must agree on the camera and the tile grid.
+FSConst raymarchConstants()
+{
+    int mouseX = 0, mouseY = 0;
+    // A fixed timestep replays the same frames, the mouse would make them differ.
+    if (!headless && timestepMs <= 0.0f)
+    {
+        SDL_GetMouseState(&mouseX, &mouseY);
+    }
+    float scaleX = (float)raymarchExtent.width / swapchainExtent.width;
+    float scaleY = (float)raymarchExtent.height / swapchainExtent.height;
+    return (FSConst){
+        { (float)raymarchExtent.width, (float)raymarchExtent.height },
+        { mouseX * scaleX, mouseY * scaleY },
+        sceneTime,
+        sdfPrimitiveCount,
+        tileCulling ? (raymarchExtent.width + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE : 0,
+        tileListStride(),
     };
-    vkBeginCommandBuffer(commandBuffers[index], &beginInfo);
+}
 
-    if (frameIndex == 0)
+FSConst raymarchFrameConstants;    // set by draw_frame
+// Resolved by draw_frame, all VK_NULL_HANDLE while a pipeline the raymarch needs is still compiling.
+VkPipeline tileCullFramePipeline;
+VkPipeline raymarchFramePipeline;
+VkPipeline upscaleFramePipeline;
+
+void executeTileCullPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!tileCullFramePipeline)
     {
-        vkCmdCopyBuffer(commandBuffers[index], uploadBuffer, staticBuffer, 1, &bufferCopyInfo);
-        vkCmdPipelineBarrier(commandBuffers[index],
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 
-            1, &(VkMemoryBarrier){
-                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-                .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
-            },
-            0, NULL, 0, NULL
-        );
+        return;
     }
+    uint32_t scope = gpuprof_begin(&gpuProfiler, commandBuffer, "tile cull");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tileCullFramePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, raymarchPipelineLayout, 0, 1, &raymarchDescriptorSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, raymarchPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(FSConst), &raymarchFrameConstants);
+    vkCmdDispatch(commandBuffer, raymarchFrameConstants.tileCountX, (raymarchExtent.height + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE, 1);
+    gpuprof_end(&gpuProfiler, commandBuffer, scope);
+}
 
-    vkCmdBeginRenderPass(commandBuffers[index],
-        &(VkRenderPassBeginInfo) {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = renderPass,
-        .framebuffer = framebuffers[imageIndex],
-        .clearValueCount = 1,
-        .pClearValues = &(VkClearValue) { 0.0f, 0.1f, 0.2f, 1.0f },
-        .renderArea.offset = (VkOffset2D) { .x = 0,.y = 0 },
-        .renderArea.extent = swapchainExtent,
-        },
-        VK_SUBPASS_CONTENTS_INLINE
-    );
+void executeRaymarchPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!raymarchFramePipeline)
+    {
+        return;
+    }
+    uint32_t scope = gpuprof_begin(&gpuProfiler, commandBuffer, "raymarch");
+    vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport){ 0.0f, 0.0f, (float)raymarchExtent.width, (float)raymarchExtent.height, 0.0f, 1.0f });
+    vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D){ {0, 0}, raymarchExtent });
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, raymarchFramePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, raymarchPipelineLayout, 0, 1, &raymarchDescriptorSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, raymarchPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(FSConst), &raymarchFrameConstants);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    gpuprof_end(&gpuProfiler, commandBuffer, scope);
+}
 
-    vkCmdBindPipeline(commandBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-    vkCmdSetViewport(commandBuffers[index], 0, 1, &(VkViewport){ 0.0f, 0.0f, (float)swapchainExtent.width, (float)swapchainExtent.height, 0.0f, 1.0f});
-    vkCmdSetScissor(commandBuffers[index], 0, 1, &(VkRect2D){ {0, 0}, swapchainExtent});
+void executeUpscalePass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!upscaleFramePipeline)
+    {
+        return;
+    }
+    // The source is as large as the output; only its top left raymarchExtent was rendered this frame.
+    float sourceWidth = (float)context->extent.width, sourceHeight = (float)context->extent.height;
+    UpscaleConst constants = {
+        { raymarchExtent.width / (sourceWidth * sourceWidth), raymarchExtent.height / (sourceHeight * sourceHeight) },
+        { (raymarchExtent.width - 0.5f) / sourceWidth, (raymarchExtent.height - 0.5f) / sourceHeight },
+    };
 
-    vkCmdBindVertexBuffers(commandBuffers[index], 0, 1, &uploadBuffer, (VkDeviceSize[]) { 0 });
-    vkCmdDraw(commandBuffers[index], 3, 1, 0, 0);
+    uint32_t scope = gpuprof_begin(&gpuProfiler, commandBuffer, "upscale");
+    vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport){ 0.0f, 0.0f, sourceWidth, sourceHeight, 0.0f, 1.0f });
+    vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D){ {0, 0}, context->extent });
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscaleFramePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &upscaleDescriptorSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    gpuprof_end(&gpuProfiler, commandBuffer, scope);
+}
 
-    vkCmdBindVertexBuffers(commandBuffers[index], 0, 1, &staticBuffer, (VkDeviceSize[]) { 0 });
-    vkCmdDraw(commandBuffers[index], 3, 1, 0, 0);
+CullObject* gpuObjects;                     // CPU copy for --object-check, else freed once uploaded
+float gpuObjectWorldHalfSize;
+VkBuffer gpuObjectBuffer;                   // CullObject per object
+DeviceAllocation gpuObjectMemory;
+VkBuffer gpuMeshBuffer;                     // CullMesh per mesh, then the vertices, then the indices
+DeviceAllocation gpuMeshMemory;
+VkDeviceSize gpuMeshVertexOffset;
+VkDeviceSize gpuMeshIndexOffset;
+uint64_t gpuObjectUploadId;
+VkBuffer gpuObjectStatsBuffer;              // visible count per frame slot, host visible
+DeviceAllocation gpuObjectStatsMemory;
+VkDescriptorSetLayout gpuObjectSetLayout;
+VkPipelineLayout gpuObjectPipelineLayout;   // shared by the cull and draw pipelines
+PipelineHandle objectCullPipeline;
+PipelineHandle objectDrawPipeline;
+#ifdef VK_KHR_draw_indirect_count
+PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount;
+#endif
+uint32_t gpuObjectDrawsResource = RG_INVALID;
+uint32_t gpuObjectCountResource = RG_INVALID;
+
+// This frame's objects, set by draw_frame before the graph runs. Null pipelines skip the object passes.
+VkPipeline objectCullFramePipeline;
+VkPipeline objectDrawFramePipeline;
+VkDescriptorSet gpuObjectDescriptorSet;
+CullConst gpuObjectFrameConstants;
+uint32_t gpuObjectFrameIndex;
+
+// Visible counts read back per frame slot.
+CullConst gpuObjectSlotConstants[MAX_FRAME_COUNT];
+int gpuObjectSlotPending[MAX_FRAME_COUNT];
+uint64_t gpuObjectVisibleSum;
+uint32_t gpuObjectVisibleFrames;
+uint32_t gpuObjectLastVisible;
+uint32_t gpuObjectMismatches;               // frames whose GPU count differed from the CPU one
+
+void executeObjectCountClearPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!objectCullFramePipeline)
+    {
+        return;
+    }
+    vkCmdFillBuffer(commandBuffer, rg_buffer(context->graph, gpuObjectCountResource), 0, sizeof(uint32_t), 0);
+}
 
-    vkCmdEndRenderPass(commandBuffers[index]);
+void executeObjectCullPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!objectCullFramePipeline)
+    {
+        return;
+    }
+    uint32_t scope = gpuprof_begin(&gpuProfiler, commandBuffer, "object cull");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, objectCullFramePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuObjectPipelineLayout, 0, 1, &gpuObjectDescriptorSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, gpuObjectPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(CullConst), &gpuObjectFrameConstants);
+    vkCmdDispatch(commandBuffer, (gpuObjectCount + GPUCULL_GROUP_SIZE - 1) / GPUCULL_GROUP_SIZE, 1, 1);
+    gpuprof_end(&gpuProfiler, commandBuffer, scope);
+}
 
-    vkEndCommandBuffer(commandBuffers[index]);
+// One draw call for every object, however many there are and however many survive culling.
+void executeObjectsPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!objectDrawFramePipeline)
+    {
+        return;
+    }
+    uint32_t scope = gpuprof_begin(&gpuProfiler, commandBuffer, "objects");
+    vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport){ 0.0f, 0.0f, (float)context->extent.width, (float)context->extent.height, 0.0f, 1.0f });
+    vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D){ {0, 0}, context->extent });
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, objectDrawFramePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gpuObjectPipelineLayout, 0, 1, &gpuObjectDescriptorSet, 0, 0);
+    vkCmdPushConstants(commandBuffer, gpuObjectPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(CullConst), &gpuObjectFrameConstants);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &gpuMeshBuffer, &gpuMeshVertexOffset);
+    vkCmdBindIndexBuffer(commandBuffer, gpuMeshBuffer, gpuMeshIndexOffset, VK_INDEX_TYPE_UINT16);
+
+    VkBuffer draws = rg_buffer(context->graph, gpuObjectDrawsResource);
+#ifdef VK_KHR_draw_indirect_count
+    if (indirectCount)
+    {
+        cmdDrawIndexedIndirectCount(commandBuffer, draws, 0, rg_buffer(context->graph, gpuObjectCountResource), 0,
+            gpuObjectCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+#endif
+    {
+        // Culled objects keep their slot with instanceCount 0.
+        vkCmdDrawIndexedIndirect(commandBuffer, draws, 0, gpuObjectCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    gpuprof_end(&gpuProfiler, commandBuffer, scope);
+}
 
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &imageAvailableSemaphores[index],
-        .pWaitDstStageMask = (VkPipelineStageFlags[]) { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT },
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffers[index],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &renderFinishedSemaphores[index],
-    };
-    vkQueueSubmit(queue, 1, &submitInfo, frameFences[index]);
+// Copies the visible count to the frame slot's stats word, read once the slot comes around again.
+void executeObjectStatsPass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    if (!objectCullFramePipeline)
+    {
+        return;
+    }
+    VkBufferCopy region = { 0, gpuObjectFrameIndex * sizeof(uint32_t), sizeof(uint32_t) };
+    vkCmdCopyBuffer(commandBuffer, rg_buffer(context->graph, gpuObjectCountResource), gpuObjectStatsBuffer, 1, &region);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &(VkMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        },
+        0, 0, 0, 0);
+}
 
-    VkPresentInfoKHR presentInfo = {
-        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &renderFinishedSemaphores[index],
-        .swapchainCount = 1,
-        .pSwapchains = &swapchain,
-        .pImageIndices = &imageIndex,
-    };
-    vkQueuePresentKHR(queue, &presentInfo);
+FrameCapture frameCapture;
+uint64_t captureFrameSerial;    // set by draw_frame before the graph runs
 
-    ++frameIndex;
+// Readback goes to host-cached memory when there is some, the CPU reads every byte of it.
+int initCapture()
+{
+    if (!capture_supports_format(surfaceFormat.format))
+    {
+        printf("Capture: backbuffer format %d is not supported\n", surfaceFormat.format);
+        return 0;
+    }
+    uint32_t memoryTypes = compatibleMemTypes[VULKAN_MEM_DEVICE_READBACK] ? compatibleMemTypes[VULKAN_MEM_DEVICE_READBACK]
+        : compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD];
+    // Frames in flight plus two the writer can be busy with before frames are dropped.
+    uint32_t slotCount = frameCount + 2 < CAPTURE_MAX_SLOTS ? frameCount + 2 : CAPTURE_MAX_SLOTS;
+    if (!capture_init(&frameCapture, device, &deviceAllocator, memoryTypes, deviceProperties.limits.nonCoherentAtomSize,
+        captureFile, surfaceFormat.format, swapchainExtent, slotCount, captureFps))
+    {
+        printf("Capture: failed to set up capture to %s\n", captureFile);
+        capture_destroy(&frameCapture);
+        return 0;
+    }
+    return 1;
 }
 
-//----------------------------------------------------------
+// Copies the finished backbuffer into the next readback buffer, if the writer has one free.
+void executeCapturePass(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData)
+{
+    capture_frame(&frameCapture, commandBuffer, rg_image(context->graph, backbufferResource), swapchainExtent, captureFrameSerial);
+}
 
-int main(int argc, char *argv[])
+RenderGraph renderGraph;
+uint32_t backbufferResource;
+uint32_t raymarchResource = RG_INVALID;
+uint32_t tileListResource = RG_INVALID;
+DrawList mainPassDraws;     // filled by draw_frame before the graph runs
+
+int createRenderGraph()
 {
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+    rg_init(&renderGraph, device, &deviceAllocator, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL],
+        deviceProperties.limits.bufferImageGranularity);
 
-    int run = init_vulkan() && init_window() && init_device() && init_swapchain() && init_render();
-    while (run)
+    // Presented images come back from the presentation engine, headless ones were last a copy source.
+    uint32_t backbufferAccess = headless ? RG_ACCESS_TRANSFER_READ : RG_ACCESS_PRESENT;
+    backbufferResource = rg_import_image(&renderGraph, "backbuffer", surfaceFormat.format, swapchainExtent,
+        backbufferAccess, backbufferAccess);
+
+    if (raymarch)
     {
-        SDL_Event evt;
-        while (SDL_PollEvent(&evt))
+        // The tile list size depends on the scene.
+        sdfPrimitiveCount = sdfscene_build(sdfPrimitives, SDF_MAX_PRIMITIVES, sdfRepeat);
+        // Same format as the backbuffer, so the pipeline works with the compatibility render pass.
+        raymarchResource = rg_create_image(&renderGraph, "raymarch", surfaceFormat.format, swapchainExtent);
+        uint32_t raymarchPass;
+        if (tileCulling)
         {
-            if (evt.type == SDL_QUIT)
-            {
-                run = 0;
-            }
+            // Sized for the tile grid at full scale.
+            uint32_t tileCount = ((swapchainExtent.width + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE)
+                * ((swapchainExtent.height + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE);
+            tileListResource = rg_create_buffer(&renderGraph, "tile lists", (VkDeviceSize)tileCount * tileListStride() * sizeof(uint32_t));
+            uint32_t tileCullPass = rg_add_pass(&renderGraph, "tile cull", RG_PASS_COMPUTE, 0, executeTileCullPass, 0);
+            rg_use(&renderGraph, tileCullPass, tileListResource, RG_ACCESS_STORAGE_WRITE);
+            raymarchPass = rg_add_pass(&renderGraph, "raymarch", RG_PASS_GRAPHICS, 0, executeRaymarchPass, 0);
+            rg_use(&renderGraph, raymarchPass, tileListResource, RG_ACCESS_STORAGE_READ);
+        }
+        else
+        {
+            raymarchPass = rg_add_pass(&renderGraph, "raymarch", RG_PASS_GRAPHICS, 0, executeRaymarchPass, 0);
         }
+        rg_use(&renderGraph, raymarchPass, raymarchResource, RG_ACCESS_COLOR_WRITE);
 
-        draw_frame();
+        uint32_t upscalePass = rg_add_pass(&renderGraph, "upscale", RG_PASS_GRAPHICS, 0, executeUpscalePass, 0);
+        rg_use(&renderGraph, upscalePass, raymarchResource, RG_ACCESS_SAMPLED_READ);
+        rg_use(&renderGraph, upscalePass, backbufferResource, RG_ACCESS_COLOR_WRITE);
+        rg_clear(&renderGraph, upscalePass, backbufferResource, (VkClearValue) { 0.0f, 0.1f, 0.2f, 1.0f });
+    }
+
+    if (gpuObjectCount)
+    {
+        gpuObjectDrawsResource = rg_create_buffer(&renderGraph, "object draws",
+            (VkDeviceSize)gpuObjectCount * sizeof(VkDrawIndexedIndirectCommand));
+        gpuObjectCountResource = rg_create_buffer(&renderGraph, "object count", sizeof(uint32_t));
+        uint32_t clearPass = rg_add_pass(&renderGraph, "object count clear", RG_PASS_TRANSFER, 0, executeObjectCountClearPass, 0);
+        rg_use(&renderGraph, clearPass, gpuObjectCountResource, RG_ACCESS_TRANSFER_WRITE);
+        uint32_t cullPass = rg_add_pass(&renderGraph, "object cull", RG_PASS_COMPUTE, 0, executeObjectCullPass, 0);
+        rg_use(&renderGraph, cullPass, gpuObjectCountResource, RG_ACCESS_STORAGE_WRITE);
+        rg_use(&renderGraph, cullPass, gpuObjectDrawsResource, RG_ACCESS_STORAGE_WRITE);
+        uint32_t objectsPass = rg_add_pass(&renderGraph, "objects", RG_PASS_GRAPHICS, 0, executeObjectsPass, 0);
+        rg_use(&renderGraph, objectsPass, gpuObjectDrawsResource, RG_ACCESS_INDIRECT_READ);
+        rg_use(&renderGraph, objectsPass, gpuObjectCountResource, RG_ACCESS_INDIRECT_READ);
+        rg_use(&renderGraph, objectsPass, backbufferResource, RG_ACCESS_COLOR_WRITE);
+        if (!raymarch)
+        {
+            rg_clear(&renderGraph, objectsPass, backbufferResource, (VkClearValue) { 0.0f, 0.1f, 0.2f, 1.0f });
+        }
+        uint32_t statsPass = rg_add_pass(&renderGraph, "object stats", RG_PASS_TRANSFER, RG_PASS_SIDE_EFFECTS,
+            executeObjectStatsPass, 0);
+        rg_use(&renderGraph, statsPass, gpuObjectCountResource, RG_ACCESS_TRANSFER_READ);
     }
 
-    fini_render();
-    fini_swapchain();
-    fini_device();
-    fini_window();
-    fini_vulkan();
+    uint32_t mainPass = rg_add_pass(&renderGraph, "main", RG_PASS_GRAPHICS, recordThreads ? RG_PASS_SECONDARY : 0,
+        executeMainPass, &mainPassDraws);
+    rg_use(&renderGraph, mainPass, backbufferResource, RG_ACCESS_COLOR_WRITE);
+    if (!raymarch && !gpuObjectCount)
+    {
+        rg_clear(&renderGraph, mainPass, backbufferResource, (VkClearValue) { 0.0f, 0.1f, 0.2f, 1.0f });
+    }
 
-    SDL_Quit();
+    if (captureFile)
+    {
+        uint32_t capturePass = rg_add_pass(&renderGraph, "capture", RG_PASS_TRANSFER, RG_PASS_SIDE_EFFECTS, executeCapturePass, 0);
+        rg_use(&renderGraph, capturePass, backbufferResource, RG_ACCESS_TRANSFER_READ);
+    }
 
-    return 0;
+    return rg_compile(&renderGraph);
+}
+
+// Every tier is the same SPIR-V module, the tier's knobs go in as specialization constants.
+PipelineHandle requestRaymarchPipeline(uint32_t quality, PipelineHandle fallback)
+{
+    const SdfQuality* tier = sdfscene_quality(quality);
+    PipelineDesc desc = {
+        .vertexShader = "shaders/fullscreentri.spv-vs",
+        .fragmentShader = "shaders/rtprimitives.spv-fs",
+        .layout = raymarchPipelineLayout,
+        .renderPass = renderPass,
+        .cullMode = VK_CULL_MODE_NONE,
+        .constantCount = 4,
+        .constants = { tier->aa, tier->marchSteps, tier->shadowSteps, tier->aoTaps },
+    };
+    return pipemgr_request(&pipelineManager, &desc, fallback);
+}
+
+// The current tier keeps drawing until the new one is compiled. Frames in flight may still
+// use any tier's pipeline, so pipelines live until shutdown.
+int setRaymarchQuality(uint32_t quality)
+{
+    if (!raymarchPipelines[quality])
+    {
+        raymarchPipelines[quality] = requestRaymarchPipeline(quality, raymarchPipelines[raymarchQuality]);
+    }
+    if (!raymarchPipelines[quality])
+    {
+        return 0;
+    }
+    raymarchQuality = quality;
+    return 1;
+}
+
+// Call every frame after beginFrameDescriptors, the sets point at the current render graph's transient image and
+// buffer. Frames still in flight keep the sets they were recorded with, so rebuilding the graph never waits on them.
+int updateRaymarchDescriptors()
+{
+    raymarchDescriptorSet = descalloc_alloc(&frameDescriptors, raymarchSetLayout);
+    upscaleDescriptorSet = descalloc_alloc(&frameDescriptors, upscaleSetLayout);
+    if (!raymarchDescriptorSet || !upscaleDescriptorSet)
+    {
+        return 0;
+    }
+
+    // Without tile culling the shaders never read the tile lists, but the binding still needs a buffer.
+    VkBuffer tileListBuffer = tileCulling ? rg_buffer(&renderGraph, tileListResource) : sdfPrimitiveBuffer;
+    VkWriteDescriptorSet writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = raymarchDescriptorSet,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &(VkDescriptorBufferInfo) { sdfPrimitiveBuffer, 0, VK_WHOLE_SIZE },
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = raymarchDescriptorSet,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .pBufferInfo = &(VkDescriptorBufferInfo) { tileListBuffer, 0, VK_WHOLE_SIZE },
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = upscaleDescriptorSet,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .pImageInfo = &(VkDescriptorImageInfo) {
+                .imageView = rg_view(&renderGraph, raymarchResource),
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            },
+        },
+    };
+    vkUpdateDescriptorSets(device, sizeof(writes) / sizeof(writes[0]), writes, 0, 0);
+    return 1;
+}
+
+int createRaymarchResources()
+{
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = sdfPrimitiveCount * sizeof(SdfPrimitive),
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    vkCreateBuffer(device, &bufferCreateInfo, 0, &sdfPrimitiveBuffer);
+    if (!devmem_alloc_buffer(&deviceAllocator, sdfPrimitiveBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD], &sdfPrimitiveMemory))
+    {
+        return 0;
+    }
+    memcpy(sdfPrimitiveMemory.mapped, sdfPrimitives, sdfPrimitiveCount * sizeof(SdfPrimitive));
+
+    VkSamplerCreateInfo samplerCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .maxLod = 0.0f,
+    };
+    vkCreateSampler(device, &samplerCreateInfo, 0, &upscaleSampler);
+
+    VkDescriptorSetLayoutCreateInfo raymarchSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 2,
+        .pBindings = (VkDescriptorSetLayoutBinding[]) {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0 },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0 },
+        },
+    };
+    vkCreateDescriptorSetLayout(device, &raymarchSetLayoutCreateInfo, 0, &raymarchSetLayout);
+
+    VkDescriptorSetLayoutCreateInfo upscaleSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 1,
+        .pBindings = &(VkDescriptorSetLayoutBinding) {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .pImmutableSamplers = &upscaleSampler,
+        },
+    };
+    vkCreateDescriptorSetLayout(device, &upscaleSetLayoutCreateInfo, 0, &upscaleSetLayout);
+
+    VkPipelineLayoutCreateInfo raymarchLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &raymarchSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &(VkPushConstantRange) { VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FSConst) },
+    };
+    vkCreatePipelineLayout(device, &raymarchLayoutCreateInfo, 0, &raymarchPipelineLayout);
+
+    VkPipelineLayoutCreateInfo upscaleLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &upscaleSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &(VkPushConstantRange) { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscaleConst) },
+    };
+    vkCreatePipelineLayout(device, &upscaleLayoutCreateInfo, 0, &upscalePipelineLayout);
+
+    // Compiled in the background, the raymarch passes are skipped until all of them are in.
+    setRaymarchQuality(raymarchQuality);
+    upscalePipeline = pipemgr_request(&pipelineManager, &(PipelineDesc) {
+        .vertexShader = "shaders/fullscreentri.spv-vs",
+        .fragmentShader = "shaders/upscale.spv-fs",
+        .layout = upscalePipelineLayout,
+        .renderPass = renderPass,
+        .cullMode = VK_CULL_MODE_NONE,
+    }, 0);
+    tileCullPipeline = pipemgr_request(&pipelineManager, &(PipelineDesc) {
+        .computeShader = "shaders/tilecull.spv-cs",
+        .layout = raymarchPipelineLayout,
+    }, 0);
+
+    float minScale = raymarchFixedScale ? raymarchFixedScale : 0.25f;
+    float maxScale = raymarchFixedScale ? raymarchFixedScale : 1.0f;
+    dynres_init(&dynamicResolution, raymarchBudgetMs, minScale, maxScale);
+
+    return raymarchPipelines[raymarchQuality] != 0 && upscalePipeline != 0 && tileCullPipeline != 0;
+}
+
+// Call after the pipeline manager is destroyed, it owns the raymarch pipelines.
+void destroyRaymarchResources()
+{
+    vkDestroyPipelineLayout(device, upscalePipelineLayout, 0);
+    vkDestroyPipelineLayout(device, raymarchPipelineLayout, 0);
+    vkDestroyDescriptorSetLayout(device, upscaleSetLayout, 0);
+    vkDestroyDescriptorSetLayout(device, raymarchSetLayout, 0);
+    vkDestroySampler(device, upscaleSampler, 0);
+    vkDestroyBuffer(device, sdfPrimitiveBuffer, 0);
+    devmem_free(&deviceAllocator, &sdfPrimitiveMemory);
+}
+
+int createGpuObjectResources()
+{
+#ifdef VK_KHR_draw_indirect_count
+    cmdDrawIndexedIndirectCount = indirectCount
+        ? (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR") : 0;
+    indirectCount = cmdDrawIndexedIndirectCount != 0;
+#endif
+
+    gpuObjects = (CullObject*)malloc(gpuObjectCount * sizeof(CullObject));
+    if (!gpuObjects)
+    {
+        return 0;
+    }
+    gpuObjectWorldHalfSize = gpucull_build_objects(gpuObjects, gpuObjectCount);
+
+    float vertices[GPUCULL_VERTEX_COUNT * 2];
+    uint16_t indices[GPUCULL_INDEX_COUNT];
+    CullMesh meshes[GPUCULL_MESH_COUNT];
+    gpucull_build_meshes(vertices, indices, meshes);
+    gpuMeshVertexOffset = sizeof(meshes);
+    gpuMeshIndexOffset = gpuMeshVertexOffset + sizeof(vertices);
+
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = gpuObjectCount * sizeof(CullObject),
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    vkCreateBuffer(device, &bufferCreateInfo, 0, &gpuObjectBuffer);
+    if (!devmem_alloc_buffer(&deviceAllocator, gpuObjectBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &gpuObjectMemory))
+    {
+        return 0;
+    }
+    bufferCreateInfo.size = gpuMeshIndexOffset + sizeof(indices);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+        | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    vkCreateBuffer(device, &bufferCreateInfo, 0, &gpuMeshBuffer);
+    if (!devmem_alloc_buffer(&deviceAllocator, gpuMeshBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &gpuMeshMemory))
+    {
+        return 0;
+    }
+    bufferCreateInfo.size = MAX_FRAME_COUNT * sizeof(uint32_t);
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    vkCreateBuffer(device, &bufferCreateInfo, 0, &gpuObjectStatsBuffer);
+    if (!devmem_alloc_buffer(&deviceAllocator, gpuObjectStatsBuffer, compatibleMemTypes[VULKAN_MEM_DEVICE_UPLOAD], &gpuObjectStatsMemory))
+    {
+        return 0;
+    }
+
+    // Device local and uploaded once, the objects are drawn from the first frame that has acquired them.
+    int uploaded = transfer_upload_buffer(&transfer, gpuObjectBuffer, 0, gpuObjects, gpuObjectCount * sizeof(CullObject))
+        && transfer_upload_buffer(&transfer, gpuMeshBuffer, 0, meshes, sizeof(meshes))
+        && transfer_upload_buffer(&transfer, gpuMeshBuffer, gpuMeshVertexOffset, vertices, sizeof(vertices))
+        && transfer_upload_buffer(&transfer, gpuMeshBuffer, gpuMeshIndexOffset, indices, sizeof(indices));
+    gpuObjectUploadId = uploaded ? transfer_flush(&transfer) : 0;
+    if (!gpuObjectCheck)
+    {
+        free(gpuObjects);
+        gpuObjects = 0;
+    }
+    if (!gpuObjectUploadId)
+    {
+        return 0;
+    }
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 4,
+        .pBindings = (VkDescriptorSetLayoutBinding[]) {
+            { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages, 0 },
+            { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0 },
+            { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0 },
+            { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0 },
+        },
+    };
+    vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, 0, &gpuObjectSetLayout);
+
+    VkPipelineLayoutCreateInfo layoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &gpuObjectSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &(VkPushConstantRange) { stages, 0, sizeof(CullConst) },
+    };
+    vkCreatePipelineLayout(device, &layoutCreateInfo, 0, &gpuObjectPipelineLayout);
+
+    objectCullPipeline = pipemgr_request(&pipelineManager, &(PipelineDesc) {
+        .computeShader = "shaders/objectcull.spv-cs",
+        .layout = gpuObjectPipelineLayout,
+    }, 0);
+    objectDrawPipeline = pipemgr_request(&pipelineManager, &(PipelineDesc) {
+        .vertexShader = "shaders/objects.spv-vs",
+        .fragmentShader = "shaders/vertex_color.spv-fs",
+        .layout = gpuObjectPipelineLayout,
+        .renderPass = renderPass,
+        .vertexStride = 2 * sizeof(float),
+        .attributeCount = 1,
+        .attributes = { {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = 0} },
+        .cullMode = VK_CULL_MODE_NONE,
+    }, 0);
+
+    return objectCullPipeline != 0 && objectDrawPipeline != 0;
+}
+
+// Call after the pipeline manager is destroyed, it owns the object pipelines.
+void destroyGpuObjectResources()
+{
+    vkDestroyPipelineLayout(device, gpuObjectPipelineLayout, 0);
+    vkDestroyDescriptorSetLayout(device, gpuObjectSetLayout, 0);
+    vkDestroyBuffer(device, gpuObjectStatsBuffer, 0);
+    devmem_free(&deviceAllocator, &gpuObjectStatsMemory);
+    vkDestroyBuffer(device, gpuMeshBuffer, 0);
+    devmem_free(&deviceAllocator, &gpuMeshMemory);
+    vkDestroyBuffer(device, gpuObjectBuffer, 0);
+    devmem_free(&deviceAllocator, &gpuObjectMemory);
+    free(gpuObjects);
+}
+
+// Picks this frame's view and set, or leaves the object passes empty until the pipelines and data are in.
+void prepareGpuObjects(uint32_t index)
+{
+    objectCullFramePipeline = pipemgr_get(&pipelineManager, objectCullPipeline);
+    objectDrawFramePipeline = pipemgr_get(&pipelineManager, objectDrawPipeline);
+    gpuObjectDescriptorSet = objectCullFramePipeline && objectDrawFramePipeline && transfer_is_acquired(&transfer, gpuObjectUploadId)
+        ? descalloc_alloc(&frameDescriptors, gpuObjectSetLayout) : VK_NULL_HANDLE;
+    if (!gpuObjectDescriptorSet)
+    {
+        objectCullFramePipeline = objectDrawFramePipeline = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = gpuObjectDescriptorSet,
+        .dstBinding = 0,
+        .descriptorCount = 4,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = (VkDescriptorBufferInfo[]) {
+            { gpuObjectBuffer, 0, VK_WHOLE_SIZE },
+            { gpuMeshBuffer, 0, gpuMeshVertexOffset },
+            { rg_buffer(&renderGraph, gpuObjectDrawsResource), 0, VK_WHOLE_SIZE },
+            { rg_buffer(&renderGraph, gpuObjectCountResource), 0, VK_WHOLE_SIZE },
+        },
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, 0);
+
+    CullConst* constants = &gpuObjectFrameConstants;
+    gpucull_view(sceneTime, (float)swapchainExtent.width / swapchainExtent.height, gpuObjectWorldHalfSize, constants->view);
+    constants->objectCount = gpuObjectCount;
+    constants->compact = indirectCount;
+    constants->time = sceneTime;
+    gpuObjectFrameIndex = index;
+    gpuObjectSlotConstants[index] = *constants;
+    gpuObjectSlotPending[index] = 1;
+}
+
+// Call once the slot's frame has finished.
+void collectGpuObjectStats(uint32_t index)
+{
+    if (!gpuObjectSlotPending[index])
+    {
+        return;
+    }
+    gpuObjectSlotPending[index] = 0;
+
+    uint32_t visible = ((const uint32_t*)gpuObjectStatsMemory.mapped)[index];
+    gpuObjectLastVisible = visible;
+    gpuObjectVisibleSum += visible;
+    ++gpuObjectVisibleFrames;
+    if (gpuObjects && visible != gpucull_count_visible(gpuObjects, gpuObjectCount, gpuObjectSlotConstants[index].view))
+    {
+        ++gpuObjectMismatches;
+    }
+}
+
+FrameScheduler frameScheduler;
+VkCommandPool commandPool;
+VkCommandBuffer commandBuffers[MAX_FRAME_COUNT];
+VkSemaphore imageAvailableSemaphores[MAX_FRAME_COUNT];
+VkSemaphore renderFinishedSemaphores[MAX_FRAME_COUNT];
+const char* gpuTraceFile = 0;
+const char* gpuCsvFile = 0;
+const char* cpuTraceFile = 0;
+
+uint32_t benchmarkSampleCount = 0;
+float* cpuFrameTimes = 0;   // ms
+float* gpuFrameTimes = 0;   // ms, 0 if frame had no GPU timing
+uint32_t gpuSampleCount = 0;
+uint64_t gpuFrameSerials[MAX_FRAME_COUNT];  // serial last submitted from each slot
+uint64_t uploadBytesSum = 0;    // measured frames only
+uint64_t uploadBytesMax = 0;
+uint32_t uploadFrames = 0;
+float sceneScale = 1.0f;        // multiplies the 2D primitive, instance and object counts
+const char* resultsFile = 0;
+const char* baselineFile = 0;
+float regressionTolerance = 0.1f;
+int benchmarkRegressed = 0;     // a metric exceeded the baseline, fails the run
+int benchmarkProduced = 0;      // results were collected and written, a run given --results or --baseline fails without them
+
+PresentPacer presentPacer;
+int framePacing = 1;            // windowed mode only
+uint64_t frameInputNs;          // when the frame being drawn sampled input, cpuprof_now_ns clock
+
+// A replaced swapchain with everything built for it, kept until the frames that used it are done.
+typedef struct tagRetiredSwapchain
+{
+    VkSwapchainKHR swapchain;
+    uint32_t imageCount;
+    VkImageView views[MAX_SWAPCHAIN_IMAGES];
+    RenderGraph* graph;         // its framebuffers use the views, 0 if the graph was kept
+    uint64_t serial;            // last frame that may have used it
+} RetiredSwapchain;
+
+RetiredSwapchain retiredSwapchains[MAX_RETIRED_SWAPCHAINS];
+uint32_t retiredSwapchainCount = 0;
+uint32_t swapchainRecreateCount = 0;
+
+void destroyRetiredSwapchains(uint64_t completedSerial)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retiredSwapchainCount; ++i)
+    {
+        RetiredSwapchain* retired = &retiredSwapchains[i];
+        if (retired->serial > completedSerial)
+        {
+            retiredSwapchains[kept++] = *retired;
+            continue;
+        }
+        if (retired->graph)
+        {
+            rg_destroy(retired->graph);
+            free(retired->graph);
+        }
+        for (uint32_t j = 0; j < retired->imageCount; ++j)
+        {
+            vkDestroyImageView(device, retired->views[j], 0);
+        }
+        vkDestroySwapchainKHR(device, retired->swapchain, 0);
+    }
+    retiredSwapchainCount = kept;
+}
+
+// Replaces the swapchain without waiting for the GPU. The old one goes in as oldSwapchain, so the
+// presentation engine can hand over, and it is destroyed with its views and render graph once the last
+// frame submitted before the switch has finished. Vulkan 1.0 has no signal for when the presentation
+// engine lets go of an image, the frame's fence is the one every implementation honours.
+// Returns 0 while there is nothing to draw to; the caller skips the frame and tries again.
+int recreateSwapchain()
+{
+    if (retiredSwapchainCount == MAX_RETIRED_SWAPCHAINS)
+    {
+        frame_wait(&frameScheduler, retiredSwapchains[0].serial);
+        destroyRetiredSwapchains(frame_completed(&frameScheduler));
+    }
+
+    RetiredSwapchain* retired = &retiredSwapchains[retiredSwapchainCount];
+    *retired = (RetiredSwapchain){ swapchain, swapchainImageCount, { 0 }, 0, frameScheduler.submittedSerial };
+    memcpy(retired->views, swapchainImageViews, swapchainImageCount * sizeof(VkImageView));
+    if (!createSwapchain(swapchain) && swapchain == retired->swapchain)
+    {
+        return 0;   // minimized, the old swapchain is untouched
+    }
+    ++retiredSwapchainCount;
+    swapchainImageCount = swapchain ? swapchainImageCount : 0;
+    if (!swapchain)
+    {
+        return 0;
+    }
+    createSwapchainViews();
+
+    // Sized for the swapchain, the old graph stays alive for the frames still using it.
+    retired->graph = (RenderGraph*)malloc(sizeof(RenderGraph));
+    if (!retired->graph)
+    {
+        return 0;
+    }
+    *retired->graph = renderGraph;
+    if (!createRenderGraph())
+    {
+        // Retried with the next frame, the old graph doesn't fit the new swapchain.
+        rg_destroy(&renderGraph);
+        renderGraph = *retired->graph;
+        free(retired->graph);
+        retired->graph = 0;
+        return 0;
+    }
+    swapchainDirty = 0;
+    ++swapchainRecreateCount;
+    printf("Swapchain: %ux%u, %u images, %s\n", swapchainExtent.width, swapchainExtent.height, swapchainImageCount,
+        present_mode_name(presentMode));
+    return 1;
+}
+
+int init_render()
+{
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueFamilyIndex,
+    };
+
+    vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &commandPool);
+
+    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = frameCount,
+    };
+
+    vkAllocateCommandBuffers(device, &commandBufferAllocInfo, commandBuffers);
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &imageAvailableSemaphores[i]);
+        vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &renderFinishedSemaphores[i]);
+    }
+
+    if (!frame_init(&frameScheduler, device, frameCount, timelineSemaphores))
+    {
+        return 0;
+    }
+    // Sized for a frame's draw constant sets and the raymarch and object sets, busier frames chain more pools.
+    VkDescriptorPoolSize framePoolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, FRAME_DESCRIPTOR_SETS },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+    };
+    if (!descalloc_init(&frameDescriptors, device, frameCount, FRAME_DESCRIPTOR_SETS, framePoolSizes,
+        sizeof(framePoolSizes) / sizeof(framePoolSizes[0])))
+    {
+        return 0;
+    }
+
+    gpuprof_init(&gpuProfiler, device, deviceProperties.limits.timestampPeriod, timestampValidBits, frameCount);
+    gpuprof_calibrate(&gpuProfiler, queue, queueFamilyIndex, cpuprof_now_ns);
+    present_pacer_init(&presentPacer, framePacing && !headless);
+
+    if (benchmarkFrames)
+    {
+        cpuFrameTimes = (float*)calloc(benchmarkFrames, sizeof(float));
+        gpuFrameTimes = (float*)calloc(benchmarkFrames, sizeof(float));
+    }
+
+    if (captureFile && !initCapture())
+    {
+        captureFile = 0;
+    }
+
+    createRenderPass();
+    createSwapchainViews();
+    if (!createRenderGraph())
+    {
+        return 0;
+    }
+    createPipelineCache();
+    openShaderPak();
+    if (!pipemgr_init(&pipelineManager, device, pipelineCache, &shaderPak, 0, shaderReload && !headless))
+    {
+        return 0;
+    }
+    // Static uploads start before the pipelines are waited for.
+    createUploadBuffer();
+    createPipeline();
+    if (raymarch && !createRaymarchResources())
+    {
+        return 0;
+    }
+    if (gpuObjectCount && !createGpuObjectResources())
+    {
+        return 0;
+    }
+    // Windowed mode starts drawing right away and reports once the pipelines are in.
+    // Benchmarks time complete frames, so headless runs wait for them.
+    if (headless)
+    {
+        pipemgr_wait_idle(&pipelineManager);
+        reportPipelineCache();
+        if (pipelineManager.stats.failed)
+        {
+            return 0;
+        }
+    }
+    batch2d_init(&batch2d, &uploadRing, vertexFormat);
+    if (batchPrimitives)
+    {
+        captureBatchOverlay();
+    }
+    initInstanceBatch();
+
+    uint32_t threads = recordBenchDraws ? RECORD_MAX_THREADS : recordThreads;
+    if (threads)
+    {
+        recorder_init(&recorder, device, queueFamilyIndex, threads, frameCount);
+    }
+
+    return 1;
+}
+
+void fini_render()
+{
+    vkDeviceWaitIdle(device);
+    if (captureFile)
+    {
+        capture_destroy(&frameCapture);
+    }
+    destroyRetiredSwapchains(UINT64_MAX);
+    if (recorder.threadCount)
+    {
+        recorder_destroy(&recorder);
+    }
+    batch2d_list_free(&batchOverlay);
+    batch2d_destroy(&batch2d);
+    destroyUploadBuffer();
+    if (!pipelineCacheReported)
+    {
+        reportPipelineCache();
+    }
+    pipemgr_destroy(&pipelineManager);
+    shaderpak_close(&shaderPak);
+    if (raymarch)
+    {
+        destroyRaymarchResources();
+    }
+    if (gpuObjectCount)
+    {
+        destroyGpuObjectResources();
+    }
+    destroyPipeline();
+    destroyPipelineCache();
+    rg_destroy(&renderGraph);
+    destroySwapchainViews();
+    destroyRenderPass();
+    descalloc_destroy(&frameDescriptors);
+    frame_destroy(&frameScheduler);
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], 0);
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], 0);
+    }
+    gpuprof_destroy(&gpuProfiler);
+    vkDestroyCommandPool(device, commandPool, 0);
+    free(cpuFrameTimes);
+    free(gpuFrameTimes);
+}
+
+// Must only be called once the slot's frame has finished, so results are already available.
+void collectGpuFrameTime(uint32_t index)
+{
+    float ms = gpuprof_collect(&gpuProfiler, index);
+    present_latency_end(&presentPacer, index, gpuProfiler.frameEndNs);
+    if (raymarch)
+    {
+        dynres_update(&dynamicResolution, raymarchFrameScales[index], ms);
+    }
+    if (ms >= 0.0f && gpuFrameSerials[index] > warmupFrames && gpuSampleCount < benchmarkFrames)
+    {
+        gpuFrameTimes[gpuSampleCount++] = ms;
+    }
+}
+
+// Waits for frames still in flight and collects their timestamps, oldest slot first so events stay in frame order.
+void collectPendingGpuFrames()
+{
+    vkDeviceWaitIdle(device);
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        collectGpuFrameTime((uint32_t)((frame_serial(&frameScheduler) - 1 + i) % frameCount));
+    }
+}
+
+void save_gpu_profile()
+{
+    if (!gpuprof_enabled(&gpuProfiler) || (!gpuTraceFile && !gpuCsvFile))
+    {
+        return;
+    }
+
+    collectPendingGpuFrames();
+    if (gpuTraceFile && !gpuprof_write_trace(&gpuProfiler, gpuTraceFile))
+    {
+        printf("GPU profile: failed to write %s\n", gpuTraceFile);
+    }
+    if (gpuCsvFile && !gpuprof_write_csv(&gpuProfiler, gpuCsvFile))
+    {
+        printf("GPU profile: failed to write %s\n", gpuCsvFile);
+    }
+}
+
+// Dumps recent frames of every thread together with the GPU scopes, also bound to F12.
+void save_cpu_trace(const char* fileName)
+{
+    collectPendingGpuFrames();
+    gpuprof_calibrate(&gpuProfiler, queue, queueFamilyIndex, cpuprof_now_ns);
+    if (cpuprof_write_trace(fileName, CPUPROF_MAX_FRAMES, gpuprof_append_trace, &gpuProfiler))
+    {
+        printf("CPU trace: wrote %s\n", fileName);
+    }
+    else
+    {
+        printf("CPU trace: failed to write %s\n", fileName);
+    }
+}
+
+void printPercentiles(const char* name, float* samples, uint32_t count)
+{
+    if (!count)
+    {
+        printf("%s: no samples\n", name);
+        return;
+    }
+
+    qsort(samples, count, sizeof(float), cmp_float);
+
+    // Nearest-rank percentiles.
+    const float percentiles[] = { 50.0f, 95.0f, 99.0f };
+    float values[3];
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        uint32_t rank = (uint32_t)(percentiles[i] / 100.0f * count + 0.999f);
+        values[i] = samples[clamp_u32(rank, 1, count) - 1];
+    }
+
+    printf("%s frame time (ms): p50 %.3f p95 %.3f p99 %.3f min %.3f max %.3f (%u frames)\n",
+        name, values[0], values[1], values[2], samples[0], samples[count - 1], count);
+}
+
+// Collects the run into JSON results and checks them against the baseline. Sorts the frame times.
+void writeBenchmarkResults()
+{
+    if (!benchmarkSampleCount)
+    {
+        printf("Results: no frames were measured\n");
+        return;
+    }
+
+    BenchResults results;
+    benchstat_init(&results);
+    // Whatever changes the work a frame does is config, a baseline from another setup is not compared against.
+    benchstat_config(&results, "device", "%s", deviceProperties.deviceName);
+    benchstat_config(&results, "size", "%ux%u", swapchainExtent.width, swapchainExtent.height);
+    benchstat_config(&results, "mode", "%s, %u frames in flight", headless ? "headless" : present_mode_name(presentMode), frameCount);
+    benchstat_config(&results, "timestep", timestepMs > 0.0f ? "%.4g ms" : "wall clock", timestepMs);
+    benchstat_config(&results, "scene", "scale %.3g, %u primitives %s, %u instances, %u objects, %u churn buffers", sceneScale,
+        batchPrimitives, vertexpack_format_name(vertexFormat), meshInstances, gpuObjectCount, memoryChurnBuffers);
+    benchstat_config(&results, "raymarch", raymarch ? "%s quality, %s" : "off", sdfscene_quality_name(raymarchQuality),
+        tileCulling ? "tile culling" : "no culling");
+    benchstat_info(&results, "frames", "%u measured after %u warm-up", benchmarkSampleCount, warmupFrames);
+
+    // Frame times get a fixed slack, a sub-millisecond frame moves by more than the tolerance on its own.
+    benchstat_timing(&results, "cpu", cpuFrameTimes, benchmarkSampleCount, 0.05);
+    if (gpuprof_enabled(&gpuProfiler))
+    {
+        benchstat_timing(&results, "gpu", gpuFrameTimes, gpuSampleCount, 0.05);
+    }
+    benchstat_metric(&results, "upload_bytes_mean", uploadFrames ? (double)uploadBytesSum / uploadFrames : 0.0, 1024.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "upload_bytes_max", (double)uploadBytesMax, 1024.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "upload_grows", uploadRing.stats.growCount, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "upload_spills", uploadRing.stats.spillCount, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "pipelines_compiled", pipelineManager.stats.compiled, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "pipelines_failed", pipelineManager.stats.failed, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "pipeline_compile_ms", pipelineManager.stats.compileMs, 0.0, 0);
+    benchstat_metric(&results, "descriptor_pools", frameDescriptors.stats.poolCount, 0.0, BENCHSTAT_CHECKED);
+    DeviceHeapStats heapStats[VK_MAX_MEMORY_HEAPS];
+    devmem_get_heap_stats(&deviceAllocator, heapStats);
+    uint32_t resourceAllocations = 0;
+    double blockBytes = 0.0;
+    for (uint32_t i = 0; i < deviceAllocator.memProperties.memoryHeapCount; ++i)
+    {
+        resourceAllocations += heapStats[i].allocationCount;
+        blockBytes += (double)heapStats[i].blockBytes;
+    }
+    benchstat_metric(&results, "device_memory_allocations", deviceAllocator.deviceMemoryCount, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "resource_allocations", resourceAllocations, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "device_memory_bytes", blockBytes, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "device_memory_peak_bytes", (double)deviceAllocator.counters.peakBlockBytes, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "device_memory_failures", deviceAllocator.counters.failures, 0.0, BENCHSTAT_CHECKED);
+    benchstat_metric(&results, "defrag_moved_bytes", (double)defragmenter.stats.movedBytes, 0.0, 0);
+    if (captureFile)
+    {
+        benchstat_metric(&results, "capture_dropped_frames", frameCapture.stats.droppedFrames, 0.0, BENCHSTAT_CHECKED);
+    }
+
+    benchmarkProduced = !resultsFile || benchstat_write_json(&results, resultsFile);
+    if (resultsFile)
+    {
+        printf(benchmarkProduced ? "Results: %s\n" : "Results: failed to write %s\n", resultsFile);
+    }
+    if (baselineFile)
+    {
+        static BenchResults baseline;
+        if (!benchstat_load_baseline(&baseline, baselineFile))
+        {
+            printf("Baseline: failed to read %s\n", baselineFile);
+            benchmarkRegressed = 1;
+            return;
+        }
+        // Different work would show up as regressions or hide them, so the run fails without being compared.
+        uint32_t mismatches = benchstat_config_mismatches(&results, &baseline);
+        if (mismatches)
+        {
+            printf("Baseline: %s was recorded with a different config, %u entries differ, not compared\n", baselineFile, mismatches);
+            benchmarkRegressed = 1;
+            return;
+        }
+        uint32_t regressions = benchstat_compare(&results, &baseline, regressionTolerance);
+        printf("Baseline: %s, %u regressions at %.0f%% tolerance\n", baselineFile, regressions, regressionTolerance * 100.0f);
+        benchmarkRegressed = regressions != 0;
+    }
+}
+
+void report_benchmark()
+{
+    if (!benchmarkFrames)
+    {
+        return;
+    }
+
+    collectPendingGpuFrames();
+
+    printf("Device: %s, %ux%u, %s, %u frames in flight (%s)\n", deviceProperties.deviceName,
+        swapchainExtent.width, swapchainExtent.height, headless ? "headless" : "windowed",
+        frameCount, frameScheduler.timeline ? "timeline semaphore" : "fences");
+    printPercentiles("CPU", cpuFrameTimes, benchmarkSampleCount);
+    if (!headless)
+    {
+        printf("Swapchain: %s, %u images, recreated %u times\n", present_mode_name(presentMode), swapchainImageCount,
+            swapchainRecreateCount);
+        present_print_stats(&presentPacer);
+    }
+    cpuprof_print_summary(CPUPROF_MAX_FRAMES);
+    if (gpuprof_enabled(&gpuProfiler))
+    {
+        printPercentiles("GPU", gpuFrameTimes, gpuSampleCount);
+        gpuprof_print_summary(&gpuProfiler);
+    }
+    else
+    {
+        printf("GPU: timestamps are not supported by the queue\n");
+    }
+    printf("Upload ring: %.1f KB, last frame %.1f KB, high water %.1f KB, %u spills, %u grows\n",
+        uploadRing.stats.ringSize / 1024.0, uploadRing.stats.frameBytes / 1024.0, uploadRing.stats.highWaterBytes / 1024.0,
+        uploadRing.stats.spillCount, uploadRing.stats.growCount);
+    descalloc_print_stats(&frameDescriptors);
+    if (batchPrimitives)
+    {
+        double batchMs = batchTicks * 1000.0 / SDL_GetPerformanceFrequency();
+        printf("2D batch: %u primitives, %u quads, %u draws, %u dropped quads per frame, %.0f primitives/ms, %s vertices\n",
+            batch2d.stats.primitiveCount, batch2d.stats.quadCount, batch2d.stats.drawCount, batch2d.stats.droppedQuads,
+            batchMs > 0.0 ? batchTotalPrimitives / batchMs : 0.0, vertexpack_format_name(vertexFormat));
+    }
+    if (meshInstances)
+    {
+        double instanceMs = instanceTicks * 1000.0 / SDL_GetPerformanceFrequency();
+        const InstanceBatchStats* stats = &instanceBatch.stats;
+        printf("Instances: %u instances, %u draws, %u dropped per frame, %.0f instances/ms, %.1f KB instance data vs %.1f KB as vertices\n",
+            stats->instanceCount, stats->drawCount, stats->droppedInstances, instanceMs > 0.0 ? instanceTotal / instanceMs : 0.0,
+            stats->instanceCount * sizeof(InstanceData) / 1024.0, stats->vertexBytes / 1024.0);
+    }
+    if (raymarch)
+    {
+        printf("Raymarch: %u primitives, %s, %s quality\n", sdfPrimitiveCount, tileCulling ? "tile culling" : "no culling",
+            sdfscene_quality_name(raymarchQuality));
+        dynres_print_stats(&dynamicResolution);
+    }
+    if (gpuObjectCount)
+    {
+        printf("GPU objects: %u objects, %s, visible mean %.0f last %u\n", gpuObjectCount,
+            indirectCount ? "compacted, draw count from the GPU" : "a command per object",
+            gpuObjectVisibleFrames ? (double)gpuObjectVisibleSum / gpuObjectVisibleFrames : 0.0, gpuObjectLastVisible);
+        if (gpuObjectCheck)
+        {
+            printf("GPU objects: %u of %u frames differ from the CPU count\n", gpuObjectMismatches, gpuObjectVisibleFrames);
+        }
+    }
+    if (captureFile)
+    {
+        // The GPU is idle, so every captured frame can be written out.
+        capture_finish(&frameCapture);
+        capture_print_stats(&frameCapture);
+    }
+    rg_print_stats(&renderGraph);
+    devmem_print_stats(&deviceAllocator);
+    defrag_print_stats(&defragmenter);
+    if (resultsFile || baselineFile)
+    {
+        writeBenchmarkResults();
+    }
+}
+
+void draw_frame()
+{
+    // Time spent waiting on the GPU and the display, the pacer moves it in front of the input sample.
+    uint64_t blockedNs = cpuprof_now_ns();
+    CPUPROF_BEGIN("frame wait");
+    uint32_t index = frame_begin(&frameScheduler);
+    CPUPROF_END();
+    blockedNs = cpuprof_now_ns() - blockedNs;
+    uint64_t frameSerial = frame_serial(&frameScheduler);
+    uint64_t completedSerial = frame_completed(&frameScheduler);
+    destroyRetiredSwapchains(completedSerial);
+    // With a fixed step, frame N shows the same scene however long it took to get there.
+    sceneTime = timestepMs > 0.0f ? (float)((frameSerial - 1) * (double)timestepMs * 1e-3) : SDL_GetTicks() * 1e-3f;
+
+    uint32_t imageIndex = index; // Headless mode has one render target per frame
+    if (!headless)
+    {
+        if (swapchainDirty && !recreateSwapchain())
+        {
+            SDL_Delay(SWAPCHAIN_RETRY_DELAY);
+            return;
+        }
+
+        CPUPROF_BEGIN("acquire");
+        uint64_t acquireStart = cpuprof_now_ns();
+        VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[index], VK_NULL_HANDLE, &imageIndex);
+        blockedNs += cpuprof_now_ns() - acquireStart;
+        CPUPROF_END();
+        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            // Nothing was acquired and the semaphore stays unsignaled, the frame slot is simply reused.
+            swapchainDirty = 1;
+            return;
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        {
+            // A lost device or surface never comes back by recreating the swapchain.
+            printf("vkAcquireNextImageKHR failed: %d\n", result);
+            fatalResult = result;
+            return;
+        }
+        // A suboptimal image still presents correctly, the swapchain is replaced before the next frame.
+        swapchainDirty |= result == VK_SUBOPTIMAL_KHR;
+    }
+
+    collectGpuFrameTime(index);
+    collectGpuObjectStats(index);
+    if (recordThreads)
+    {
+        recorder_begin_frame(&recorder, index);
+    }
+
+    pipemgr_update(&pipelineManager, frameSerial, completedSerial);
+    if (!pipelineCacheReported && pipemgr_idle(&pipelineManager))
+    {
+        reportPipelineCache();
+    }
+
+    upload_begin_frame(&uploadRing, frameSerial, completedSerial);
+    beginFrameDescriptors(index);
+
+    uint32_t mask = ((uint32_t)(sceneTime * 1000.0f) >> 3) & 0x1FF;
+    mask = mask > 0xFF ? 0x1FF - mask : mask;
+    mask = (mask << 16) | (mask << 8) | mask;
+    VertexP2C dynamicVertices[] = {
+        { -0.5f, -1.0f, 0xFF0000FF|mask },
+        {  0.0f,  0.0f, 0xFF00FF00|mask },
+        { -1.0f,  0.0f, 0xFFFF0000|mask }
+    };
+    UploadAllocation dynamicAlloc;
+    void* dynamicPtr = upload_alloc(&uploadRing, sizeof(dynamicVertices), 0, &dynamicAlloc);
+    if (dynamicPtr)
+    {
+        memcpy(dynamicPtr, dynamicVertices, sizeof(dynamicVertices));
+    }
+
+    transfer_poll(&transfer, completedSerial);
+    if (captureFile)
+    {
+        capture_poll(&frameCapture, completedSerial);
+        captureFrameSerial = frameSerial;
+    }
+
+    CPUPROF_BEGIN("record");
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffers[index], &beginInfo);
+
+    gpuprof_begin_frame(&gpuProfiler, commandBuffers[index], index, frameSerial);
+    uint32_t frameScope = gpuprof_begin(&gpuProfiler, commandBuffers[index], "frame");
+
+    VkSemaphore waitSemaphores[1 + TRANSFER_MAX_BATCHES];
+    VkPipelineStageFlags waitStages[1 + TRANSFER_MAX_BATCHES];
+    uint32_t waitCount = 0;
+    if (!headless)
+    {
+        waitSemaphores[waitCount] = imageAvailableSemaphores[index];
+        waitStages[waitCount] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        ++waitCount;
+    }
+
+    // Picks up static uploads that have already landed, static geometry shows up once its batch is acquired.
+    int staticAcquired = transfer_is_acquired(&transfer, staticUploadId);
+    uint32_t acquireScope = gpuprof_begin(&gpuProfiler, commandBuffers[index], "transfer acquire");
+    waitCount += transfer_acquire(&transfer, commandBuffers[index], frameSerial, waitSemaphores + waitCount, waitStages + waitCount);
+    gpuprof_end(&gpuProfiler, commandBuffers[index], acquireScope);
+
+    // Static buffers only move once they were acquired on an earlier frame. Moves switch the handles
+    // right away, so everything recorded below, the instance meshes included, reads the copies.
+    if (staticAcquired)
+    {
+        if (memoryChurnBuffers)
+        {
+            churnDeviceMemory(frameSerial);
+        }
+        uint32_t defragScope = gpuprof_begin(&gpuProfiler, commandBuffers[index], "defrag");
+        if (defrag_step(&defragmenter, commandBuffers[index], frameSerial, completedSerial))
+        {
+            for (uint32_t i = 0; i < instanceBatch.meshCount; ++i)
+            {
+                instanceBatch.meshes[i].buffer = staticBuffer;
+            }
+        }
+        gpuprof_end(&gpuProfiler, commandBuffers[index], defragScope);
+    }
+
+    DrawItem drawItems[2 + BATCH2D_MAX_DRAWS + INSTBATCH_MAX_DRAWS];
+    uint32_t drawCount = 0;
+    int vertexColorReady = pipemgr_ready(&pipelineManager, pipeline);
+    if (dynamicPtr && vertexColorReady)
+    {
+        drawItems[drawCount] = (DrawItem){ "dynamic triangle", dynamicAlloc.buffer, dynamicAlloc.offset, 3, 0 };
+        drawCount += streamDrawConstants(&identityDrawConstants, &drawItems[drawCount]);
+    }
+    if (vertexColorReady && transfer_is_acquired(&transfer, staticUploadId))
+    {
+        // The static triangle sways, its vertices never change but its constants do every frame.
+        float sway = 0.1f * sinf(sceneTime * 2.0f);
+        DrawConstants constants = { { 1.0f, 1.0f, sway, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+        drawItems[drawCount] = (DrawItem){ "static triangle", staticBuffer, 0, 3, 0 };
+        drawCount += streamDrawConstants(&constants, &drawItems[drawCount]);
+    }
+    // The shared quad index buffer comes with the static upload.
+    if (batchPrimitives && transfer_is_acquired(&transfer, staticUploadId))
+    {
+        CPUPROF_BEGIN("batch2d");
+        uint64_t batchStart = SDL_GetPerformanceCounter();
+        batch2d_begin_frame(&batch2d, swapchainExtent.width, swapchainExtent.height);
+        emitBatchScene(sceneTime);
+        batch2d_draw_list(&batch2d, &batchOverlay);
+        uint32_t batchDrawCount = batch2d_flush(&batch2d);
+        batchTicks += SDL_GetPerformanceCounter() - batchStart;
+        batchTotalPrimitives += batch2d.stats.primitiveCount;
+        CPUPROF_END();
+
+        // Batch vertices are already in clip space, every batch draw shares one identity allocation.
+        DrawItem batchConstants = { 0 };
+        if (batchDrawCount && streamDrawConstants(&identityDrawConstants, &batchConstants))
+        {
+            for (uint32_t i = 0; i < batchDrawCount; ++i)
+            {
+                const Batch2DDraw* draw = &batch2d.draws[i];
+                VkPipeline batchPipeline = pipemgr_get(&pipelineManager, batchPipelines[draw->state]);
+                if (batchPipeline)
+                {
+                    drawItems[drawCount++] = (DrawItem){ "2d batch", draw->buffer, draw->offset, 0, 0, batchPipeline, draw->indexCount,
+                        batchConstants.constantSet, batchConstants.constantOffset };
+                }
+            }
+        }
+    }
+    // The meshes come with the static upload.
+    if (meshInstances && transfer_is_acquired(&transfer, staticUploadId))
+    {
+        CPUPROF_BEGIN("instances");
+        uint64_t instanceStart = SDL_GetPerformanceCounter();
+        instbatch_begin_frame(&instanceBatch);
+        emitInstanceScene(sceneTime);
+        uint32_t instanceDrawCount = instbatch_flush(&instanceBatch);
+        instanceTicks += SDL_GetPerformanceCounter() - instanceStart;
+        instanceTotal += instanceBatch.stats.instanceCount;
+        CPUPROF_END();
+
+        // Instances are placed in a square, the constants stretch it back to the window's aspect.
+        DrawConstants constants = { { (float)swapchainExtent.height / swapchainExtent.width, 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+        DrawItem instanceConstants = { 0 };
+        VkPipeline instanced = pipemgr_get(&pipelineManager, instancedPipeline);
+        if (instanced && instanceDrawCount && streamDrawConstants(&constants, &instanceConstants))
+        {
+            for (uint32_t i = 0; i < instanceDrawCount; ++i)
+            {
+                const InstanceDraw* draw = &instanceBatch.draws[i];
+                const InstanceMesh* mesh = &instanceBatch.meshes[draw->mesh];
+                drawItems[drawCount++] = (DrawItem){ "instances", mesh->buffer, mesh->offset, mesh->vertexCount, mesh->firstVertex,
+                    instanced, 0, instanceConstants.constantSet, instanceConstants.constantOffset,
+                    draw->buffer, draw->offset, draw->instanceCount };
+            }
+        }
+    }
+    mainPassDraws = (DrawList){ drawItems, drawCount, recordThreads ? 0 : &gpuProfiler };
+
+    if (raymarch)
+    {
+        raymarchExtent = dynres_extent(&dynamicResolution, swapchainExtent);
+        raymarchFrameScales[index] = dynamicResolution.scale;
+        raymarchFrameConstants = raymarchConstants();
+        tileCullFramePipeline = pipemgr_get(&pipelineManager, tileCullPipeline);
+        raymarchFramePipeline = pipemgr_get(&pipelineManager, raymarchPipelines[raymarchQuality]);
+        upscaleFramePipeline = pipemgr_get(&pipelineManager, upscalePipeline);
+        if (!raymarchFramePipeline || !upscaleFramePipeline || (tileCulling && !tileCullFramePipeline) ||
+            !updateRaymarchDescriptors())
+        {
+            tileCullFramePipeline = raymarchFramePipeline = upscaleFramePipeline = VK_NULL_HANDLE;
+        }
+    }
+    if (gpuObjectCount)
+    {
+        prepareGpuObjects(index);
+    }
+
+    uint32_t graphScope = gpuprof_begin(&gpuProfiler, commandBuffers[index], "render graph");
+    rg_bind_image(&renderGraph, backbufferResource, swapchainImages[imageIndex], swapchainImageViews[imageIndex]);
+    rg_execute(&renderGraph, commandBuffers[index]);
+    gpuprof_end(&gpuProfiler, commandBuffers[index], graphScope);
+    gpuprof_end(&gpuProfiler, commandBuffers[index], frameScope);
+
+    vkEndCommandBuffer(commandBuffers[index]);
+    upload_end_frame(&uploadRing);
+    CPUPROF_END();
+    if (frameSerial > warmupFrames)
+    {
+        uploadBytesSum += uploadRing.stats.frameBytes;
+        uploadBytesMax = uploadRing.stats.frameBytes > uploadBytesMax ? uploadRing.stats.frameBytes : uploadBytesMax;
+        ++uploadFrames;
+    }
+    gpuFrameSerials[index] = frameSerial;
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = waitCount,
+        .pWaitSemaphores = waitSemaphores,
+        .pWaitDstStageMask = waitStages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffers[index],
+        .signalSemaphoreCount = headless ? 0 : 1,
+        .pSignalSemaphores = &renderFinishedSemaphores[index],
+    };
+    CPUPROF_BEGIN("submit");
+    present_latency_begin(&presentPacer, index, frameInputNs);
+    frame_submit(&frameScheduler, queue, &submitInfo);
+    CPUPROF_END();
+
+    if (headless)
+    {
+        return;
+    }
+
+    VkPresentInfoKHR presentInfo = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &renderFinishedSemaphores[index],
+        .swapchainCount = 1,
+        .pSwapchains = &swapchain,
+        .pImageIndices = &imageIndex,
+    };
+    CPUPROF_BEGIN("present");
+    uint64_t presentStart = cpuprof_now_ns();
+    VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+    blockedNs += cpuprof_now_ns() - presentStart;
+    CPUPROF_END();
+    swapchainDirty |= result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR;
+    if (result != VK_SUCCESS && result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR)
+    {
+        printf("vkQueuePresentKHR failed: %d\n", result);
+        fatalResult = result;
+    }
+
+    present_pacer_update(&presentPacer, blockedNs * 1e-6f);
+}
+
+int memoryCheck = 0;
+
+// Allocates past half a block, where the allocator switches to dedicated blocks, at every alignment a driver
+// is likely to ask for, checks the placement and that freeing gives every block back.
+uint32_t countDedicatedBlocks()
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        for (uint32_t j = 0; j < DEVMEM_KIND_COUNT; ++j)
+        {
+            for (const DeviceMemoryBlock* block = deviceAllocator.blocks[i][j]; block; block = block->next)
+            {
+                count += block->dedicated;
+            }
+        }
+    }
+    return count;
+}
+
+int run_memory_check()
+{
+    const VkDeviceSize blockSize = deviceAllocator.blockSize;
+    const VkDeviceSize sizes[] = { blockSize / 2 + 1, 3840 * 2160 * 4, blockSize * 5 / 8, blockSize, blockSize * 3 / 2 };
+    const VkDeviceSize alignments[] = { 1, 256, 4096, 65536 };
+    uint32_t dedicatedBlocks = countDedicatedBlocks();
+    int ok = 1;
+
+    for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        for (uint32_t j = 0; j < sizeof(alignments) / sizeof(alignments[0]); ++j)
+        {
+            VkMemoryRequirements memoryRequirements = { sizes[i], alignments[j], ~0u };
+            DeviceAllocation allocation = { 0 };
+            int placed = devmem_alloc(&deviceAllocator, &memoryRequirements, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL],
+                DEVMEM_KIND_LINEAR, &allocation);
+            placed = placed && allocation.offset % alignments[j] == 0
+                && allocation.offset + sizes[i] <= allocation.block->tlsf.size;
+            printf("%10.2f MB aligned %6u: %s\n", sizes[i] / (1024.0 * 1024.0), (uint32_t)alignments[j],
+                !placed ? "FAILED" : allocation.block->dedicated ? "dedicated" : "shared");
+            devmem_free(&deviceAllocator, &allocation);
+            ok = ok && placed;
+        }
+    }
+
+    // A full screen offscreen image goes through the same path as init_offscreen.
+    VkImageCreateInfo imageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_B8G8R8A8_UNORM,
+        .extent = { 3840, 2160, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VkImage image;
+    DeviceAllocation imageMemory = { 0 };
+    int imageOk = vkCreateImage(device, &imageCreateInfo, 0, &image) == VK_SUCCESS;
+    if (imageOk)
+    {
+        imageOk = devmem_alloc_image(&deviceAllocator, image, compatibleMemTypes[VULKAN_MEM_DEVICE_LOCAL], &imageMemory);
+        vkDestroyImage(device, image, 0);
+        devmem_free(&deviceAllocator, &imageMemory);
+    }
+    printf("3840x2160 image: %s\n", imageOk ? "ok" : "FAILED");
+    ok = ok && imageOk;
+
+    // Shared blocks may be kept around for reuse, dedicated ones must all be gone.
+    uint32_t leaked = countDedicatedBlocks() - dedicatedBlocks;
+    printf("Memory check: %s, %u dedicated blocks leaked\n", ok ? "passed" : "FAILED", leaked);
+    return ok && !leaked;
+}
+
+// Records recordBenchDraws draws into secondaries with 1, 2, 4... threads and reports how recording time scales.
+void run_record_benchmark()
+{
+    const uint32_t iterations = 20;
+
+    // Bench draws use the default pipeline.
+    pipemgr_wait_idle(&pipelineManager);
+    vkDeviceWaitIdle(device);
+
+    // Two sets of constants alternating per draw, so every draw moves the dynamic offset.
+    upload_begin_frame(&uploadRing, frame_serial(&frameScheduler), frame_completed(&frameScheduler));
+    beginFrameDescriptors(0);
+    DrawItem constants[2] = { 0 };
+    int constantsReady = streamDrawConstants(&identityDrawConstants, &constants[0]) &&
+        streamDrawConstants(&identityDrawConstants, &constants[1]);
+    upload_end_frame(&uploadRing);
+    if (!constantsReady)
+    {
+        printf("Record benchmark: out of upload or descriptor memory\n");
+        return;
+    }
+
+    DrawItem* items = (DrawItem*)malloc(recordBenchDraws * sizeof(DrawItem));
+    for (uint32_t i = 0; i < recordBenchDraws; ++i)
+    {
+        // A vertex buffer change every few draws, like a scene with a handful of meshes per buffer.
+        items[i] = (DrawItem){ "bench", staticBuffer, (i / 4) % 2 ? sizeof(VertexP2C) : 0, 3, 0, 0, 0,
+            constants[i % 2].constantSet, constants[i % 2].constantOffset };
+    }
+    DrawList drawList = { items, recordBenchDraws, 0 };
+
+    uint32_t maxThreads = clamp_u32((uint32_t)SDL_GetCPUCount(), 1, recorder.threadCount);
+    double baseTime = 0.0;
+
+    printf("Recording %u draws, %u iterations, up to %u threads\n", recordBenchDraws, iterations, maxThreads);
+    for (uint32_t threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+    {
+        recorder.activeThreads = threads;
+
+        double best = 0.0;
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            VkCommandBuffer secondaries[RECORD_MAX_THREADS];
+
+            recorder_begin_frame(&recorder, 0);
+            uint64_t start = SDL_GetPerformanceCounter();
+            recorder_record(&recorder, renderPass, 0, VK_NULL_HANDLE, recordBenchDraws, recordDraws, &drawList, secondaries);
+            uint64_t end = SDL_GetPerformanceCounter();
+
+            double ms = (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+            best = (i == 0 || ms < best) ? ms : best;
+        }
+        baseTime = threads == 1 ? best : baseTime;
+
+        printf("%2u threads: %8.3f ms, %6.2f Mdraws/s, speedup %.2fx\n",
+            threads, best, recordBenchDraws / best * 1e-3, baseTime / best);
+
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    recorder.activeThreads = recorder.threadCount;
+    recorder_begin_frame(&recorder, 0);
+    free(items);
+}
+
+// Packs vertexPackBenchVertices vertices with every format and kernel the CPU supports, checking each against scalar.
+int run_vertex_pack_benchmark()
+{
+    const uint32_t iterations = 10;
+    uint32_t count = vertexPackBenchVertices;
+
+    VertexP2C* src = (VertexP2C*)malloc(count * sizeof(VertexP2C));
+    void* dst = malloc(count * sizeof(VertexP2C));
+    void* reference = malloc(count * sizeof(VertexP2C));
+    if (!src || !dst || !reference)
+    {
+        free(src);
+        free(dst);
+        free(reference);
+        return 0;
+    }
+    // Mostly on screen, with some out of range to exercise clamping.
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        seed = seed * 1664525 + 1013904223;
+        src[i].x = (float)(int32_t)seed / 1.9e9f;
+        seed = seed * 1664525 + 1013904223;
+        src[i].y = (float)(int32_t)seed / 1.9e9f;
+        src[i].rgba = seed;
+    }
+
+    int ok = 1;
+    printf("Packing %u vertices, %u iterations, best kernel %s\n", count, iterations, vertexpack_isa_name(vertexpack_best_isa()));
+    for (uint32_t format = 0; format < VERTEX_FORMAT_COUNT; ++format)
+    {
+        uint32_t stride = vertexpack_stride(format);
+        vertexpack_func(format, VERTEXPACK_ISA_SCALAR)(src, reference, count);
+        for (uint32_t isa = 0; isa < VERTEXPACK_ISA_COUNT; ++isa)
+        {
+            VertexPackFunc pack = vertexpack_func(format, isa);
+            if (!pack)
+            {
+                continue;
+            }
+
+            double best = 0.0;
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                uint64_t start = SDL_GetPerformanceCounter();
+                pack(src, dst, count);
+                uint64_t end = SDL_GetPerformanceCounter();
+
+                double ms = (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+                best = (i == 0 || ms < best) ? ms : best;
+            }
+            int match = memcmp(dst, reference, (size_t)count * stride) == 0;
+            ok = ok && match;
+
+            // Bandwidth counts both the source read and the packed write.
+            printf("%-8s %-6s: %8.3f ms, %8.1f Mvertices/s, %6.2f GB/s%s\n",
+                vertexpack_format_name(format), vertexpack_isa_name(isa), best, count / best * 1e-3,
+                count * (double)(sizeof(VertexP2C) + stride) / best * 1e-6, match ? "" : ", MISMATCH");
+        }
+    }
+
+    free(src);
+    free(dst);
+    free(reference);
+    return ok;
+}
+
+// Renders the SDF scene on the CPU with every kernel the CPU supports, comparing each with scalar.
+// The best kernel's image goes to cpuRenderFile and must match cpuGoldenFile.
+int run_cpu_reference_render()
+{
+    size_t size = (size_t)width * height * 3;
+    uint8_t* image = (uint8_t*)malloc(size);
+    uint8_t* reference = (uint8_t*)malloc(size);
+    if (!image || !reference)
+    {
+        free(image);
+        free(reference);
+        return 0;
+    }
+
+    // Fixed time and mouse, so the image only depends on size, scene and culling.
+    SdfCpuView view = { width, height, { 0.0f, 0.0f }, 0.0f, tileCulling, raymarchQuality };
+    sdfPrimitiveCount = sdfscene_build(sdfPrimitives, SDF_MAX_PRIMITIVES, sdfRepeat);
+    printf("CPU raymarch %ux%u, %u primitives, %s, %s quality, best kernel %s\n", width, height, sdfPrimitiveCount,
+        tileCulling ? "tile culling" : "no culling", sdfscene_quality_name(raymarchQuality), sdfcpu_isa_name(sdfcpu_best_isa()));
+
+    int ok = 1;
+    const uint8_t* result = reference;
+    for (uint32_t isa = 0; isa < SDFCPU_ISA_COUNT && ok; ++isa)
+    {
+        if (!sdfcpu_isa_supported(isa))
+        {
+            continue;
+        }
+
+        SdfCpuStats stats;
+        uint8_t* pixels = isa == SDFCPU_ISA_SCALAR ? reference : image;
+        ok = sdfcpu_render(sdfPrimitives, sdfPrimitiveCount, &view, isa, cpuRenderThreads, pixels, &stats);
+        if (!ok)
+        {
+            printf("CPU raymarch failed, too many tiles or out of memory\n");
+            break;
+        }
+        result = pixels;
+
+        uint32_t maxDiff = 0;
+        sdfcpu_compare(pixels, reference, width, height, 0, &maxDiff);
+        printf("%-6s: %9.1f ms, %2u threads, %7.3f Mrays/s (%llu primary, %llu shadow), %u tiles stolen, max diff %u\n",
+            sdfcpu_isa_name(isa), stats.ms, stats.threadCount, (stats.primaryRays + stats.shadowRays) / stats.ms * 1e-3,
+            (unsigned long long)stats.primaryRays, (unsigned long long)stats.shadowRays, stats.stolenTiles, maxDiff);
+    }
+
+    if (ok && cpuRenderFile && !sdfcpu_write_ppm(cpuRenderFile, result, width, height))
+    {
+        printf("Can't write %s\n", cpuRenderFile);
+        ok = 0;
+    }
+
+    if (ok && cpuGoldenFile)
+    {
+        uint32_t goldenWidth, goldenHeight;
+        uint8_t* golden = sdfcpu_read_ppm(cpuGoldenFile, &goldenWidth, &goldenHeight);
+        if (!golden || goldenWidth != width || goldenHeight != height)
+        {
+            printf("Golden image %s missing or not %ux%u\n", cpuGoldenFile, width, height);
+            ok = 0;
+        }
+        else
+        {
+            // Grazing rays near the horizon can flip between hit and miss, so a few outliers are allowed.
+            uint32_t maxDiff = 0;
+            uint32_t mismatches = sdfcpu_compare(result, golden, width, height, cpuGoldenTolerance, &maxDiff);
+            ok = mismatches <= width * height / 1000;
+            printf("Golden %s: %u pixels off by more than %u, max diff %u, %s\n",
+                cpuGoldenFile, mismatches, cpuGoldenTolerance, maxDiff, ok ? "match" : "MISMATCH");
+        }
+        free(golden);
+    }
+
+    free(image);
+    free(reference);
+    return ok;
+}
+
+//----------------------------------------------------------
+
+// Index of value among the count names, or count after listing the valid ones.
+uint32_t parseNamedOption(const char* option, const char* value, const char* (*name)(uint32_t), uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (strcmp(value, name(i)) == 0)
+        {
+            return i;
+        }
+    }
+    printf("Unknown %s %s, expected", option, value);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        printf("%s %s", i ? "," : "", name(i));
+    }
+    printf("\n");
+    return count;
+}
+
+// Returns 0 if an option has a value it does not know.
+int parse_args(int argc, char *argv[])
+{
+    int valid = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = 1;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            benchmarkFrames = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            sscanf(argv[++i], "%ux%u", &width, &height);
+        }
+        else if (strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc)
+        {
+            pipelineCacheFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-pipeline-cache") == 0)
+        {
+            pipelineCacheFile = 0;
+        }
+        else if (strcmp(argv[i], "--no-shader-reload") == 0)
+        {
+            shaderReload = 0;
+        }
+        else if (strcmp(argv[i], "--shader-pak") == 0 && i + 1 < argc)
+        {
+            shaderPakFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-shader-pak") == 0)
+        {
+            shaderPakFile = 0;
+        }
+        else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+        {
+            uint32_t policy = parseNamedOption("--present", argv[++i], present_policy_name, PRESENT_POLICY_COUNT);
+            presentPolicy = policy < PRESENT_POLICY_COUNT ? policy : presentPolicy;
+            valid = valid && policy < PRESENT_POLICY_COUNT;
+        }
+        else if (strcmp(argv[i], "--no-pacing") == 0)
+        {
+            framePacing = 0;
+        }
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            frameCount = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 1, MAX_FRAME_COUNT);
+        }
+        else if (strcmp(argv[i], "--gpu-trace") == 0 && i + 1 < argc)
+        {
+            gpuTraceFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--gpu-csv") == 0 && i + 1 < argc)
+        {
+            gpuCsvFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-trace") == 0 && i + 1 < argc)
+        {
+            cpuTraceFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            recordThreads = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 0, RECORD_MAX_THREADS);
+        }
+        else if (strcmp(argv[i], "--record-bench") == 0 && i + 1 < argc)
+        {
+            recordBenchDraws = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--batch2d") == 0 && i + 1 < argc)
+        {
+            batchPrimitives = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+        {
+            meshInstances = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 0, MAX_MESH_INSTANCES);
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+        {
+            uint32_t format = parseNamedOption("--vertex-format", argv[++i], vertexpack_format_name, VERTEX_FORMAT_COUNT);
+            vertexFormat = format < VERTEX_FORMAT_COUNT ? format : vertexFormat;
+            valid = valid && format < VERTEX_FORMAT_COUNT;
+        }
+        else if (strcmp(argv[i], "--raymarch") == 0)
+        {
+            raymarch = 1;
+        }
+        else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+        {
+            raymarchBudgetMs = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--raymarch-scale") == 0 && i + 1 < argc)
+        {
+            float scale = (float)atof(argv[++i]);
+            raymarchFixedScale = scale < 0.1f ? 0.1f : (scale > 1.0f ? 1.0f : scale);
+        }
+        else if (strcmp(argv[i], "--no-tile-cull") == 0)
+        {
+            tileCulling = 0;
+        }
+        else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc)
+        {
+            uint32_t quality = parseNamedOption("--quality", argv[++i], sdfscene_quality_name, SDF_QUALITY_COUNT);
+            raymarchQuality = quality < SDF_QUALITY_COUNT ? quality : raymarchQuality;
+            valid = valid && quality < SDF_QUALITY_COUNT;
+        }
+        else if (strcmp(argv[i], "--sdf-repeat") == 0 && i + 1 < argc)
+        {
+            sdfRepeat = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 1, 7);
+        }
+        else if (strcmp(argv[i], "--vertex-pack-bench") == 0 && i + 1 < argc)
+        {
+            vertexPackBenchVertices = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--cpu-render") == 0 && i + 1 < argc)
+        {
+            cpuRenderFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-golden") == 0 && i + 1 < argc)
+        {
+            cpuGoldenFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-tolerance") == 0 && i + 1 < argc)
+        {
+            cpuGoldenTolerance = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--cpu-threads") == 0 && i + 1 < argc)
+        {
+            cpuRenderThreads = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 0, SDFCPU_MAX_THREADS);
+        }
+        else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+        {
+            gpuObjectCount = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 0, GPUCULL_MAX_OBJECTS);
+        }
+        else if (strcmp(argv[i], "--no-indirect-count") == 0)
+        {
+            indirectCount = 0;
+        }
+        else if (strcmp(argv[i], "--object-check") == 0)
+        {
+            gpuObjectCheck = 1;
+        }
+        else if (strcmp(argv[i], "--memory-check") == 0)
+        {
+            memoryCheck = 1;
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            captureFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture-fps") == 0 && i + 1 < argc)
+        {
+            captureFps = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 1, 1000);
+        }
+        else if (strcmp(argv[i], "--defrag-budget") == 0 && i + 1 < argc)
+        {
+            defragFrameKb = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--memory-churn") == 0 && i + 1 < argc)
+        {
+            memoryChurnBuffers = clamp_u32((uint32_t)strtoul(argv[++i], 0, 10), 0, MAX_CHURN_BUFFERS);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            warmupFrames = (uint32_t)strtoul(argv[++i], 0, 10);
+        }
+        else if (strcmp(argv[i], "--timestep") == 0 && i + 1 < argc)
+        {
+            timestepMs = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--scene-scale") == 0 && i + 1 < argc)
+        {
+            sceneScale = (float)atof(argv[++i]);
+            sceneScale = sceneScale > 0.0f ? sceneScale : 1.0f;
+        }
+        else if (strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+        {
+            resultsFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baselineFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            regressionTolerance = (float)atof(argv[++i]) * 0.01f;
+            regressionTolerance = regressionTolerance > 0.0f ? regressionTolerance : 0.0f;
+        }
+        else
+        {
+            printf("Usage: %s [--headless] [--frames N] [--size WxH] [--pipeline-cache FILE] [--no-pipeline-cache]"
+                " [--no-shader-reload] [--shader-pak FILE] [--no-shader-pak] [--frames-in-flight 1-4]"
+                " [--present fifo|fifo-relaxed|mailbox|immediate] [--no-pacing]"
+                " [--gpu-trace FILE] [--gpu-csv FILE] [--cpu-trace FILE] [--threads N] [--record-bench DRAWS]"
+                " [--batch2d PRIMITIVES] [--instances N] [--vertex-format f32|snorm16|half] [--vertex-pack-bench VERTICES]"
+                " [--raymarch] [--gpu-budget MS] [--raymarch-scale 0.1-1] [--no-tile-cull] [--sdf-repeat 1-7]"
+                " [--quality low|medium|high|ultra]"
+                " [--cpu-render FILE] [--cpu-golden FILE] [--cpu-tolerance STEPS] [--cpu-threads N]"
+                " [--objects N] [--no-indirect-count] [--object-check] [--memory-check]"
+                " [--capture FILE.y4m|FILE.png|FILE] [--capture-fps N] [--defrag-budget KB] [--memory-churn BUFFERS]"
+                " [--warmup N] [--timestep MS] [--scene-scale F] [--results FILE] [--baseline FILE] [--tolerance PCT]\n", argv[0]);
+        }
+    }
+
+    if (headless && !benchmarkFrames)
+    {
+        benchmarkFrames = HEADLESS_DEFAULT_FRAME_COUNT;
+    }
+    if ((resultsFile || baselineFile) && !benchmarkFrames)
+    {
+        benchmarkFrames = HEADLESS_DEFAULT_FRAME_COUNT;
+    }
+    // Results are meant to be compared, so they animate the same frames unless a step was given.
+    if ((resultsFile || baselineFile) && timestepMs < 0.0f)
+    {
+        timestepMs = 1000.0f / 60.0f;
+    }
+    if (sceneScale != 1.0f)
+    {
+        batchPrimitives = (uint32_t)(batchPrimitives * sceneScale + 0.5f);
+        meshInstances = (uint32_t)fminf(meshInstances * sceneScale + 0.5f, (float)MAX_MESH_INSTANCES);
+        gpuObjectCount = clamp_u32((uint32_t)(gpuObjectCount * sceneScale + 0.5f), gpuObjectCount ? 1 : 0, GPUCULL_MAX_OBJECTS);
+    }
+
+    return valid;
+}
+
+int main(int argc, char *argv[])
+{
+    if (!parse_args(argc, argv))
+    {
+        return 1;
+    }
+
+    SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+
+    if (vertexPackBenchVertices)
+    {
+        int ok = run_vertex_pack_benchmark();
+        SDL_Quit();
+        return ok ? 0 : 1;
+    }
+    if (cpuRenderFile || cpuGoldenFile)
+    {
+        int ok = run_cpu_reference_render();
+        SDL_Quit();
+        return ok ? 0 : 1;
+    }
+
+    uint32_t initStage = INIT_STAGE_NONE;
+    int run = init_vulkan() && (initStage = INIT_STAGE_VULKAN)
+        && (headless || init_window()) && (initStage = INIT_STAGE_WINDOW)
+        && init_device() && (initStage = INIT_STAGE_DEVICE)
+        && (headless ? init_offscreen() : init_swapchain()) && (initStage = INIT_STAGE_TARGET)
+        && init_render() && (initStage = INIT_STAGE_RENDER);
+    if (!run)
+    {
+        printf("Initialization failed\n");
+    }
+    if (run && recordBenchDraws)
+    {
+        run_record_benchmark();
+        run = 0;
+    }
+    int memoryCheckFailed = 0;
+    if (run && memoryCheck)
+    {
+        vkDeviceWaitIdle(device);
+        memoryCheckFailed = !run_memory_check();
+        run = 0;
+    }
+    CPUPROF_THREAD("main");
+    while (run)
+    {
+        CPUPROF_FRAME(frame_serial(&frameScheduler));
+
+        CPUPROF_BEGIN("pacing");
+        frameInputNs = present_pacer_wait(&presentPacer);
+        CPUPROF_END();
+
+        CPUPROF_BEGIN("poll events");
+        SDL_Event evt;
+        while (!headless && SDL_PollEvent(&evt))
+        {
+            if (evt.type == SDL_QUIT)
+            {
+                run = 0;
+            }
+            else if (evt.type == SDL_WINDOWEVENT && evt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            {
+                width = (uint32_t)evt.window.data1;
+                height = (uint32_t)evt.window.data2;
+                swapchainDirty = 1;
+            }
+            else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F6)
+            {
+                presentPolicy = (presentPolicy + 1) % PRESENT_POLICY_COUNT;
+                swapchainDirty = 1;
+                printf("Present policy: %s\n", present_policy_name(presentPolicy));
+            }
+            else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F12)
+            {
+                save_cpu_trace(cpuTraceFile ? cpuTraceFile : "cpu_trace.json");
+            }
+            else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F5 && raymarch)
+            {
+                uint32_t quality = (raymarchQuality + 1) % SDF_QUALITY_COUNT;
+                const char* status = !setRaymarchQuality(quality) ? " failed"
+                    : pipemgr_ready(&pipelineManager, raymarchPipelines[quality]) ? "" : ", compiling";
+                printf("Raymarch quality: %s%s\n", sdfscene_quality_name(quality), status);
+            }
+        }
+        CPUPROF_END();
+
+        uint64_t serial = frame_serial(&frameScheduler);
+        uint64_t frameStart = SDL_GetPerformanceCounter();
+        CPUPROF_BEGIN("draw_frame");
+        draw_frame();
+        CPUPROF_END();
+        uint64_t frameEnd = SDL_GetPerformanceCounter();
+
+        // Only frames that were submitted count, warm-up ones are left out.
+        if (benchmarkFrames && serial > warmupFrames && frame_serial(&frameScheduler) != serial)
+        {
+            cpuFrameTimes[benchmarkSampleCount++] = (float)((frameEnd - frameStart) * 1000.0 / SDL_GetPerformanceFrequency());
+            run = run && benchmarkSampleCount < benchmarkFrames;
+        }
+        run = run && fatalResult == VK_SUCCESS;
+    }
+
+    if (initStage == INIT_STAGE_RENDER && !recordBenchDraws && !memoryCheck)
+    {
+        report_benchmark();
+        save_gpu_profile();
+        if (cpuTraceFile)
+        {
+            save_cpu_trace(cpuTraceFile);
+        }
+    }
+
+    if (initStage >= INIT_STAGE_RENDER)
+    {
+        fini_render();
+    }
+    if (initStage >= INIT_STAGE_TARGET)
+    {
+        if (headless)
+        {
+            fini_offscreen();
+        }
+        else
+        {
+            fini_swapchain();
+        }
+    }
+    if (initStage >= INIT_STAGE_DEVICE)
+    {
+        fini_device();
+    }
+    if (initStage >= INIT_STAGE_WINDOW && !headless)
+    {
+        fini_window();
+    }
+    if (initStage >= INIT_STAGE_VULKAN)
+    {
+        fini_vulkan();
+    }
+
+    SDL_Quit();
+
+    // A gated run that stopped before producing results must not pass as one without regressions.
+    int ungated = (resultsFile || baselineFile) && !benchmarkProduced;
+    int failed = initStage != INIT_STAGE_RENDER || benchmarkRegressed || ungated || memoryCheckFailed || fatalResult != VK_SUCCESS;
+    return failed ? 1 : 0;
 }
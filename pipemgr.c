@@ -0,0 +1,739 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>
+
+#include "pipemgr.h"
+#include "cpuprof.h"
+
+enum {
+    SPIRV_MAGIC = 0x07230203,
+};
+
+static uint32_t hash_fnv1a(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int copy_path(char* dst, const char* src)
+{
+    size_t length = strlen(src);
+    if (length >= PIPEMGR_MAX_PATH)
+    {
+        return 0;
+    }
+    memcpy(dst, src, length);
+    return 1;
+}
+
+// Copies desc into out with everything the description does not use zeroed, so equal
+// descriptions hash and compare equal regardless of padding or stale bytes.
+static int canonical_desc(PipelineDesc* out, const PipelineDesc* desc)
+{
+    memset(out, 0, sizeof(*out));
+    if (desc->attributeCount > PIPEMGR_MAX_ATTRIBUTES || desc->constantCount > PIPEMGR_MAX_CONSTANTS)
+    {
+        return 0;
+    }
+    if (!copy_path(out->vertexShader, desc->vertexShader)
+        || !copy_path(out->fragmentShader, desc->fragmentShader)
+        || !copy_path(out->computeShader, desc->computeShader))
+    {
+        return 0;
+    }
+    out->layout = desc->layout;
+    out->constantCount = desc->constantCount;
+    memcpy(out->constants, desc->constants, desc->constantCount * sizeof(uint32_t));
+    if (out->computeShader[0])
+    {
+        return 1;
+    }
+
+    out->renderPass = desc->renderPass;
+    out->vertexStride = desc->vertexStride;
+    out->instanceStride = desc->vertexStride ? desc->instanceStride : 0;
+    out->attributeCount = desc->vertexStride ? desc->attributeCount : 0;
+    memcpy(out->attributes, desc->attributes, out->attributeCount * sizeof(VkVertexInputAttributeDescription));
+    out->cullMode = desc->cullMode;
+    out->blend = desc->blend;
+    return 1;
+}
+
+static int stat_file(const char* path, int64_t* mtime, int64_t* size)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        return 0;
+    }
+    *mtime = (int64_t)st.st_mtime;
+    *size = (int64_t)st.st_size;
+    return 1;
+}
+
+static uint32_t find_file(PipelineManager* mgr, const char* path)
+{
+    if (!path[0])
+    {
+        return PIPEMGR_MAX_FILES;
+    }
+    for (uint32_t i = 0; i < mgr->fileCount; ++i)
+    {
+        if (strcmp(mgr->files[i].path, path) == 0)
+        {
+            return i;
+        }
+    }
+    if (mgr->fileCount == PIPEMGR_MAX_FILES)
+    {
+        return PIPEMGR_MAX_FILES;   // still compiled, just not watched
+    }
+
+    PipelineFile* file = &mgr->files[mgr->fileCount];
+    memset(file, 0, sizeof(*file));
+    strcpy(file->path, path);
+    stat_file(path, &file->mtime, &file->size);
+    return mgr->fileCount++;
+}
+
+static VkShaderModule load_shader(VkDevice device, const char* path)
+{
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return VK_NULL_HANDLE;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // A file caught halfway through being rewritten by the compiler fails here rather than in the driver.
+    uint32_t* code = size >= 20 && size % 4 == 0 ? (uint32_t*)malloc(size) : 0;
+    if (code && fread(code, 1, size, file) == (size_t)size && code[0] == SPIRV_MAGIC)
+    {
+        VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+            .codeSize = size,
+            .pCode = code,
+        };
+        vkCreateShaderModule(device, &shaderModuleCreateInfo, 0, &shaderModule);
+    }
+    free(code);
+    fclose(file);
+
+    return shaderModule;
+}
+
+static const char* file_name(const char* path)
+{
+    const char* name = path;
+    for (const char* c = path; *c; ++c)
+    {
+        if (*c == '/' || *c == '\\')
+        {
+            name = c + 1;
+        }
+    }
+    return name;
+}
+
+static const char* stage_path(const PipelineDesc* desc, uint32_t stage)
+{
+    return stage == PIPEMGR_STAGE_VERTEX ? desc->vertexShader
+        : stage == PIPEMGR_STAGE_FRAGMENT ? desc->fragmentShader : desc->computeShader;
+}
+
+// Archive modules are shared and live as long as the manager, modules read from disk belong to one compile.
+// A blob that fails its hash check is replaced by the file it was built from. Sets *shared for archive modules.
+static VkShaderModule acquire_shader(PipelineManager* mgr, const PipelineEntry* entry, uint32_t stage, int* shared)
+{
+    uint32_t blob = entry->blobs[stage];
+    *shared = 0;
+    if (blob == SHADERPAK_NOT_FOUND)
+    {
+        return load_shader(mgr->device, stage_path(&entry->desc, stage));
+    }
+
+    SDL_LockMutex(mgr->lock);
+    VkShaderModule shaderModule = mgr->pakModules[blob];
+    SDL_UnlockMutex(mgr->lock);
+    if (shaderModule)
+    {
+        *shared = 1;
+        return shaderModule;
+    }
+
+    // Hashing the blob and creating the module happen outside the lock, the other workers keep compiling meanwhile.
+    size_t size;
+    const uint32_t* code = shaderpak_code(mgr->pak, blob, &size);
+    if (!code)
+    {
+        SDL_LockMutex(mgr->lock);
+        ++mgr->stats.archiveMismatches;
+        SDL_UnlockMutex(mgr->lock);
+        return load_shader(mgr->device, stage_path(&entry->desc, stage));
+    }
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = size,
+        .pCode = code,
+    };
+    if (vkCreateShaderModule(mgr->device, &shaderModuleCreateInfo, 0, &shaderModule) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    // Two workers may have created the same blob, the first one to publish it wins.
+    SDL_LockMutex(mgr->lock);
+    VkShaderModule published = mgr->pakModules[blob];
+    if (!published)
+    {
+        mgr->pakModules[blob] = shaderModule;
+        ++mgr->stats.archiveModules;
+    }
+    SDL_UnlockMutex(mgr->lock);
+    if (published)
+    {
+        vkDestroyShaderModule(mgr->device, shaderModule, 0);
+        shaderModule = published;
+    }
+    *shared = 1;
+    return shaderModule;
+}
+
+static void release_shader(PipelineManager* mgr, VkShaderModule shaderModule, int shared)
+{
+    if (!shared)
+    {
+        vkDestroyShaderModule(mgr->device, shaderModule, 0);
+    }
+}
+
+static VkPipeline compile_graphics(PipelineManager* mgr, const PipelineEntry* entry, const VkSpecializationInfo* specialization, float* compileMs)
+{
+    VkPipeline result = VK_NULL_HANDLE;
+    const PipelineDesc* desc = &entry->desc;
+
+    int vertexShared, fragmentShared;
+    VkShaderModule vertexShader = acquire_shader(mgr, entry, PIPEMGR_STAGE_VERTEX, &vertexShared);
+    VkShaderModule fragmentShader = acquire_shader(mgr, entry, PIPEMGR_STAGE_FRAGMENT, &fragmentShared);
+    if (!vertexShader || !fragmentShader)
+    {
+        release_shader(mgr, vertexShader, vertexShared);
+        release_shader(mgr, fragmentShader, fragmentShared);
+        return VK_NULL_HANDLE;
+    }
+
+    const VkPipelineShaderStageCreateInfo stages[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertexShader,
+            .pName = "main",
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragmentShader,
+            .pName = "main",
+            .pSpecializationInfo = specialization,
+        },
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInputState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = desc->vertexStride ? (desc->instanceStride ? 2 : 1) : 0,
+        .pVertexBindingDescriptions = (VkVertexInputBindingDescription[]) {
+            { 0, desc->vertexStride, VK_VERTEX_INPUT_RATE_VERTEX },
+            { 1, desc->instanceStride, VK_VERTEX_INPUT_RATE_INSTANCE },
+        },
+        .vertexAttributeDescriptionCount = desc->attributeCount,
+        .pVertexAttributeDescriptions = desc->attributes,
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE,
+    };
+    VkPipelineRasterizationStateCreateInfo rasterizationState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .depthClampEnable = VK_FALSE,
+        .rasterizerDiscardEnable = VK_FALSE,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = desc->cullMode,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .lineWidth = 1.0f,
+    };
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1,
+    };
+    VkPipelineMultisampleStateCreateInfo multisampleState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .minSampleShading = 1.0f,
+    };
+    VkPipelineColorBlendStateCreateInfo colorBlendState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .attachmentCount = 1,
+        .pAttachments = (VkPipelineColorBlendAttachmentState[]) {
+            {
+                .blendEnable = desc->blend,
+                .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+                .dstColorBlendFactor = desc->blend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO,
+                .colorBlendOp = VK_BLEND_OP_ADD,
+                .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+                .dstAlphaBlendFactor = desc->blend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO,
+                .alphaBlendOp = VK_BLEND_OP_ADD,
+                .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+            },
+        },
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = (VkDynamicState[]) { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR },
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 2,
+        .pStages = stages,
+        .pVertexInputState = &vertexInputState,
+        .pInputAssemblyState = &inputAssemblyState,
+        .pViewportState = &viewportState,
+        .pRasterizationState = &rasterizationState,
+        .pMultisampleState = &multisampleState,
+        .pColorBlendState = &colorBlendState,
+        .pDynamicState = &dynamicState,
+        .layout = desc->layout,
+        .renderPass = desc->renderPass,
+    };
+
+    uint64_t createStart = SDL_GetPerformanceCounter();
+    vkCreateGraphicsPipelines(mgr->device, mgr->cache, 1, &pipelineCreateInfo, 0, &result);
+    *compileMs = (float)((SDL_GetPerformanceCounter() - createStart) * 1000.0 / SDL_GetPerformanceFrequency());
+
+    release_shader(mgr, vertexShader, vertexShared);
+    release_shader(mgr, fragmentShader, fragmentShared);
+
+    return result;
+}
+
+static VkPipeline compile_compute(PipelineManager* mgr, const PipelineEntry* entry, const VkSpecializationInfo* specialization, float* compileMs)
+{
+    VkPipeline result = VK_NULL_HANDLE;
+    const PipelineDesc* desc = &entry->desc;
+
+    int computeShared;
+    VkShaderModule computeShader = acquire_shader(mgr, entry, PIPEMGR_STAGE_COMPUTE, &computeShared);
+    if (!computeShader)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = computeShader,
+            .pName = "main",
+            .pSpecializationInfo = specialization,
+        },
+        .layout = desc->layout,
+    };
+
+    uint64_t createStart = SDL_GetPerformanceCounter();
+    vkCreateComputePipelines(mgr->device, mgr->cache, 1, &pipelineCreateInfo, 0, &result);
+    *compileMs = (float)((SDL_GetPerformanceCounter() - createStart) * 1000.0 / SDL_GetPerformanceFrequency());
+
+    release_shader(mgr, computeShader, computeShared);
+
+    return result;
+}
+
+static VkPipeline compile(PipelineManager* mgr, const PipelineEntry* entry, float* compileMs)
+{
+    const PipelineDesc* desc = &entry->desc;
+    VkSpecializationMapEntry entries[PIPEMGR_MAX_CONSTANTS];
+    for (uint32_t i = 0; i < desc->constantCount; ++i)
+    {
+        entries[i] = (VkSpecializationMapEntry){ i, i * sizeof(uint32_t), sizeof(uint32_t) };
+    }
+    VkSpecializationInfo specialization = {
+        .mapEntryCount = desc->constantCount,
+        .pMapEntries = entries,
+        .dataSize = desc->constantCount * sizeof(uint32_t),
+        .pData = desc->constants,
+    };
+    const VkSpecializationInfo* specializationInfo = desc->constantCount ? &specialization : 0;
+
+    *compileMs = 0.0f;
+    return desc->computeShader[0]
+        ? compile_compute(mgr, entry, specializationInfo, compileMs)
+        : compile_graphics(mgr, entry, specializationInfo, compileMs);
+}
+
+static int worker_main(void* data)
+{
+    PipelineManager* mgr = (PipelineManager*)data;
+
+    CPUPROF_THREAD("pipeline worker");
+    for (;;)
+    {
+        SDL_SemWait(mgr->jobSignal);
+        SDL_LockMutex(mgr->lock);
+        if (mgr->quit)
+        {
+            SDL_UnlockMutex(mgr->lock);
+            break;
+        }
+        uint32_t index = mgr->jobs[mgr->jobHead];
+        mgr->jobHead = (mgr->jobHead + 1) % PIPEMGR_MAX_PIPELINES;
+        --mgr->jobCount;
+        SDL_UnlockMutex(mgr->lock);
+
+        // The description and blobs never change while the entry is queued.
+        PipelineEntry* entry = &mgr->entries[index];
+        CPUPROF_BEGIN("compile pipeline");
+        entry->compiled = compile(mgr, entry, &entry->compileMs);
+        CPUPROF_END();
+
+        SDL_LockMutex(mgr->lock);
+        mgr->finished[mgr->finishedCount++] = index;
+        SDL_UnlockMutex(mgr->lock);
+        SDL_SemPost(mgr->finishedSignal);
+    }
+
+    return 0;
+}
+
+static uint32_t find_blob(const PipelineManager* mgr, const PipelineEntry* entry, uint32_t stage)
+{
+    const char* path = stage_path(&entry->desc, stage);
+    uint32_t file = entry->files[stage];
+    if (!mgr->pak || !path[0] || (file < PIPEMGR_MAX_FILES && mgr->files[file].changed))
+    {
+        return SHADERPAK_NOT_FOUND;
+    }
+    return shaderpak_find(mgr->pak, file_name(path));
+}
+
+static void queue_entry(PipelineManager* mgr, uint32_t index)
+{
+    PipelineEntry* entry = &mgr->entries[index];
+    for (uint32_t i = 0; i < PIPEMGR_STAGE_COUNT; ++i)
+    {
+        entry->blobs[i] = find_blob(mgr, entry, i);
+    }
+    entry->queued = 1;
+    ++mgr->busy;
+
+    SDL_LockMutex(mgr->lock);
+    mgr->jobs[(mgr->jobHead + mgr->jobCount) % PIPEMGR_MAX_PIPELINES] = index;
+    ++mgr->jobCount;
+    SDL_UnlockMutex(mgr->lock);
+    SDL_SemPost(mgr->jobSignal);
+}
+
+static const char* entry_name(const PipelineEntry* entry)
+{
+    return entry->desc.computeShader[0] ? entry->desc.computeShader : entry->desc.fragmentShader;
+}
+
+static void publish(PipelineManager* mgr)
+{
+    uint32_t finished[PIPEMGR_MAX_PIPELINES];
+
+    SDL_LockMutex(mgr->lock);
+    uint32_t finishedCount = mgr->finishedCount;
+    memcpy(finished, mgr->finished, finishedCount * sizeof(uint32_t));
+    mgr->finishedCount = 0;
+    SDL_UnlockMutex(mgr->lock);
+
+    for (uint32_t i = 0; i < finishedCount; ++i)
+    {
+        PipelineEntry* entry = &mgr->entries[finished[i]];
+        if (entry->compiled && entry->pipeline && mgr->retiredCount == PIPEMGR_MAX_RETIRED)
+        {
+            // No room to retire the old pipeline until frames finish, try again next update.
+            SDL_LockMutex(mgr->lock);
+            mgr->finished[mgr->finishedCount++] = finished[i];
+            SDL_UnlockMutex(mgr->lock);
+            continue;
+        }
+
+        mgr->stats.compileMs += entry->compileMs;
+        if (entry->compiled)
+        {
+            if (entry->pipeline)
+            {
+                mgr->retired[mgr->retiredCount++] = (RetiredPipeline){ entry->pipeline, mgr->retireSerial };
+            }
+            entry->pipeline = entry->compiled;
+            entry->compiled = VK_NULL_HANDLE;
+            entry->failed = 0;
+            ++mgr->stats.compiled;
+        }
+        else
+        {
+            printf("Pipeline manager: failed to compile %s%s\n", entry_name(entry), entry->pipeline ? ", keeping the old pipeline" : "");
+            entry->failed = 1;
+            ++mgr->stats.failed;
+        }
+
+        entry->queued = 0;
+        --mgr->busy;
+        if (entry->reload)
+        {
+            entry->reload = 0;
+            queue_entry(mgr, finished[i]);
+        }
+    }
+}
+
+static void poll_files(PipelineManager* mgr)
+{
+    for (uint32_t i = 0; i < mgr->fileCount; ++i)
+    {
+        PipelineFile* file = &mgr->files[i];
+        int64_t mtime, size;
+        if (!stat_file(file->path, &mtime, &size) || (mtime == file->mtime && size == file->size))
+        {
+            continue;
+        }
+        file->mtime = mtime;
+        file->size = size;
+        file->changed = 1;
+
+        printf("Pipeline manager: %s changed, rebuilding\n", file->path);
+        for (uint32_t j = 0; j < mgr->entryCount; ++j)
+        {
+            PipelineEntry* entry = &mgr->entries[j];
+            if (entry->files[PIPEMGR_STAGE_VERTEX] != i && entry->files[PIPEMGR_STAGE_FRAGMENT] != i && entry->files[PIPEMGR_STAGE_COMPUTE] != i)
+            {
+                continue;
+            }
+            ++mgr->stats.reloads;
+            if (entry->queued)
+            {
+                entry->reload = 1;
+            }
+            else
+            {
+                queue_entry(mgr, j);
+            }
+        }
+    }
+}
+
+int pipemgr_init(PipelineManager* mgr, VkDevice device, VkPipelineCache cache, const ShaderPak* pak, uint32_t threadCount, int watch)
+{
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->device = device;
+    mgr->cache = cache;
+    mgr->pak = pak && pak->data ? pak : 0;
+    mgr->watch = watch;
+    mgr->lastPoll = SDL_GetTicks();
+
+    if (!threadCount)
+    {
+        int cpuCount = SDL_GetCPUCount();
+        threadCount = cpuCount > 2 ? cpuCount - 1 : 1;
+    }
+    threadCount = threadCount > PIPEMGR_MAX_THREADS ? PIPEMGR_MAX_THREADS : threadCount;
+
+    mgr->lock = SDL_CreateMutex();
+    mgr->jobSignal = SDL_CreateSemaphore(0);
+    mgr->finishedSignal = SDL_CreateSemaphore(0);
+    mgr->pakModules = mgr->pak ? (VkShaderModule*)calloc(mgr->pak->header->blobCount, sizeof(VkShaderModule)) : 0;
+    if (!mgr->lock || !mgr->jobSignal || !mgr->finishedSignal || (mgr->pak && !mgr->pakModules))
+    {
+        pipemgr_destroy(mgr);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        mgr->threads[i] = SDL_CreateThread(worker_main, "PipelineWorker", mgr);
+        if (!mgr->threads[i])
+        {
+            break;
+        }
+        ++mgr->threadCount;
+    }
+    if (!mgr->threadCount)
+    {
+        pipemgr_destroy(mgr);
+        return 0;
+    }
+
+    return 1;
+}
+
+void pipemgr_destroy(PipelineManager* mgr)
+{
+    if (mgr->lock)
+    {
+        SDL_LockMutex(mgr->lock);
+        mgr->quit = 1;
+        SDL_UnlockMutex(mgr->lock);
+    }
+    for (uint32_t i = 0; i < mgr->threadCount; ++i)
+    {
+        SDL_SemPost(mgr->jobSignal);
+    }
+    for (uint32_t i = 0; i < mgr->threadCount; ++i)
+    {
+        SDL_WaitThread(mgr->threads[i], 0);
+    }
+
+    // Workers are gone, so finished results that were never published are safe to read.
+    for (uint32_t i = 0; i < mgr->finishedCount; ++i)
+    {
+        vkDestroyPipeline(mgr->device, mgr->entries[mgr->finished[i]].compiled, 0);
+    }
+    for (uint32_t i = 0; i < mgr->entryCount; ++i)
+    {
+        vkDestroyPipeline(mgr->device, mgr->entries[i].pipeline, 0);
+    }
+    for (uint32_t i = 0; i < mgr->retiredCount; ++i)
+    {
+        vkDestroyPipeline(mgr->device, mgr->retired[i].pipeline, 0);
+    }
+    for (uint32_t i = 0; mgr->pakModules && i < mgr->pak->header->blobCount; ++i)
+    {
+        vkDestroyShaderModule(mgr->device, mgr->pakModules[i], 0);
+    }
+    free(mgr->pakModules);
+
+    if (mgr->finishedSignal)
+    {
+        SDL_DestroySemaphore(mgr->finishedSignal);
+    }
+    if (mgr->jobSignal)
+    {
+        SDL_DestroySemaphore(mgr->jobSignal);
+    }
+    if (mgr->lock)
+    {
+        SDL_DestroyMutex(mgr->lock);
+    }
+    memset(mgr, 0, sizeof(*mgr));
+}
+
+PipelineHandle pipemgr_request(PipelineManager* mgr, const PipelineDesc* desc, PipelineHandle fallback)
+{
+    PipelineDesc canonical;
+    if (!canonical_desc(&canonical, desc))
+    {
+        return 0;
+    }
+    uint32_t hash = hash_fnv1a(&canonical, sizeof(canonical));
+
+    ++mgr->stats.requests;
+    for (uint32_t i = 0; i < mgr->entryCount; ++i)
+    {
+        if (mgr->entries[i].hash == hash && memcmp(&mgr->entries[i].desc, &canonical, sizeof(canonical)) == 0)
+        {
+            ++mgr->stats.deduplicated;
+            return i + 1;
+        }
+    }
+    if (mgr->entryCount == PIPEMGR_MAX_PIPELINES)
+    {
+        return 0;
+    }
+
+    uint32_t index = mgr->entryCount++;
+    PipelineEntry* entry = &mgr->entries[index];
+    memset(entry, 0, sizeof(*entry));
+    entry->desc = canonical;
+    entry->hash = hash;
+    entry->fallback = fallback <= index ? fallback : 0;
+    entry->files[PIPEMGR_STAGE_VERTEX] = find_file(mgr, canonical.vertexShader);
+    entry->files[PIPEMGR_STAGE_FRAGMENT] = find_file(mgr, canonical.fragmentShader);
+    entry->files[PIPEMGR_STAGE_COMPUTE] = find_file(mgr, canonical.computeShader);
+    queue_entry(mgr, index);
+
+    return index + 1;
+}
+
+VkPipeline pipemgr_get(const PipelineManager* mgr, PipelineHandle handle)
+{
+    while (handle)
+    {
+        const PipelineEntry* entry = &mgr->entries[handle - 1];
+        if (entry->pipeline)
+        {
+            return entry->pipeline;
+        }
+        handle = entry->fallback;
+    }
+    return VK_NULL_HANDLE;
+}
+
+int pipemgr_ready(const PipelineManager* mgr, PipelineHandle handle)
+{
+    return handle && mgr->entries[handle - 1].pipeline != VK_NULL_HANDLE;
+}
+
+int pipemgr_failed(const PipelineManager* mgr, PipelineHandle handle)
+{
+    return !handle || mgr->entries[handle - 1].failed;
+}
+
+void pipemgr_update(PipelineManager* mgr, uint64_t frameSerial, uint64_t completedSerial)
+{
+    // Frames up to the last submitted one may have bound anything published so far.
+    mgr->retireSerial = frameSerial - 1;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < mgr->retiredCount; ++i)
+    {
+        if (mgr->retired[i].serial <= completedSerial)
+        {
+            vkDestroyPipeline(mgr->device, mgr->retired[i].pipeline, 0);
+        }
+        else
+        {
+            mgr->retired[kept++] = mgr->retired[i];
+        }
+    }
+    mgr->retiredCount = kept;
+
+    publish(mgr);
+
+    uint32_t now = SDL_GetTicks();
+    if (mgr->watch && now - mgr->lastPoll >= PIPEMGR_WATCH_INTERVAL)
+    {
+        mgr->lastPoll = now;
+        CPUPROF_BEGIN("watch shaders");
+        poll_files(mgr);
+        CPUPROF_END();
+    }
+}
+
+void pipemgr_wait_idle(PipelineManager* mgr)
+{
+    publish(mgr);
+    while (mgr->busy)
+    {
+        SDL_SemWait(mgr->finishedSignal);
+        publish(mgr);
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "shaderpak.h"
+
+/*
+** Pipeline manager.
+**
+** Pipelines are requested by value: a PipelineDesc names the SPIR-V
+** files and the few pieces of fixed-function state that differ between
+** our pipelines. Descriptions are hashed, and requesting the same state
+** twice returns the same handle. New pipelines are compiled by a pool of
+** worker threads against the shared VkPipelineCache, so a request never
+** waits for the driver compiler.
+**
+** A handle resolves to its pipeline once a worker has finished it and
+** pipemgr_update has published it. Until then it resolves to its
+** fallback, or to VK_NULL_HANDLE, and the caller skips the work that
+** needs it. A fallback is always an older handle, so chains end.
+**
+** With watching on, pipemgr_update checks the modification time of every
+** shader file each PIPEMGR_WATCH_INTERVAL ms and recompiles the pipelines
+** that use a changed file in the background. The old pipeline stays in
+** use until its replacement is published, and is destroyed once every
+** frame that may have bound it has finished, so reloads never wait for
+** the device to go idle. A reload that fails to compile keeps the old
+** pipeline.
+**
+** With a shader archive, shaders are looked up in it by file name and
+** their modules are created from the mapping on first use, one per
+** unique blob, shared by every pipeline that needs it. Files missing
+** from the archive, changed since startup, or whose blob fails its hash
+** check are read from disk.
+*/
+
+enum {
+    PIPEMGR_MAX_THREADS = 8,
+    PIPEMGR_MAX_PIPELINES = 64,
+    PIPEMGR_MAX_FILES = 32,
+    PIPEMGR_MAX_RETIRED = 64,
+    PIPEMGR_MAX_PATH = 64,
+    PIPEMGR_MAX_ATTRIBUTES = 8,     // over both bindings
+    PIPEMGR_MAX_CONSTANTS = 8,
+    PIPEMGR_WATCH_INTERVAL = 250,   // ms
+};
+
+enum {
+    PIPEMGR_STAGE_VERTEX,
+    PIPEMGR_STAGE_FRAGMENT,
+    PIPEMGR_STAGE_COMPUTE,
+    PIPEMGR_STAGE_COUNT,
+};
+
+typedef uint32_t PipelineHandle;    // 0 - none
+
+// A compute pipeline if computeShader is set, otherwise a graphics pipeline with dynamic viewport
+// and scissor. Start from a zero-initialized struct; bytes past the counts and strings are ignored.
+typedef struct tagPipelineDesc
+{
+    char vertexShader[PIPEMGR_MAX_PATH];
+    char fragmentShader[PIPEMGR_MAX_PATH];
+    char computeShader[PIPEMGR_MAX_PATH];
+    VkPipelineLayout layout;
+    VkRenderPass renderPass;
+    uint32_t vertexStride;          // binding 0, 0 - no vertex input
+    uint32_t instanceStride;        // binding 1, advanced per instance, 0 - none; needs vertexStride
+    uint32_t attributeCount;
+    VkVertexInputAttributeDescription attributes[PIPEMGR_MAX_ATTRIBUTES];
+    VkCullModeFlags cullMode;
+    VkBool32 blend;                 // premultiplied alpha
+    uint32_t constantCount;         // 32-bit specialization constants 0..count-1, fragment or compute stage
+    uint32_t constants[PIPEMGR_MAX_CONSTANTS];
+} PipelineDesc;
+
+typedef struct tagPipelineEntry
+{
+    PipelineDesc desc;              // unused bytes zeroed, so descriptions compare as memory
+    uint32_t hash;
+    PipelineHandle fallback;
+    uint32_t files[PIPEMGR_STAGE_COUNT];    // file table indices, PIPEMGR_MAX_FILES - stage unused
+    uint32_t blobs[PIPEMGR_STAGE_COUNT];    // archive blobs, SHADERPAK_NOT_FOUND - read the file; set when queued
+    VkPipeline pipeline;            // published, VK_NULL_HANDLE until the first compile succeeds
+    int queued;                     // waiting for or being compiled by a worker
+    int reload;                     // a file changed while queued, compile again once finished
+    int failed;                     // last compile failed
+
+    // Written by the worker, read once it is on the finished list.
+    VkPipeline compiled;
+    float compileMs;
+} PipelineEntry;
+
+typedef struct tagPipelineFile
+{
+    char path[PIPEMGR_MAX_PATH];
+    int64_t mtime;
+    int64_t size;
+    int changed;                    // since startup, so the archive copy is stale
+} PipelineFile;
+
+typedef struct tagRetiredPipeline
+{
+    VkPipeline pipeline;
+    uint64_t serial;                // last frame that may have bound it
+} RetiredPipeline;
+
+typedef struct tagPipelineStats
+{
+    uint32_t requests;
+    uint32_t deduplicated;          // requests answered with an existing handle
+    uint32_t compiled;
+    uint32_t failed;
+    uint32_t reloads;               // compiles queued because a shader file changed
+    uint32_t archiveModules;        // modules created from the shader archive
+    uint32_t archiveMismatches;     // blobs that failed their hash check, read from disk instead
+    float compileMs;                // driver time, summed over all workers
+} PipelineStats;
+
+typedef struct tagPipelineManager
+{
+    VkDevice device;
+    VkPipelineCache cache;
+    const ShaderPak* pak;           // 0 - every shader is read from disk
+    VkShaderModule* pakModules;     // per archive blob, created on first use and published under lock
+    uint32_t threadCount;
+    struct SDL_Thread* threads[PIPEMGR_MAX_THREADS];
+    int watch;                      // poll shader files for changes
+    uint32_t lastPoll;              // SDL_GetTicks
+    uint64_t retireSerial;          // last submitted frame, from pipemgr_update
+
+    uint32_t entryCount;
+    PipelineEntry entries[PIPEMGR_MAX_PIPELINES];
+    uint32_t fileCount;
+    PipelineFile files[PIPEMGR_MAX_FILES];
+    uint32_t retiredCount;
+    RetiredPipeline retired[PIPEMGR_MAX_RETIRED];
+    uint32_t busy;                  // entries queued or finished but not yet published
+
+    // Shared with the workers, guarded by lock.
+    struct SDL_mutex* lock;
+    struct SDL_semaphore* jobSignal;        // one post per queued job
+    struct SDL_semaphore* finishedSignal;   // one post per finished job
+    uint32_t jobs[PIPEMGR_MAX_PIPELINES];   // ring of entry indices
+    uint32_t jobHead;
+    uint32_t jobCount;
+    uint32_t finished[PIPEMGR_MAX_PIPELINES];
+    uint32_t finishedCount;
+    int quit;
+
+    PipelineStats stats;
+} PipelineManager;
+
+// threadCount 0 uses one thread less than there are cores, at least one.
+// pak may be 0 and must stay open until pipemgr_destroy.
+int pipemgr_init(PipelineManager* mgr, VkDevice device, VkPipelineCache cache, const ShaderPak* pak, uint32_t threadCount, int watch);
+// Stops the workers and destroys every pipeline; the device must be idle.
+void pipemgr_destroy(PipelineManager* mgr);
+
+// Returns the handle of the pipeline described by desc, queuing it for compilation unless an identical
+// description was requested before. Returns 0 if the table is full or a path is too long.
+PipelineHandle pipemgr_request(PipelineManager* mgr, const PipelineDesc* desc, PipelineHandle fallback);
+
+// The handle's pipeline, else the first published pipeline along its fallbacks, else VK_NULL_HANDLE.
+VkPipeline pipemgr_get(const PipelineManager* mgr, PipelineHandle handle);
+int pipemgr_ready(const PipelineManager* mgr, PipelineHandle handle);
+int pipemgr_failed(const PipelineManager* mgr, PipelineHandle handle);
+
+// Call once per frame before recording. Publishes finished pipelines, destroys retired ones
+// that completedSerial has passed, and checks the shader files if watching.
+void pipemgr_update(PipelineManager* mgr, uint64_t frameSerial, uint64_t completedSerial);
+
+// Blocks until every queued pipeline is finished and published. For tools and benchmarks only.
+void pipemgr_wait_idle(PipelineManager* mgr);
+
+static inline int pipemgr_idle(const PipelineManager* mgr) { return mgr->busy == 0; }
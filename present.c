@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#include "present.h"
+#include "cpuprof.h"
+
+static const char* const policyNames[PRESENT_POLICY_COUNT] = { "fifo", "fifo-relaxed", "mailbox", "immediate" };
+
+// Preferred mode first, FIFO last.
+static const VkPresentModeKHR fallbacks[PRESENT_POLICY_COUNT][3] = {
+    { VK_PRESENT_MODE_FIFO_KHR },
+    { VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR },
+    { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR },
+    { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR },
+};
+
+const char* present_policy_name(uint32_t policy)
+{
+    return policy < PRESENT_POLICY_COUNT ? policyNames[policy] : "unknown";
+}
+
+const char* present_mode_name(VkPresentModeKHR mode)
+{
+    switch (mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo-relaxed";
+    default: return "unknown";
+    }
+}
+
+VkPresentModeKHR present_choose_mode(uint32_t policy, const VkPresentModeKHR* modes, uint32_t modeCount)
+{
+    const VkPresentModeKHR* chain = fallbacks[policy < PRESENT_POLICY_COUNT ? policy : PRESENT_POLICY_FIFO];
+    for (uint32_t i = 0; chain[i] != VK_PRESENT_MODE_FIFO_KHR; ++i)
+    {
+        for (uint32_t j = 0; j < modeCount; ++j)
+        {
+            if (modes[j] == chain[i])
+            {
+                return chain[i];
+            }
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;   // always supported
+}
+
+uint32_t present_image_count(VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR* capabilities, uint32_t maxImages)
+{
+    // Mailbox needs one image on screen, one waiting and one being rendered; the others get by with two.
+    uint32_t count = mode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+    uint32_t maxCount = capabilities->maxImageCount && capabilities->maxImageCount < maxImages ? capabilities->maxImageCount : maxImages;
+    count = count < capabilities->minImageCount ? capabilities->minImageCount : count;
+    return count < maxCount ? count : maxCount;
+}
+
+void present_pacer_init(PresentPacer* pacer, int enabled)
+{
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->enabled = enabled;
+}
+
+uint64_t present_pacer_wait(PresentPacer* pacer)
+{
+    uint64_t now = cpuprof_now_ns();
+    if (!pacer->enabled || pacer->delayMs <= 0.0f)
+    {
+        return now;
+    }
+
+    // Sleep is only good to a millisecond or so, spin the rest.
+    uint64_t end = now + (uint64_t)(pacer->delayMs * 1e6f);
+    if (pacer->delayMs > 2.0f)
+    {
+        SDL_Delay((uint32_t)pacer->delayMs - 1);
+    }
+    while ((now = cpuprof_now_ns()) < end)
+    {
+    }
+    return now;
+}
+
+void present_pacer_update(PresentPacer* pacer, float blockedMs)
+{
+    ++pacer->frameCount;
+    pacer->delaySum += pacer->delayMs;
+    pacer->blockedSum += blockedMs;
+    if (!pacer->enabled)
+    {
+        return;
+    }
+
+    float error = blockedMs - PRESENT_PACE_SLACK_MS;
+    float delay = pacer->delayMs + error * (error > 0.0f ? 0.25f : 1.0f);
+    pacer->delayMs = delay < 0.0f ? 0.0f : (delay > PRESENT_PACE_MAX_DELAY_MS ? PRESENT_PACE_MAX_DELAY_MS : delay);
+}
+
+void present_latency_begin(PresentPacer* pacer, uint32_t frame, uint64_t inputNs)
+{
+    pacer->inputNs[frame] = inputNs;
+}
+
+void present_latency_end(PresentPacer* pacer, uint32_t frame, uint64_t endNs)
+{
+    uint64_t inputNs = pacer->inputNs[frame];
+    pacer->inputNs[frame] = 0;
+    if (!inputNs || endNs <= inputNs)
+    {
+        return;
+    }
+
+    float ms = (float)((endNs - inputNs) * 1e-6);
+    pacer->latencyMin = !pacer->latencyCount || ms < pacer->latencyMin ? ms : pacer->latencyMin;
+    pacer->latencyMax = ms > pacer->latencyMax ? ms : pacer->latencyMax;
+    pacer->latencySum += ms;
+    ++pacer->latencyCount;
+}
+
+void present_print_stats(const PresentPacer* pacer)
+{
+    if (pacer->frameCount)
+    {
+        printf("Frame pacing: %s, delay mean %.2f ms last %.2f ms, blocked mean %.2f ms\n", pacer->enabled ? "on" : "off",
+            pacer->delaySum / pacer->frameCount, pacer->delayMs, pacer->blockedSum / pacer->frameCount);
+    }
+    if (!pacer->latencyCount)
+    {
+        printf("Input to present: needs calibrated GPU timestamps\n");
+        return;
+    }
+    printf("Input to present (ms): mean %.2f min %.2f max %.2f (%u frames)\n",
+        pacer->latencySum / pacer->latencyCount, pacer->latencyMin, pacer->latencyMax, pacer->latencyCount);
+}
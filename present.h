@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+/*
+** Present policy and frame pacing.
+**
+** A policy names the presentation mode asked for. Surfaces support
+** different modes, so present_choose_mode walks a fallback chain that
+** ends in FIFO, which every surface supports.
+**
+** The pacer delays each frame before its input is sampled, so the frame
+** reaches the queue as the one ahead of it drains instead of waiting
+** behind it. Time the frame then spends blocked - on its frame slot, on
+** a swapchain image, in present - is how much too early it started. The
+** delay moves to leave PRESENT_PACE_SLACK_MS of blocking, growing slowly
+** and shrinking quickly, so one long frame doesn't cost a display
+** interval. With the delay settled, the queue in front of the display
+** holds about one frame whatever the present mode.
+**
+** Input-to-present latency runs from the moment a frame samples input to
+** the end of its GPU work on the CPU clock, which is when the image goes
+** to the presentation engine. The wait in the presentation queue after
+** that is not visible without display timing extensions; keeping that
+** queue short is what pacing is for.
+*/
+
+enum {
+    PRESENT_POLICY_FIFO,            // vsync, never tears
+    PRESENT_POLICY_FIFO_RELAXED,    // vsync, tears when a frame is late
+    PRESENT_POLICY_MAILBOX,         // latest frame at vsync, never tears
+    PRESENT_POLICY_IMMEDIATE,       // no vsync, tears
+    PRESENT_POLICY_COUNT,
+};
+
+enum {
+    PRESENT_MAX_FRAMES = 4,         // frame slots with a latency sample in flight
+    PRESENT_PACE_SLACK_MS = 1,
+    PRESENT_PACE_MAX_DELAY_MS = 50,
+};
+
+typedef struct tagPresentPacer
+{
+    int enabled;
+    float delayMs;                  // before the next frame samples input
+    uint64_t inputNs[PRESENT_MAX_FRAMES];   // per frame slot, 0 - no sample in flight
+
+    uint32_t frameCount;
+    double delaySum;
+    double blockedSum;
+    uint32_t latencyCount;
+    double latencySum;
+    float latencyMin;
+    float latencyMax;
+} PresentPacer;
+
+const char* present_policy_name(uint32_t policy);
+const char* present_mode_name(VkPresentModeKHR mode);
+
+// Mode for the policy among the supported ones, falling back towards FIFO.
+VkPresentModeKHR present_choose_mode(uint32_t policy, const VkPresentModeKHR* modes, uint32_t modeCount);
+
+// Fewest images that let the mode run without waiting on the display more than it has to, within the
+// surface limits and maxImages.
+uint32_t present_image_count(VkPresentModeKHR mode, const VkSurfaceCapabilitiesKHR* capabilities, uint32_t maxImages);
+
+void present_pacer_init(PresentPacer* pacer, int enabled);
+
+// Sleeps for the current delay, returns the time input is sampled at, cpuprof_now_ns clock.
+uint64_t present_pacer_wait(PresentPacer* pacer);
+
+// Feeds the time the frame spent blocked after sampling input.
+void present_pacer_update(PresentPacer* pacer, float blockedMs);
+
+// A submitted frame in slot frame sampled input at inputNs.
+void present_latency_begin(PresentPacer* pacer, uint32_t frame, uint64_t inputNs);
+
+// The slot's frame finished on the GPU at endNs, 0 if unknown.
+void present_latency_end(PresentPacer* pacer, uint32_t frame, uint64_t endNs);
+
+void present_print_stats(const PresentPacer* pacer);
@@ -0,0 +1,203 @@
+#include <string.h>
+#include <assert.h>
+
+#include <SDL2/SDL.h>
+
+#include "record.h"
+#include "cpuprof.h"
+
+static VkCommandBuffer acquire_buffer(ParallelRecorder* recorder, RecordWorker* worker)
+{
+    uint32_t frame = recorder->frame;
+    if (worker->used == RECORD_MAX_JOBS_PER_FRAME)
+    {
+        return VK_NULL_HANDLE;
+    }
+    if (worker->used == worker->allocated[frame])
+    {
+        VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = worker->pools[frame],
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1,
+        };
+        vkAllocateCommandBuffers(recorder->device, &commandBufferAllocInfo, &worker->buffers[frame][worker->allocated[frame]++]);
+    }
+
+    return worker->buffers[frame][worker->used++];
+}
+
+static void record_range(ParallelRecorder* recorder, RecordWorker* worker)
+{
+    uint32_t i = worker->index;
+    uint32_t first = (uint32_t)((uint64_t)recorder->itemCount * i / recorder->activeThreads);
+    uint32_t last = (uint32_t)((uint64_t)recorder->itemCount * (i + 1) / recorder->activeThreads);
+
+    recorder->results[i] = VK_NULL_HANDLE;
+    if (first == last)
+    {
+        return;
+    }
+
+    VkCommandBuffer commandBuffer = acquire_buffer(recorder, worker);
+    if (!commandBuffer)
+    {
+        return;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &recorder->inheritance,
+    };
+    CPUPROF_BEGIN("record range");
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    recorder->func(commandBuffer, first, last - first, recorder->userData);
+    vkEndCommandBuffer(commandBuffer);
+    CPUPROF_END();
+
+    recorder->results[i] = commandBuffer;
+}
+
+static int worker_main(void* data)
+{
+    RecordWorker* worker = (RecordWorker*)data;
+    ParallelRecorder* recorder = worker->recorder;
+
+    CPUPROF_THREAD("record worker");
+    for (;;)
+    {
+        SDL_SemWait(worker->start);
+        if (recorder->quit)
+        {
+            break;
+        }
+        record_range(recorder, worker);
+        SDL_SemPost(recorder->done);
+    }
+
+    return 0;
+}
+
+int recorder_init(ParallelRecorder* recorder, VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount)
+{
+    assert(frameCount <= RECORD_MAX_FRAMES);
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->device = device;
+    recorder->threadCount = threadCount < 1 ? 1 : (threadCount > RECORD_MAX_THREADS ? RECORD_MAX_THREADS : threadCount);
+    recorder->activeThreads = recorder->threadCount;
+    recorder->frameCount = frameCount;
+    recorder->done = SDL_CreateSemaphore(0);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queueFamilyIndex,
+    };
+
+    for (uint32_t i = 0; i < recorder->threadCount; ++i)
+    {
+        RecordWorker* worker = &recorder->workers[i];
+        worker->recorder = recorder;
+        worker->index = i;
+        for (uint32_t j = 0; j < frameCount; ++j)
+        {
+            vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &worker->pools[j]);
+        }
+
+        // Worker 0 is the calling thread.
+        if (i > 0)
+        {
+            worker->start = SDL_CreateSemaphore(0);
+            worker->thread = SDL_CreateThread(worker_main, "RecordWorker", worker);
+            if (!worker->thread)
+            {
+                for (uint32_t j = 0; j < frameCount; ++j)
+                {
+                    vkDestroyCommandPool(device, worker->pools[j], 0);
+                }
+                SDL_DestroySemaphore(worker->start);
+                recorder->threadCount = recorder->activeThreads = i;
+                break;
+            }
+        }
+    }
+
+    return 1;
+}
+
+void recorder_destroy(ParallelRecorder* recorder)
+{
+    recorder->quit = 1;
+    for (uint32_t i = 1; i < recorder->threadCount; ++i)
+    {
+        RecordWorker* worker = &recorder->workers[i];
+        if (worker->thread)
+        {
+            SDL_SemPost(worker->start);
+            SDL_WaitThread(worker->thread, 0);
+            SDL_DestroySemaphore(worker->start);
+        }
+    }
+
+    for (uint32_t i = 0; i < recorder->threadCount; ++i)
+    {
+        for (uint32_t j = 0; j < recorder->frameCount; ++j)
+        {
+            vkDestroyCommandPool(recorder->device, recorder->workers[i].pools[j], 0);
+        }
+    }
+    SDL_DestroySemaphore(recorder->done);
+}
+
+void recorder_begin_frame(ParallelRecorder* recorder, uint32_t frame)
+{
+    recorder->frame = frame;
+    for (uint32_t i = 0; i < recorder->threadCount; ++i)
+    {
+        vkResetCommandPool(recorder->device, recorder->workers[i].pools[frame], 0);
+        recorder->workers[i].used = 0;
+    }
+}
+
+uint32_t recorder_record(ParallelRecorder* recorder, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+    uint32_t itemCount, RecordFunc func, void* userData, VkCommandBuffer* commandBuffers)
+{
+    recorder->func = func;
+    recorder->userData = userData;
+    recorder->itemCount = itemCount;
+    recorder->inheritance = (VkCommandBufferInheritanceInfo){
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderPass,
+        .subpass = subpass,
+        .framebuffer = framebuffer,
+    };
+
+    // Never wake more threads than there are items.
+    uint32_t threads = recorder->activeThreads < itemCount ? recorder->activeThreads : (itemCount ? itemCount : 1);
+    uint32_t activeThreads = recorder->activeThreads;
+    recorder->activeThreads = threads;
+
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        SDL_SemPost(recorder->workers[i].start);
+    }
+    record_range(recorder, &recorder->workers[0]);
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        SDL_SemWait(recorder->done);
+    }
+
+    recorder->activeThreads = activeThreads;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < threads; ++i)
+    {
+        if (recorder->results[i])
+        {
+            commandBuffers[count++] = recorder->results[i];
+        }
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/*
+** Parallel command recording.
+**
+** A job of N items is split into contiguous ranges, one per thread, and
+** every thread records its range into a secondary command buffer that
+** continues the current render pass. The calling thread records the
+** first range itself. Secondaries are returned in item order, so
+** executing them in sequence preserves draw order.
+**
+** Every worker owns one command pool per frame in flight. Pools are
+** reset in bulk by recorder_begin_frame, which must only be called once
+** the frame's fence has signaled.
+*/
+
+enum {
+    RECORD_MAX_THREADS = 16,
+    RECORD_MAX_FRAMES = 4,
+    RECORD_MAX_JOBS_PER_FRAME = 16,
+};
+
+typedef void (*RecordFunc)(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, void* userData);
+
+typedef struct tagRecordWorker
+{
+    struct tagParallelRecorder* recorder;
+    uint32_t index;
+    struct SDL_Thread* thread;
+    struct SDL_semaphore* start;
+    VkCommandPool pools[RECORD_MAX_FRAMES];
+    VkCommandBuffer buffers[RECORD_MAX_FRAMES][RECORD_MAX_JOBS_PER_FRAME];
+    uint32_t allocated[RECORD_MAX_FRAMES];
+    uint32_t used;
+} RecordWorker;
+
+typedef struct tagParallelRecorder
+{
+    VkDevice device;
+    uint32_t threadCount;
+    uint32_t activeThreads;     // threads used per job, 1..threadCount
+    uint32_t frameCount;
+    uint32_t frame;
+    RecordWorker workers[RECORD_MAX_THREADS];
+    struct SDL_semaphore* done;
+    int quit;
+
+    // Job being recorded.
+    RecordFunc func;
+    void* userData;
+    uint32_t itemCount;
+    VkCommandBufferInheritanceInfo inheritance;
+    VkCommandBuffer results[RECORD_MAX_THREADS];
+} ParallelRecorder;
+
+int recorder_init(ParallelRecorder* recorder, VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t frameCount);
+void recorder_destroy(ParallelRecorder* recorder);
+
+void recorder_begin_frame(ParallelRecorder* recorder, uint32_t frame);
+
+// Records itemCount items with func on all active threads, writes secondaries to commandBuffers
+// and returns how many were written, ready for vkCmdExecuteCommands.
+uint32_t recorder_record(ParallelRecorder* recorder, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer,
+    uint32_t itemCount, RecordFunc func, void* userData, VkCommandBuffer* commandBuffers);
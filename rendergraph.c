@@ -0,0 +1,981 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "rendergraph.h"
+
+// Pass type for accesses outside the graph: the previous or next frame, whose shader stages are unknown.
+enum {
+    RG_PASS_EXTERNAL = RG_PASS_TRANSFER + 1,
+};
+
+typedef struct tagRgAccessInfo
+{
+    VkPipelineStageFlags stages;    // 0 - shader stages of the pass
+    VkAccessFlags access;
+    VkImageLayout layout;
+    uint32_t write;
+    VkImageUsageFlags imageUsage;
+    VkBufferUsageFlags bufferUsage;
+} RgAccessInfo;
+
+static const RgAccessInfo accessInfo[RG_ACCESS_COUNT] = {
+    [RG_ACCESS_NONE] = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0 },
+    [RG_ACCESS_COLOR_WRITE] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0 },
+    [RG_ACCESS_DEPTH_WRITE] = { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 },
+    [RG_ACCESS_DEPTH_READ] = { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 0, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0 },
+    [RG_ACCESS_SAMPLED_READ] = { 0, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, VK_IMAGE_USAGE_SAMPLED_BIT, VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT },
+    [RG_ACCESS_STORAGE_READ] = { 0, VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL, 0, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+    [RG_ACCESS_STORAGE_WRITE] = { 0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL, 1, VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+    [RG_ACCESS_UNIFORM_READ] = { 0, VK_ACCESS_UNIFORM_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT },
+    [RG_ACCESS_VERTEX_READ] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT },
+    [RG_ACCESS_INDEX_READ] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT },
+    [RG_ACCESS_INDIRECT_READ] = { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT },
+    [RG_ACCESS_TRANSFER_READ] = { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+    [RG_ACCESS_TRANSFER_WRITE] = { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+    [RG_ACCESS_PRESENT] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, 0, 0, 0 },
+};
+
+static const VkAccessFlags writeAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+// Hazard tracking state of one resource while walking the passes.
+typedef struct tagRgState
+{
+    VkPipelineStageFlags writeStages;   // last write, or last layout transition
+    VkAccessFlags writeAccess;
+    VkPipelineStageFlags readStages;    // reads since then
+    VkPipelineStageFlags visibleStages; // stages and accesses the write was made visible to
+    VkAccessFlags visibleAccess;
+    VkImageLayout layout;
+} RgState;
+
+static VkPipelineStageFlags stages_of(uint32_t passType, uint32_t access)
+{
+    if (accessInfo[access].stages)
+    {
+        return accessInfo[access].stages;
+    }
+    switch (passType)
+    {
+    case RG_PASS_GRAPHICS: return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    case RG_PASS_COMPUTE: return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    default: return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+}
+
+static VkImageAspectFlags aspect_of(VkFormat format)
+{
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    case VK_FORMAT_S8_UINT:
+        return VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+static VkDeviceSize align_up64(VkDeviceSize value, VkDeviceSize align)
+{
+    return (value + (align - 1)) / align * align;
+}
+
+static uint32_t is_attachment(uint32_t access)
+{
+    return access == RG_ACCESS_COLOR_WRITE || access == RG_ACCESS_DEPTH_WRITE || access == RG_ACCESS_DEPTH_READ;
+}
+
+static RgState state_after(uint32_t passType, uint32_t access)
+{
+    RgState state = { 0 };
+    if (accessInfo[access].write)
+    {
+        state.writeStages = stages_of(passType, access);
+        state.writeAccess = accessInfo[access].access & writeAccessMask;
+    }
+    else if (access != RG_ACCESS_NONE)
+    {
+        state.readStages = stages_of(passType, access);
+    }
+    state.layout = accessInfo[access].layout;
+    return state;
+}
+
+// Moves the resource to a new access, adding whatever dependency that needs to the batch.
+static void transition(RgState* state, const RgResource* resource, uint32_t resourceIndex,
+    VkPipelineStageFlags stages, uint32_t access, RgBarrierBatch* batch)
+{
+    VkAccessFlags accessMask = accessInfo[access].access;
+    VkImageLayout layout = resource->isImage ? accessInfo[access].layout : VK_IMAGE_LAYOUT_UNDEFINED;
+    uint32_t write = accessInfo[access].write;
+    uint32_t layoutChange = resource->isImage && layout != state->layout;
+
+    uint32_t needed = layoutChange;
+    if (write)
+    {
+        needed |= (state->writeStages | state->readStages) != 0;
+    }
+    else
+    {
+        needed |= state->writeStages
+            && ((stages & ~state->visibleStages) || (accessMask & ~state->visibleAccess));
+    }
+
+    if (needed && batch)
+    {
+        VkPipelineStageFlags srcStages = state->writeStages | state->readStages;
+        batch->srcStages |= srcStages ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        batch->dstStages |= stages;
+        if (layoutChange)
+        {
+            assert(batch->imageBarrierCount < RG_MAX_PASS_ACCESSES);
+            batch->imageBarriers[batch->imageBarrierCount++] = (RgImageBarrier){
+                resourceIndex, state->writeAccess, accessMask, state->layout, layout
+            };
+        }
+        else
+        {
+            batch->srcAccess |= state->writeAccess;
+            batch->dstAccess |= accessMask;
+        }
+    }
+
+    if (write)
+    {
+        state->writeStages = stages;
+        state->writeAccess = accessMask & writeAccessMask;
+        state->readStages = 0;
+        state->visibleStages = 0;
+        state->visibleAccess = 0;
+    }
+    else if (layoutChange)
+    {
+        // The transition itself writes the image and makes earlier writes visible to this access.
+        state->writeStages = stages;
+        state->writeAccess = 0;
+        state->readStages = stages;
+        state->visibleStages = stages;
+        state->visibleAccess = accessMask;
+    }
+    else
+    {
+        state->readStages |= stages;
+        if (needed)
+        {
+            state->visibleStages |= stages;
+            state->visibleAccess |= accessMask;
+        }
+    }
+    state->layout = layout;
+}
+
+static RgPassAccess* find_access(RgPass* pass, uint32_t resource)
+{
+    for (uint32_t i = 0; i < pass->accessCount; ++i)
+    {
+        if (pass->accesses[i].resource == resource)
+        {
+            return &pass->accesses[i];
+        }
+    }
+    return 0;
+}
+
+static RgPassAccess* first_access(RenderGraph* graph, uint32_t resource)
+{
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        RgPassAccess* access = graph->passes[i].live ? find_access(&graph->passes[i], resource) : 0;
+        if (access)
+        {
+            return access;
+        }
+    }
+    return 0;
+}
+
+// Walks the live passes from the given initial states, optionally recording barriers.
+static void simulate(RenderGraph* graph, RgState* states, int emit)
+{
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        RgPass* pass = &graph->passes[i];
+        if (!pass->live)
+        {
+            continue;
+        }
+        if (emit)
+        {
+            memset(&pass->barriers, 0, sizeof(pass->barriers));
+        }
+        for (uint32_t j = 0; j < pass->accessCount; ++j)
+        {
+            const RgPassAccess* access = &pass->accesses[j];
+            transition(&states[access->resource], &graph->resources[access->resource], access->resource,
+                stages_of(pass->type, access->access), access->access, emit ? &pass->barriers : 0);
+        }
+    }
+}
+
+static void cull(RenderGraph* graph)
+{
+    uint32_t needed[RG_MAX_RESOURCES];
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        needed[i] = graph->resources[i].imported && graph->resources[i].finalAccess != RG_ACCESS_NONE;
+    }
+
+    for (uint32_t i = graph->passCount; i-- > 0;)
+    {
+        RgPass* pass = &graph->passes[i];
+        pass->live = (pass->flags & RG_PASS_SIDE_EFFECTS) != 0;
+        for (uint32_t j = 0; j < pass->accessCount; ++j)
+        {
+            pass->live |= accessInfo[pass->accesses[j].access].write && needed[pass->accesses[j].resource];
+        }
+        if (!pass->live)
+        {
+            continue;
+        }
+
+        // A clear replaces the contents, earlier writers of it are no longer needed. Everything else is read.
+        for (uint32_t j = 0; j < pass->accessCount; ++j)
+        {
+            const RgPassAccess* access = &pass->accesses[j];
+            needed[access->resource] = !access->clear;
+        }
+    }
+}
+
+static int create_transient(RenderGraph* graph, RgResource* resource)
+{
+    if (resource->isImage)
+    {
+        VkImageCreateInfo imageCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = resource->format,
+            .extent = { resource->extent.width, resource->extent.height, 1 },
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = resource->imageUsage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        };
+        if (vkCreateImage(graph->device, &imageCreateInfo, 0, &resource->image) != VK_SUCCESS)
+        {
+            return 0;
+        }
+        vkGetImageMemoryRequirements(graph->device, resource->image, &resource->memoryRequirements);
+    }
+    else
+    {
+        VkBufferCreateInfo bufferCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = resource->size,
+            .usage = resource->bufferUsage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        if (vkCreateBuffer(graph->device, &bufferCreateInfo, 0, &resource->buffer) != VK_SUCCESS)
+        {
+            return 0;
+        }
+        vkGetBufferMemoryRequirements(graph->device, resource->buffer, &resource->memoryRequirements);
+    }
+
+    return 1;
+}
+
+static int lifetimes_overlap(const RgResource* a, const RgResource* b)
+{
+    return a->firstPass <= b->lastPass && b->firstPass <= a->lastPass;
+}
+
+static int memory_overlaps(const RgResource* a, const RgResource* b)
+{
+    return a->offset < b->offset + b->memoryRequirements.size && b->offset < a->offset + a->memoryRequirements.size;
+}
+
+// Greedy placement, biggest first: every resource goes to the lowest offset that doesn't collide
+// with a placed resource whose pass range overlaps its own.
+static VkDeviceSize place_transients(RenderGraph* graph, uint32_t* transients, uint32_t count, VkDeviceSize alignment)
+{
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        uint32_t value = transients[i];
+        uint32_t j = i;
+        while (j > 0 && graph->resources[transients[j - 1]].memoryRequirements.size < graph->resources[value].memoryRequirements.size)
+        {
+            transients[j] = transients[j - 1];
+            --j;
+        }
+        transients[j] = value;
+    }
+
+    VkDeviceSize heapSize = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        RgResource* resource = &graph->resources[transients[i]];
+        VkDeviceSize best = VK_WHOLE_SIZE;
+
+        // Candidates are the block start and the end of every placed neighbour in time.
+        for (uint32_t c = 0; c <= i; ++c)
+        {
+            const RgResource* candidate = c < i ? &graph->resources[transients[c]] : 0;
+            if (candidate && !lifetimes_overlap(candidate, resource))
+            {
+                continue;
+            }
+            resource->offset = candidate ? align_up64(candidate->offset + candidate->memoryRequirements.size, alignment) : 0;
+            if (resource->offset >= best)
+            {
+                continue;
+            }
+
+            uint32_t fits = 1;
+            for (uint32_t j = 0; j < i && fits; ++j)
+            {
+                const RgResource* placed = &graph->resources[transients[j]];
+                fits = !lifetimes_overlap(placed, resource) || !memory_overlaps(placed, resource);
+            }
+            if (fits)
+            {
+                best = resource->offset;
+            }
+        }
+
+        resource->offset = best;
+        heapSize = best + resource->memoryRequirements.size > heapSize ? best + resource->memoryRequirements.size : heapSize;
+    }
+
+    return heapSize;
+}
+
+static int allocate_transients(RenderGraph* graph)
+{
+    uint32_t transients[RG_MAX_RESOURCES];
+    uint32_t count = 0;
+    uint32_t memoryTypes = graph->memoryTypes;
+    VkDeviceSize alignment = graph->bufferImageGranularity ? graph->bufferImageGranularity : 1;
+
+    graph->unaliasedSize = 0;
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        RgResource* resource = &graph->resources[i];
+        if (resource->imported || resource->firstPass == RG_INVALID)
+        {
+            continue;
+        }
+        if (!create_transient(graph, resource))
+        {
+            return 0;
+        }
+        memoryTypes &= resource->memoryRequirements.memoryTypeBits;
+        alignment = resource->memoryRequirements.alignment > alignment ? resource->memoryRequirements.alignment : alignment;
+        graph->unaliasedSize += resource->memoryRequirements.size;
+        transients[count++] = i;
+    }
+
+    graph->transientSize = 0;
+    if (!count)
+    {
+        return 1;
+    }
+
+    // Memory types that suit every transient: one block, aliased. Otherwise every resource gets its own.
+    if (memoryTypes)
+    {
+        graph->transientSize = place_transients(graph, transients, count, alignment);
+
+        VkMemoryRequirements requirements = {
+            .size = graph->transientSize,
+            .alignment = alignment,
+            .memoryTypeBits = memoryTypes,
+        };
+        if (devmem_alloc(graph->allocator, &requirements, graph->memoryTypes, DEVMEM_KIND_OPTIMAL, &graph->transientMemory))
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                RgResource* resource = &graph->resources[transients[i]];
+                VkDeviceSize offset = graph->transientMemory.offset + resource->offset;
+                if (resource->isImage)
+                {
+                    vkBindImageMemory(graph->device, resource->image, graph->transientMemory.memory, offset);
+                }
+                else
+                {
+                    vkBindBufferMemory(graph->device, resource->buffer, graph->transientMemory.memory, offset);
+                }
+            }
+            return 1;
+        }
+        graph->transientSize = 0;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        RgResource* resource = &graph->resources[transients[i]];
+        resource->offset = VK_WHOLE_SIZE;
+        int allocated = resource->isImage
+            ? devmem_alloc_image(graph->allocator, resource->image, graph->memoryTypes, &resource->memory)
+            : devmem_alloc_buffer(graph->allocator, resource->buffer, graph->memoryTypes, &resource->memory);
+        if (!allocated)
+        {
+            return 0;
+        }
+        graph->transientSize += resource->memoryRequirements.size;
+    }
+
+    return 1;
+}
+
+static int create_views(RenderGraph* graph)
+{
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        RgResource* resource = &graph->resources[i];
+        if (resource->imported || !resource->isImage || !resource->image)
+        {
+            continue;
+        }
+
+        VkImageViewCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = resource->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = resource->format,
+            .subresourceRange = { aspect_of(resource->format), 0, 1, 0, 1 },
+        };
+        if (vkCreateImageView(graph->device, &createInfo, 0, &resource->view) != VK_SUCCESS)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Whether a live pass before (or after, if later) the given one touches the resource.
+static uint32_t used_by_live_pass(RenderGraph* graph, uint32_t resource, uint32_t pass, int later)
+{
+    uint32_t begin = later ? pass + 1 : 0;
+    uint32_t end = later ? graph->passCount : pass;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        if (graph->passes[i].live && find_access(&graph->passes[i], resource))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int create_render_pass(RenderGraph* graph, uint32_t passIndex)
+{
+    RgPass* pass = &graph->passes[passIndex];
+    VkAttachmentDescription attachments[RG_MAX_ATTACHMENTS + 1];
+    VkAttachmentReference colorReferences[RG_MAX_ATTACHMENTS];
+    VkAttachmentReference depthReference;
+    uint32_t colorCount = 0;
+    uint32_t hasDepth = 0;
+
+    pass->attachmentCount = 0;
+    for (uint32_t i = 0; i < pass->accessCount; ++i)
+    {
+        const RgPassAccess* access = &pass->accesses[i];
+        if (!is_attachment(access->access))
+        {
+            continue;
+        }
+
+        const RgResource* resource = &graph->resources[access->resource];
+        uint32_t hasContents = resource->imported || used_by_live_pass(graph, access->resource, passIndex, 0);
+        uint32_t keepContents = (resource->imported && resource->finalAccess != RG_ACCESS_NONE)
+            || used_by_live_pass(graph, access->resource, passIndex, 1);
+        VkAttachmentLoadOp loadOp = access->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR
+            : (hasContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+        VkAttachmentStoreOp storeOp = keepContents ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        VkImageLayout layout = accessInfo[access->access].layout;
+        uint32_t stencil = (aspect_of(resource->format) & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+
+        uint32_t index = pass->attachmentCount++;
+        attachments[index] = (VkAttachmentDescription){
+            .format = resource->format,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = loadOp,
+            .storeOp = storeOp,
+            .stencilLoadOp = stencil ? loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = stencil ? storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            // Layout changes happen in the graph's barriers, the render pass itself never transitions.
+            .initialLayout = layout,
+            .finalLayout = layout,
+        };
+        pass->attachments[index] = access->resource;
+        pass->clearValues[index] = access->clearValue;
+
+        if (access->access == RG_ACCESS_COLOR_WRITE)
+        {
+            assert(colorCount < RG_MAX_ATTACHMENTS);
+            colorReferences[colorCount++] = (VkAttachmentReference){ index, layout };
+        }
+        else
+        {
+            assert(!hasDepth);
+            depthReference = (VkAttachmentReference){ index, layout };
+            hasDepth = 1;
+        }
+    }
+
+    VkRenderPassCreateInfo renderPassCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = pass->attachmentCount,
+        .pAttachments = attachments,
+        .subpassCount = 1,
+        .pSubpasses = &(VkSubpassDescription) {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = colorCount,
+            .pColorAttachments = colorReferences,
+            .pDepthStencilAttachment = hasDepth ? &depthReference : 0,
+        },
+    };
+
+    return vkCreateRenderPass(graph->device, &renderPassCreateInfo, 0, &pass->renderPass) == VK_SUCCESS;
+}
+
+static VkFramebuffer get_framebuffer(RenderGraph* graph, const RgPass* pass, VkExtent2D extent)
+{
+    VkImageView views[RG_MAX_ATTACHMENTS + 1] = { 0 };
+    for (uint32_t i = 0; i < pass->attachmentCount; ++i)
+    {
+        views[i] = graph->resources[pass->attachments[i]].view;
+    }
+
+    for (uint32_t i = 0; i < graph->framebufferCount; ++i)
+    {
+        RgFramebuffer* cached = &graph->framebuffers[i];
+        if (cached->renderPass == pass->renderPass && memcmp(cached->views, views, sizeof(views)) == 0
+            && cached->extent.width == extent.width && cached->extent.height == extent.height)
+        {
+            return cached->framebuffer;
+        }
+    }
+
+    // Framebuffers may be in flight, so the cache only grows until the graph is destroyed.
+    if (graph->framebufferCount == RG_MAX_FRAMEBUFFERS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    RgFramebuffer* entry = &graph->framebuffers[graph->framebufferCount];
+    VkFramebufferCreateInfo framebufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = pass->renderPass,
+        .attachmentCount = pass->attachmentCount,
+        .pAttachments = views,
+        .width = extent.width,
+        .height = extent.height,
+        .layers = 1,
+    };
+    if (vkCreateFramebuffer(graph->device, &framebufferCreateInfo, 0, &entry->framebuffer) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+    entry->renderPass = pass->renderPass;
+    memcpy(entry->views, views, sizeof(views));
+    entry->extent = extent;
+    ++graph->framebufferCount;
+
+    return entry->framebuffer;
+}
+
+static void record_barriers(RenderGraph* graph, VkCommandBuffer commandBuffer, const RgBarrierBatch* batch)
+{
+    if (!batch->dstStages)
+    {
+        return;
+    }
+
+    VkImageMemoryBarrier imageBarriers[RG_MAX_PASS_ACCESSES];
+    for (uint32_t i = 0; i < batch->imageBarrierCount; ++i)
+    {
+        const RgImageBarrier* barrier = &batch->imageBarriers[i];
+        const RgResource* resource = &graph->resources[barrier->resource];
+        imageBarriers[i] = (VkImageMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = barrier->srcAccess,
+            .dstAccessMask = barrier->dstAccess,
+            .oldLayout = barrier->oldLayout,
+            .newLayout = barrier->newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = resource->image,
+            .subresourceRange = { aspect_of(resource->format), 0, 1, 0, 1 },
+        };
+    }
+
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = batch->srcAccess,
+        .dstAccessMask = batch->dstAccess,
+    };
+    uint32_t memoryBarrierCount = (batch->srcAccess || batch->dstAccess) ? 1 : 0;
+
+    vkCmdPipelineBarrier(commandBuffer, batch->srcStages, batch->dstStages, 0,
+        memoryBarrierCount, &memoryBarrier, 0, 0, batch->imageBarrierCount, imageBarriers);
+}
+
+void rg_init(RenderGraph* graph, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes, VkDeviceSize bufferImageGranularity)
+{
+    memset(graph, 0, sizeof(*graph));
+    graph->device = device;
+    graph->allocator = allocator;
+    graph->memoryTypes = memoryTypes;
+    graph->bufferImageGranularity = bufferImageGranularity;
+}
+
+void rg_destroy(RenderGraph* graph)
+{
+    for (uint32_t i = 0; i < graph->framebufferCount; ++i)
+    {
+        vkDestroyFramebuffer(graph->device, graph->framebuffers[i].framebuffer, 0);
+    }
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        if (graph->passes[i].renderPass)
+        {
+            vkDestroyRenderPass(graph->device, graph->passes[i].renderPass, 0);
+        }
+    }
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        RgResource* resource = &graph->resources[i];
+        if (resource->imported)
+        {
+            continue;
+        }
+        if (resource->view)
+        {
+            vkDestroyImageView(graph->device, resource->view, 0);
+        }
+        if (resource->image)
+        {
+            vkDestroyImage(graph->device, resource->image, 0);
+        }
+        if (resource->buffer)
+        {
+            vkDestroyBuffer(graph->device, resource->buffer, 0);
+        }
+        if (resource->memory.memory)
+        {
+            devmem_free(graph->allocator, &resource->memory);
+        }
+    }
+    if (graph->transientMemory.memory)
+    {
+        devmem_free(graph->allocator, &graph->transientMemory);
+    }
+    memset(graph, 0, sizeof(*graph));
+}
+
+static uint32_t add_resource(RenderGraph* graph, const char* name, uint32_t isImage, uint32_t imported)
+{
+    assert(!graph->compiled && graph->resourceCount < RG_MAX_RESOURCES);
+
+    uint32_t index = graph->resourceCount++;
+    RgResource* resource = &graph->resources[index];
+    memset(resource, 0, sizeof(*resource));
+    resource->name = name;
+    resource->isImage = isImage;
+    resource->imported = imported;
+    return index;
+}
+
+uint32_t rg_import_image(RenderGraph* graph, const char* name, VkFormat format, VkExtent2D extent, uint32_t initialAccess, uint32_t finalAccess)
+{
+    uint32_t index = add_resource(graph, name, 1, 1);
+    graph->resources[index].format = format;
+    graph->resources[index].extent = extent;
+    graph->resources[index].initialAccess = initialAccess;
+    graph->resources[index].finalAccess = finalAccess;
+    return index;
+}
+
+uint32_t rg_import_buffer(RenderGraph* graph, const char* name, VkDeviceSize size, uint32_t initialAccess, uint32_t finalAccess)
+{
+    uint32_t index = add_resource(graph, name, 0, 1);
+    graph->resources[index].size = size;
+    graph->resources[index].initialAccess = initialAccess;
+    graph->resources[index].finalAccess = finalAccess;
+    return index;
+}
+
+uint32_t rg_create_image(RenderGraph* graph, const char* name, VkFormat format, VkExtent2D extent)
+{
+    uint32_t index = add_resource(graph, name, 1, 0);
+    graph->resources[index].format = format;
+    graph->resources[index].extent = extent;
+    return index;
+}
+
+uint32_t rg_create_buffer(RenderGraph* graph, const char* name, VkDeviceSize size)
+{
+    uint32_t index = add_resource(graph, name, 0, 0);
+    graph->resources[index].size = size;
+    return index;
+}
+
+uint32_t rg_add_pass(RenderGraph* graph, const char* name, uint32_t type, uint32_t flags, RgExecuteFunc execute, void* userData)
+{
+    assert(!graph->compiled && graph->passCount < RG_MAX_PASSES);
+
+    uint32_t index = graph->passCount++;
+    RgPass* pass = &graph->passes[index];
+    memset(pass, 0, sizeof(*pass));
+    pass->name = name;
+    pass->type = type;
+    pass->flags = flags;
+    pass->execute = execute;
+    pass->userData = userData;
+    return index;
+}
+
+void rg_use(RenderGraph* graph, uint32_t pass, uint32_t resource, uint32_t access)
+{
+    RgPass* p = &graph->passes[pass];
+    RgResource* r = &graph->resources[resource];
+    assert(!graph->compiled && p->accessCount < RG_MAX_PASS_ACCESSES);
+    // One access per resource and pass, there is no place for a barrier inside a pass.
+    assert(!find_access(p, resource));
+    assert(p->type == RG_PASS_GRAPHICS || !is_attachment(access));
+
+    p->accesses[p->accessCount++] = (RgPassAccess){ .resource = resource, .access = access };
+    r->imageUsage |= accessInfo[access].imageUsage;
+    r->bufferUsage |= accessInfo[access].bufferUsage;
+}
+
+void rg_clear(RenderGraph* graph, uint32_t pass, uint32_t resource, VkClearValue clearValue)
+{
+    RgPassAccess* access = find_access(&graph->passes[pass], resource);
+    assert(access && is_attachment(access->access));
+    access->clear = 1;
+    access->clearValue = clearValue;
+}
+
+int rg_compile(RenderGraph* graph)
+{
+    assert(!graph->compiled);
+
+    cull(graph);
+
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        graph->resources[i].firstPass = RG_INVALID;
+        graph->resources[i].lastPass = RG_INVALID;
+    }
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        const RgPass* pass = &graph->passes[i];
+        for (uint32_t j = 0; pass->live && j < pass->accessCount; ++j)
+        {
+            RgResource* resource = &graph->resources[pass->accesses[j].resource];
+            resource->firstPass = resource->firstPass == RG_INVALID ? i : resource->firstPass;
+            resource->lastPass = i;
+        }
+    }
+
+    if (!allocate_transients(graph) || !create_views(graph))
+    {
+        return 0;
+    }
+
+    // First walk: how every resource is left at the end of a frame.
+    RgState states[RG_MAX_RESOURCES];
+    RgState finalStates[RG_MAX_RESOURCES];
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        const RgResource* resource = &graph->resources[i];
+        states[i] = state_after(RG_PASS_EXTERNAL, resource->imported ? resource->initialAccess : RG_ACCESS_NONE);
+    }
+    simulate(graph, states, 0);
+    memcpy(finalStates, states, sizeof(states));
+
+    // Second walk records barriers. A transient starts where the last user of its memory left off:
+    // an earlier resource in this frame, or the last one in the previous frame, maybe itself.
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        const RgResource* resource = &graph->resources[i];
+        RgPassAccess* first = first_access(graph, i);
+        if (resource->imported)
+        {
+            states[i] = state_after(RG_PASS_EXTERNAL, resource->initialAccess);
+            if (first && first->clear)
+            {
+                states[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+            continue;
+        }
+        if (resource->firstPass == RG_INVALID)
+        {
+            continue;
+        }
+
+        uint32_t previous = i;
+        uint32_t previousEarlier = RG_INVALID;
+        for (uint32_t j = 0; j < graph->resourceCount; ++j)
+        {
+            const RgResource* other = &graph->resources[j];
+            if (other->imported || other->firstPass == RG_INVALID || !memory_overlaps(other, resource)
+                || (resource->offset == VK_WHOLE_SIZE && j != i))
+            {
+                continue;
+            }
+            if (other->lastPass < resource->firstPass
+                && (previousEarlier == RG_INVALID || other->lastPass > graph->resources[previousEarlier].lastPass))
+            {
+                previousEarlier = j;
+            }
+            if (other->lastPass > graph->resources[previous].lastPass)
+            {
+                previous = j;
+            }
+        }
+        previous = previousEarlier != RG_INVALID ? previousEarlier : previous;
+
+        states[i] = finalStates[previous];
+        states[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        states[i].visibleStages = 0;
+        states[i].visibleAccess = 0;
+    }
+    simulate(graph, states, 1);
+
+    memset(&graph->finalBarriers, 0, sizeof(graph->finalBarriers));
+    for (uint32_t i = 0; i < graph->resourceCount; ++i)
+    {
+        const RgResource* resource = &graph->resources[i];
+        if (resource->imported && resource->finalAccess != RG_ACCESS_NONE)
+        {
+            transition(&states[i], resource, i, stages_of(RG_PASS_EXTERNAL, resource->finalAccess),
+                resource->finalAccess, &graph->finalBarriers);
+        }
+    }
+
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        if (graph->passes[i].live && graph->passes[i].type == RG_PASS_GRAPHICS && !create_render_pass(graph, i))
+        {
+            return 0;
+        }
+    }
+
+    graph->compiled = 1;
+    return 1;
+}
+
+void rg_bind_image(RenderGraph* graph, uint32_t resource, VkImage image, VkImageView view)
+{
+    assert(graph->resources[resource].imported && graph->resources[resource].isImage);
+    graph->resources[resource].image = image;
+    graph->resources[resource].view = view;
+}
+
+void rg_bind_buffer(RenderGraph* graph, uint32_t resource, VkBuffer buffer)
+{
+    assert(graph->resources[resource].imported && !graph->resources[resource].isImage);
+    graph->resources[resource].buffer = buffer;
+}
+
+void rg_execute(RenderGraph* graph, VkCommandBuffer commandBuffer)
+{
+    assert(graph->compiled);
+
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        const RgPass* pass = &graph->passes[i];
+        if (!pass->live)
+        {
+            continue;
+        }
+
+        record_barriers(graph, commandBuffer, &pass->barriers);
+
+        RgPassContext context = { graph, i, VK_NULL_HANDLE, VK_NULL_HANDLE, { 0, 0 } };
+        if (pass->type != RG_PASS_GRAPHICS)
+        {
+            pass->execute(commandBuffer, &context, pass->userData);
+            continue;
+        }
+
+        context.renderPass = pass->renderPass;
+        context.extent = pass->attachmentCount ? graph->resources[pass->attachments[0]].extent : (VkExtent2D){ 0, 0 };
+        context.framebuffer = get_framebuffer(graph, pass, context.extent);
+        if (!context.framebuffer)
+        {
+            continue;
+        }
+
+        vkCmdBeginRenderPass(commandBuffer,
+            &(VkRenderPassBeginInfo) {
+            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            .renderPass = pass->renderPass,
+            .framebuffer = context.framebuffer,
+            .renderArea = { { 0, 0 }, context.extent },
+            .clearValueCount = pass->attachmentCount,
+            .pClearValues = pass->clearValues,
+            },
+            (pass->flags & RG_PASS_SECONDARY) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE
+        );
+        pass->execute(commandBuffer, &context, pass->userData);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    record_barriers(graph, commandBuffer, &graph->finalBarriers);
+}
+
+void rg_print_stats(const RenderGraph* graph)
+{
+    uint32_t livePasses = 0;
+    uint32_t barrierBatches = graph->finalBarriers.dstStages != 0;
+    uint32_t imageBarriers = graph->finalBarriers.imageBarrierCount;
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        const RgPass* pass = &graph->passes[i];
+        livePasses += pass->live;
+        barrierBatches += pass->live && pass->barriers.dstStages;
+        imageBarriers += pass->live ? pass->barriers.imageBarrierCount : 0;
+    }
+
+    printf("Render graph: %u passes, %u culled, %u barrier batches with %u image barriers per frame\n",
+        livePasses, graph->passCount - livePasses, barrierBatches, imageBarriers);
+    printf("  transient memory %.2f MB, %.2f MB without aliasing\n",
+        graph->transientSize / (1024.0 * 1024.0), graph->unaliasedSize / (1024.0 * 1024.0));
+    for (uint32_t i = 0; i < graph->passCount; ++i)
+    {
+        printf("  %s%s\n", graph->passes[i].name, graph->passes[i].live ? "" : " (culled)");
+    }
+}
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "devmem.h"
+
+/*
+** Render graph.
+**
+** Passes declare every image and buffer they touch together with how
+** they touch it (RG_ACCESS_*). rg_compile then:
+**
+** - culls passes whose results never reach an output: an imported
+**   resource with a final access, or a pass flagged RG_PASS_SIDE_EFFECTS;
+** - creates transient resources and places them in one memory block,
+**   letting resources whose pass ranges don't overlap share memory;
+** - derives, per pass, one batched vkCmdPipelineBarrier with the layout
+**   transitions and memory dependencies the declared accesses need, and
+**   one final batch that moves imported resources to their final access;
+** - creates a VkRenderPass for every graphics pass, with load and store
+**   ops picked from whether contents are needed before and after.
+**
+** The graph is compiled once and executed every frame. Imported resources
+** may change per frame (swapchain images) through rg_bind_image. The
+** first access of a transient waits for the last access of whatever
+** resource used its memory before, possibly in the previous frame, so
+** frames in flight never race on aliased memory.
+**
+** An imported image's initial access describes how the previous frame
+** left it. Its old layout is only honoured when the first pass needs the
+** contents; otherwise the graph transitions from UNDEFINED.
+*/
+
+enum {
+    RG_MAX_RESOURCES = 32,
+    RG_MAX_PASSES = 32,
+    RG_MAX_PASS_ACCESSES = 8,
+    RG_MAX_ATTACHMENTS = 4,         // color attachments per pass, plus depth
+    RG_MAX_FRAMEBUFFERS = 32,
+    RG_INVALID = UINT32_MAX,
+};
+
+enum {
+    RG_ACCESS_NONE,
+    RG_ACCESS_COLOR_WRITE,          // color attachment, loaded unless cleared
+    RG_ACCESS_DEPTH_WRITE,
+    RG_ACCESS_DEPTH_READ,
+    RG_ACCESS_SAMPLED_READ,
+    RG_ACCESS_STORAGE_READ,
+    RG_ACCESS_STORAGE_WRITE,
+    RG_ACCESS_UNIFORM_READ,
+    RG_ACCESS_VERTEX_READ,
+    RG_ACCESS_INDEX_READ,
+    RG_ACCESS_INDIRECT_READ,
+    RG_ACCESS_TRANSFER_READ,
+    RG_ACCESS_TRANSFER_WRITE,
+    RG_ACCESS_PRESENT,
+    RG_ACCESS_COUNT,
+};
+
+enum {
+    RG_PASS_GRAPHICS,
+    RG_PASS_COMPUTE,
+    RG_PASS_TRANSFER,
+};
+
+enum {
+    RG_PASS_SECONDARY = 1,          // render pass contents are recorded into secondaries
+    RG_PASS_SIDE_EFFECTS = 2,       // never culled
+};
+
+typedef struct tagRenderGraph RenderGraph;
+
+typedef struct tagRgPassContext
+{
+    RenderGraph* graph;
+    uint32_t pass;
+    VkRenderPass renderPass;        // graphics passes only
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+} RgPassContext;
+
+typedef void (*RgExecuteFunc)(VkCommandBuffer commandBuffer, const RgPassContext* context, void* userData);
+
+typedef struct tagRgResource
+{
+    const char* name;
+    uint32_t isImage;
+    uint32_t imported;
+    uint32_t initialAccess;         // imported only
+    uint32_t finalAccess;           // imported only, RG_ACCESS_NONE if not an output
+
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags imageUsage;
+    VkDeviceSize size;
+    VkBufferUsageFlags bufferUsage;
+
+    VkImage image;
+    VkImageView view;
+    VkBuffer buffer;
+
+    // Filled by rg_compile.
+    uint32_t firstPass;
+    uint32_t lastPass;
+    VkMemoryRequirements memoryRequirements;
+    VkDeviceSize offset;            // in the transient block
+    DeviceAllocation memory;        // own memory when it couldn't go into the block
+} RgResource;
+
+typedef struct tagRgPassAccess
+{
+    uint32_t resource;
+    uint32_t access;
+    uint32_t clear;
+    VkClearValue clearValue;
+} RgPassAccess;
+
+typedef struct tagRgImageBarrier
+{
+    uint32_t resource;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+} RgImageBarrier;
+
+typedef struct tagRgBarrierBatch
+{
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    VkAccessFlags srcAccess;        // global memory barrier
+    VkAccessFlags dstAccess;
+    uint32_t imageBarrierCount;
+    RgImageBarrier imageBarriers[RG_MAX_PASS_ACCESSES];
+} RgBarrierBatch;
+
+typedef struct tagRgPass
+{
+    const char* name;
+    uint32_t type;
+    uint32_t flags;
+    RgExecuteFunc execute;
+    void* userData;
+    uint32_t accessCount;
+    RgPassAccess accesses[RG_MAX_PASS_ACCESSES];
+
+    // Filled by rg_compile.
+    uint32_t live;
+    RgBarrierBatch barriers;
+    VkRenderPass renderPass;
+    uint32_t attachmentCount;
+    uint32_t attachments[RG_MAX_ATTACHMENTS + 1];
+    VkClearValue clearValues[RG_MAX_ATTACHMENTS + 1];
+} RgPass;
+
+typedef struct tagRgFramebuffer
+{
+    VkRenderPass renderPass;
+    VkImageView views[RG_MAX_ATTACHMENTS + 1];
+    VkExtent2D extent;
+    VkFramebuffer framebuffer;
+} RgFramebuffer;
+
+struct tagRenderGraph
+{
+    VkDevice device;
+    DeviceMemoryAllocator* allocator;
+    uint32_t memoryTypes;
+    VkDeviceSize bufferImageGranularity;
+
+    uint32_t resourceCount;
+    RgResource resources[RG_MAX_RESOURCES];
+    uint32_t passCount;
+    RgPass passes[RG_MAX_PASSES];
+    RgBarrierBatch finalBarriers;
+
+    DeviceAllocation transientMemory;
+    VkDeviceSize transientSize;     // block size after aliasing
+    VkDeviceSize unaliasedSize;     // what the transients would take without aliasing
+    uint32_t compiled;
+
+    uint32_t framebufferCount;
+    RgFramebuffer framebuffers[RG_MAX_FRAMEBUFFERS];
+};
+
+void rg_init(RenderGraph* graph, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t memoryTypes, VkDeviceSize bufferImageGranularity);
+void rg_destroy(RenderGraph* graph);
+
+uint32_t rg_import_image(RenderGraph* graph, const char* name, VkFormat format, VkExtent2D extent, uint32_t initialAccess, uint32_t finalAccess);
+uint32_t rg_import_buffer(RenderGraph* graph, const char* name, VkDeviceSize size, uint32_t initialAccess, uint32_t finalAccess);
+uint32_t rg_create_image(RenderGraph* graph, const char* name, VkFormat format, VkExtent2D extent);
+uint32_t rg_create_buffer(RenderGraph* graph, const char* name, VkDeviceSize size);
+
+uint32_t rg_add_pass(RenderGraph* graph, const char* name, uint32_t type, uint32_t flags, RgExecuteFunc execute, void* userData);
+void rg_use(RenderGraph* graph, uint32_t pass, uint32_t resource, uint32_t access);
+void rg_clear(RenderGraph* graph, uint32_t pass, uint32_t resource, VkClearValue clearValue);
+
+int rg_compile(RenderGraph* graph);
+
+void rg_bind_image(RenderGraph* graph, uint32_t resource, VkImage image, VkImageView view);
+void rg_bind_buffer(RenderGraph* graph, uint32_t resource, VkBuffer buffer);
+
+void rg_execute(RenderGraph* graph, VkCommandBuffer commandBuffer);
+
+void rg_print_stats(const RenderGraph* graph);
+
+static inline VkImage rg_image(const RenderGraph* graph, uint32_t resource) { return graph->resources[resource].image; }
+static inline VkImageView rg_view(const RenderGraph* graph, uint32_t resource) { return graph->resources[resource].view; }
+static inline VkBuffer rg_buffer(const RenderGraph* graph, uint32_t resource) { return graph->resources[resource].buffer; }
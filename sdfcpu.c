@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL2/SDL.h>
+
+#include "sdfcpu.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SDFCPU_X64 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SDFCPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SDFCPU_TARGET_AVX2
+#endif
+
+typedef struct tagSdfCpuJob
+{
+    const SdfPrimitive* primitives;
+    uint32_t primitiveCount;
+    uint32_t width, height;
+    float ro[3];
+    float cu[3], cv[3], cw[3];      // camera to world, the columns of setCamera's matrix
+    const float* rects;             // per primitive: near and far pixel rectangle, min xy then max xy
+    const uint32_t* allIndices;     // 0..primitiveCount-1
+    SdfQuality quality;
+    int tileCulling;
+    uint32_t tileCountX;
+    uint8_t* rgb;
+} SdfCpuJob;
+
+typedef struct tagSdfCpuTileLists
+{
+    const uint32_t* indices[2];     // SDF_LIST_NEAR, SDF_LIST_FAR
+    uint32_t counts[2];
+} SdfCpuTileLists;
+
+static uint32_t sdfcpu_popcount(uint32_t bits)
+{
+    uint32_t count = 0;
+    for (; bits; bits &= bits - 1)
+    {
+        ++count;
+    }
+    return count;
+}
+
+static void sdfcpu_normalize(float* v)
+{
+    float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+}
+
+#define SDFK_WIDTH 1
+#define SDFK_PACKET_X 1
+#define SDFK_SUFFIX scalar
+#define SDFK_FUNC static inline
+#include "sdfcpu_kernel.h"
+
+#ifdef SDFCPU_X64
+#define SDFK_WIDTH 4
+#define SDFK_PACKET_X 2
+#define SDFK_SUFFIX sse2
+#define SDFK_FUNC static inline
+#include "sdfcpu_kernel.h"
+
+#define SDFK_WIDTH 8
+#define SDFK_PACKET_X 4
+#define SDFK_SUFFIX avx2
+#define SDFK_FUNC static inline SDFCPU_TARGET_AVX2
+#include "sdfcpu_kernel.h"
+#endif
+
+typedef void (*SdfCpuTileFunc)(const SdfCpuJob* job, const SdfCpuTileLists* lists, uint32_t tileX, uint32_t tileY,
+    uint64_t* primaryRays, uint64_t* shadowRays);
+
+//----------------------------------------------------------
+// Tile lists
+
+static void cross3(const float* a, const float* b, float* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// sdfCamera of shaders/sdfscene.glsl.
+static void setup_camera(SdfCpuJob* job, const SdfCpuView* view)
+{
+    float moX = view->mouse[0] / (float)view->width;
+    float moY = view->mouse[1] / (float)view->height;
+    float time = 15.0f + view->time;
+    job->ro[0] = -0.5f + 3.5f * cosf(0.1f * time + 6.0f * moX);
+    job->ro[1] = 1.0f + 6.0f * moY;
+    job->ro[2] = 0.5f + 4.0f * sinf(0.1f * time + 6.0f * moX);
+
+    const float ta[3] = { -0.5f, -0.4f, 0.5f };
+    const float cp[3] = { 0.0f, 1.0f, 0.0f };
+    for (int i = 0; i < 3; ++i)
+    {
+        job->cw[i] = ta[i] - job->ro[i];
+    }
+    sdfcpu_normalize(job->cw);
+    cross3(job->cw, cp, job->cu);
+    sdfcpu_normalize(job->cu);
+    cross3(job->cu, job->cw, job->cv);
+    sdfcpu_normalize(job->cv);
+}
+
+// projectBox of tilecull.glsl-cs.
+static void project_box(const SdfCpuJob* job, const float* center, const float* halfSize, float margin, float* rect)
+{
+    float lo[2] = { 1e30f, 1e30f };
+    float hi[2] = { -1e30f, -1e30f };
+    for (int i = 0; i < 8; ++i)
+    {
+        float d[3];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float sign = (i >> axis) & 1 ? 1.0f : -1.0f;
+            d[axis] = center[axis] + (halfSize[axis] + margin) * sign - job->ro[axis];
+        }
+        float vx = d[0] * job->cu[0] + d[1] * job->cu[1] + d[2] * job->cu[2];
+        float vy = d[0] * job->cv[0] + d[1] * job->cv[1] + d[2] * job->cv[2];
+        float vz = d[0] * job->cw[0] + d[1] * job->cw[1] + d[2] * job->cw[2];
+        if (vz < 1e-3f)
+        {
+            rect[0] = rect[1] = -1e30f;
+            rect[2] = rect[3] = 1e30f;
+            return;
+        }
+        float px = 2.0f * vx / vz;
+        float py = 2.0f * vy / vz;
+        lo[0] = px < lo[0] ? px : lo[0];
+        lo[1] = py < lo[1] ? py : lo[1];
+        hi[0] = px > hi[0] ? px : hi[0];
+        hi[1] = py > hi[1] ? py : hi[1];
+    }
+    float resX = (float)job->width;
+    float resY = (float)job->height;
+    rect[0] = 0.5f * (lo[0] * resY + resX);
+    rect[1] = 0.5f * (resY - hi[1] * resY);
+    rect[2] = 0.5f * (hi[0] * resY + resX);
+    rect[3] = 0.5f * (resY - lo[1] * resY);
+}
+
+static void project_primitives(const SdfCpuJob* job, float* rects)
+{
+    static const float margins[2] = { 0.25f, 2.85f };   // SDF_NEAR_MARGIN, SDF_FAR_MARGIN
+    for (uint32_t i = 0; i < job->primitiveCount; ++i)
+    {
+        const SdfPrimitive* prim = &job->primitives[i];
+        for (uint32_t list = 0; list < 2; ++list)
+        {
+            float* rect = rects + (i * 2 + list) * 4;
+            if (prim->halfSize[0] < 0.0f)
+            {
+                rect[0] = rect[1] = -1e30f;
+                rect[2] = rect[3] = 1e30f;
+            }
+            else
+            {
+                project_box(job, prim->position, prim->halfSize, margins[list], rect);
+            }
+        }
+    }
+}
+
+// Same lists as the tile cull pass, in scene order; storage holds SDF_MAX_TILE_PRIMITIVES per list.
+static void build_tile_lists(const SdfCpuJob* job, uint32_t tileX, uint32_t tileY, uint32_t* storage, SdfCpuTileLists* lists)
+{
+    uint32_t maxCount = job->primitiveCount < SDF_MAX_TILE_PRIMITIVES ? job->primitiveCount : SDF_MAX_TILE_PRIMITIVES;
+    float minX = (float)(tileX * SDF_TILE_SIZE);
+    float minY = (float)(tileY * SDF_TILE_SIZE);
+    float maxX = minX + SDF_TILE_SIZE;
+    float maxY = minY + SDF_TILE_SIZE;
+    for (uint32_t list = 0; list < 2; ++list)
+    {
+        uint32_t* indices = storage + list * SDF_MAX_TILE_PRIMITIVES;
+        uint32_t count = 0;
+        for (uint32_t i = 0; job->tileCulling && i < job->primitiveCount && count <= maxCount; ++i)
+        {
+            const float* rect = job->rects + (i * 2 + list) * 4;
+            if (rect[0] <= maxX && rect[2] >= minX && rect[1] <= maxY && rect[3] >= minY)
+            {
+                if (count < maxCount)
+                {
+                    indices[count] = i;
+                }
+                ++count;
+            }
+        }
+
+        int all = !job->tileCulling || count > maxCount;
+        lists->indices[list] = all ? job->allIndices : indices;
+        lists->counts[list] = all ? job->primitiveCount : count;
+    }
+}
+
+//----------------------------------------------------------
+// Scheduler
+
+typedef struct tagSdfCpuWorker
+{
+    const SdfCpuJob* job;
+    SdfCpuTileFunc renderTile;
+    struct tagSdfCpuWorker* workers;
+    uint32_t workerCount;
+    SDL_atomic_t range;             // tiles still to do: first in the low 16 bits, end in the high 16 bits
+    uint64_t primaryRays;
+    uint64_t shadowRays;
+    uint32_t stolenTiles;
+    uint32_t lists[2 * SDF_MAX_TILE_PRIMITIVES];
+} SdfCpuWorker;
+
+static int pack_range(uint32_t first, uint32_t end)
+{
+    return (int)(first | end << 16);
+}
+
+// Takes the first tile of the worker's own range, UINT32_MAX if it is empty.
+static uint32_t pop_tile(SdfCpuWorker* worker)
+{
+    for (;;)
+    {
+        int range = SDL_AtomicGet(&worker->range);
+        uint32_t first = (uint32_t)range & 0xFFFF;
+        uint32_t end = (uint32_t)range >> 16;
+        if (first >= end)
+        {
+            return UINT32_MAX;
+        }
+        if (SDL_AtomicCAS(&worker->range, range, pack_range(first + 1, end)))
+        {
+            return first;
+        }
+    }
+}
+
+// Moves the back half of the fullest other range into the worker's own. 0 once every range is empty.
+static int steal_tiles(SdfCpuWorker* worker)
+{
+    for (;;)
+    {
+        SdfCpuWorker* victim = 0;
+        uint32_t most = 0;
+        for (uint32_t i = 0; i < worker->workerCount; ++i)
+        {
+            uint32_t range = (uint32_t)SDL_AtomicGet(&worker->workers[i].range);
+            uint32_t remaining = (range >> 16) - (range & 0xFFFF);
+            if (&worker->workers[i] != worker && (range >> 16) > (range & 0xFFFF) && remaining > most)
+            {
+                victim = &worker->workers[i];
+                most = remaining;
+            }
+        }
+        if (!victim)
+        {
+            return 0;
+        }
+
+        int range = SDL_AtomicGet(&victim->range);
+        uint32_t first = (uint32_t)range & 0xFFFF;
+        uint32_t end = (uint32_t)range >> 16;
+        if (first >= end)
+        {
+            continue;
+        }
+        uint32_t split = end - (end - first + 1) / 2;
+        if (SDL_AtomicCAS(&victim->range, range, pack_range(first, split)))
+        {
+            // Nobody takes from an empty range, so the worker's own can be replaced outright.
+            worker->stolenTiles += end - split;
+            SDL_AtomicSet(&worker->range, pack_range(split, end));
+            return 1;
+        }
+    }
+}
+
+static int worker_main(void* data)
+{
+    SdfCpuWorker* worker = (SdfCpuWorker*)data;
+    const SdfCpuJob* job = worker->job;
+    do
+    {
+        for (uint32_t tile = pop_tile(worker); tile != UINT32_MAX; tile = pop_tile(worker))
+        {
+            uint32_t tileX = tile % job->tileCountX;
+            uint32_t tileY = tile / job->tileCountX;
+            SdfCpuTileLists lists;
+            build_tile_lists(job, tileX, tileY, worker->lists, &lists);
+            worker->renderTile(job, &lists, tileX, tileY, &worker->primaryRays, &worker->shadowRays);
+        }
+    } while (steal_tiles(worker));
+    return 0;
+}
+
+//----------------------------------------------------------
+
+int sdfcpu_isa_supported(uint32_t isa)
+{
+    switch (isa)
+    {
+    case SDFCPU_ISA_SCALAR:
+        return 1;
+#ifdef SDFCPU_X64
+    case SDFCPU_ISA_SSE2:
+        return 1;
+    case SDFCPU_ISA_AVX2:
+        return SDL_HasAVX2();
+#endif
+    default:
+        return 0;
+    }
+}
+
+uint32_t sdfcpu_best_isa(void)
+{
+    for (uint32_t isa = SDFCPU_ISA_COUNT; isa-- > 0;)
+    {
+        if (sdfcpu_isa_supported(isa))
+        {
+            return isa;
+        }
+    }
+    return SDFCPU_ISA_SCALAR;
+}
+
+const char* sdfcpu_isa_name(uint32_t isa)
+{
+    static const char* names[SDFCPU_ISA_COUNT] = { "scalar", "SSE2", "AVX2" };
+    return isa < SDFCPU_ISA_COUNT ? names[isa] : "?";
+}
+
+static SdfCpuTileFunc tile_func(uint32_t isa)
+{
+    switch (isa)
+    {
+#ifdef SDFCPU_X64
+    case SDFCPU_ISA_SSE2:
+        return render_tile_sse2;
+    case SDFCPU_ISA_AVX2:
+        return render_tile_avx2;
+#endif
+    default:
+        return render_tile_scalar;
+    }
+}
+
+int sdfcpu_render(const SdfPrimitive* primitives, uint32_t primitiveCount, const SdfCpuView* view,
+    uint32_t isa, uint32_t threadCount, uint8_t* rgb, SdfCpuStats* stats)
+{
+    uint32_t tileCountX = (view->width + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE;
+    uint32_t tileCountY = (view->height + SDF_TILE_SIZE - 1) / SDF_TILE_SIZE;
+    uint32_t tileCount = tileCountX * tileCountY;
+    if (!tileCount || tileCount > SDFCPU_MAX_TILES)
+    {
+        return 0;
+    }
+
+    threadCount = threadCount ? threadCount : (uint32_t)SDL_GetCPUCount();
+    threadCount = threadCount < SDFCPU_MAX_THREADS ? threadCount : SDFCPU_MAX_THREADS;
+    threadCount = threadCount < tileCount ? threadCount : tileCount;
+    threadCount = threadCount ? threadCount : 1;
+
+    float* rects = (float*)malloc((size_t)primitiveCount * 8 * sizeof(float) + 1);
+    uint32_t* allIndices = (uint32_t*)malloc((size_t)primitiveCount * sizeof(uint32_t) + 1);
+    SdfCpuWorker* workers = (SdfCpuWorker*)calloc(threadCount, sizeof(SdfCpuWorker));
+    SDL_Thread* threads[SDFCPU_MAX_THREADS] = { 0 };
+    if (!rects || !allIndices || !workers)
+    {
+        free(rects);
+        free(allIndices);
+        free(workers);
+        return 0;
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    SdfCpuJob job = {
+        .primitives = primitives,
+        .primitiveCount = primitiveCount,
+        .width = view->width,
+        .height = view->height,
+        .rects = rects,
+        .allIndices = allIndices,
+        .quality = *sdfscene_quality(view->quality),
+        .tileCulling = view->tileCulling,
+        .tileCountX = tileCountX,
+        .rgb = rgb,
+    };
+    setup_camera(&job, view);
+    project_primitives(&job, rects);
+    for (uint32_t i = 0; i < primitiveCount; ++i)
+    {
+        allIndices[i] = i;
+    }
+
+    // Contiguous ranges keep each thread's tiles together in the image while nobody steals.
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        SdfCpuWorker* worker = &workers[i];
+        worker->job = &job;
+        worker->renderTile = tile_func(sdfcpu_isa_supported(isa) ? isa : SDFCPU_ISA_SCALAR);
+        worker->workers = workers;
+        worker->workerCount = threadCount;
+        SDL_AtomicSet(&worker->range, pack_range(tileCount * i / threadCount, tileCount * (i + 1) / threadCount));
+    }
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        threads[i] = SDL_CreateThread(worker_main, "sdfcpu", &workers[i]);
+    }
+    // The calling thread works too, and steals the tiles of any thread that failed to start.
+    worker_main(&workers[0]);
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        SDL_WaitThread(threads[i], 0);
+    }
+
+    uint64_t end = SDL_GetPerformanceCounter();
+
+    if (stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+        stats->ms = (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+        stats->threadCount = threadCount;
+        stats->tileCount = tileCount;
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            stats->primaryRays += workers[i].primaryRays;
+            stats->shadowRays += workers[i].shadowRays;
+            stats->stolenTiles += workers[i].stolenTiles;
+        }
+    }
+
+    free(rects);
+    free(allIndices);
+    free(workers);
+    return 1;
+}
+
+//----------------------------------------------------------
+// Images
+
+int sdfcpu_write_ppm(const char* path, const uint8_t* rgb, uint32_t width, uint32_t height)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        return 0;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    size_t size = (size_t)width * height * 3;
+    int ok = fwrite(rgb, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+uint8_t* sdfcpu_read_ppm(const char* path, uint32_t* width, uint32_t* height)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    unsigned int w = 0, h = 0, maxValue = 0;
+    uint8_t* rgb = 0;
+    if (fscanf(file, "P6 %u %u %u", &w, &h, &maxValue) == 3 && maxValue == 255 && w && h && fgetc(file) != EOF)
+    {
+        size_t size = (size_t)w * h * 3;
+        rgb = (uint8_t*)malloc(size);
+        if (rgb && fread(rgb, 1, size, file) != size)
+        {
+            free(rgb);
+            rgb = 0;
+        }
+    }
+    fclose(file);
+
+    *width = w;
+    *height = h;
+    return rgb;
+}
+
+uint32_t sdfcpu_compare(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height, uint32_t tolerance, uint32_t* maxDiff)
+{
+    uint32_t mismatches = 0;
+    uint32_t largest = 0;
+    for (size_t i = 0; i < (size_t)width * height; ++i)
+    {
+        uint32_t pixelDiff = 0;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            uint32_t diff = (uint32_t)abs((int)a[i * 3 + c] - (int)b[i * 3 + c]);
+            pixelDiff = diff > pixelDiff ? diff : pixelDiff;
+        }
+        mismatches += pixelDiff > tolerance;
+        largest = pixelDiff > largest ? pixelDiff : largest;
+    }
+    if (maxDiff)
+    {
+        *maxDiff = largest;
+    }
+    return mismatches;
+}
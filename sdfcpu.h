@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sdfscene.h"
+
+/*
+** CPU reference renderer for the SDF scene.
+**
+** A C port of map, castRay, softshadow, calcNormal, calcAO and render
+** from rtprimitives.glsl-fs, evaluating the same primitive table with the
+** same camera and quality tier, so its images can be checked against the GPU and it gives
+** a baseline on machines without one.
+**
+** Rays are marched in packets of 1, 2x2 (SSE2) or 4x2 (AVX2) pixels,
+** one lane per pixel, struct-of-arrays. A packet keeps stepping while
+** any lane is still marching; finished lanes are masked.
+** Every 16x16 tile gets near and far primitive lists exactly like
+** tilecull.glsl-cs, falling back to every primitive when a list is too
+** long.
+**
+** Tiles are split into one contiguous range per thread. Threads take
+** tiles from the front of their own range and, once it is empty, steal
+** the back half of the fullest other range.
+**
+** The scalar kernel uses the C library's sin, atan2, pow and exp; the
+** SIMD kernels use polynomial approximations good to a few ulps, so
+** images from different kernels (or the GPU) can differ by a step or
+** two in places and are compared with a tolerance.
+*/
+
+enum {
+    SDFCPU_ISA_SCALAR,
+    SDFCPU_ISA_SSE2,
+    SDFCPU_ISA_AVX2,
+    SDFCPU_ISA_COUNT,
+    SDFCPU_MAX_THREADS = 64,
+    SDFCPU_MAX_TILES = 0xFFFF,      // tile ranges are packed into 16 bits
+};
+
+// The FSConst inputs of rtprimitives.glsl-fs.
+typedef struct tagSdfCpuView
+{
+    uint32_t width, height;
+    float mouse[2];
+    float time;
+    int tileCulling;                // 0 - every pixel evaluates every primitive
+    uint32_t quality;               // SDF_QUALITY_*
+} SdfCpuView;
+
+typedef struct tagSdfCpuStats
+{
+    double ms;
+    uint64_t primaryRays;
+    uint64_t shadowRays;
+    uint32_t threadCount;
+    uint32_t tileCount;
+    uint32_t stolenTiles;
+} SdfCpuStats;
+
+int sdfcpu_isa_supported(uint32_t isa);
+uint32_t sdfcpu_best_isa(void);
+const char* sdfcpu_isa_name(uint32_t isa);
+
+// Renders view->width x view->height RGB8 pixels, top row first, into rgb.
+// threadCount 0 uses every core. Returns 0 if the image has too many tiles or memory runs out.
+int sdfcpu_render(const SdfPrimitive* primitives, uint32_t primitiveCount, const SdfCpuView* view,
+    uint32_t isa, uint32_t threadCount, uint8_t* rgb, SdfCpuStats* stats);
+
+// Binary PPM (P6) files. sdfcpu_read_ppm returns a malloc'd image, 0 on failure.
+int sdfcpu_write_ppm(const char* path, const uint8_t* rgb, uint32_t width, uint32_t height);
+uint8_t* sdfcpu_read_ppm(const char* path, uint32_t* width, uint32_t* height);
+
+// Number of pixels with a channel more than tolerance steps apart; maxDiff gets the largest difference.
+uint32_t sdfcpu_compare(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height, uint32_t tolerance, uint32_t* maxDiff);
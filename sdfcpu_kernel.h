@@ -0,0 +1,786 @@
+/*
+** Packet kernel of the CPU reference renderer, see sdfcpu.h.
+**
+** sdfcpu.c includes this once per instruction set, after defining
+** SDFK_WIDTH (lanes), SDFK_PACKET_X (lanes per packet row), SDFK_SUFFIX
+** (appended to every function name) and SDFK_FUNC (storage class and
+** target attributes). The V* and M* macros
+** are the only instruction set specific parts: V is a float per lane, M a
+** lane mask. Everything below them is written once and follows
+** rtprimitives.glsl-fs line by line, with selects where the shader
+** branches per pixel.
+*/
+
+#define SDFK_NAME2(name, suffix) name##_##suffix
+#define SDFK_NAME1(name, suffix) SDFK_NAME2(name, suffix)
+#define K(name) SDFK_NAME1(name, SDFK_SUFFIX)
+
+#if SDFK_WIDTH == 1
+
+typedef float K(Float);
+typedef int K(Mask);
+
+static inline float K(min)(float a, float b) { return a < b ? a : b; }
+static inline float K(max)(float a, float b) { return a > b ? a : b; }
+
+#define VSET(x)         ((float)(x))
+#define VLANEX()        0.0f
+#define VLANEY()        0.0f
+#define VADD(a, b)      ((a) + (b))
+#define VSUB(a, b)      ((a) - (b))
+#define VMUL(a, b)      ((a) * (b))
+#define VDIV(a, b)      ((a) / (b))
+#define VMIN(a, b)      K(min)(a, b)
+#define VMAX(a, b)      K(max)(a, b)
+#define VSQRT(a)        sqrtf(a)
+#define VABS(a)         fabsf(a)
+#define VFLOOR(a)       floorf(a)
+#define VLT(a, b)       ((a) < (b))
+#define VGT(a, b)       ((a) > (b))
+#define VSEL(m, a, b)   ((m) ? (a) : (b))
+#define VSTORE(p, a)    (*(p) = (a))
+#define MAND(a, b)      ((a) && (b))
+#define MOR(a, b)       ((a) || (b))
+#define MANDNOT(a, b)   ((a) && !(b))
+#define MBITS(m)        ((uint32_t)((m) != 0))
+
+#elif SDFK_WIDTH == 4
+
+typedef __m128 K(Float);
+typedef __m128 K(Mask);
+
+static inline __m128 K(floor)(__m128 a)
+{
+    // SSE2 only truncates; step down where that rounded up. Inputs stay well inside the int range.
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+
+#define VSET(x)         _mm_set1_ps((float)(x))
+#define VLANEX()        _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f)
+#define VLANEY()        _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f)
+#define VADD(a, b)      _mm_add_ps(a, b)
+#define VSUB(a, b)      _mm_sub_ps(a, b)
+#define VMUL(a, b)      _mm_mul_ps(a, b)
+#define VDIV(a, b)      _mm_div_ps(a, b)
+#define VMIN(a, b)      _mm_min_ps(a, b)
+#define VMAX(a, b)      _mm_max_ps(a, b)
+#define VSQRT(a)        _mm_sqrt_ps(a)
+#define VABS(a)         _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define VFLOOR(a)       K(floor)(a)
+#define VROUND(a)       _mm_cvtepi32_ps(_mm_cvtps_epi32(a))
+#define VLT(a, b)       _mm_cmplt_ps(a, b)
+#define VGT(a, b)       _mm_cmpgt_ps(a, b)
+#define VSEL(m, a, b)   _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#define VSTORE(p, a)    _mm_storeu_ps(p, a)
+#define MAND(a, b)      _mm_and_ps(a, b)
+#define MOR(a, b)       _mm_or_ps(a, b)
+#define MANDNOT(a, b)   _mm_andnot_ps(b, a)
+#define MBITS(m)        ((uint32_t)_mm_movemask_ps(m))
+// 2^n for integral n in the normal range, the exponent of a (> 0) and its mantissa in [1, 2).
+#define VPOW2I(n)       _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23))
+#define VEXPONENT(a)    _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(127)))
+#define VMANTISSA(a)    _mm_or_ps(_mm_and_ps(a, _mm_castsi128_ps(_mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(1.0f))
+
+#elif SDFK_WIDTH == 8
+
+typedef __m256 K(Float);
+typedef __m256 K(Mask);
+
+#define VSET(x)         _mm256_set1_ps((float)(x))
+#define VLANEX()        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 0.0f, 1.0f, 2.0f, 3.0f)
+#define VLANEY()        _mm256_setr_ps(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f)
+#define VADD(a, b)      _mm256_add_ps(a, b)
+#define VSUB(a, b)      _mm256_sub_ps(a, b)
+#define VMUL(a, b)      _mm256_mul_ps(a, b)
+#define VDIV(a, b)      _mm256_div_ps(a, b)
+#define VMIN(a, b)      _mm256_min_ps(a, b)
+#define VMAX(a, b)      _mm256_max_ps(a, b)
+#define VSQRT(a)        _mm256_sqrt_ps(a)
+#define VABS(a)         _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define VFLOOR(a)       _mm256_floor_ps(a)
+#define VROUND(a)       _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define VLT(a, b)       _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define VGT(a, b)       _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define VSEL(m, a, b)   _mm256_blendv_ps(b, a, m)
+#define VSTORE(p, a)    _mm256_storeu_ps(p, a)
+#define MAND(a, b)      _mm256_and_ps(a, b)
+#define MOR(a, b)       _mm256_or_ps(a, b)
+#define MANDNOT(a, b)   _mm256_andnot_ps(b, a)
+#define MBITS(m)        ((uint32_t)_mm256_movemask_ps(m))
+#define VPOW2I(n)       _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23))
+#define VEXPONENT(a)    _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(a), 23), _mm256_set1_epi32(127)))
+#define VMANTISSA(a)    _mm256_or_ps(_mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x007FFFFF))), _mm256_set1_ps(1.0f))
+
+#else
+#error "SDFK_WIDTH must be 1, 4 or 8"
+#endif
+
+#define V K(Float)
+#define M K(Mask)
+#define V3 K(Vec3)
+
+#define VMADD(a, b, c)  VADD(VMUL(a, b), c)
+#define VNEG(a)         VSUB(VSET(0.0f), a)
+#define VCLAMP(a, lo, hi) VMIN(VMAX(a, VSET(lo)), VSET(hi))
+#define MANY(m)         (MBITS(m) != 0)
+
+typedef struct K(tagVec3)
+{
+    V x, y, z;
+} V3;
+
+//----------------------------------------------------------
+// Math
+
+#if SDFK_WIDTH == 1
+
+SDFK_FUNC void K(sincos)(V a, V* s, V* c)
+{
+    *s = sinf(a);
+    *c = cosf(a);
+}
+
+SDFK_FUNC V K(atan2)(V y, V x)
+{
+    return atan2f(y, x);
+}
+
+SDFK_FUNC V K(pow)(V a, float b)
+{
+    return powf(a, b);
+}
+
+SDFK_FUNC V K(exp)(V a)
+{
+    return expf(a);
+}
+
+#else
+
+// Reduced to [-pi/4, pi/4] around the nearest multiple of pi/2 (pi/2 split in three for exact products).
+SDFK_FUNC void K(sincos)(V a, V* s, V* c)
+{
+    V q = VROUND(VMUL(a, VSET(0.63661977f)));
+    V r = VSUB(a, VMUL(q, VSET(1.5703125f)));
+    r = VSUB(r, VMUL(q, VSET(4.8375129699707031e-4f)));
+    r = VSUB(r, VMUL(q, VSET(7.5497899548918821e-8f)));
+    V r2 = VMUL(r, r);
+
+    V sr = VMADD(r2, VSET(-1.9515295891e-4f), VSET(8.3321608736e-3f));
+    sr = VMADD(r2, sr, VSET(-1.6666654611e-1f));
+    sr = VMADD(VMUL(r, r2), sr, r);
+    V cr = VMADD(r2, VSET(2.443315711809948e-5f), VSET(-1.388731625493765e-3f));
+    cr = VMADD(r2, cr, VSET(4.166664568298827e-2f));
+    cr = VMADD(VMUL(r2, r2), cr, VSUB(VSET(1.0f), VMUL(r2, VSET(0.5f))));
+
+    // Quadrant 1 and 3 swap sin and cos, 2 and 3 negate sin, 1 and 2 negate cos.
+    V quadrant = VSUB(q, VMUL(VFLOOR(VMUL(q, VSET(0.25f))), VSET(4.0f)));
+    V odd = VSUB(quadrant, VMUL(VFLOOR(VMUL(quadrant, VSET(0.5f))), VSET(2.0f)));
+    M swap = VGT(odd, VSET(0.5f));
+    M negateSin = VGT(quadrant, VSET(1.5f));
+    M negateCos = MAND(VGT(quadrant, VSET(0.5f)), VLT(quadrant, VSET(2.5f)));
+    V sv = VSEL(swap, cr, sr);
+    V cv = VSEL(swap, sr, cr);
+    *s = VSEL(negateSin, VNEG(sv), sv);
+    *c = VSEL(negateCos, VNEG(cv), cv);
+}
+
+SDFK_FUNC V K(atan2)(V y, V x)
+{
+    V ax = VABS(x);
+    V ay = VABS(y);
+    V a = VDIV(VMIN(ax, ay), VMAX(VMAX(ax, ay), VSET(1e-30f)));
+    M big = VGT(a, VSET(0.41421356f));
+    V z = VSEL(big, VDIV(VSUB(a, VSET(1.0f)), VADD(a, VSET(1.0f))), a);
+    V z2 = VMUL(z, z);
+    V r = VMADD(z2, VSET(8.05374449538e-2f), VSET(-1.38776856032e-1f));
+    r = VMADD(z2, r, VSET(1.99777106478e-1f));
+    r = VMADD(z2, r, VSET(-3.33329491539e-1f));
+    r = VMADD(VMUL(z2, z), r, z);
+    r = VSEL(big, VADD(r, VSET(0.78539816f)), r);
+    r = VSEL(VGT(ay, ax), VSUB(VSET(1.57079633f), r), r);
+    r = VSEL(VLT(x, VSET(0.0f)), VSUB(VSET(3.14159265f), r), r);
+    return VSEL(VLT(y, VSET(0.0f)), VNEG(r), r);
+}
+
+// a > 0 and normal.
+SDFK_FUNC V K(log2)(V a)
+{
+    V e = VEXPONENT(a);
+    V m = VMANTISSA(a);
+    M high = VGT(m, VSET(1.41421356f));
+    m = VSEL(high, VMUL(m, VSET(0.5f)), m);
+    e = VSEL(high, VADD(e, VSET(1.0f)), e);
+
+    V f = VSUB(m, VSET(1.0f));
+    V z = VMUL(f, f);
+    V y = VMADD(f, VSET(7.0376836292e-2f), VSET(-1.1514610310e-1f));
+    y = VMADD(f, y, VSET(1.1676998740e-1f));
+    y = VMADD(f, y, VSET(-1.2420140846e-1f));
+    y = VMADD(f, y, VSET(1.4249322787e-1f));
+    y = VMADD(f, y, VSET(-1.6668057665e-1f));
+    y = VMADD(f, y, VSET(2.0000714765e-1f));
+    y = VMADD(f, y, VSET(-2.4999993993e-1f));
+    y = VMADD(f, y, VSET(3.3333331174e-1f));
+    y = VSUB(VMUL(VMUL(y, f), z), VMUL(z, VSET(0.5f)));
+    return VMADD(VADD(f, y), VSET(1.44269504f), e);
+}
+
+SDFK_FUNC V K(exp2)(V a)
+{
+    a = VCLAMP(a, -126.0f, 126.0f);
+    V n = VROUND(a);
+    V f = VSUB(a, n);
+    V p = VMADD(f, VSET(1.535336188319500e-4f), VSET(1.339887440266574e-3f));
+    p = VMADD(f, p, VSET(9.618437357674640e-3f));
+    p = VMADD(f, p, VSET(5.550332471162809e-2f));
+    p = VMADD(f, p, VSET(2.402264791363012e-1f));
+    p = VMADD(f, p, VSET(6.931472028550421e-1f));
+    p = VMADD(f, p, VSET(1.0f));
+    return VMUL(p, VPOW2I(n));
+}
+
+SDFK_FUNC V K(pow)(V a, float b)
+{
+    M positive = VGT(a, VSET(0.0f));
+    V safe = VSEL(positive, a, VSET(1.0f));
+    return VSEL(positive, K(exp2)(VMUL(K(log2)(safe), VSET(b))), VSET(0.0f));
+}
+
+SDFK_FUNC V K(exp)(V a)
+{
+    return K(exp2)(VMUL(a, VSET(1.44269504f)));
+}
+
+#endif
+
+//----------------------------------------------------------
+// Vectors
+
+SDFK_FUNC V3 K(vec3)(V x, V y, V z)
+{
+    V3 v = { x, y, z };
+    return v;
+}
+
+SDFK_FUNC V3 K(splat3)(const float* v)
+{
+    return K(vec3)(VSET(v[0]), VSET(v[1]), VSET(v[2]));
+}
+
+SDFK_FUNC V3 K(add3)(V3 a, V3 b)
+{
+    return K(vec3)(VADD(a.x, b.x), VADD(a.y, b.y), VADD(a.z, b.z));
+}
+
+SDFK_FUNC V3 K(sub3)(V3 a, V3 b)
+{
+    return K(vec3)(VSUB(a.x, b.x), VSUB(a.y, b.y), VSUB(a.z, b.z));
+}
+
+SDFK_FUNC V3 K(scale3)(V3 a, V s)
+{
+    return K(vec3)(VMUL(a.x, s), VMUL(a.y, s), VMUL(a.z, s));
+}
+
+// a + b*s
+SDFK_FUNC V3 K(madd3)(V3 a, V3 b, V s)
+{
+    return K(vec3)(VMADD(b.x, s, a.x), VMADD(b.y, s, a.y), VMADD(b.z, s, a.z));
+}
+
+SDFK_FUNC V K(dot3)(V3 a, V3 b)
+{
+    return VMADD(a.x, b.x, VMADD(a.y, b.y, VMUL(a.z, b.z)));
+}
+
+SDFK_FUNC V K(length3)(V3 a)
+{
+    return VSQRT(K(dot3)(a, a));
+}
+
+SDFK_FUNC V K(length2)(V x, V y)
+{
+    return VSQRT(VMADD(x, x, VMUL(y, y)));
+}
+
+SDFK_FUNC V3 K(normalize3)(V3 a)
+{
+    return K(scale3)(a, VDIV(VSET(1.0f), K(length3)(a)));
+}
+
+//----------------------------------------------------------
+// Distance functions
+
+// length(max(vec2(d1,d2),0.0)) + min(max(d1,d2), 0.)
+SDFK_FUNC V K(extrude)(V d1, V d2)
+{
+    V zero = VSET(0.0f);
+    return VADD(K(length2)(VMAX(d1, zero), VMAX(d2, zero)), VMIN(VMAX(d1, d2), zero));
+}
+
+SDFK_FUNC V K(sd_box)(V3 p, V bx, V by, V bz)
+{
+    V zero = VSET(0.0f);
+    V dx = VSUB(VABS(p.x), bx);
+    V dy = VSUB(VABS(p.y), by);
+    V dz = VSUB(VABS(p.z), bz);
+    V outside = K(length3)(K(vec3)(VMAX(dx, zero), VMAX(dy, zero), VMAX(dz, zero)));
+    return VADD(VMIN(VMAX(dx, VMAX(dy, dz)), zero), outside);
+}
+
+SDFK_FUNC V K(ud_round_box)(V3 p, V b, V r)
+{
+    V zero = VSET(0.0f);
+    V3 d = K(vec3)(VMAX(VSUB(VABS(p.x), b), zero), VMAX(VSUB(VABS(p.y), b), zero), VMAX(VSUB(VABS(p.z), b), zero));
+    return VSUB(K(length3)(d), r);
+}
+
+SDFK_FUNC V K(length6)(V x, V y)
+{
+    x = VMUL(VMUL(x, x), x);
+    y = VMUL(VMUL(y, y), y);
+    return K(pow)(VMADD(x, x, VMUL(y, y)), 1.0f / 6.0f);
+}
+
+SDFK_FUNC V K(length8)(V x, V y)
+{
+    x = VMUL(x, x); x = VMUL(x, x);
+    y = VMUL(y, y); y = VMUL(y, y);
+    return K(pow)(VMADD(x, x, VMUL(y, y)), 1.0f / 8.0f);
+}
+
+SDFK_FUNC V K(sd_torus82)(V3 p, const float* t)
+{
+    return VSUB(K(length8)(VSUB(K(length2)(p.x, p.z), VSET(t[0])), p.y), VSET(t[1]));
+}
+
+SDFK_FUNC V K(sd_cylinder)(V3 p, V hx, V hy)
+{
+    return K(extrude)(VSUB(K(length2)(p.x, p.z), hx), VSUB(VABS(p.y), hy));
+}
+
+// mod(a, c) - 0.5*c
+SDFK_FUNC V K(rep)(V a, float c)
+{
+    return VSUB(VSUB(a, VMUL(VFLOOR(VDIV(a, VSET(c))), VSET(c))), VSET(0.5f * c));
+}
+
+// sdPrimitive of rtprimitives.glsl-fs; the type is the same for every lane.
+SDFK_FUNC V K(sd_primitive)(V3 pos, const SdfPrimitive* prim)
+{
+    V3 p = K(sub3)(pos, K(splat3)(prim->position));
+    const float* a = prim->params;
+    V zero = VSET(0.0f);
+    switch (prim->type)
+    {
+    case SDF_PLANE:
+        return p.y;
+    case SDF_SPHERE:
+        return VSUB(K(length3)(p), VSET(a[0]));
+    case SDF_BOX:
+        return K(sd_box)(p, VSET(a[0]), VSET(a[1]), VSET(a[2]));
+    case SDF_ROUND_BOX:
+    {
+        V3 d = K(vec3)(VMAX(VSUB(VABS(p.x), VSET(a[0])), zero), VMAX(VSUB(VABS(p.y), VSET(a[1])), zero),
+            VMAX(VSUB(VABS(p.z), VSET(a[2])), zero));
+        return VSUB(K(length3)(d), VSET(a[3]));
+    }
+    case SDF_TORUS:
+        return VSUB(K(length2)(VSUB(K(length2)(p.x, p.z), VSET(a[0])), p.y), VSET(a[1]));
+    case SDF_CAPSULE:
+    {
+        // Segment from -a.xyz to a.xyz.
+        V3 ba = K(vec3)(VSET(2.0f * a[0]), VSET(2.0f * a[1]), VSET(2.0f * a[2]));
+        V3 pa = K(add3)(p, K(splat3)(a));
+        float baba = 4.0f * (a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        V h = VCLAMP(VDIV(K(dot3)(pa, ba), VSET(baba)), 0.0f, 1.0f);
+        return VSUB(K(length3)(K(sub3)(pa, K(scale3)(ba, h))), VSET(a[3]));
+    }
+    case SDF_TRI_PRISM:
+    {
+        V d1 = VSUB(VABS(p.z), VSET(a[1]));
+        V d2 = VSUB(VMAX(VMADD(VABS(p.x), VSET(0.866025f), VMUL(p.y, VSET(0.5f))), VNEG(p.y)), VSET(0.5f * a[0]));
+        return K(extrude)(d1, d2);
+    }
+    case SDF_CYLINDER:
+        return K(sd_cylinder)(p, VSET(a[0]), VSET(a[1]));
+    case SDF_CONE:
+    {
+        V qx = K(length2)(p.x, p.z);
+        V d1 = VSUB(VNEG(p.y), VSET(a[2]));
+        V d2 = VMAX(VMADD(qx, VSET(a[0]), VMUL(p.y, VSET(a[1]))), p.y);
+        return K(extrude)(d1, d2);
+    }
+    case SDF_TORUS82:
+        return K(sd_torus82)(p, a);
+    case SDF_TORUS88:
+        return VSUB(K(length8)(VSUB(K(length8)(p.x, p.z), VSET(a[0])), p.y), VSET(a[1]));
+    case SDF_CYLINDER6:
+        return VMAX(VSUB(K(length6)(p.x, p.z), VSET(a[0])), VSUB(VABS(p.y), VSET(a[1])));
+    case SDF_HEX_PRISM:
+    {
+        V qy = VABS(p.y);
+        V d1 = VSUB(VABS(p.z), VSET(a[1]));
+        V d2 = VSUB(VMAX(VMADD(VABS(p.x), VSET(0.866025f), VMUL(qy, VSET(0.5f))), qy), VSET(a[0]));
+        return K(extrude)(d1, d2);
+    }
+    case SDF_PYRAMID4:
+    {
+        // Octahedron minus the cube below it, a = { cos, sin, height }.
+        V size = VSET(2.0f * a[2]);
+        V box = K(sd_box)(K(vec3)(p.x, VADD(p.y, size), p.z), size, size, size);
+        V hx = VSET(a[0]);
+        V hy = VSET(a[1]);
+        V d = zero;
+        d = VMAX(d, VABS(VMADD(p.y, hy, VMUL(p.x, VNEG(hx)))));
+        d = VMAX(d, VABS(VMADD(p.y, hy, VMUL(p.x, hx))));
+        d = VMAX(d, VABS(VMADD(p.y, hy, VMUL(p.z, hx))));
+        d = VMAX(d, VABS(VMADD(p.y, hy, VMUL(p.z, VNEG(hx)))));
+        V octa = VSUB(d, VSET(a[2]));
+        return VMAX(VNEG(box), octa);
+    }
+    case SDF_ROUND_BOX_MINUS_SPHERE:
+    {
+        V box = K(ud_round_box)(p, VSET(a[0]), VSET(a[1]));
+        V sphere = VSUB(K(length3)(p), VSET(a[2]));
+        return VMAX(VNEG(sphere), box);
+    }
+    case SDF_SLOTTED_TORUS:
+    {
+        V3 q = K(vec3)(
+            K(rep)(VMUL(K(atan2)(p.x, p.z), VSET(1.0f / 6.2831f)), 0.05f),
+            K(rep)(pos.y, 1.0f),
+            K(rep)(VMADD(K(length3)(p), VSET(0.5f), VSET(0.02f)), 0.05f));
+        V slots = K(sd_cylinder)(q, VSET(0.02f), VSET(0.6f));
+        return VMAX(VNEG(slots), K(sd_torus82)(p, a));
+    }
+    case SDF_DISPLACED_SPHERE:
+    {
+        V sx, sy, sz, c;
+        K(sincos)(VMUL(pos.x, VSET(50.0f)), &sx, &c);
+        K(sincos)(VMUL(pos.y, VSET(50.0f)), &sy, &c);
+        K(sincos)(VMUL(pos.z, VSET(50.0f)), &sz, &c);
+        V sphere = VSUB(K(length3)(p), VSET(a[0]));
+        return VMADD(sphere, VSET(0.5f), VMUL(VMUL(VMUL(sx, sy), sz), VSET(0.03f)));
+    }
+    case SDF_TWISTED_TORUS:
+    {
+        // opTwist gives (c*x + s*z, -s*x + c*z, y); sdTorus reads its xz and y.
+        V s, c;
+        K(sincos)(VMADD(p.y, VSET(10.0f), VSET(10.0f)), &s, &c);
+        V qx = VADD(VMUL(c, p.x), VMUL(s, p.z));
+        V qy = VSUB(VMUL(c, p.z), VMUL(s, p.x));
+        V torus = VSUB(K(length2)(VSUB(K(length2)(qx, p.y), VSET(a[0])), qy), VSET(a[1]));
+        return VMUL(torus, VSET(0.5f));
+    }
+    case SDF_CONE_SECTION:
+    {
+        float h = a[0];
+        float si = 0.5f * (a[1] - a[2]) / h;
+        V d1 = VSUB(VNEG(p.y), VSET(h));
+        V q = VSUB(p.y, VSET(h));
+        V xz = VMADD(p.x, p.x, VMUL(p.z, p.z));
+        V d2 = VMAX(VSUB(VMADD(q, VSET(si), VSQRT(VMUL(xz, VSET(1.0f - si * si)))), VSET(a[2])), q);
+        return K(extrude)(d1, d2);
+    }
+    case SDF_ELLIPSOID:
+    {
+        float r = a[0] < a[1] ? a[0] : a[1];
+        r = r < a[2] ? r : a[2];
+        V3 q = K(vec3)(VMUL(p.x, VSET(1.0f / a[0])), VMUL(p.y, VSET(1.0f / a[1])), VMUL(p.z, VSET(1.0f / a[2])));
+        return VMUL(VSUB(K(length3)(q), VSET(1.0f)), VSET(r));
+    }
+    }
+    return VSET(1e10f);
+}
+
+//----------------------------------------------------------
+// Marching
+
+SDFK_FUNC V K(map)(const SdfCpuJob* job, const SdfCpuTileLists* lists, uint32_t list, V3 pos, V* material)
+{
+    V res = VSET(1e10f);
+    V mat = VSET(-1.0f);
+    const uint32_t* indices = lists->indices[list];
+    for (uint32_t i = 0; i < lists->counts[list]; ++i)
+    {
+        const SdfPrimitive* prim = &job->primitives[indices[i]];
+        V d = K(sd_primitive)(pos, prim);
+        // opU keeps res only when it is strictly closer, ties go to the later primitive.
+        M keep = VLT(res, d);
+        res = VSEL(keep, res, d);
+        mat = VSEL(keep, mat, VSET(prim->material));
+    }
+    if (material)
+    {
+        *material = mat;
+    }
+    return res;
+}
+
+SDFK_FUNC V K(cast_ray)(const SdfCpuJob* job, const SdfCpuTileLists* lists, V3 ro, V3 rd, M active, V* material)
+{
+    V tmin = VSET(1.0f);
+    V tmax = VSET(20.0f);
+
+    // bounding volume
+    V tp1 = VDIV(VNEG(ro.y), rd.y);
+    tmax = VSEL(VGT(tp1, VSET(0.0f)), VMIN(tmax, tp1), tmax);
+    V tp2 = VDIV(VSUB(VSET(1.6f), ro.y), rd.y);
+    M above = VGT(ro.y, VSET(1.6f));
+    M ahead = VGT(tp2, VSET(0.0f));
+    tmin = VSEL(MAND(ahead, above), VMAX(tmin, tp2), tmin);
+    tmax = VSEL(MANDNOT(ahead, above), VMIN(tmax, tp2), tmax);
+
+    V t = tmin;
+    V m = VSET(-1.0f);
+    M marching = active;
+    for (uint32_t i = 0; i < job->quality.marchSteps && MANY(marching); ++i)
+    {
+        V precis = VMUL(t, VSET(0.0005f));
+        V mat;
+        V res = K(map)(job, lists, SDF_LIST_NEAR, K(madd3)(ro, rd, t), &mat);
+        marching = MANDNOT(marching, MOR(VLT(res, precis), VGT(t, tmax)));
+        t = VSEL(marching, VADD(t, res), t);
+        m = VSEL(marching, mat, m);
+    }
+
+    *material = VSEL(VGT(t, tmax), VSET(-1.0f), m);
+    return t;
+}
+
+SDFK_FUNC V K(softshadow)(const SdfCpuJob* job, const SdfCpuTileLists* lists, V3 ro, V3 rd, float mint, float tmax,
+    M active, uint64_t* rays)
+{
+    V res = VSET(1.0f);
+    V t = VSET(mint);
+    M marching = active;
+    *rays += sdfcpu_popcount(MBITS(active));
+    for (uint32_t i = 0; i < job->quality.shadowSteps && MANY(marching); ++i)
+    {
+        V h = K(map)(job, lists, SDF_LIST_FAR, K(madd3)(ro, rd, t), 0);
+        res = VSEL(marching, VMIN(res, VDIV(VMUL(h, VSET(8.0f)), t)), res);
+        t = VSEL(marching, VADD(t, VCLAMP(h, 0.02f, 0.10f)), t);
+        marching = MANDNOT(marching, MOR(VLT(h, VSET(0.001f)), VGT(t, VSET(tmax))));
+    }
+    return VCLAMP(res, 0.0f, 1.0f);
+}
+
+SDFK_FUNC V3 K(calc_normal)(const SdfCpuJob* job, const SdfCpuTileLists* lists, V3 pos)
+{
+    const float e = 0.5773f * 0.0005f;
+    V pe = VSET(e);
+    V ne = VSET(-e);
+    V d0 = K(map)(job, lists, SDF_LIST_NEAR, K(add3)(pos, K(vec3)(pe, ne, ne)), 0);
+    V d1 = K(map)(job, lists, SDF_LIST_NEAR, K(add3)(pos, K(vec3)(ne, ne, pe)), 0);
+    V d2 = K(map)(job, lists, SDF_LIST_NEAR, K(add3)(pos, K(vec3)(ne, pe, ne)), 0);
+    V d3 = K(map)(job, lists, SDF_LIST_NEAR, K(add3)(pos, K(vec3)(pe, pe, pe)), 0);
+    V3 n = K(vec3)(
+        VADD(VSUB(VSUB(d0, d1), d2), d3),
+        VADD(VSUB(VSUB(VNEG(d0), d1), VNEG(d2)), d3),
+        VADD(VSUB(VADD(VNEG(d0), d1), d2), d3));
+    return K(normalize3)(n);
+}
+
+SDFK_FUNC V K(calc_ao)(const SdfCpuJob* job, const SdfCpuTileLists* lists, V3 pos, V3 nor)
+{
+    V occ = VSET(0.0f);
+    float sca = 1.0f;
+    uint32_t taps = job->quality.aoTaps;
+    for (uint32_t i = 0; i < taps; ++i)
+    {
+        float hr = 0.01f + 0.12f * (float)i / (float)(taps > 1 ? taps - 1 : 1);
+        V dd = K(map)(job, lists, SDF_LIST_NEAR, K(madd3)(pos, nor, VSET(hr)), 0);
+        occ = VADD(occ, VMUL(VSUB(VSET(hr), dd), VSET(sca)));
+        sca *= 0.95f;
+    }
+    return VCLAMP(VSUB(VSET(1.0f), VMUL(occ, VSET(3.0f * 5.0f / (float)taps))), 0.0f, 1.0f);
+}
+
+SDFK_FUNC V3 K(render)(const SdfCpuJob* job, const SdfCpuTileLists* lists, V3 ro, V3 rd, M active, uint64_t* rays)
+{
+    V3 col = K(vec3)(VMADD(rd.y, VSET(0.8f), VSET(0.7f)), VMADD(rd.y, VSET(0.8f), VSET(0.9f)), VMADD(rd.y, VSET(0.8f), VSET(1.0f)));
+    V m;
+    V t = K(cast_ray)(job, lists, ro, rd, active, &m);
+    M hit = MAND(active, VGT(m, VSET(-0.5f)));
+    if (!MANY(hit))
+    {
+        return col;
+    }
+
+    V3 pos = K(madd3)(ro, rd, t);
+    V3 nor = K(calc_normal)(job, lists, pos);
+    V3 ref = K(madd3)(rd, nor, VMUL(K(dot3)(nor, rd), VSET(-2.0f)));
+
+    // material
+    V sr, sg, sb, c;
+    V mm = VSUB(m, VSET(1.0f));
+    K(sincos)(VMUL(mm, VSET(0.05f)), &sr, &c);
+    K(sincos)(VMUL(mm, VSET(0.08f)), &sg, &c);
+    K(sincos)(VMUL(mm, VSET(0.10f)), &sb, &c);
+    V3 mate = K(vec3)(VMADD(sr, VSET(0.35f), VSET(0.45f)), VMADD(sg, VSET(0.35f), VSET(0.45f)), VMADD(sb, VSET(0.35f), VSET(0.45f)));
+    V checker = VADD(VFLOOR(VMUL(pos.z, VSET(5.0f))), VFLOOR(VMUL(pos.x, VSET(5.0f))));
+    V f = VSUB(checker, VMUL(VFLOOR(VMUL(checker, VSET(0.5f))), VSET(2.0f)));
+    V floorColor = VMADD(f, VSET(0.1f), VSET(0.3f));
+    M ground = VLT(m, VSET(1.5f));
+    mate = K(vec3)(VSEL(ground, floorColor, mate.x), VSEL(ground, floorColor, mate.y), VSEL(ground, floorColor, mate.z));
+
+    // lighting
+    float lig[3] = { -0.4f, 0.7f, -0.6f };
+    sdfcpu_normalize(lig);
+    float back[3] = { -lig[0], 0.0f, -lig[2] };
+    sdfcpu_normalize(back);
+    V3 light = K(splat3)(lig);
+    V occ = K(calc_ao)(job, lists, pos, nor);
+    V amb = VCLAMP(VMADD(nor.y, VSET(0.5f), VSET(0.5f)), 0.0f, 1.0f);
+    V dif = VCLAMP(K(dot3)(nor, light), 0.0f, 1.0f);
+    V bac = VMUL(VCLAMP(K(dot3)(nor, K(splat3)(back)), 0.0f, 1.0f), VCLAMP(VSUB(VSET(1.0f), pos.y), 0.0f, 1.0f));
+    V dom = VCLAMP(VMUL(VADD(ref.y, VSET(0.1f)), VSET(5.0f)), 0.0f, 1.0f);
+    dom = VMUL(VMUL(dom, dom), VSUB(VSET(3.0f), VMUL(dom, VSET(2.0f))));
+    V fre = VCLAMP(VADD(VSET(1.0f), K(dot3)(nor, rd)), 0.0f, 1.0f);
+    fre = VMUL(fre, fre);
+    V spe = VCLAMP(K(dot3)(ref, light), 0.0f, 1.0f);
+    spe = VMUL(spe, spe); spe = VMUL(spe, spe); spe = VMUL(spe, spe); spe = VMUL(spe, spe);
+
+    // A zero factor stays zero whatever the shadow, so only lanes that can be lit trace one.
+    V zero = VSET(0.0f);
+    dif = VMUL(dif, K(softshadow)(job, lists, pos, light, 0.02f, 2.5f, MAND(hit, VGT(dif, zero)), rays));
+    dom = VMUL(dom, K(softshadow)(job, lists, pos, ref, 0.02f, 2.5f, MAND(hit, VGT(dom, zero)), rays));
+
+    static const float lights[6][3] = {
+        { 1.30f * 1.00f, 1.30f * 0.80f, 1.30f * 0.55f },
+        { 2.00f * 1.00f, 2.00f * 0.90f, 2.00f * 0.70f },
+        { 0.40f * 0.40f, 0.40f * 0.60f, 0.40f * 1.00f },
+        { 0.50f * 0.40f, 0.50f * 0.60f, 0.50f * 1.00f },
+        { 0.50f * 0.25f, 0.50f * 0.25f, 0.50f * 0.25f },
+        { 0.25f * 1.00f, 0.25f * 1.00f, 0.25f * 1.00f },
+    };
+    V terms[6] = { dif, VMUL(spe, dif), VMUL(amb, occ), VMUL(dom, occ), VMUL(bac, occ), VMUL(fre, occ) };
+    V3 lin = K(vec3)(zero, zero, zero);
+    for (int i = 0; i < 6; ++i)
+    {
+        lin = K(madd3)(lin, K(splat3)(lights[i]), terms[i]);
+    }
+    V3 lit = K(vec3)(VMUL(mate.x, lin.x), VMUL(mate.y, lin.y), VMUL(mate.z, lin.z));
+
+    V fog = VSUB(VSET(1.0f), K(exp)(VMUL(VMUL(VMUL(t, t), t), VSET(-0.0002f))));
+    const float fogColor[3] = { 0.8f, 0.9f, 1.0f };
+    lit = K(madd3)(lit, K(sub3)(K(splat3)(fogColor), lit), fog);
+
+    return K(vec3)(VSEL(hit, lit.x, col.x), VSEL(hit, lit.y, col.y), VSEL(hit, lit.z, col.z));
+}
+
+//----------------------------------------------------------
+
+// Renders one tile in packets SDFK_PACKET_X pixels wide; square-ish packets keep the lanes' rays together.
+SDFK_FUNC void K(render_tile)(const SdfCpuJob* job, const SdfCpuTileLists* lists, uint32_t tileX, uint32_t tileY,
+    uint64_t* primaryRays, uint64_t* shadowRays)
+{
+    const uint32_t packetY = SDFK_WIDTH / SDFK_PACKET_X;
+    float resX = (float)job->width;
+    float resY = (float)job->height;
+    V3 ro = K(splat3)(job->ro);
+    V3 cu = K(splat3)(job->cu);
+    V3 cv = K(splat3)(job->cv);
+    V3 cw = K(splat3)(job->cw);
+    uint32_t x0 = tileX * SDF_TILE_SIZE;
+    uint32_t y0 = tileY * SDF_TILE_SIZE;
+    uint32_t x1 = x0 + SDF_TILE_SIZE < job->width ? x0 + SDF_TILE_SIZE : job->width;
+    uint32_t y1 = y0 + SDF_TILE_SIZE < job->height ? y0 + SDF_TILE_SIZE : job->height;
+
+    uint32_t aa = job->quality.aa;
+    for (uint32_t y = y0; y < y1; y += packetY)
+    {
+        for (uint32_t x = x0; x < x1; x += SDFK_PACKET_X)
+        {
+            V fragX = VADD(VLANEX(), VSET((float)x + 0.5f));
+            V fragY = VADD(VLANEY(), VSET((float)y + 0.5f));
+            M active = MAND(VLT(fragX, VSET(resX)), VLT(fragY, VSET(resY)));
+
+            V3 tot = K(vec3)(VSET(0.0f), VSET(0.0f), VSET(0.0f));
+            for (uint32_t m = 0; m < aa; ++m)
+            {
+                for (uint32_t n = 0; n < aa; ++n)
+                {
+                    // pixel coordinates, samples centered in the pixel
+                    V sampleX = VADD(fragX, VSET(((float)m + 0.5f) / (float)aa - 0.5f));
+                    V sampleY = VADD(fragY, VSET(((float)n + 0.5f) / (float)aa - 0.5f));
+                    V px = VDIV(VSUB(VMUL(sampleX, VSET(2.0f)), VSET(resX)), VSET(resY));
+                    V py = VDIV(VSUB(VSET(resY), VMUL(sampleY, VSET(2.0f))), VSET(resY));
+
+                    // ray direction
+                    V3 d = K(normalize3)(K(vec3)(px, py, VSET(2.0f)));
+                    V3 rd = K(madd3)(K(madd3)(K(scale3)(cu, d.x), cv, d.y), cw, d.z);
+
+                    V3 col = K(render)(job, lists, ro, rd, active, shadowRays);
+                    *primaryRays += sdfcpu_popcount(MBITS(active));
+
+                    // gamma
+                    tot.x = VADD(tot.x, K(pow)(VCLAMP(col.x, 0.0f, 1.0f), 0.4545f));
+                    tot.y = VADD(tot.y, K(pow)(VCLAMP(col.y, 0.0f, 1.0f), 0.4545f));
+                    tot.z = VADD(tot.z, K(pow)(VCLAMP(col.z, 0.0f, 1.0f), 0.4545f));
+                }
+            }
+
+            float r[SDFK_WIDTH], g[SDFK_WIDTH], b[SDFK_WIDTH];
+            V weight = VSET(1.0f / (float)(aa * aa));
+            VSTORE(r, VMUL(tot.x, weight));
+            VSTORE(g, VMUL(tot.y, weight));
+            VSTORE(b, VMUL(tot.z, weight));
+
+            for (uint32_t i = 0; i < SDFK_WIDTH; ++i)
+            {
+                uint32_t pixelX = x + i % SDFK_PACKET_X;
+                uint32_t pixelY = y + i / SDFK_PACKET_X;
+                if (pixelX < x1 && pixelY < y1)
+                {
+                    uint8_t* out = job->rgb + ((size_t)pixelY * job->width + pixelX) * 3;
+                    out[0] = (uint8_t)(r[i] * 255.0f + 0.5f);
+                    out[1] = (uint8_t)(g[i] * 255.0f + 0.5f);
+                    out[2] = (uint8_t)(b[i] * 255.0f + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+#undef V
+#undef M
+#undef V3
+#undef VSET
+#undef VLANEX
+#undef VLANEY
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VMIN
+#undef VMAX
+#undef VSQRT
+#undef VABS
+#undef VFLOOR
+#undef VROUND
+#undef VLT
+#undef VGT
+#undef VSEL
+#undef VSTORE
+#undef MAND
+#undef MOR
+#undef MANDNOT
+#undef MBITS
+#undef VPOW2I
+#undef VEXPONENT
+#undef VMANTISSA
+#undef VMADD
+#undef VNEG
+#undef VCLAMP
+#undef MANY
+#undef K
+#undef SDFK_NAME1
+#undef SDFK_NAME2
+#undef SDFK_WIDTH
+#undef SDFK_PACKET_X
+#undef SDFK_SUFFIX
+#undef SDFK_FUNC
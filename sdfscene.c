@@ -0,0 +1,74 @@
+#include "sdfscene.h"
+
+enum {
+    SDF_REPEAT_SPACING = 6,     // scene units between copies, the objects span about 4
+};
+
+static const SdfPrimitive objects[] = {
+    { {  0.0f,  0.25f,  0.0f }, SDF_SPHERE, { 0.25f }, { 0.25f, 0.25f, 0.25f }, 46.9f },
+    { {  1.0f,  0.25f,  0.0f }, SDF_BOX, { 0.25f, 0.25f, 0.25f }, { 0.25f, 0.25f, 0.25f }, 3.0f },
+    { {  1.0f,  0.25f,  1.0f }, SDF_ROUND_BOX, { 0.15f, 0.15f, 0.15f, 0.1f }, { 0.25f, 0.25f, 0.25f }, 41.0f },
+    { {  0.0f,  0.25f,  1.0f }, SDF_TORUS, { 0.20f, 0.05f }, { 0.25f, 0.05f, 0.25f }, 25.0f },
+    { { -1.05f, 0.30f,  0.05f }, SDF_CAPSULE, { 0.25f, 0.20f, 0.15f, 0.1f }, { 0.35f, 0.30f, 0.25f }, 31.9f },
+    { { -1.0f,  0.25f, -1.0f }, SDF_TRI_PRISM, { 0.25f, 0.05f }, { 0.22f, 0.25f, 0.05f }, 43.5f },
+    { {  1.0f,  0.30f, -1.0f }, SDF_CYLINDER, { 0.1f, 0.2f }, { 0.1f, 0.2f, 0.1f }, 8.0f },
+    { {  0.0f,  0.50f, -1.0f }, SDF_CONE, { 0.8f, 0.6f, 0.3f }, { 0.23f, 0.3f, 0.23f }, 55.0f },
+    { {  0.0f,  0.25f,  2.0f }, SDF_TORUS82, { 0.20f, 0.05f }, { 0.25f, 0.05f, 0.25f }, 50.0f },
+    { { -1.0f,  0.25f,  2.0f }, SDF_TORUS88, { 0.20f, 0.05f }, { 0.25f, 0.05f, 0.25f }, 43.0f },
+    { {  1.0f,  0.30f,  2.0f }, SDF_CYLINDER6, { 0.1f, 0.2f }, { 0.1f, 0.2f, 0.1f }, 12.0f },
+    { { -1.0f,  0.20f,  1.0f }, SDF_HEX_PRISM, { 0.25f, 0.05f }, { 0.29f, 0.25f, 0.05f }, 17.0f },
+    { { -1.0f,  0.15f, -2.0f }, SDF_PYRAMID4, { 0.8f, 0.6f, 0.25f }, { 0.32f, 0.42f, 0.32f }, 37.0f },
+    { { -2.0f,  0.2f,   1.0f }, SDF_ROUND_BOX_MINUS_SPHERE, { 0.15f, 0.05f, 0.25f }, { 0.2f, 0.2f, 0.2f }, 13.0f },
+    { { -2.0f,  0.2f,   0.0f }, SDF_SLOTTED_TORUS, { 0.20f, 0.1f }, { 0.3f, 0.1f, 0.3f }, 51.0f },
+    { { -2.0f,  0.25f, -1.0f }, SDF_DISPLACED_SPHERE, { 0.2f }, { 0.26f, 0.26f, 0.26f }, 65.0f },
+    { { -2.0f,  0.25f,  2.0f }, SDF_TWISTED_TORUS, { 0.20f, 0.05f }, { 0.26f, 0.25f, 0.26f }, 46.7f },
+    { {  0.0f,  0.35f, -2.0f }, SDF_CONE_SECTION, { 0.15f, 0.2f, 0.1f }, { 0.2f, 0.15f, 0.2f }, 13.67f },
+    { {  1.0f,  0.35f, -2.0f }, SDF_ELLIPSOID, { 0.15f, 0.2f, 0.05f }, { 0.15f, 0.2f, 0.05f }, 43.17f },
+};
+
+uint32_t sdfscene_build(SdfPrimitive* primitives, uint32_t maxCount, uint32_t repeat)
+{
+    const uint32_t objectCount = sizeof(objects) / sizeof(objects[0]);
+    if (!maxCount)
+    {
+        return 0;
+    }
+
+    primitives[0] = (SdfPrimitive){ { 0.0f, 0.0f, 0.0f }, SDF_PLANE, { 0.0f }, { -1.0f, -1.0f, -1.0f }, 1.0f };
+    uint32_t count = 1;
+
+    // The original scene stays at the origin, copies spread out from it along +x and -z.
+    repeat = repeat ? repeat : 1;
+    for (uint32_t row = 0; row < repeat; ++row)
+    {
+        for (uint32_t column = 0; column < repeat; ++column)
+        {
+            for (uint32_t i = 0; i < objectCount && count < maxCount; ++i)
+            {
+                SdfPrimitive* primitive = &primitives[count++];
+                *primitive = objects[i];
+                primitive->position[0] += (float)(column * SDF_REPEAT_SPACING);
+                primitive->position[2] -= (float)(row * SDF_REPEAT_SPACING);
+            }
+        }
+    }
+    return count;
+}
+
+static const SdfQuality qualities[SDF_QUALITY_COUNT] = {
+    { 1, 32, 8, 3 },
+    { 1, 64, 16, 5 },
+    { 2, 96, 24, 5 },
+    { 3, 128, 32, 8 },
+};
+
+const SdfQuality* sdfscene_quality(uint32_t tier)
+{
+    return &qualities[tier < SDF_QUALITY_COUNT ? tier : SDF_QUALITY_MEDIUM];
+}
+
+const char* sdfscene_quality_name(uint32_t tier)
+{
+    static const char* names[SDF_QUALITY_COUNT] = { "low", "medium", "high", "ultra" };
+    return tier < SDF_QUALITY_COUNT ? names[tier] : "?";
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+** SDF scene description.
+**
+** The primitives of rtprimitives.glsl-fs as data: every primitive has a
+** type, a position, up to four type-specific parameters and a material,
+** laid out like the std430 SdfPrimitive in shaders/sdfscene.glsl. The
+** shader evaluates them in array order, so ties pick the later one
+** exactly like the original chain of opU calls.
+**
+** halfSize bounds the primitive's surface around its position; negative
+** means unbounded (the ground plane). Tile culling inflates the bounds by
+** a margin, so they only need to hold the zero set, not the whole
+** distance field.
+**
+** Quality tiers set the cost knobs of rtprimitives.glsl-fs through
+** specialization constants, so every tier is the same SPIR-V module.
+** Medium matches the original shader.
+*/
+
+enum {
+    SDF_PLANE,
+    SDF_SPHERE,
+    SDF_BOX,
+    SDF_ROUND_BOX,
+    SDF_TORUS,
+    SDF_CAPSULE,                // params.xyz half segment, centered on position
+    SDF_TRI_PRISM,
+    SDF_CYLINDER,
+    SDF_CONE,
+    SDF_TORUS82,
+    SDF_TORUS88,
+    SDF_CYLINDER6,
+    SDF_HEX_PRISM,
+    SDF_PYRAMID4,
+    SDF_ROUND_BOX_MINUS_SPHERE,
+    SDF_SLOTTED_TORUS,
+    SDF_DISPLACED_SPHERE,
+    SDF_TWISTED_TORUS,
+    SDF_CONE_SECTION,
+    SDF_ELLIPSOID,
+    SDF_TYPE_COUNT,
+
+    SDF_MAX_PRIMITIVES = 1024,      // shaders/sdfscene.glsl sizes its tile masks for this
+    SDF_TILE_SIZE = 16,             // pixels
+    SDF_MAX_TILE_PRIMITIVES = 128,  // per tile list, longer lists fall back to every primitive
+    SDF_LIST_NEAR = 0,              // primary ray, normal and AO
+    SDF_LIST_FAR = 1,               // soft shadows too
+};
+
+enum {
+    SDF_QUALITY_LOW,
+    SDF_QUALITY_MEDIUM,
+    SDF_QUALITY_HIGH,
+    SDF_QUALITY_ULTRA,
+    SDF_QUALITY_COUNT,
+};
+
+// Specialization constants 0-3 of rtprimitives.glsl-fs, in this order.
+typedef struct tagSdfQuality
+{
+    uint32_t aa;                    // aa x aa samples per pixel
+    uint32_t marchSteps;            // castRay iterations
+    uint32_t shadowSteps;           // softshadow iterations
+    uint32_t aoTaps;                // calcAO samples
+} SdfQuality;
+
+typedef struct tagSdfPrimitive
+{
+    float position[3];
+    uint32_t type;
+    float params[4];
+    float halfSize[3];
+    float material;
+} SdfPrimitive;
+
+// The rtprimitives scene; repeat > 1 lays out repeat x repeat copies of the objects on the plane.
+// Returns the primitive count, at most maxCount.
+uint32_t sdfscene_build(SdfPrimitive* primitives, uint32_t maxCount, uint32_t repeat);
+
+// Out of range tiers give medium.
+const SdfQuality* sdfscene_quality(uint32_t tier);
+const char* sdfscene_quality_name(uint32_t tier);
@@ -0,0 +1,189 @@
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "shaderpak.h"
+
+uint64_t shaderpak_hash(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static int map_file(ShaderPak* pak, const char* path)
+{
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return 0;
+    }
+    pak->data = (const uint8_t*)data;
+    pak->size = (size_t)st.st_size;
+#else
+    // Shared for delete, so the shader build can replace the archive while we have it mapped.
+    HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(hFile, &size);
+
+    HANDLE hMapping = size.QuadPart ? CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    CloseHandle(hFile);
+    if (!hMapping)
+    {
+        return 0;
+    }
+
+    pak->data = (const uint8_t*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!pak->data)
+    {
+        CloseHandle(hMapping);
+        return 0;
+    }
+    pak->mapping = hMapping;
+    pak->size = (size_t)size.QuadPart;
+#endif
+
+    return 1;
+}
+
+// Only the index is checked, blobs are checked on first use.
+static int validate(const ShaderPak* pak)
+{
+    const ShaderPakHeader* header = (const ShaderPakHeader*)pak->data;
+    if (pak->size < sizeof(ShaderPakHeader) || header->magic != SHADERPAK_MAGIC || header->version != SHADERPAK_VERSION)
+    {
+        return 0;
+    }
+
+    uint64_t indexSize = sizeof(ShaderPakHeader) + (uint64_t)header->entryCount * sizeof(ShaderPakEntry)
+        + (uint64_t)header->blobCount * sizeof(ShaderPakBlob);
+    if (indexSize > pak->size)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < header->blobCount; ++i)
+    {
+        const ShaderPakBlob* blob = &pak->blobs[i];
+        if (blob->offset < indexSize || blob->offset % SHADERPAK_ALIGNMENT != 0
+            || blob->size == 0 || blob->size % 4 != 0 || (uint64_t)blob->offset + blob->size > pak->size)
+        {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < header->entryCount; ++i)
+    {
+        const ShaderPakEntry* entry = &pak->entries[i];
+        if (entry->blob >= header->blobCount || memchr(entry->name, 0, SHADERPAK_MAX_NAME) == 0)
+        {
+            return 0;
+        }
+        if (i > 0 && strcmp(pak->entries[i - 1].name, entry->name) >= 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int shaderpak_open(ShaderPak* pak, const char* path)
+{
+    memset(pak, 0, sizeof(*pak));
+    if (!map_file(pak, path))
+    {
+        return 0;
+    }
+
+    pak->header = (const ShaderPakHeader*)pak->data;
+    pak->entries = (const ShaderPakEntry*)(pak->header + 1);
+    pak->blobs = (const ShaderPakBlob*)(pak->entries + (pak->size >= sizeof(ShaderPakHeader) ? pak->header->entryCount : 0));
+    if (!validate(pak))
+    {
+        shaderpak_close(pak);
+        return 0;
+    }
+
+    return 1;
+}
+
+void shaderpak_close(ShaderPak* pak)
+{
+    if (pak->data)
+    {
+#ifndef _WIN32
+        munmap((void*)pak->data, pak->size);
+#else
+        UnmapViewOfFile(pak->data);
+        CloseHandle((HANDLE)pak->mapping);
+#endif
+    }
+    memset(pak, 0, sizeof(*pak));
+}
+
+uint32_t shaderpak_find(const ShaderPak* pak, const char* name)
+{
+    uint32_t first = 0, last = pak->data ? pak->header->entryCount : 0;
+    while (first < last)
+    {
+        uint32_t middle = first + (last - first) / 2;
+        int order = strcmp(pak->entries[middle].name, name);
+        if (order == 0)
+        {
+            return pak->entries[middle].blob;
+        }
+        if (order < 0)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return SHADERPAK_NOT_FOUND;
+}
+
+const uint32_t* shaderpak_code(const ShaderPak* pak, uint32_t blob, size_t* size)
+{
+    const ShaderPakBlob* entry = &pak->blobs[blob];
+    const uint8_t* code = pak->data + entry->offset;
+    if (shaderpak_hash(code, entry->size) != entry->hash)
+    {
+        return 0;
+    }
+    *size = entry->size;
+    return (const uint32_t*)code;
+}
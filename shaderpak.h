@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+** Packed shader archive.
+**
+** shaders/packshaders.py writes every compiled SPIR-V file into one
+** archive: a header, an index of names sorted for binary search, a blob
+** table with a 64-bit FNV-1a hash per blob, and the blobs themselves
+** aligned to 16 bytes. Files with identical contents share a blob, so
+** a blob index identifies unique code.
+**
+** The archive is mapped read-only once and shader code is handed to
+** the driver straight from the mapping. Opening only checks the index;
+** a blob's hash is checked when its code is first asked for.
+*/
+
+enum {
+    SHADERPAK_MAGIC = 0x4B415053,   // 'SPAK'
+    SHADERPAK_VERSION = 1,
+    SHADERPAK_MAX_NAME = 60,
+    SHADERPAK_ALIGNMENT = 16,
+    SHADERPAK_NOT_FOUND = UINT32_MAX,
+};
+
+typedef struct tagShaderPakHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t blobCount;
+} ShaderPakHeader;
+
+typedef struct tagShaderPakEntry
+{
+    char name[SHADERPAK_MAX_NAME];  // file name, NUL padded
+    uint32_t blob;
+} ShaderPakEntry;
+
+typedef struct tagShaderPakBlob
+{
+    uint32_t offset;                // from the start of the file
+    uint32_t size;
+    uint64_t hash;                  // FNV-1a 64 of the code
+} ShaderPakBlob;
+
+typedef struct tagShaderPak
+{
+    const uint8_t* data;            // the mapping
+    size_t size;
+    void* mapping;                  // Win32 file mapping handle
+    const ShaderPakHeader* header;
+    const ShaderPakEntry* entries;
+    const ShaderPakBlob* blobs;
+} ShaderPak;
+
+int shaderpak_open(ShaderPak* pak, const char* path);
+void shaderpak_close(ShaderPak* pak);
+
+// Blob of the shader with the given file name, SHADERPAK_NOT_FOUND if there is none.
+uint32_t shaderpak_find(const ShaderPak* pak, const char* name);
+
+// SPIR-V of a blob inside the mapping, 0 if its contents do not match the hash.
+const uint32_t* shaderpak_code(const ShaderPak* pak, uint32_t blob, size_t* size);
+
+uint64_t shaderpak_hash(const void* data, size_t size);
@@ -0,0 +1,24 @@
+// Shared by objectcull.glsl-cs and objects.glsl-vs, matches gpucull.h.
+
+struct CullObject
+{
+    vec2 center;
+    float radius;
+    uint mesh;
+    uint color;         // RGBA8
+    float phase;
+    uint pad0;
+    uint pad1;
+};
+
+layout(push_constant) uniform CullConst {
+    vec4 view;          // xy center, zw half size
+    uint objectCount;
+    uint compact;
+    float time;
+    uint pad;
+} u_cull;
+
+layout(std430, set = 0, binding = 0) readonly buffer Objects {
+    CullObject objects[];
+};
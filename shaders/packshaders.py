@@ -0,0 +1,88 @@
+"""Packs compiled SPIR-V into one archive, read by shaderpak.c.
+
+Usage: python packshaders.py OUTPUT INPUT...
+
+Layout, all little endian:
+    header  'SPAK', version, entry count, blob count        4 x uint32
+    entries name (NUL padded), blob index, sorted by name   60 bytes + uint32
+    blobs   offset, size, FNV-1a 64 of the contents         2 x uint32 + uint64
+    data    SPIR-V, every blob aligned to 16 bytes
+
+Entries are named by file name. Files with identical contents share a blob.
+"""
+
+import os
+import struct
+import sys
+
+MAGIC = b'SPAK'
+VERSION = 1
+MAX_NAME = 60
+ALIGNMENT = 16
+SPIRV_MAGIC = 0x07230203
+
+
+def fnv1a64(data):
+    h = 0xcbf29ce484222325
+    for b in bytearray(data):
+        h = ((h ^ b) * 0x100000001b3) & 0xffffffffffffffff
+    return h
+
+
+def align(offset):
+    return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1)
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.stderr.write(__doc__)
+        return 1
+    output, inputs = argv[1], argv[2:]
+
+    entries = {}
+    blobs = []          # (hash, data)
+    blob_index = {}     # (hash, data) -> index
+    for path in inputs:
+        name = os.path.basename(path).encode('ascii')
+        if len(name) >= MAX_NAME:
+            sys.stderr.write('%s: name longer than %d characters\n' % (path, MAX_NAME - 1))
+            return 1
+        with open(path, 'rb') as f:
+            data = f.read()
+        if len(data) < 20 or len(data) % 4 or struct.unpack_from('<I', data)[0] != SPIRV_MAGIC:
+            sys.stderr.write('%s: not a SPIR-V module\n' % path)
+            return 1
+        key = (fnv1a64(data), data)
+        if key not in blob_index:
+            blob_index[key] = len(blobs)
+            blobs.append(key)
+        entries[name] = blob_index[key]
+
+    offset = 16 + len(entries) * (MAX_NAME + 4) + len(blobs) * 16
+    table = []
+    for h, data in blobs:
+        offset = align(offset)
+        table.append((offset, len(data), h))
+        offset += len(data)
+
+    out = bytearray(struct.pack('<4sIII', MAGIC, VERSION, len(entries), len(blobs)))
+    for name in sorted(entries):
+        out += struct.pack('<%dsI' % MAX_NAME, name, entries[name])
+    for entry in table:
+        out += struct.pack('<IIQ', *entry)
+    for (offset, size, h), (_, data) in zip(table, blobs):
+        out += b'\0' * (offset - len(out))
+        out += data
+
+    # Replace the archive in one step, a running program may have the old one mapped.
+    temp = output + '.tmp'
+    with open(temp, 'wb') as f:
+        f.write(out)
+    os.replace(temp, output)
+
+    print('%s: %d shaders, %d unique, %d bytes' % (output, len(entries), len(blobs), len(out)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,73 @@
+// Shared by rtprimitives.glsl-fs and tilecull.glsl-cs, matches sdfscene.h.
+
+#define SDF_PLANE                   0u
+#define SDF_SPHERE                  1u
+#define SDF_BOX                     2u
+#define SDF_ROUND_BOX               3u
+#define SDF_TORUS                   4u
+#define SDF_CAPSULE                 5u
+#define SDF_TRI_PRISM               6u
+#define SDF_CYLINDER                7u
+#define SDF_CONE                    8u
+#define SDF_TORUS82                 9u
+#define SDF_TORUS88                 10u
+#define SDF_CYLINDER6               11u
+#define SDF_HEX_PRISM               12u
+#define SDF_PYRAMID4                13u
+#define SDF_ROUND_BOX_MINUS_SPHERE  14u
+#define SDF_SLOTTED_TORUS           15u
+#define SDF_DISPLACED_SPHERE        16u
+#define SDF_TWISTED_TORUS           17u
+#define SDF_CONE_SECTION            18u
+#define SDF_ELLIPSOID               19u
+
+#define SDF_MAX_PRIMITIVES  1024u
+#define SDF_TILE_SIZE       16u
+
+// Tile lists: near primitives can affect the primary ray, normal and AO of a pixel in the tile,
+// far ones also its soft shadows (2.5 units long, plus the distance that still darkens the penumbra).
+#define SDF_NEAR_MARGIN     0.25
+#define SDF_FAR_MARGIN      2.85
+#define SDF_LIST_NEAR       0u
+#define SDF_LIST_FAR        1u
+#define SDF_LIST_ALL        0xFFFFFFFFu     // list count when the tile overflowed
+
+struct SdfPrimitive
+{
+    vec3 position;
+    uint type;
+    vec4 params;
+    vec3 halfSize;      // negative - unbounded
+    float material;
+};
+
+layout(push_constant) uniform FSConst {
+    vec2 resolution;
+    vec2 mouse;
+    float time;
+    uint primitiveCount;
+    uint tileCountX;    // 0 - no tile lists, every pixel evaluates every primitive
+    uint tileStride;    // uints per tile: near count, far count, then both lists
+} u_input;
+
+layout(std430, set = 0, binding = 0) readonly buffer Primitives {
+    SdfPrimitive primitives[];
+};
+
+mat3 setCamera( in vec3 ro, in vec3 ta, float cr )
+{
+	vec3 cw = normalize(ta-ro);
+	vec3 cp = vec3(sin(cr), cos(cr),0.0);
+	vec3 cu = normalize( cross(cw,cp) );
+	vec3 cv = normalize( cross(cu,cw) );
+    return mat3( cu, cv, cw );
+}
+
+void sdfCamera( out vec3 ro, out mat3 ca )
+{
+    vec2 mo = u_input.mouse/u_input.resolution;
+	float time = 15.0 + u_input.time;
+    ro = vec3( -0.5+3.5*cos(0.1*time + 6.0*mo.x), 1.0 + 6.0*mo.y, 0.5 + 4.0*sin(0.1*time + 6.0*mo.x) );
+    vec3 ta = vec3( -0.5, -0.4, 0.5 );
+    ca = setCamera( ro, ta, 0.0 );
+}
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "bits.h"
+#include "tlsf.h"
+
+static void mapping_insert(uint32_t size, uint32_t* fl, uint32_t* sl)
+{
+    if (size < TLSF_SMALL_BLOCK_SIZE)
+    {
+        *fl = 0;
+        *sl = size / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_COUNT);
+    }
+    else
+    {
+        uint32_t f = bit_fls32(size);
+        *sl = (size >> (f - TLSF_SL_COUNT_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = f - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+// Rounds size up to the next bin boundary, so any block from the bin found is big enough.
+static void mapping_search(uint32_t size, uint32_t* fl, uint32_t* sl)
+{
+    if (size >= TLSF_SMALL_BLOCK_SIZE)
+    {
+        size += (1u << (bit_fls32(size) - TLSF_SL_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static uint32_t node_new(Tlsf* tlsf)
+{
+    if (tlsf->unusedNodes != TLSF_INVALID)
+    {
+        uint32_t index = tlsf->unusedNodes;
+        tlsf->unusedNodes = tlsf->nodes[index].nextFree;
+        return index;
+    }
+
+    uint32_t capacity = tlsf->nodeCapacity * 2;
+    TlsfNode* nodes = (TlsfNode*)realloc(tlsf->nodes, capacity * sizeof(TlsfNode));
+    if (!nodes)
+    {
+        return TLSF_INVALID;
+    }
+    tlsf->nodes = nodes;
+
+    // Keep the first new slot, chain the rest into the unused list.
+    for (uint32_t i = tlsf->nodeCapacity + 1; i < capacity; ++i)
+    {
+        nodes[i].nextFree = i + 1 < capacity ? i + 1 : TLSF_INVALID;
+    }
+    tlsf->unusedNodes = tlsf->nodeCapacity + 1 < capacity ? tlsf->nodeCapacity + 1 : TLSF_INVALID;
+
+    uint32_t index = tlsf->nodeCapacity;
+    tlsf->nodeCapacity = capacity;
+    return index;
+}
+
+static void node_release(Tlsf* tlsf, uint32_t index)
+{
+    tlsf->nodes[index].nextFree = tlsf->unusedNodes;
+    tlsf->unusedNodes = index;
+}
+
+static void insert_free(Tlsf* tlsf, uint32_t index)
+{
+    TlsfNode* node = &tlsf->nodes[index];
+    uint32_t fl, sl;
+    mapping_insert(node->size, &fl, &sl);
+
+    uint32_t head = tlsf->freeHeads[fl][sl];
+    node->isFree = 1;
+    node->prevFree = TLSF_INVALID;
+    node->nextFree = head;
+    if (head != TLSF_INVALID)
+    {
+        tlsf->nodes[head].prevFree = index;
+    }
+    tlsf->freeHeads[fl][sl] = index;
+    tlsf->flBitmap |= 1u << fl;
+    tlsf->slBitmap[fl] |= 1u << sl;
+    ++tlsf->freeBlockCount;
+}
+
+static void remove_free(Tlsf* tlsf, uint32_t index)
+{
+    TlsfNode* node = &tlsf->nodes[index];
+    uint32_t fl, sl;
+    mapping_insert(node->size, &fl, &sl);
+
+    if (node->prevFree != TLSF_INVALID)
+    {
+        tlsf->nodes[node->prevFree].nextFree = node->nextFree;
+    }
+    if (node->nextFree != TLSF_INVALID)
+    {
+        tlsf->nodes[node->nextFree].prevFree = node->prevFree;
+    }
+    if (tlsf->freeHeads[fl][sl] == index)
+    {
+        tlsf->freeHeads[fl][sl] = node->nextFree;
+        if (node->nextFree == TLSF_INVALID)
+        {
+            tlsf->slBitmap[fl] &= ~(1u << sl);
+            if (!tlsf->slBitmap[fl])
+            {
+                tlsf->flBitmap &= ~(1u << fl);
+            }
+        }
+    }
+    node->isFree = 0;
+    --tlsf->freeBlockCount;
+}
+
+static uint32_t find_suitable(Tlsf* tlsf, uint32_t fl, uint32_t sl)
+{
+    uint32_t slMap = tlsf->slBitmap[fl] & (~0u << sl);
+    if (!slMap)
+    {
+        uint32_t flMap = tlsf->flBitmap & (~0u << (fl + 1));
+        if (!flMap)
+        {
+            return TLSF_INVALID;
+        }
+        fl = bit_ffs32(flMap);
+        slMap = tlsf->slBitmap[fl];
+    }
+    sl = bit_ffs32(slMap);
+    return tlsf->freeHeads[fl][sl];
+}
+
+// Splits node at offset + size, the tail becomes a new free block.
+static uint32_t split(Tlsf* tlsf, uint32_t index, uint32_t size)
+{
+    uint32_t tail = node_new(tlsf);
+    if (tail == TLSF_INVALID)
+    {
+        return TLSF_INVALID; // keep the slack inside the block
+    }
+
+    TlsfNode* node = &tlsf->nodes[index];
+    TlsfNode* tailNode = &tlsf->nodes[tail];
+    tailNode->offset = node->offset + size;
+    tailNode->size = node->size - size;
+    tailNode->prevPhys = index;
+    tailNode->nextPhys = node->nextPhys;
+    if (node->nextPhys != TLSF_INVALID)
+    {
+        tlsf->nodes[node->nextPhys].prevPhys = tail;
+    }
+    node->nextPhys = tail;
+    node->size = size;
+
+    insert_free(tlsf, tail);
+    return tail;
+}
+
+int tlsf_init(Tlsf* tlsf, uint32_t size)
+{
+    assert(size >= TLSF_ALIGN_SIZE && size <= (1u << 31));
+
+    tlsf->size = size & ~(TLSF_ALIGN_SIZE - 1);
+    tlsf->usedSize = 0;
+    tlsf->allocCount = 0;
+    tlsf->freeBlockCount = 0;
+    tlsf->flBitmap = 0;
+    for (uint32_t i = 0; i < TLSF_FL_COUNT; ++i)
+    {
+        tlsf->slBitmap[i] = 0;
+        for (uint32_t j = 0; j < TLSF_SL_COUNT; ++j)
+        {
+            tlsf->freeHeads[i][j] = TLSF_INVALID;
+        }
+    }
+
+    tlsf->nodeCapacity = 16;
+    tlsf->nodes = (TlsfNode*)malloc(tlsf->nodeCapacity * sizeof(TlsfNode));
+    if (!tlsf->nodes)
+    {
+        return 0;
+    }
+    for (uint32_t i = 1; i < tlsf->nodeCapacity; ++i)
+    {
+        tlsf->nodes[i].nextFree = i + 1 < tlsf->nodeCapacity ? i + 1 : TLSF_INVALID;
+    }
+    tlsf->unusedNodes = 1;
+
+    tlsf->nodes[0] = (TlsfNode){
+        .offset = 0,
+        .size = tlsf->size,
+        .prevPhys = TLSF_INVALID,
+        .nextPhys = TLSF_INVALID,
+    };
+    insert_free(tlsf, 0);
+
+    return 1;
+}
+
+void tlsf_destroy(Tlsf* tlsf)
+{
+    free(tlsf->nodes);
+    tlsf->nodes = 0;
+    tlsf->nodeCapacity = 0;
+}
+
+uint32_t tlsf_alloc(Tlsf* tlsf, uint32_t size, uint32_t align, uint32_t* offset)
+{
+    assert(bit_is_pow2(align));
+
+    align = align < TLSF_ALIGN_SIZE ? TLSF_ALIGN_SIZE : align;
+    if (size == 0 || size > tlsf->size || align > tlsf->size)
+    {
+        return TLSF_INVALID;
+    }
+    size = bit_align_up(size, TLSF_ALIGN_SIZE);
+
+    // Free block offsets are TLSF_ALIGN_SIZE aligned, so at most align - TLSF_ALIGN_SIZE is lost to padding.
+    uint32_t searchSize = size + (align - TLSF_ALIGN_SIZE);
+    uint32_t fl, sl;
+    mapping_search(searchSize, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT)
+    {
+        return TLSF_INVALID;
+    }
+
+    uint32_t index = find_suitable(tlsf, fl, sl);
+    if (index == TLSF_INVALID)
+    {
+        return TLSF_INVALID;
+    }
+    remove_free(tlsf, index);
+
+    uint32_t gap = bit_align_up(tlsf->nodes[index].offset, align) - tlsf->nodes[index].offset;
+    if (gap)
+    {
+        // Padding stays behind as a free block, the previous block is never free so no merge is needed.
+        uint32_t padding = index;
+        index = split(tlsf, padding, gap);
+        if (index == TLSF_INVALID)
+        {
+            insert_free(tlsf, padding); // out of node memory
+            return TLSF_INVALID;
+        }
+        remove_free(tlsf, index);
+        insert_free(tlsf, padding);
+    }
+
+    if (tlsf->nodes[index].size - size >= TLSF_ALIGN_SIZE)
+    {
+        split(tlsf, index, size);
+    }
+
+    tlsf->usedSize += tlsf->nodes[index].size;
+    ++tlsf->allocCount;
+    *offset = tlsf->nodes[index].offset;
+
+    return index;
+}
+
+uint32_t tlsf_fit_size(uint32_t size, uint32_t align)
+{
+    align = align < TLSF_ALIGN_SIZE ? TLSF_ALIGN_SIZE : align;
+    uint64_t searchSize = bit_align_up(size, TLSF_ALIGN_SIZE) + (uint64_t)(align - TLSF_ALIGN_SIZE);
+    if (searchSize > (1u << 31))
+    {
+        return 0;
+    }
+    // Same rounding as mapping_search, a free block of the rounded size sits at the start of the bin searched.
+    uint32_t fitSize = (uint32_t)searchSize;
+    if (fitSize >= TLSF_SMALL_BLOCK_SIZE)
+    {
+        fitSize += (1u << (bit_fls32(fitSize) - TLSF_SL_COUNT_LOG2)) - 1;
+        fitSize &= ~((1u << (bit_fls32(fitSize) - TLSF_SL_COUNT_LOG2)) - 1);
+    }
+    return fitSize <= (1u << 31) ? fitSize : 0;
+}
+
+void tlsf_free(Tlsf* tlsf, uint32_t handle)
+{
+    assert(handle < tlsf->nodeCapacity && !tlsf->nodes[handle].isFree);
+
+    tlsf->usedSize -= tlsf->nodes[handle].size;
+    --tlsf->allocCount;
+
+    uint32_t prev = tlsf->nodes[handle].prevPhys;
+    if (prev != TLSF_INVALID && tlsf->nodes[prev].isFree)
+    {
+        remove_free(tlsf, prev);
+        tlsf->nodes[prev].size += tlsf->nodes[handle].size;
+        tlsf->nodes[prev].nextPhys = tlsf->nodes[handle].nextPhys;
+        if (tlsf->nodes[handle].nextPhys != TLSF_INVALID)
+        {
+            tlsf->nodes[tlsf->nodes[handle].nextPhys].prevPhys = prev;
+        }
+        node_release(tlsf, handle);
+        handle = prev;
+    }
+
+    uint32_t next = tlsf->nodes[handle].nextPhys;
+    if (next != TLSF_INVALID && tlsf->nodes[next].isFree)
+    {
+        remove_free(tlsf, next);
+        tlsf->nodes[handle].size += tlsf->nodes[next].size;
+        tlsf->nodes[handle].nextPhys = tlsf->nodes[next].nextPhys;
+        if (tlsf->nodes[next].nextPhys != TLSF_INVALID)
+        {
+            tlsf->nodes[tlsf->nodes[next].nextPhys].prevPhys = handle;
+        }
+        node_release(tlsf, next);
+    }
+
+    insert_free(tlsf, handle);
+}
+
+uint32_t tlsf_largest_free(const Tlsf* tlsf)
+{
+    if (!tlsf->flBitmap)
+    {
+        return 0;
+    }
+
+    uint32_t fl = bit_fls32(tlsf->flBitmap);
+    uint32_t sl = bit_fls32(tlsf->slBitmap[fl]);
+    uint32_t largest = 0;
+    for (uint32_t i = tlsf->freeHeads[fl][sl]; i != TLSF_INVALID; i = tlsf->nodes[i].nextFree)
+    {
+        largest = tlsf->nodes[i].size > largest ? tlsf->nodes[i].size : largest;
+    }
+    return largest;
+}
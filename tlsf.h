@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+** Two-Level Segregated Fit allocator.
+**
+** Manages offsets inside a single contiguous range [0, size) and never
+** touches the memory itself, so it can sub-allocate GPU memory that is
+** not visible to the CPU. Block headers live in a separate node array;
+** allocation handles are indices into that array.
+**
+** First level splits sizes by power of two, second level splits every
+** power-of-two range linearly into TLSF_SL_COUNT bins. Both levels keep
+** a bitmap of non-empty bins, so finding a suitable free block is a pair
+** of bit_ffs32 calls and alloc/free are O(1).
+*/
+
+enum {
+    TLSF_SL_COUNT_LOG2 = 5,
+    TLSF_SL_COUNT = 1 << TLSF_SL_COUNT_LOG2,
+    TLSF_ALIGN_SIZE_LOG2 = 4,
+    TLSF_ALIGN_SIZE = 1 << TLSF_ALIGN_SIZE_LOG2,     // minimum granularity of sizes and offsets
+    TLSF_FL_SHIFT = TLSF_SL_COUNT_LOG2 + TLSF_ALIGN_SIZE_LOG2,
+    TLSF_SMALL_BLOCK_SIZE = 1 << TLSF_FL_SHIFT,      // below this size first level is 0 and second level is linear
+    TLSF_FL_COUNT = 32 - TLSF_FL_SHIFT + 1,
+    TLSF_INVALID = UINT32_MAX,
+};
+
+typedef struct tagTlsfNode
+{
+    uint32_t offset;
+    uint32_t size;
+    uint32_t prevPhys, nextPhys;    // physical neighbours, TLSF_INVALID at range ends
+    uint32_t prevFree, nextFree;    // free list links; nextFree doubles as node free list link
+    uint32_t isFree;
+} TlsfNode;
+
+typedef struct tagTlsf
+{
+    uint32_t size;
+    uint32_t usedSize;
+    uint32_t allocCount;
+    uint32_t freeBlockCount;
+
+    uint32_t flBitmap;
+    uint32_t slBitmap[TLSF_FL_COUNT];
+    uint32_t freeHeads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+    TlsfNode* nodes;
+    uint32_t nodeCapacity;
+    uint32_t unusedNodes;   // list of recycled node slots
+} Tlsf;
+
+int tlsf_init(Tlsf* tlsf, uint32_t size);
+void tlsf_destroy(Tlsf* tlsf);
+
+// Returns allocation handle or TLSF_INVALID, offset is aligned to max(align, TLSF_ALIGN_SIZE).
+uint32_t tlsf_alloc(Tlsf* tlsf, uint32_t size, uint32_t align, uint32_t* offset);
+// Smallest range size in which tlsf_alloc(size, align) succeeds while the range is empty, 0 above 2 GB.
+// The search rounds up to the next bin, so a range of exactly the requested size is not enough.
+uint32_t tlsf_fit_size(uint32_t size, uint32_t align);
+void tlsf_free(Tlsf* tlsf, uint32_t handle);
+
+static inline uint32_t tlsf_offset(const Tlsf* tlsf, uint32_t handle) { return tlsf->nodes[handle].offset; }
+static inline uint32_t tlsf_size(const Tlsf* tlsf, uint32_t handle) { return tlsf->nodes[handle].size; }
+static inline int tlsf_is_empty(const Tlsf* tlsf) { return tlsf->allocCount == 0; }
+
+// Size of the largest free block, O(number of blocks in the top non-empty bin).
+uint32_t tlsf_largest_free(const Tlsf* tlsf);
@@ -0,0 +1,301 @@
+#include <string.h>
+#include <assert.h>
+
+#include "transfer.h"
+
+enum {
+    TRANSFER_BATCH_FREE,
+    TRANSFER_BATCH_RECORDING,
+    TRANSFER_BATCH_SUBMITTED,
+    TRANSFER_BATCH_ACQUIRED,
+};
+
+static TransferBatch* batch_at(TransferContext* ctx, uint32_t i)
+{
+    return &ctx->batches[(ctx->firstBatch + i) % TRANSFER_MAX_BATCHES];
+}
+
+static void free_staging(TransferContext* ctx, TransferBatch* batch)
+{
+    for (uint32_t i = 0; i < batch->regionCount; ++i)
+    {
+        TransferRegion* region = &batch->regions[i];
+        if (region->staging)
+        {
+            vkDestroyBuffer(ctx->device, region->staging, 0);
+            devmem_free(ctx->allocator, &region->stagingMemory);
+            region->staging = VK_NULL_HANDLE;
+        }
+    }
+}
+
+static TransferBatch* open_batch(TransferContext* ctx)
+{
+    if (ctx->batchCount)
+    {
+        TransferBatch* last = batch_at(ctx, ctx->batchCount - 1);
+        if (last->state == TRANSFER_BATCH_RECORDING)
+        {
+            return last;
+        }
+    }
+    if (ctx->batchCount == TRANSFER_MAX_BATCHES)
+    {
+        return 0;
+    }
+
+    TransferBatch* batch = batch_at(ctx, ctx->batchCount++);
+    batch->state = TRANSFER_BATCH_RECORDING;
+    batch->regionCount = 0;
+    vkResetFences(ctx->device, 1, &batch->fence);
+    vkBeginCommandBuffer(batch->commandBuffer, &(VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    });
+
+    return batch;
+}
+
+int transfer_init(TransferContext* ctx, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t stagingTypes,
+    VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->device = device;
+    ctx->allocator = allocator;
+    ctx->stagingTypes = stagingTypes;
+    ctx->transferQueue = transferQueue;
+    ctx->transferFamily = transferFamily;
+    ctx->graphicsFamily = graphicsFamily;
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = transferFamily,
+    };
+    if (vkCreateCommandPool(device, &commandPoolCreateInfo, 0, &ctx->commandPool) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    VkCommandBuffer commandBuffers[TRANSFER_MAX_BATCHES];
+    VkCommandBufferAllocateInfo commandBufferAllocInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = ctx->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = TRANSFER_MAX_BATCHES,
+    };
+    vkAllocateCommandBuffers(device, &commandBufferAllocInfo, commandBuffers);
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    for (uint32_t i = 0; i < TRANSFER_MAX_BATCHES; ++i)
+    {
+        ctx->batches[i].commandBuffer = commandBuffers[i];
+        vkCreateSemaphore(device, &semaphoreCreateInfo, 0, &ctx->batches[i].semaphore);
+        vkCreateFence(device, &fenceCreateInfo, 0, &ctx->batches[i].fence);
+    }
+
+    return 1;
+}
+
+void transfer_destroy(TransferContext* ctx)
+{
+    for (uint32_t i = 0; i < TRANSFER_MAX_BATCHES; ++i)
+    {
+        free_staging(ctx, &ctx->batches[i]);
+        vkDestroySemaphore(ctx->device, ctx->batches[i].semaphore, 0);
+        vkDestroyFence(ctx->device, ctx->batches[i].fence, 0);
+    }
+    vkDestroyCommandPool(ctx->device, ctx->commandPool, 0);
+}
+
+int transfer_upload_buffer(TransferContext* ctx, VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+    TransferBatch* batch = open_batch(ctx);
+    if (batch && batch->regionCount == TRANSFER_MAX_REGIONS)
+    {
+        transfer_flush(ctx);
+        batch = open_batch(ctx);
+    }
+    if (!batch)
+    {
+        return 0;
+    }
+
+    TransferRegion* region = &batch->regions[batch->regionCount];
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    if (vkCreateBuffer(ctx->device, &bufferCreateInfo, 0, &region->staging) != VK_SUCCESS)
+    {
+        return 0;
+    }
+    if (!devmem_alloc_buffer(ctx->allocator, region->staging, ctx->stagingTypes, &region->stagingMemory))
+    {
+        vkDestroyBuffer(ctx->device, region->staging, 0);
+        region->staging = VK_NULL_HANDLE;
+        return 0;
+    }
+    memcpy(region->stagingMemory.mapped, data, size);
+
+    region->buffer = buffer;
+    region->offset = offset;
+    region->size = size;
+    ++batch->regionCount;
+
+    vkCmdCopyBuffer(batch->commandBuffer, region->staging, buffer, 1, &(VkBufferCopy) {
+        .srcOffset = 0,
+        .dstOffset = offset,
+        .size = size,
+    });
+
+    return 1;
+}
+
+uint64_t transfer_flush(TransferContext* ctx)
+{
+    if (!ctx->batchCount)
+    {
+        return 0;
+    }
+    TransferBatch* batch = batch_at(ctx, ctx->batchCount - 1);
+    if (batch->state != TRANSFER_BATCH_RECORDING || !batch->regionCount)
+    {
+        return 0;
+    }
+
+    // Release half of the queue family ownership transfer, graphics records the matching acquire.
+    if (ctx->transferFamily != ctx->graphicsFamily)
+    {
+        VkBufferMemoryBarrier barriers[TRANSFER_MAX_REGIONS];
+        for (uint32_t i = 0; i < batch->regionCount; ++i)
+        {
+            barriers[i] = (VkBufferMemoryBarrier){
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = 0,
+                .srcQueueFamilyIndex = ctx->transferFamily,
+                .dstQueueFamilyIndex = ctx->graphicsFamily,
+                .buffer = batch->regions[i].buffer,
+                .offset = batch->regions[i].offset,
+                .size = batch->regions[i].size,
+            };
+        }
+        vkCmdPipelineBarrier(batch->commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, NULL, batch->regionCount, barriers, 0, NULL);
+    }
+    vkEndCommandBuffer(batch->commandBuffer);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch->commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &batch->semaphore,
+    };
+    vkQueueSubmit(ctx->transferQueue, 1, &submitInfo, batch->fence);
+
+    batch->state = TRANSFER_BATCH_SUBMITTED;
+    batch->id = ++ctx->nextId;
+
+    return batch->id;
+}
+
+void transfer_poll(TransferContext* ctx, uint64_t completedSerial)
+{
+    for (uint32_t i = 0; i < ctx->batchCount; ++i)
+    {
+        TransferBatch* batch = batch_at(ctx, i);
+        if (batch->state == TRANSFER_BATCH_SUBMITTED && vkGetFenceStatus(ctx->device, batch->fence) == VK_SUCCESS)
+        {
+            free_staging(ctx, batch);
+        }
+    }
+
+    // Semaphore is reusable once the frame that waited on it has finished.
+    while (ctx->batchCount)
+    {
+        TransferBatch* batch = batch_at(ctx, 0);
+        if (batch->state != TRANSFER_BATCH_ACQUIRED || batch->acquireSerial > completedSerial)
+        {
+            break;
+        }
+        free_staging(ctx, batch);
+        batch->state = TRANSFER_BATCH_FREE;
+        ctx->firstBatch = (ctx->firstBatch + 1) % TRANSFER_MAX_BATCHES;
+        --ctx->batchCount;
+    }
+}
+
+uint32_t transfer_acquire(TransferContext* ctx, VkCommandBuffer commandBuffer, uint64_t serial,
+    VkSemaphore* waitSemaphores, VkPipelineStageFlags* waitStages)
+{
+    const VkAccessFlags readAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+        | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    const VkPipelineStageFlags readStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+        | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    // Compute passes may run before any vertex input, the wait has to cover them too.
+    const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    uint32_t waitCount = 0;
+
+    for (uint32_t i = 0; i < ctx->batchCount; ++i)
+    {
+        TransferBatch* batch = batch_at(ctx, i);
+        if (batch->state == TRANSFER_BATCH_ACQUIRED)
+        {
+            continue;
+        }
+        // Acquire strictly in order and only finished batches, so nothing ever waits on a transfer in flight.
+        if (batch->state != TRANSFER_BATCH_SUBMITTED || vkGetFenceStatus(ctx->device, batch->fence) != VK_SUCCESS)
+        {
+            break;
+        }
+
+        if (ctx->transferFamily != ctx->graphicsFamily)
+        {
+            VkBufferMemoryBarrier barriers[TRANSFER_MAX_REGIONS];
+            for (uint32_t j = 0; j < batch->regionCount; ++j)
+            {
+                barriers[j] = (VkBufferMemoryBarrier){
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                    .srcAccessMask = 0,
+                    .dstAccessMask = readAccess,
+                    .srcQueueFamilyIndex = ctx->transferFamily,
+                    .dstQueueFamilyIndex = ctx->graphicsFamily,
+                    .buffer = batch->regions[j].buffer,
+                    .offset = batch->regions[j].offset,
+                    .size = batch->regions[j].size,
+                };
+            }
+            // Source stage matches the semaphore wait stage so the two form a dependency chain.
+            vkCmdPipelineBarrier(commandBuffer,
+                waitStage, readStages, 0,
+                0, NULL, batch->regionCount, barriers, 0, NULL);
+        }
+        else
+        {
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, readStages, 0,
+                1, &(VkMemoryBarrier){
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = readAccess,
+                },
+                0, NULL, 0, NULL);
+        }
+
+        waitSemaphores[waitCount] = batch->semaphore;
+        waitStages[waitCount] = waitStage;
+        ++waitCount;
+
+        batch->state = TRANSFER_BATCH_ACQUIRED;
+        batch->acquireSerial = serial;
+        ctx->acquiredId = batch->id;
+    }
+
+    return waitCount;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "devmem.h"
+
+/*
+** Asynchronous uploads of static data.
+**
+** Copies are recorded into batches that are submitted to a dedicated
+** transfer queue, so big uploads overlap with rendering. Every batch
+** signals a fence and a semaphore. Once the fence shows the copies are
+** done, the graphics side acquires the batch: it records the
+** queue-family acquire barriers and waits on the semaphore, so the frame
+** that first uses the data never blocks on the transfer. On devices with
+** one queue family the transfer queue is the graphics queue and the
+** ownership transfer collapses to a plain memory barrier.
+*/
+
+enum {
+    TRANSFER_MAX_BATCHES = 8,
+    TRANSFER_MAX_REGIONS = 32,
+};
+
+typedef struct tagTransferRegion
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    VkBuffer staging;
+    DeviceAllocation stagingMemory;
+} TransferRegion;
+
+typedef struct tagTransferBatch
+{
+    uint64_t id;
+    uint32_t state;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkSemaphore semaphore;
+    uint64_t acquireSerial;     // graphics frame that waited on the semaphore
+    uint32_t regionCount;
+    TransferRegion regions[TRANSFER_MAX_REGIONS];
+} TransferBatch;
+
+typedef struct tagTransferContext
+{
+    VkDevice device;
+    DeviceMemoryAllocator* allocator;
+    uint32_t stagingTypes;
+    VkQueue transferQueue;
+    uint32_t transferFamily;
+    uint32_t graphicsFamily;
+    VkCommandPool commandPool;
+
+    TransferBatch batches[TRANSFER_MAX_BATCHES];    // ring, ordered by id
+    uint32_t firstBatch;
+    uint32_t batchCount;
+    uint64_t nextId;
+    uint64_t acquiredId;        // all batches up to this id are usable by graphics
+} TransferContext;
+
+int transfer_init(TransferContext* ctx, VkDevice device, DeviceMemoryAllocator* allocator, uint32_t stagingTypes,
+    VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily);
+void transfer_destroy(TransferContext* ctx);
+
+// Stages data and records a copy into the open batch.
+int transfer_upload_buffer(TransferContext* ctx, VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+// Submits the open batch, returns its id or 0 if there was nothing to submit.
+uint64_t transfer_flush(TransferContext* ctx);
+
+// Releases resources of finished batches, completedSerial is the last finished graphics frame.
+void transfer_poll(TransferContext* ctx, uint64_t completedSerial);
+
+// Records acquire barriers for every finished batch into graphics command buffer and
+// appends their semaphores to the wait list. Returns number of semaphores appended.
+uint32_t transfer_acquire(TransferContext* ctx, VkCommandBuffer commandBuffer, uint64_t serial,
+    VkSemaphore* waitSemaphores, VkPipelineStageFlags* waitStages);
+
+static inline int transfer_is_acquired(const TransferContext* ctx, uint64_t id) { return id && id <= ctx->acquiredId; }
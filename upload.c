@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "upload.h"
+
+static VkDeviceSize align_up64(VkDeviceSize value, VkDeviceSize align)
+{
+    return (value + (align - 1)) & ~(align - 1);
+}
+
+static UploadBlock* create_block(UploadRing* ring, VkDeviceSize size)
+{
+    UploadBlock* block = (UploadBlock*)calloc(1, sizeof(UploadBlock));
+    if (!block)
+    {
+        return 0;
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = ring->usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    if (vkCreateBuffer(ring->device, &bufferCreateInfo, 0, &block->buffer) != VK_SUCCESS)
+    {
+        free(block);
+        return 0;
+    }
+    if (!devmem_alloc_buffer(ring->allocator, block->buffer, ring->memoryTypes, &block->memory) || !block->memory.mapped)
+    {
+        vkDestroyBuffer(ring->device, block->buffer, 0);
+        devmem_free(ring->allocator, &block->memory);
+        free(block);
+        return 0;
+    }
+    block->size = size;
+
+    return block;
+}
+
+static void destroy_block(UploadRing* ring, UploadBlock* block)
+{
+    vkDestroyBuffer(ring->device, block->buffer, 0);
+    devmem_free(ring->allocator, &block->memory);
+    free(block);
+}
+
+static void destroy_list(UploadRing* ring, UploadBlock* block)
+{
+    while (block)
+    {
+        UploadBlock* next = block->next;
+        destroy_block(ring, block);
+        block = next;
+    }
+}
+
+int upload_init(UploadRing* ring, VkDevice device, DeviceMemoryAllocator* allocator,
+    uint32_t memoryTypes, VkBufferUsageFlags usage, VkDeviceSize initialSize)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->device = device;
+    ring->allocator = allocator;
+    ring->memoryTypes = memoryTypes;
+    ring->usage = usage;
+    ring->ring = create_block(ring, initialSize);
+    ring->stats.ringSize = initialSize;
+
+    return ring->ring != 0;
+}
+
+void upload_destroy(UploadRing* ring)
+{
+    destroy_list(ring, ring->spill);
+    destroy_list(ring, ring->retired);
+    destroy_list(ring, ring->ring);
+    memset(ring, 0, sizeof(*ring));
+}
+
+void upload_begin_frame(UploadRing* ring, uint64_t serial, uint64_t completedSerial)
+{
+    uint32_t retiredFrames = 0;
+    while (retiredFrames < ring->pendingCount && ring->pending[retiredFrames].serial <= completedSerial)
+    {
+        ring->tail = ring->pending[retiredFrames].end;
+        ++retiredFrames;
+    }
+    ring->pendingCount -= retiredFrames;
+    memmove(ring->pending, ring->pending + retiredFrames, ring->pendingCount * sizeof(ring->pending[0]));
+
+    UploadBlock** link = &ring->retired;
+    while (*link)
+    {
+        UploadBlock* block = *link;
+        if (block->retireSerial <= completedSerial)
+        {
+            *link = block->next;
+            destroy_block(ring, block);
+        }
+        else
+        {
+            link = &block->next;
+        }
+    }
+
+    // Last frame spilled: replace the ring with one that holds several such frames,
+    // in-flight frames keep the old ring alive until their serials complete.
+    if (ring->spillBytes)
+    {
+        VkDeviceSize newSize = ring->stats.ringSize * 2;
+        newSize = newSize > ring->stats.frameBytes * 4 ? newSize : ring->stats.frameBytes * 4;
+        newSize = align_up64(newSize, 64 * 1024);
+        UploadBlock* block = create_block(ring, newSize);
+        if (block)
+        {
+            ring->ring->retireSerial = serial - 1;
+            ring->ring->next = ring->retired;
+            ring->retired = ring->ring;
+            ring->ring = block;
+            ring->head = ring->tail = 0;
+            ring->pendingCount = 0;
+            ring->stats.ringSize = newSize;
+            ++ring->stats.growCount;
+        }
+    }
+
+    ring->serial = serial;
+    ring->frameStart = ring->head;
+    ring->spillUsed = 0;
+    ring->spillBytes = 0;
+}
+
+void upload_end_frame(UploadRing* ring)
+{
+    assert(ring->pendingCount < UPLOAD_MAX_PENDING_FRAMES);
+
+    ring->pending[ring->pendingCount].serial = ring->serial;
+    ring->pending[ring->pendingCount].end = ring->head;
+    ++ring->pendingCount;
+
+    while (ring->spill)
+    {
+        UploadBlock* block = ring->spill;
+        ring->spill = block->next;
+        block->retireSerial = ring->serial;
+        block->next = ring->retired;
+        ring->retired = block;
+    }
+
+    ring->stats.frameBytes = (ring->head - ring->frameStart) + ring->spillBytes;
+    if (ring->stats.frameBytes > ring->stats.highWaterBytes)
+    {
+        ring->stats.highWaterBytes = ring->stats.frameBytes;
+    }
+}
+
+void* upload_alloc(UploadRing* ring, VkDeviceSize size, VkDeviceSize align, UploadAllocation* allocation)
+{
+    align = align ? align : UPLOAD_DEFAULT_ALIGNMENT;
+
+    VkDeviceSize ringSize = ring->ring->size;
+    VkDeviceSize position = ring->head % ringSize;
+    VkDeviceSize offset = align_up64(position, align);
+    uint64_t head = ring->head + (offset - position) + size;
+    if (offset + size > ringSize)
+    {
+        // Doesn't fit before the end, wrap around to the start.
+        offset = 0;
+        head = ring->head + (ringSize - position) + size;
+    }
+
+    if (head - ring->tail <= ringSize)
+    {
+        ring->head = head;
+        allocation->buffer = ring->ring->buffer;
+        allocation->offset = offset;
+        allocation->ptr = (uint8_t*)ring->ring->memory.mapped + offset;
+        return allocation->ptr;
+    }
+
+    // Out of ring space, serve from spill blocks owned by this frame.
+    offset = align_up64(ring->spillUsed, align);
+    if (!ring->spill || offset + size > ring->spill->size)
+    {
+        UploadBlock* block = create_block(ring, size > ringSize ? align_up64(size, 64 * 1024) : ringSize);
+        if (!block)
+        {
+            return 0;
+        }
+        block->next = ring->spill;
+        ring->spill = block;
+        ++ring->stats.spillCount;
+        offset = 0;
+    }
+
+    ring->spillUsed = offset + size;
+    ring->spillBytes += size;
+    allocation->buffer = ring->spill->buffer;
+    allocation->offset = offset;
+    allocation->ptr = (uint8_t*)ring->spill->memory.mapped + offset;
+    return allocation->ptr;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "devmem.h"
+
+/*
+** Per-frame upload ring.
+**
+** Transient vertex, index and uniform data is bump-allocated from a
+** persistently mapped ring buffer. Each frame is tagged with a serial;
+** once the GPU is known to have finished a serial, the space that frame
+** used is reclaimed. When a frame runs out of ring space the remainder is
+** served from spill blocks, and the ring is regrown before the next frame
+** so steady state runs without spilling.
+*/
+
+enum {
+    UPLOAD_MAX_PENDING_FRAMES = 8,
+    UPLOAD_DEFAULT_ALIGNMENT = 16,
+};
+
+typedef struct tagUploadBlock
+{
+    VkBuffer buffer;
+    DeviceAllocation memory;
+    VkDeviceSize size;
+    uint64_t retireSerial;      // safe to destroy once this serial completes
+    struct tagUploadBlock* next;
+} UploadBlock;
+
+typedef struct tagUploadAllocation
+{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* ptr;
+} UploadAllocation;
+
+typedef struct tagUploadStats
+{
+    VkDeviceSize frameBytes;        // bytes handed out in the last finished frame
+    VkDeviceSize highWaterBytes;    // largest frameBytes seen
+    VkDeviceSize ringSize;
+    uint32_t spillCount;            // spill blocks created
+    uint32_t growCount;             // ring reallocations
+} UploadStats;
+
+typedef struct tagUploadRing
+{
+    VkDevice device;
+    DeviceMemoryAllocator* allocator;
+    uint32_t memoryTypes;
+    VkBufferUsageFlags usage;
+
+    UploadBlock* ring;
+    uint64_t head;              // monotonic byte counters, position is counter % ring size
+    uint64_t tail;
+
+    struct { uint64_t serial, end; } pending[UPLOAD_MAX_PENDING_FRAMES];
+    uint32_t pendingCount;
+
+    UploadBlock* spill;         // spill blocks of the frame being recorded
+    VkDeviceSize spillUsed;     // bytes used in the newest spill block
+    VkDeviceSize spillBytes;    // total bytes spilled this frame
+    UploadBlock* retired;       // blocks waiting for the GPU
+
+    uint64_t serial;
+    VkDeviceSize frameStart;    // head at upload_begin_frame
+    UploadStats stats;
+} UploadRing;
+
+int upload_init(UploadRing* ring, VkDevice device, DeviceMemoryAllocator* allocator,
+    uint32_t memoryTypes, VkBufferUsageFlags usage, VkDeviceSize initialSize);
+void upload_destroy(UploadRing* ring);
+
+// completedSerial is the newest serial the GPU has finished, everything up to it is reclaimed.
+void upload_begin_frame(UploadRing* ring, uint64_t serial, uint64_t completedSerial);
+void upload_end_frame(UploadRing* ring);
+
+// Returns mapped pointer or 0 when even a spill block can not be allocated.
+void* upload_alloc(UploadRing* ring, VkDeviceSize size, VkDeviceSize align, UploadAllocation* allocation);
@@ -0,0 +1,393 @@
+#include <string.h>
+#include <math.h>
+
+#include <SDL2/SDL.h>
+
+#include "vertexpack.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define VERTEXPACK_X64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+#define VERTEXPACK_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VERTEXPACK_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define VERTEXPACK_TARGET_AVX2
+#endif
+
+//----------------------------------------------------------
+// Scalar
+
+// Same NaN handling as the SIMD min/max: NaN clamps to 1.
+static int16_t to_snorm16(float v)
+{
+    v = v < 1.0f ? v : 1.0f;
+    v = v > -1.0f ? v : -1.0f;
+    return (int16_t)lrintf(v * 32767.0f);
+}
+
+static uint16_t to_half(float f)
+{
+    union { float f; uint32_t u; } v = { f };
+    union { float f; uint32_t u; } denormMagic = { 0 };
+    denormMagic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t sign = v.u & 0x80000000u;
+    v.u ^= sign;
+
+    uint16_t half;
+    if (v.u >= (127u + 16u) << 23)
+    {
+        half = v.u > 255u << 23 ? 0x7E00 : 0x7C00;
+    }
+    else if (v.u < 113u << 23)
+    {
+        // Denormal result: let the FPU round by adding into a float with the right exponent.
+        v.f += denormMagic.f;
+        half = (uint16_t)(v.u - denormMagic.u);
+    }
+    else
+    {
+        // Rebias the exponent and round the 13 dropped mantissa bits to nearest even.
+        uint32_t mantissaOdd = (v.u >> 13) & 1;
+        v.u += 0xC8000FFFu + mantissaOdd;
+        half = (uint16_t)(v.u >> 13);
+    }
+
+    return half | (uint16_t)(sign >> 16);
+}
+
+static void pack_f32(const VertexP2C* src, void* dst, uint32_t count)
+{
+    memcpy(dst, src, count * sizeof(VertexP2C));
+}
+
+static void pack_snorm16_scalar(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2S* out = (VertexP2S*)dst;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = (VertexP2S){ to_snorm16(src[i].x), to_snorm16(src[i].y), src[i].rgba };
+    }
+}
+
+static void pack_half_scalar(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2H* out = (VertexP2H*)dst;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = (VertexP2H){ to_half(src[i].x), to_half(src[i].y), src[i].rgba };
+    }
+}
+
+//----------------------------------------------------------
+// SSE2 and AVX2
+
+#ifdef VERTEXPACK_X64
+
+// Four VertexP2C from 48 bytes: positions of vertices 0-1 and 2-3, and the colors.
+static inline void load4(const VertexP2C* src, __m128* xy01, __m128* xy23, __m128i* colors)
+{
+    const float* f = (const float*)src;
+    __m128 v0 = _mm_loadu_ps(f);        // x0 y0 c0 x1
+    __m128 v1 = _mm_loadu_ps(f + 4);    // y1 c1 x2 y2
+    __m128 v2 = _mm_loadu_ps(f + 8);    // c2 x3 y3 c3
+
+    __m128 x1y1 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 3, 3));
+    *xy01 = _mm_shuffle_ps(v0, x1y1, _MM_SHUFFLE(2, 0, 1, 0));
+    *xy23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 1, 3, 2));
+
+    __m128 c01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 c23 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0));
+    *colors = _mm_castps_si128(_mm_shuffle_ps(c01, c23, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// Interleaves 8 packed 16-bit coordinates with 4 colors into 32 bytes.
+static inline void store4(void* dst, __m128i xy, __m128i colors)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(xy, colors));
+    _mm_storeu_si128((__m128i*)dst + 1, _mm_unpackhi_epi32(xy, colors));
+}
+
+static inline __m128i snorm4_sse2(__m128 v)
+{
+    v = _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(1.0f)), _mm_set1_ps(-1.0f));
+    return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(32767.0f)));
+}
+
+// to_half for 4 lanes, results in the low 16 bits of each lane.
+static inline __m128i half4_sse2(__m128 f)
+{
+    const __m128 denormMagic = _mm_castsi128_ps(_mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23));
+
+    __m128i u = _mm_castps_si128(f);
+    __m128i sign = _mm_and_si128(u, _mm_set1_epi32((int)0x80000000u));
+    u = _mm_xor_si128(u, sign);
+
+    __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+    __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32((int)0xC8000FFFu)), mantissaOdd), 13);
+    __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), denormMagic)), _mm_castps_si128(denormMagic));
+    __m128i infNan = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(_mm_cmpgt_epi32(u, _mm_set1_epi32(255 << 23)), _mm_set1_epi32(0x0200)));
+
+    __m128i isDenormal = _mm_cmplt_epi32(u, _mm_set1_epi32(113 << 23));
+    __m128i isBig = _mm_cmpgt_epi32(u, _mm_set1_epi32(((127 + 16) << 23) - 1));
+    __m128i result = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+    result = _mm_or_si128(_mm_and_si128(isBig, infNan), _mm_andnot_si128(isBig, result));
+
+    return _mm_or_si128(result, _mm_srli_epi32(sign, 16));
+}
+
+// Packs two vectors of 16-bit values held in 32-bit lanes without signed saturation.
+static inline __m128i pack_u16(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+static void pack_snorm16_sse2(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2S* out = (VertexP2S*)dst;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 xy01, xy23;
+        __m128i colors;
+        load4(src + i, &xy01, &xy23, &colors);
+        store4(out + i, _mm_packs_epi32(snorm4_sse2(xy01), snorm4_sse2(xy23)), colors);
+    }
+    pack_snorm16_scalar(src + i, out + i, count - i);
+}
+
+static void pack_half_sse2(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2H* out = (VertexP2H*)dst;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 xy01, xy23;
+        __m128i colors;
+        load4(src + i, &xy01, &xy23, &colors);
+        store4(out + i, pack_u16(half4_sse2(xy01), half4_sse2(xy23)), colors);
+    }
+    pack_half_scalar(src + i, out + i, count - i);
+}
+
+VERTEXPACK_TARGET_AVX2
+static void pack_snorm16_avx2(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2S* out = (VertexP2S*)dst;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 xy01, xy23;
+        __m128i colors;
+        load4(src + i, &xy01, &xy23, &colors);
+
+        __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(xy01), xy23, 1);
+        __m256i v = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_max_ps(_mm256_min_ps(xy, one), minusOne), scale));
+        store4(out + i, _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)), colors);
+    }
+    pack_snorm16_scalar(src + i, out + i, count - i);
+}
+
+VERTEXPACK_TARGET_AVX2
+static void pack_half_avx2(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2H* out = (VertexP2H*)dst;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 xy01, xy23;
+        __m128i colors;
+        load4(src + i, &xy01, &xy23, &colors);
+
+        __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(xy01), xy23, 1);
+        store4(out + i, _mm256_cvtps_ph(xy, _MM_FROUND_TO_NEAREST_INT), colors);
+    }
+    pack_half_scalar(src + i, out + i, count - i);
+}
+
+static int cpu_has_f16c(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 29) & 1;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 29) & 1);
+#endif
+}
+
+#endif
+
+//----------------------------------------------------------
+// NEON
+
+#ifdef VERTEXPACK_NEON
+
+static inline int16x4_t snorm4_neon(float32x4_t v)
+{
+    v = vmaxnmq_f32(vminnmq_f32(v, vdupq_n_f32(1.0f)), vdupq_n_f32(-1.0f));
+    return vqmovn_s32(vcvtnq_s32_f32(vmulq_f32(v, vdupq_n_f32(32767.0f))));
+}
+
+static inline void store4_neon(void* dst, int16x4_t x, int16x4_t y, float32x4_t colors)
+{
+    int16x4x2_t xy = vzip_s16(x, y);
+    uint32x4x2_t interleaved;
+    interleaved.val[0] = vreinterpretq_u32_s16(vcombine_s16(xy.val[0], xy.val[1]));
+    interleaved.val[1] = vreinterpretq_u32_f32(colors);
+    vst2q_u32((uint32_t*)dst, interleaved);
+}
+
+static void pack_snorm16_neon(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2S* out = (VertexP2S*)dst;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4x3_t v = vld3q_f32((const float*)(src + i));
+        store4_neon(out + i, snorm4_neon(v.val[0]), snorm4_neon(v.val[1]), v.val[2]);
+    }
+    pack_snorm16_scalar(src + i, out + i, count - i);
+}
+
+static void pack_half_neon(const VertexP2C* src, void* dst, uint32_t count)
+{
+    VertexP2H* out = (VertexP2H*)dst;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4x3_t v = vld3q_f32((const float*)(src + i));
+        int16x4_t x = vreinterpret_s16_f16(vcvt_f16_f32(v.val[0]));
+        int16x4_t y = vreinterpret_s16_f16(vcvt_f16_f32(v.val[1]));
+        store4_neon(out + i, x, y, v.val[2]);
+    }
+    pack_half_scalar(src + i, out + i, count - i);
+}
+
+#endif
+
+//----------------------------------------------------------
+
+static VertexPackFunc bestFuncs[VERTEX_FORMAT_COUNT];
+
+static int isa_supported(uint32_t isa)
+{
+    switch (isa)
+    {
+    case VERTEXPACK_ISA_SCALAR:
+        return 1;
+#ifdef VERTEXPACK_X64
+    case VERTEXPACK_ISA_SSE2:
+        return 1;
+    case VERTEXPACK_ISA_AVX2:
+        return SDL_HasAVX2() && cpu_has_f16c();
+#endif
+#ifdef VERTEXPACK_NEON
+    case VERTEXPACK_ISA_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+VertexPackFunc vertexpack_func(uint32_t format, uint32_t isa)
+{
+    if (!isa_supported(isa))
+    {
+        return 0;
+    }
+    if (format == VERTEX_FORMAT_F32)
+    {
+        return pack_f32;
+    }
+
+    switch (isa)
+    {
+    case VERTEXPACK_ISA_SCALAR:
+        return format == VERTEX_FORMAT_SNORM16 ? pack_snorm16_scalar : pack_half_scalar;
+#ifdef VERTEXPACK_X64
+    case VERTEXPACK_ISA_SSE2:
+        return format == VERTEX_FORMAT_SNORM16 ? pack_snorm16_sse2 : pack_half_sse2;
+    case VERTEXPACK_ISA_AVX2:
+        return format == VERTEX_FORMAT_SNORM16 ? pack_snorm16_avx2 : pack_half_avx2;
+#endif
+#ifdef VERTEXPACK_NEON
+    case VERTEXPACK_ISA_NEON:
+        return format == VERTEX_FORMAT_SNORM16 ? pack_snorm16_neon : pack_half_neon;
+#endif
+    default:
+        return 0;
+    }
+}
+
+uint32_t vertexpack_best_isa(void)
+{
+    for (uint32_t isa = VERTEXPACK_ISA_COUNT; isa-- > 0;)
+    {
+        if (isa_supported(isa))
+        {
+            return isa;
+        }
+    }
+    return VERTEXPACK_ISA_SCALAR;
+}
+
+const char* vertexpack_isa_name(uint32_t isa)
+{
+    static const char* names[VERTEXPACK_ISA_COUNT] = { "scalar", "SSE2", "AVX2", "NEON" };
+    return isa < VERTEXPACK_ISA_COUNT ? names[isa] : "?";
+}
+
+const char* vertexpack_format_name(uint32_t format)
+{
+    static const char* names[VERTEX_FORMAT_COUNT] = { "f32", "snorm16", "half" };
+    return format < VERTEX_FORMAT_COUNT ? names[format] : "?";
+}
+
+uint32_t vertexpack_stride(uint32_t format)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_SNORM16: return sizeof(VertexP2S);
+    case VERTEX_FORMAT_HALF: return sizeof(VertexP2H);
+    default: return sizeof(VertexP2C);
+    }
+}
+
+VkFormat vertexpack_position_format(uint32_t format)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_SNORM16: return VK_FORMAT_R16G16_SNORM;
+    case VERTEX_FORMAT_HALF: return VK_FORMAT_R16G16_SFLOAT;
+    default: return VK_FORMAT_R32G32_SFLOAT;
+    }
+}
+
+void vertexpack(uint32_t format, const VertexP2C* src, void* dst, uint32_t count)
+{
+    if (!bestFuncs[format])
+    {
+        bestFuncs[format] = vertexpack_func(format, vertexpack_best_isa());
+    }
+    bestFuncs[format](src, dst, count);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+/*
+** Compact vertex formats.
+**
+** VertexP2C keeps positions as two floats, 12 bytes per vertex. The
+** packed formats store them as 16-bit SNORM (the [-1, 1] clip range in
+** 1/32767 steps) or half floats (any range, 11 bits of mantissa), 8
+** bytes per vertex. Packing kernels convert VertexP2C streams, and every
+** instruction set matches the scalar kernel bit for bit: SNORM clamps
+** (NaN to 1) and rounds to nearest even; halves round to nearest even
+** and keep denormals and infinities. NaNs stay NaN, but their
+** payload may differ between kernels.
+**
+** vertexpack() picks the best kernel the CPU supports on first use.
+*/
+
+enum {
+    VERTEX_FORMAT_F32,          // VertexP2C
+    VERTEX_FORMAT_SNORM16,      // VertexP2S
+    VERTEX_FORMAT_HALF,         // VertexP2H
+    VERTEX_FORMAT_COUNT,
+};
+
+enum {
+    VERTEXPACK_ISA_SCALAR,
+    VERTEXPACK_ISA_SSE2,
+    VERTEXPACK_ISA_AVX2,        // with F16C
+    VERTEXPACK_ISA_NEON,
+    VERTEXPACK_ISA_COUNT,
+};
+
+typedef struct tagVertexP2C
+{
+    float x, y;
+    uint32_t rgba;
+} VertexP2C;
+
+typedef struct tagVertexP2S
+{
+    int16_t x, y;
+    uint32_t rgba;
+} VertexP2S;
+
+typedef struct tagVertexP2H
+{
+    uint16_t x, y;
+    uint32_t rgba;
+} VertexP2H;
+
+typedef void (*VertexPackFunc)(const VertexP2C* src, void* dst, uint32_t count);
+
+// 0 if the kernel isn't compiled in or the CPU lacks the instructions.
+VertexPackFunc vertexpack_func(uint32_t format, uint32_t isa);
+uint32_t vertexpack_best_isa(void);
+const char* vertexpack_isa_name(uint32_t isa);
+
+const char* vertexpack_format_name(uint32_t format);
+uint32_t vertexpack_stride(uint32_t format);
+VkFormat vertexpack_position_format(uint32_t format);
+
+void vertexpack(uint32_t format, const VertexP2C* src, void* dst, uint32_t count);